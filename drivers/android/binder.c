@@ -56,6 +56,7 @@
 #include <linux/file.h>
 #include <linux/freezer.h>
 #include <linux/fs.h>
+#include <linux/hashtable.h>
 #include <linux/list.h>
 #include <linux/miscdevice.h>
 #include <linux/module.h>
@@ -63,6 +64,7 @@
 #include <linux/nsproxy.h>
 #include <linux/poll.h>
 #include <linux/debugfs.h>
+#include <linux/radix-tree.h>
 #include <linux/rbtree.h>
 #include <linux/sched/signal.h>
 #include <linux/sched/mm.h>
@@ -85,13 +87,14 @@ int system_server_pid = 0;
 #ifdef CONFIG_FAST_TRACK
 #include <cpu/ftt/ftt.h>
 
-#define MAX_FG_WORKS_PROCEEDED 2
-
 static uint8_t binder_enable_fg_switch = 1;
-static atomic64_t binder_work_seq;
 static atomic64_t binder_fg_req_num;
 #endif
 
+#define MAX_FG_WORKS_PROCEEDED 2
+
+static atomic64_t binder_work_seq;
+
 
 static HLIST_HEAD(binder_deferred_list);
 static DEFINE_MUTEX(binder_deferred_lock);
@@ -158,6 +161,16 @@ module_param_named(debug_mask, binder_debug_mask, uint, 0644);
 static char *binder_devices_param = CONFIG_ANDROID_BINDER_DEVICES;
 module_param_named(devices, binder_devices_param, charp, 0444);
 
+/*
+ * Synchronous callers whose uclamp.min is at least this value are
+ * queued ahead of regular work; 0 disables the uclamp hint.
+ */
+static unsigned int binder_urgent_uclamp_min = SCHED_CAPACITY_SCALE / 2;
+module_param_named(urgent_uclamp_min, binder_urgent_uclamp_min, uint, 0644);
+
+static bool binder_latency_stats;
+module_param_named(latency_stats, binder_latency_stats, bool, 0644);
+
 static DECLARE_WAIT_QUEUE_HEAD(binder_user_error_wait);
 static int binder_stop_on_user_error;
 
@@ -328,9 +341,7 @@ struct binder_work {
 		BINDER_WORK_CLEAR_DEATH_NOTIFICATION,
 	} type;
 
-#ifdef CONFIG_FAST_TRACK
 	uint64_t seq;
-#endif
 };
 
 struct binder_error {
@@ -338,6 +349,51 @@ struct binder_error {
 	uint32_t cmd;
 };
 
+#define BINDER_LATENCY_SUB_SHIFT	2
+#define BINDER_LATENCY_BUCKETS		(24 << BINDER_LATENCY_SUB_SHIFT)
+
+#define BINDER_IFACE_NAME_MAX		128
+
+/**
+ * struct binder_iface_latency - round-trip time of sync transactions to an
+ *                               interface
+ * @entry:                node for binder_iface_latencies
+ * @lock:                 protects the fields below
+ * @count:                number of replies accounted
+ * @total_ns:             sum of all round-trip times
+ * @max_ns:               slowest round trip seen
+ * @hist:                 histogram of round-trip times in microseconds,
+ *                        split into (1 << BINDER_LATENCY_SUB_SHIFT) buckets
+ *                        per power of two
+ * @refs:                 nodes labelled with this interface, protected by
+ *                        binder_iface_latencies_lock
+ * @name:                 interface descriptor, e.g. "android.os.IServiceManager"
+ *
+ * Shared by all nodes implementing the interface, and freed with the last
+ * of them. Nodes without a label, or whose label did not fit in the table,
+ * are accounted to binder_iface_unknown.
+ */
+struct binder_iface_latency {
+	struct hlist_node entry;
+	spinlock_t lock;
+	u64 count;
+	u64 total_ns;
+	u64 max_ns;
+	u32 hist[BINDER_LATENCY_BUCKETS];
+	unsigned int refs;
+	char name[BINDER_IFACE_NAME_MAX];
+};
+
+#define BINDER_IFACE_LATENCY_MAX	512
+
+static DEFINE_HASHTABLE(binder_iface_latencies, 7);
+static unsigned int binder_iface_latencies_count;
+static DEFINE_SPINLOCK(binder_iface_latencies_lock);
+static struct binder_iface_latency binder_iface_unknown = {
+	.lock = __SPIN_LOCK_UNLOCKED(binder_iface_unknown.lock),
+	.name = "<unknown>",
+};
+
 /**
  * struct binder_node - binder node bookkeeping
  * @debug_id:             unique ID for debugging
@@ -398,6 +454,8 @@ struct binder_error {
  *                        (invariant after initialized)
  * @async_todo:           list of async work items
  *                        (protected by @proc->inner_lock)
+ * @latency:              latency statistics of the node's interface, or NULL
+ *                        (set once, never changes after that)
  *
  * Bookkeeping structure for binder nodes.
  */
@@ -439,6 +497,7 @@ struct binder_node {
 	};
 	bool has_async_transaction;
 	struct list_head async_todo;
+	struct binder_iface_latency *latency;
 };
 
 struct binder_ref_death {
@@ -462,12 +521,17 @@ struct binder_ref_death {
  * the actual ref can only be accessed with a lock, this structure
  * is used to return information about the ref to callers of
  * ref inc/dec functions.
+ *
+ * The counts are atomic so that binder_update_ref_fast() can adjust
+ * them without @proc->outer_lock, as long as they don't move between
+ * 0 and 1. Those transitions, which may need to update the node, are
+ * only done with the lock held.
  */
 struct binder_ref_data {
 	int debug_id;
 	uint32_t desc;
-	int strong;
-	int weak;
+	atomic_t strong;
+	atomic_t weak;
 };
 
 /**
@@ -483,9 +547,12 @@ struct binder_ref_data {
  *               @node indicates the node must be freed
  * @death:       pointer to death notification (ref_death) if requested
  *               (protected by @node->lock)
+ * @rcu:         used to defer freeing until lockless lookups are done
  *
  * Structure to track references from procA to target node (on procB). This
- * structure is unsafe to access without holding @proc->outer_lock.
+ * structure is unsafe to access without holding @proc->outer_lock, except
+ * for the counts in @data under rcu_read_lock() (see
+ * binder_update_ref_fast()).
  */
 struct binder_ref {
 	/* Lookups needed: */
@@ -499,6 +566,7 @@ struct binder_ref {
 	struct binder_proc *proc;
 	struct binder_node *node;
 	struct binder_ref_death *death;
+	struct rcu_head rcu;
 };
 
 enum binder_deferred_state {
@@ -533,6 +601,10 @@ struct binder_priority {
  *                        (protected by @inner_lock)
  * @refs_by_desc:         rbtree of refs ordered by ref->desc
  *                        (protected by @outer_lock)
+ * @refs_by_desc_rcu:     radix tree of refs indexed by ref->desc for
+ *                        lockless lookups; a missing entry only
+ *                        disables the fast path for that ref
+ *                        (updated under @outer_lock, read under RCU)
  * @refs_by_node:         rbtree of refs ordered by ref->node
  *                        (protected by @outer_lock)
  * @waiting_threads:      threads currently waiting for proc work
@@ -563,6 +635,12 @@ struct binder_priority {
  *                        (protected by @inner_lock)
  * @todo:                 list of work for this process
  *                        (protected by @inner_lock)
+ * @fg_todo:              list of urgent synchronous transactions, drained
+ *                        ahead of @todo (see binder_transaction_urgent())
+ *                        (protected by @inner_lock)
+ * @fg_count:             consecutive items taken from @fg_todo while
+ *                        @todo was waiting
+ *                        (protected by @inner_lock)
  * @stats:                per-process binder statistics
  *                        (atomics, no lock needed)
  * @delivered_death:      list of delivered death notification
@@ -597,6 +675,7 @@ struct binder_proc {
 	struct rb_root threads;
 	struct rb_root nodes;
 	struct rb_root refs_by_desc;
+	struct radix_tree_root refs_by_desc_rcu;
 	struct rb_root refs_by_node;
 	struct list_head waiting_threads;
 	int pid;
@@ -613,10 +692,8 @@ struct binder_proc {
 	wait_queue_head_t freeze_wait;
 
 	struct list_head todo;
-#ifdef CONFIG_FAST_TRACK
 	struct list_head fg_todo;
 	uint32_t fg_count;
-#endif
 	struct binder_stats stats;
 	struct list_head delivered_death;
 	int max_threads;
@@ -715,6 +792,15 @@ struct binder_transaction {
 	struct binder_priority	saved_priority;
 	bool    set_priority_called;
 	kuid_t	sender_euid;
+	ktime_t	start_time;
+	/*
+	 * @latency_node: target node of a synchronous transaction; the
+	 * transaction holds a tmpref on it until it is freed.
+	 * @latency_label: interface token of the transaction, used to label
+	 * @latency_node if its owner accepts the call.
+	 */
+	struct binder_node *latency_node;
+	char *latency_label;
 	binder_uintptr_t security_ctx;
 	/**
 	 * @lock:  protects @from, @to_proc, and @to_thread
@@ -1004,9 +1090,7 @@ binder_enqueue_work_ilocked(struct binder_work *work,
 {
 	BUG_ON(target_list == NULL);
 	BUG_ON(work->entry.next && !list_empty(&work->entry));
-#ifdef CONFIG_FAST_TRACK
 	work->seq = (uint64_t)atomic64_inc_return(&binder_work_seq);
-#endif
 	list_add_tail(&work->entry, target_list);
 }
 
@@ -1096,6 +1180,46 @@ static struct binder_work *binder_dequeue_work_head_ilocked(
 	return w;
 }
 
+static inline bool binder_proc_worklist_empty_ilocked(struct binder_proc *proc)
+{
+	return binder_worklist_empty_ilocked(&proc->todo) &&
+		binder_worklist_empty_ilocked(&proc->fg_todo);
+}
+
+/*
+ * Urgent work in @proc->fg_todo goes first, but after every
+ * MAX_FG_WORKS_PROCEEDED items the oldest entry of @proc->todo gets a
+ * turn if it was queued earlier, so regular work cannot starve.
+ */
+static inline struct list_head *binder_proc_select_worklist_ilocked(
+	struct binder_proc *proc)
+{
+	if (binder_worklist_empty_ilocked(&proc->fg_todo)) {
+		proc->fg_count = 0;
+		return &proc->todo;
+	}
+
+	if (proc->fg_count >= MAX_FG_WORKS_PROCEEDED) {
+		proc->fg_count = 0;
+
+		if (!binder_worklist_empty_ilocked(&proc->todo)) {
+			struct binder_work *fg_w;
+			struct binder_work *w;
+
+			fg_w = list_first_entry(&proc->fg_todo,
+				struct binder_work, entry);
+			w = list_first_entry(&proc->todo,
+				struct binder_work, entry);
+
+			if (w->seq < fg_w->seq)
+				return &proc->todo;
+		}
+	}
+
+	proc->fg_count++;
+	return &proc->fg_todo;
+}
+
 #ifdef CONFIG_FAST_TRACK
 static int binder_count_show(struct seq_file *m, void *unused)
 {
@@ -1147,40 +1271,6 @@ static const struct file_operations binder_switch_fops = {
 	.write = binder_switch_write,
 };
 
-static inline bool binder_proc_worklist_empty_ilocked(struct binder_proc *proc)
-{
-	return binder_worklist_empty_ilocked(&proc->todo) &&
-		binder_worklist_empty_ilocked(&proc->fg_todo);
-}
-
-static inline struct list_head *binder_proc_select_worklist_ilocked(
-	struct binder_proc *proc)
-{
-	if (binder_worklist_empty_ilocked(&proc->fg_todo)) {
-		proc->fg_count = 0;
-		return &proc->todo;
-	}
-
-	if (proc->fg_count >= MAX_FG_WORKS_PROCEEDED) {
-		proc->fg_count = 0;
-
-		if (!binder_worklist_empty_ilocked(&proc->todo)) {
-			struct binder_work *fg_w;
-			struct binder_work *w;
-
-			fg_w = list_first_entry(&proc->fg_todo,
-				struct binder_work, entry);
-			w = list_first_entry(&proc->todo,
-				struct binder_work, entry);
-
-			if (w->seq < fg_w->seq)
-				return &proc->todo;
-		}
-	}
-
-	proc->fg_count++;
-	return &proc->fg_todo;
-}
 static inline int is_static_ftt(struct sched_entity *se)
 {
 	return se->ftt_mark;
@@ -1274,11 +1364,7 @@ static bool binder_has_work_ilocked(struct binder_thread *thread,
 	return thread->process_todo ||
 		thread->looper_need_return ||
 		(do_proc_work &&
-#ifdef CONFIG_FAST_TRACK
 		 !binder_proc_worklist_empty_ilocked(thread->proc));
-#else
-		 !binder_worklist_empty_ilocked(&thread->proc->todo));
-#endif
 }
 
 static bool binder_has_work(struct binder_thread *thread, bool do_proc_work)
@@ -1663,6 +1749,7 @@ static struct binder_node *binder_new_node(struct binder_proc *proc,
 
 static void binder_free_node(struct binder_node *node)
 {
+	binder_node_latency_put(node);
 	kmem_cache_free(binder_node_pool, node);
 	binder_stats_deleted(BINDER_STAT_NODE);
 }
@@ -1891,7 +1978,7 @@ static struct binder_ref *binder_get_ref_olocked(struct binder_proc *proc,
 			n = n->rb_left;
 		} else if (desc > ref->data.desc) {
 			n = n->rb_right;
-		} else if (need_strong_ref && !ref->data.strong) {
+		} else if (need_strong_ref && !atomic_read(&ref->data.strong)) {
 			binder_user_error("tried to use weak ref as strong ref\n");
 			return NULL;
 		} else {
@@ -1973,6 +2060,9 @@ static struct binder_ref *binder_get_ref_for_node_olocked(
 	}
 	rb_link_node(&new_ref->rb_node_desc, parent, p);
 	rb_insert_color(&new_ref->rb_node_desc, &proc->refs_by_desc);
+	/* on failure the ref is only reachable through the locked path */
+	radix_tree_insert(&proc->refs_by_desc_rcu, new_ref->data.desc,
+			  new_ref);
 
 	binder_node_lock(node);
 	hlist_add_head(&new_ref->node_entry, &node->refs);
@@ -1995,10 +2085,12 @@ static void binder_cleanup_ref_olocked(struct binder_ref *ref)
 		      ref->node->debug_id);
 
 	rb_erase(&ref->rb_node_desc, &ref->proc->refs_by_desc);
+	radix_tree_delete_item(&ref->proc->refs_by_desc_rcu, ref->data.desc,
+			       ref);
 	rb_erase(&ref->rb_node_node, &ref->proc->refs_by_node);
 
 	binder_node_inner_lock(ref->node);
-	if (ref->data.strong)
+	if (atomic_read(&ref->data.strong))
 		binder_dec_node_nilocked(ref->node, 1, 1);
 
 	hlist_del(&ref->node_entry);
@@ -2043,19 +2135,19 @@ static int binder_inc_ref_olocked(struct binder_ref *ref, int strong,
 	int ret;
 
 	if (strong) {
-		if (ref->data.strong == 0) {
+		if (atomic_read(&ref->data.strong) == 0) {
 			ret = binder_inc_node(ref->node, 1, 1, target_list);
 			if (ret)
 				return ret;
 		}
-		ref->data.strong++;
+		atomic_inc(&ref->data.strong);
 	} else {
-		if (ref->data.weak == 0) {
+		if (atomic_read(&ref->data.weak) == 0) {
 			ret = binder_inc_node(ref->node, 0, 1, target_list);
 			if (ret)
 				return ret;
 		}
-		ref->data.weak++;
+		atomic_inc(&ref->data.weak);
 	}
 	return 0;
 }
@@ -2072,27 +2164,29 @@ static int binder_inc_ref_olocked(struct binder_ref *ref, int strong,
 static bool binder_dec_ref_olocked(struct binder_ref *ref, int strong)
 {
 	if (strong) {
-		if (ref->data.strong == 0) {
+		if (atomic_read(&ref->data.strong) == 0) {
 			binder_user_error("%d invalid dec strong, ref %d desc %d s %d w %d\n",
 					  ref->proc->pid, ref->data.debug_id,
-					  ref->data.desc, ref->data.strong,
-					  ref->data.weak);
+					  ref->data.desc,
+					  atomic_read(&ref->data.strong),
+					  atomic_read(&ref->data.weak));
 			return false;
 		}
-		ref->data.strong--;
-		if (ref->data.strong == 0)
+		if (atomic_dec_and_test(&ref->data.strong))
 			binder_dec_node(ref->node, strong, 1);
 	} else {
-		if (ref->data.weak == 0) {
+		if (atomic_read(&ref->data.weak) == 0) {
 			binder_user_error("%d invalid dec weak, ref %d desc %d s %d w %d\n",
 					  ref->proc->pid, ref->data.debug_id,
-					  ref->data.desc, ref->data.strong,
-					  ref->data.weak);
+					  ref->data.desc,
+					  atomic_read(&ref->data.strong),
+					  atomic_read(&ref->data.weak));
 			return false;
 		}
-		ref->data.weak--;
+		atomic_dec(&ref->data.weak);
 	}
-	if (ref->data.strong == 0 && ref->data.weak == 0) {
+	if (atomic_read(&ref->data.strong) == 0 &&
+	    atomic_read(&ref->data.weak) == 0) {
 		binder_cleanup_ref_olocked(ref);
 		return true;
 	}
@@ -2139,6 +2233,12 @@ err_no_ref:
 	return NULL;
 }
 
+static void binder_free_ref_rcu(struct rcu_head *rcu)
+{
+	kmem_cache_free(binder_ref_pool,
+			container_of(rcu, struct binder_ref, rcu));
+}
+
 /**
  * binder_free_ref() - free the binder_ref
  * @ref:	ref to free
@@ -2152,7 +2252,54 @@ static void binder_free_ref(struct binder_ref *ref)
 		binder_free_node(ref->node);
 	if (ref->death)
 		kmem_cache_free(binder_ref_death_pool, ref->death);
-	kmem_cache_free(binder_ref_pool, ref);
+	call_rcu(&ref->rcu, binder_free_ref_rcu);
+}
+
+/**
+ * binder_update_ref_fast() - inc/dec a ref without taking any locks
+ * @proc:	proc containing the ref
+ * @desc:	the handle associated with the ref
+ * @increment:	true=inc reference, false=dec reference
+ * @strong:	true=strong reference, false=weak reference
+ * @rdata:	the id/refcount data for the ref
+ *
+ * Handles the common case of a ref that is already held being
+ * acquired again, or released without dropping the last count of its
+ * kind. Neither case needs to touch the node or the proc rbtrees.
+ * Counts only move between 0 and 1 under @proc->outer_lock, so a ref
+ * seen here with a non-zero count cannot be freed under us, and RCU
+ * keeps the memory valid for the lookup itself.
+ *
+ * Return: true if the ref was updated, false if the caller must fall
+ * back to the locked path
+ */
+static bool binder_update_ref_fast(struct binder_proc *proc,
+		uint32_t desc, bool increment, bool strong,
+		struct binder_ref_data *rdata)
+{
+	struct binder_ref *ref;
+	atomic_t *count;
+	bool done = false;
+	int old;
+
+	rcu_read_lock();
+	ref = radix_tree_lookup(&proc->refs_by_desc_rcu, desc);
+	if (!ref)
+		goto out;
+
+	count = strong ? &ref->data.strong : &ref->data.weak;
+	if (increment) {
+		done = atomic_inc_not_zero(count);
+	} else {
+		old = atomic_read(count);
+		while (old > 1 && !done)
+			done = atomic_try_cmpxchg(count, &old, old - 1);
+	}
+	if (done && rdata)
+		*rdata = ref->data;
+out:
+	rcu_read_unlock();
+	return done;
 }
 
 /**
@@ -2176,6 +2323,9 @@ static int binder_update_ref_for_handle(struct binder_proc *proc,
 	struct binder_ref *ref;
 	bool delete_ref = false;
 
+	if (binder_update_ref_fast(proc, desc, increment, strong, rdata))
+		return 0;
+
 	binder_proc_lock(proc);
 	ref = binder_get_ref_olocked(proc, desc, strong);
 	if (!ref) {
@@ -2239,6 +2389,7 @@ static int binder_inc_ref_for_node(struct binder_proc *proc,
 {
 	struct binder_ref *ref;
 	struct binder_ref *new_ref = NULL;
+	bool preloaded = false;
 	int ret = 0;
 
 	binder_proc_lock(proc);
@@ -2248,6 +2399,7 @@ static int binder_inc_ref_for_node(struct binder_proc *proc,
 		new_ref = kmem_cache_zalloc(binder_ref_pool, GFP_KERNEL);
 		if (!new_ref)
 			return -ENOMEM;
+		preloaded = !radix_tree_preload(GFP_KERNEL);
 		binder_proc_lock(proc);
 		ref = binder_get_ref_for_node_olocked(proc, node, new_ref);
 	}
@@ -2266,12 +2418,16 @@ static int binder_inc_ref_for_node(struct binder_proc *proc,
 	}
 
 	binder_proc_unlock(proc);
+	if (preloaded)
+		radix_tree_preload_end();
 	if (new_ref && ref != new_ref)
 		/*
 		 * Another thread created the ref first so
-		 * free the one we allocated
+		 * free the one we allocated. If the ref was
+		 * published and then cleaned up above, a lockless
+		 * lookup may still be looking at it.
 		 */
-		kmem_cache_free(binder_ref_pool, new_ref);
+		call_rcu(&new_ref->rcu, binder_free_ref_rcu);
 	return ret;
 }
 
@@ -2422,10 +2578,205 @@ static void binder_free_transaction(struct binder_transaction *t)
 	 * If the transaction has no target_proc, then
 	 * t->buffer->transaction has already been cleared.
 	 */
+	if (t->latency_node)
+		binder_dec_node_tmpref(t->latency_node);
+	kfree(t->latency_label);
 	kmem_cache_free(binder_transaction_pool, t);
 	binder_stats_deleted(BINDER_STAT_TRANSACTION);
 }
 
+static unsigned int binder_latency_bucket(u64 us)
+{
+	unsigned int order, bucket;
+
+	if (us < (1U << BINDER_LATENCY_SUB_SHIFT))
+		return us;
+
+	order = ilog2(us);
+	bucket = ((order - BINDER_LATENCY_SUB_SHIFT + 1) <<
+		  BINDER_LATENCY_SUB_SHIFT) +
+		 ((us >> (order - BINDER_LATENCY_SUB_SHIFT)) &
+		  ((1U << BINDER_LATENCY_SUB_SHIFT) - 1));
+
+	return min_t(unsigned int, bucket, BINDER_LATENCY_BUCKETS - 1);
+}
+
+/* exclusive upper bound, in microseconds, of a histogram bucket */
+static u64 binder_latency_bucket_limit(unsigned int bucket)
+{
+	unsigned int sub = 1U << BINDER_LATENCY_SUB_SHIFT;
+	unsigned int order = bucket >> BINDER_LATENCY_SUB_SHIFT;
+
+	if (!order)
+		return bucket + 1;
+
+	return (u64)(sub + (bucket & (sub - 1)) + 1) << (order - 1);
+}
+
+/*
+ * Parcel::writeInterfaceToken() starts a transaction with one to three
+ * int32 header words, depending on the Android release, followed by the
+ * interface descriptor as a String16: an int32 length, then the UTF-16
+ * characters and a NUL. Returns a copy of the first plausible descriptor,
+ * or NULL.
+ */
+static noinline_for_stack char *
+binder_iface_descriptor(struct binder_proc *proc, struct binder_buffer *buffer)
+{
+	u16 chars[BINDER_IFACE_NAME_MAX];
+	char name[BINDER_IFACE_NAME_MAX];
+	size_t off, i;
+	u32 len;
+
+	for (off = sizeof(u32); off <= 3 * sizeof(u32); off += sizeof(u32)) {
+		if (off + sizeof(len) > buffer->data_size)
+			break;
+		binder_alloc_copy_from_buffer(&proc->alloc, &len, buffer, off,
+					      sizeof(len));
+		if (!len || len >= BINDER_IFACE_NAME_MAX ||
+		    off + sizeof(len) + (len + 1) * sizeof(u16) >
+		    buffer->data_size)
+			continue;
+		binder_alloc_copy_from_buffer(&proc->alloc, chars, buffer,
+					      off + sizeof(len),
+					      (len + 1) * sizeof(u16));
+		if (chars[len])
+			continue;
+		for (i = 0; i < len; i++) {
+			if (chars[i] < 0x20 || chars[i] >= 0x7f)
+				break;
+			name[i] = chars[i];
+		}
+		if (i == len) {
+			name[len] = '\0';
+			return kstrdup(name, GFP_KERNEL);
+		}
+	}
+	return NULL;
+}
+
+/*
+ * The interface token comes from the caller, so it only labels the node
+ * once the node's owner has accepted it: a stub rejects a call to the
+ * wrong interface with a status code reply or with a non-zero exception
+ * code as the first word of the reply.
+ */
+static bool binder_reply_accepted(struct binder_proc *proc,
+				  struct binder_transaction *reply)
+{
+	u32 exception;
+
+	if (reply->flags & TF_STATUS_CODE ||
+	    reply->buffer->data_size < sizeof(exception))
+		return false;
+	binder_alloc_copy_from_buffer(&proc->alloc, &exception, reply->buffer,
+				      0, sizeof(exception));
+	return !exception;
+}
+
+/**
+ * binder_node_latency_init() - label a node with its interface
+ * @node:	node the owner accepted a call with interface token @name on
+ * @name:	interface descriptor
+ *
+ * Looks up or creates the statistics of interface @name and attaches
+ * them to @node. Once the table is full, @node stays unlabelled.
+ */
+static void binder_node_latency_init(struct binder_node *node,
+				     const char *name)
+{
+	struct binder_iface_latency *lat, *new;
+	u32 hash = full_name_hash(NULL, name, strlen(name));
+
+	new = kzalloc(sizeof(*new), GFP_KERNEL);
+	if (!new)
+		return;
+
+	spin_lock(&binder_iface_latencies_lock);
+	hash_for_each_possible(binder_iface_latencies, lat, entry, hash) {
+		if (!strcmp(lat->name, name))
+			goto found;
+	}
+	if (binder_iface_latencies_count >= BINDER_IFACE_LATENCY_MAX)
+		goto out;
+	lat = new;
+	new = NULL;
+	spin_lock_init(&lat->lock);
+	strlcpy(lat->name, name, sizeof(lat->name));
+	hash_add(binder_iface_latencies, &lat->entry, hash);
+	binder_iface_latencies_count++;
+found:
+	if (!cmpxchg(&node->latency, NULL, lat))
+		lat->refs++;
+	else if (!lat->refs) {
+		hash_del(&lat->entry);
+		binder_iface_latencies_count--;
+		new = lat;
+	}
+out:
+	spin_unlock(&binder_iface_latencies_lock);
+	kfree(new);
+}
+
+static void binder_node_latency_put(struct binder_node *node)
+{
+	struct binder_iface_latency *lat = node->latency;
+
+	if (!lat)
+		return;
+
+	spin_lock(&binder_iface_latencies_lock);
+	if (--lat->refs) {
+		lat = NULL;
+	} else {
+		hash_del(&lat->entry);
+		binder_iface_latencies_count--;
+	}
+	spin_unlock(&binder_iface_latencies_lock);
+	kfree(lat);
+}
+
+/**
+ * binder_txn_latency_account() - account the round trip of a sync transaction
+ * @t:		transaction being replied to
+ * @from:	thread that sent @t and is about to receive the reply
+ * @to:		thread sending the reply
+ *
+ * Emits the binder_transaction_latency tracepoint and, if the
+ * latency_stats module parameter is set, adds the round trip to the
+ * histogram of the interface of the node @t was sent to, or to
+ * binder_iface_unknown while the node has no label.
+ */
+static void binder_txn_latency_account(struct binder_transaction *t,
+				       struct binder_thread *from,
+				       struct binder_thread *to)
+{
+	struct binder_node *node = t->latency_node;
+	struct binder_iface_latency *lat;
+	u64 ns;
+
+	if (!node)
+		return;
+
+	ns = ktime_to_ns(ktime_sub(ktime_get(), t->start_time));
+	trace_binder_transaction_latency(t, node, from, to, ns);
+
+	if (!binder_latency_stats)
+		return;
+
+	lat = READ_ONCE(node->latency);
+	if (!lat)
+		lat = &binder_iface_unknown;
+
+	spin_lock(&lat->lock);
+	lat->count++;
+	lat->total_ns += ns;
+	if (ns > lat->max_ns)
+		lat->max_ns = ns;
+	lat->hist[binder_latency_bucket(div_u64(ns, NSEC_PER_USEC))]++;
+	spin_unlock(&lat->lock);
+}
+
 static void binder_send_failed_reply(struct binder_transaction *t,
 				     uint32_t error_code)
 {
@@ -3190,6 +3541,37 @@ static int binder_fixup_parent(struct binder_transaction *t,
 	return 0;
 }
 
+/**
+ * binder_transaction_urgent() - check if a transaction may jump the queue
+ * @t:		transaction being queued by the current task
+ *
+ * Synchronous transactions from a caller in the RT scheduling class,
+ * marked for fast-track, or with a uclamp.min of at least
+ * binder_urgent_uclamp_min go to @proc->fg_todo, which binder threads
+ * drain ahead of @proc->todo. Oneway transactions never qualify, so a
+ * backlog of oneway calls cannot delay a latency-sensitive caller.
+ *
+ * Return:	true if @t should be queued as urgent work
+ */
+static bool binder_transaction_urgent(struct binder_transaction *t)
+{
+	if (t->flags & TF_ONE_WAY)
+		return false;
+
+	if (is_rt_policy(current->policy))
+		return true;
+#ifdef CONFIG_FAST_TRACK
+	if (is_ftt(&current->se) && binder_enable_fg_switch)
+		return true;
+#endif
+#ifdef CONFIG_UCLAMP_TASK
+	if (binder_urgent_uclamp_min &&
+	    current->uclamp[UCLAMP_MIN].value >= binder_urgent_uclamp_min)
+		return true;
+#endif
+	return false;
+}
+
 /**
  * binder_proc_transaction() - sends a transaction to a process and wakes it up
  * @t:		transaction to send
@@ -3257,14 +3639,14 @@ static int binder_proc_transaction(struct binder_transaction *t,
 #endif
 		binder_enqueue_thread_work_ilocked(thread, &t->work);
 	} else if (!pending_async) {
-#ifdef CONFIG_FAST_TRACK
-		if (is_ftt(&current->se) && !oneway &&
-			binder_enable_fg_switch) {
+		if (binder_transaction_urgent(t)) {
 			binder_enqueue_work_ilocked(&t->work, &proc->fg_todo);
+#ifdef CONFIG_FAST_TRACK
 			atomic64_inc(&binder_fg_req_num);
-		} else
 #endif
-		binder_enqueue_work_ilocked(&t->work, &proc->todo);
+		} else {
+			binder_enqueue_work_ilocked(&t->work, &proc->todo);
+		}
 	} else {
 		binder_enqueue_work_ilocked(&t->work, &node->async_todo);
 	}
@@ -3631,6 +4013,7 @@ static void binder_transaction(struct binder_proc *proc,
 	t->to_thread = target_thread;
 	t->code = tr->code;
 	t->flags = tr->flags;
+	t->start_time = ktime_get();
 	if (!(t->flags & TF_ONE_WAY) &&
 	    binder_supported_policy(current->policy)) {
 		/* Inherit supported policies for synchronous transactions */
@@ -3904,10 +4287,16 @@ static void binder_transaction(struct binder_proc *proc,
 				return_error_line = __LINE__;
 				goto err_bad_offset;
 			}
-			if (binder_alloc_copy_user_to_buffer(
+			/*
+			 * Large buffers from sealed memfds are mapped
+			 * rather than copied, which may move the buffer
+			 * forward within the remaining sg space.
+			 */
+			if (binder_alloc_map_user_to_buffer(
 						&target_proc->alloc,
 						t->buffer,
-						sg_buf_offset,
+						&sg_buf_offset,
+						buf_left,
 						(const void __user *)
 							(uintptr_t)bp->buffer,
 						bp->length)) {
@@ -3958,6 +4347,11 @@ static void binder_transaction(struct binder_proc *proc,
 	t->work.type = BINDER_WORK_TRANSACTION;
 
 	if (reply) {
+		/* Read the reply before its receiver can free it */
+		if (in_reply_to->latency_label &&
+		    binder_reply_accepted(target_proc, t))
+			binder_node_latency_init(in_reply_to->latency_node,
+						 in_reply_to->latency_label);
 		binder_enqueue_thread_work(thread, tcomplete);
 		binder_inner_proc_lock(target_proc);
 		if (target_thread->is_dead || target_proc->is_frozen) {
@@ -3977,6 +4371,7 @@ static void binder_transaction(struct binder_proc *proc,
 		ftt_binder_dequeue(thread);
 #endif
 
+		binder_txn_latency_account(in_reply_to, target_thread, thread);
 		binder_restore_priority(current, in_reply_to->saved_priority);
 		binder_free_transaction(in_reply_to);
 	} else if (!(t->flags & TF_ONE_WAY)) {
@@ -3994,6 +4389,10 @@ static void binder_transaction(struct binder_proc *proc,
 		t->from_parent = thread->transaction_stack;
 		thread->transaction_stack = t;
 		binder_inner_proc_unlock(proc);
+		t->latency_node = target_node;
+		if (binder_latency_stats && !READ_ONCE(target_node->latency))
+			t->latency_label = binder_iface_descriptor(target_proc,
+								   t->buffer);
 		return_error = binder_proc_transaction(t,
 				target_proc, target_thread);
 		if (return_error) {
@@ -4002,6 +4401,8 @@ static void binder_transaction(struct binder_proc *proc,
 			binder_inner_proc_unlock(proc);
 			goto err_dead_proc_or_thread;
 		}
+		/* t owns the tmpref on target_node from here on */
+		target_node = NULL;
 	} else {
 		BUG_ON(target_node == NULL);
 		BUG_ON(t->buffer->async_transaction != 1);
@@ -4187,8 +4588,9 @@ static int binder_thread_write(struct binder_proc *proc,
 			binder_debug(BINDER_DEBUG_USER_REFS,
 				     "%d:%d %s ref %d desc %d s %d w %d\n",
 				     proc->pid, thread->pid, debug_string,
-				     rdata.debug_id, rdata.desc, rdata.strong,
-				     rdata.weak);
+				     rdata.debug_id, rdata.desc,
+				     atomic_read(&rdata.strong),
+				     atomic_read(&rdata.weak));
 			break;
 		}
 		case BC_INCREFS_DONE:
@@ -4443,8 +4845,10 @@ static int binder_thread_write(struct binder_proc *proc,
 				     "BC_REQUEST_DEATH_NOTIFICATION" :
 				     "BC_CLEAR_DEATH_NOTIFICATION",
 				     (u64)cookie, ref->data.debug_id,
-				     ref->data.desc, ref->data.strong,
-				     ref->data.weak, ref->node->debug_id);
+				     ref->data.desc,
+				     atomic_read(&ref->data.strong),
+				     atomic_read(&ref->data.weak),
+				     ref->node->debug_id);
 
 			binder_node_lock(ref->node);
 			if (cmd == BC_REQUEST_DEATH_NOTIFICATION) {
@@ -4711,15 +5115,9 @@ retry:
 		binder_inner_proc_lock(proc);
 		if (!binder_worklist_empty_ilocked(&thread->todo))
 			list = &thread->todo;
-#ifdef CONFIG_FAST_TRACK
 		else if (!binder_proc_worklist_empty_ilocked(proc) &&
 			   wait_for_proc_work)
 			list = binder_proc_select_worklist_ilocked(proc);
-#else
-		else if (!binder_worklist_empty_ilocked(&proc->todo) &&
-			   wait_for_proc_work)
-			list = &proc->todo;
-#endif
 		else {
 			binder_inner_proc_unlock(proc);
 
@@ -5324,11 +5722,7 @@ static int binder_ioctl_write_read(struct file *filp,
 					 filp->f_flags & O_NONBLOCK);
 		trace_binder_read_done(ret);
 		binder_inner_proc_lock(proc);
-#ifdef CONFIG_FAST_TRACK
 		if (!binder_proc_worklist_empty_ilocked(proc))
-#else
-		if (!binder_worklist_empty_ilocked(&proc->todo))
-#endif
 			binder_wakeup_proc_ilocked(proc);
 		binder_inner_proc_unlock(proc);
 		if (ret < 0) {
@@ -5857,10 +6251,9 @@ static int binder_open(struct inode *nodp, struct file *filp)
 	proc->tsk = current->group_leader;
 	mutex_init(&proc->files_lock);
 	INIT_LIST_HEAD(&proc->todo);
-#ifdef CONFIG_FAST_TRACK
 	INIT_LIST_HEAD(&proc->fg_todo);
+	INIT_RADIX_TREE(&proc->refs_by_desc_rcu, GFP_NOWAIT | __GFP_NOWARN);
 	proc->fg_count = 0;
-#endif
 
 	init_waitqueue_head(&proc->freeze_wait);
 	if (binder_supported_policy(current->policy)) {
@@ -6091,9 +6484,7 @@ static void binder_deferred_release(struct binder_proc *proc)
 	binder_proc_unlock(proc);
 
 	binder_release_work(proc, &proc->todo);
-#ifdef CONFIG_FAST_TRACK
 	binder_release_work(proc, &proc->fg_todo);
-#endif
 	binder_release_work(proc, &proc->delivered_death);
 
 	binder_debug(BINDER_DEBUG_OPEN_CLOSE,
@@ -6321,8 +6712,8 @@ static void print_binder_ref_olocked(struct seq_file *m,
 	seq_printf(m, "  ref %d: desc %d %snode %d s %d w %d d %pK\n",
 		   ref->data.debug_id, ref->data.desc,
 		   ref->node->proc ? "" : "dead ",
-		   ref->node->debug_id, ref->data.strong,
-		   ref->data.weak, ref->death);
+		   ref->node->debug_id, atomic_read(&ref->data.strong),
+		   atomic_read(&ref->data.weak), ref->death);
 	binder_node_unlock(ref->node);
 }
 
@@ -6385,11 +6776,9 @@ static void print_binder_proc(struct seq_file *m,
 	list_for_each_entry(w, &proc->todo, entry)
 		print_binder_work_ilocked(m, proc, "  ",
 					  "  pending transaction", w);
-#ifdef CONFIG_FAST_TRACK
 	list_for_each_entry(w, &proc->fg_todo, entry)
 		print_binder_work_ilocked(m, proc, "  ",
 					  "  pending foreground transaction", w);
-#endif
 	list_for_each_entry(w, &proc->delivered_death, entry) {
 		seq_puts(m, "  has delivered dead binder\n");
 		break;
@@ -6448,8 +6837,7 @@ static void binder_in_transaction(struct binder_proc *proc, int uid)
 	}
 
 	//check binder proc todo list
-#ifdef CONFIG_FAST_TRACK
-    empty = binder_proc_worklist_empty_ilocked(proc);
+	empty = binder_proc_worklist_empty_ilocked(proc);
 	if (!empty) {
 		list_for_each_entry(w, &proc->todo, entry) {
 			if (w->type == BINDER_WORK_TRANSACTION) {
@@ -6483,30 +6871,6 @@ static void binder_in_transaction(struct binder_proc *proc, int uid)
 			return;
 		}
 	}
-#else
-	empty = binder_worklist_empty_ilocked(&proc->todo);
-	if (!empty) {
-		list_for_each_entry(w, &proc->todo, entry) {
-			if (w->type == BINDER_WORK_TRANSACTION) {
-				t = container_of(w, struct binder_transaction, work);
-				if (!(t->flags & TF_ONE_WAY)) {
-					found = true;
-					break;
-				}
-			}
-			else if (w->type != BINDER_WORK_TRANSACTION_COMPLETE && w->type != BINDER_WORK_NODE) {
-				found = true;
-				break;
-			}
-		}
-
-		if (found == true) {
-			binder_inner_proc_unlock(proc);
-			cfb_report(uid, "proc");
-			return;
-		}
-	}
-#endif
 	binder_inner_proc_unlock(proc);
 }
 
@@ -6662,8 +7026,8 @@ static void print_binder_proc_stats(struct seq_file *m,
 		struct binder_ref *ref = rb_entry(n, struct binder_ref,
 						  rb_node_desc);
 		count++;
-		strong += ref->data.strong;
-		weak += ref->data.weak;
+		strong += atomic_read(&ref->data.strong);
+		weak += atomic_read(&ref->data.weak);
 	}
 	binder_proc_unlock(proc);
 	seq_printf(m, "  refs: %d s %d w %d\n", count, strong, weak);
@@ -6682,7 +7046,6 @@ static void print_binder_proc_stats(struct seq_file *m,
 	binder_inner_proc_unlock(proc);
 	seq_printf(m, "  pending transactions: %d\n", count);
 
-#ifdef CONFIG_FAST_TRACK
 	count = 0;
 	binder_inner_proc_lock(proc);
 	list_for_each_entry(w, &proc->fg_todo, entry) {
@@ -6691,7 +7054,6 @@ static void print_binder_proc_stats(struct seq_file *m,
 	}
 	binder_inner_proc_unlock(proc);
 	seq_printf(m, "  pending foreground transactions: %d\n", count);
-#endif
 	print_binder_stats(m, "  ", &proc->stats);
 }
 
@@ -6764,6 +7126,51 @@ static int binder_transactions_show(struct seq_file *m, void *unused)
 	return 0;
 }
 
+static u64 binder_latency_percentile(struct binder_iface_latency *lat,
+				     unsigned int pct)
+{
+	u64 want = div_u64(lat->count * pct + 99, 100);
+	u64 seen = 0;
+	unsigned int i;
+
+	for (i = 0; i < BINDER_LATENCY_BUCKETS - 1; i++) {
+		seen += lat->hist[i];
+		if (seen >= want)
+			break;
+	}
+	return binder_latency_bucket_limit(i);
+}
+
+static void print_binder_iface_latency(struct seq_file *m,
+				       struct binder_iface_latency *lat)
+{
+	spin_lock(&lat->lock);
+	if (lat->count)
+		seq_printf(m, "  %s: count %llu avg %lluus p50 <%lluus p99 <%lluus max %lluus\n",
+			   lat->name, lat->count,
+			   div_u64(div64_u64(lat->total_ns, lat->count),
+				   NSEC_PER_USEC),
+			   binder_latency_percentile(lat, 50),
+			   binder_latency_percentile(lat, 99),
+			   div_u64(lat->max_ns, NSEC_PER_USEC));
+	spin_unlock(&lat->lock);
+}
+
+static int binder_transaction_latency_show(struct seq_file *m, void *unused)
+{
+	struct binder_iface_latency *lat;
+	int bkt;
+
+	seq_puts(m, "binder transaction latency:\n");
+	spin_lock(&binder_iface_latencies_lock);
+	hash_for_each(binder_iface_latencies, bkt, lat, entry)
+		print_binder_iface_latency(m, lat);
+	spin_unlock(&binder_iface_latencies_lock);
+	print_binder_iface_latency(m, &binder_iface_unknown);
+
+	return 0;
+}
+
 static int binder_proc_show(struct seq_file *m, void *unused)
 {
 	struct binder_proc *itr;
@@ -6843,6 +7250,7 @@ BINDER_DEBUG_ENTRY(state);
 BINDER_DEBUG_ENTRY(stats);
 BINDER_DEBUG_ENTRY(transactions);
 BINDER_DEBUG_ENTRY(transaction_log);
+BINDER_DEBUG_ENTRY(transaction_latency);
 
 static int __init init_binder_device(const char *name)
 {
@@ -6988,6 +7396,11 @@ static int __init binder_init(void)
 				    binder_debugfs_dir_entry_root,
 				    &binder_transaction_log_failed,
 				    &binder_transaction_log_fops);
+		debugfs_create_file("transaction_latency",
+				    0444,
+				    binder_debugfs_dir_entry_root,
+				    NULL,
+				    &binder_transaction_latency_fops);
 #ifdef CONFIG_FAST_TRACK
 		debugfs_create_file("count",
 				    S_IRUGO,
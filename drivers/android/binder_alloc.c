@@ -30,6 +30,9 @@
 #include <linux/list_lru.h>
 #include <linux/uaccess.h>
 #include <linux/highmem.h>
+#include <linux/shmem_fs.h>
+#include <linux/sizes.h>
+#include <uapi/linux/fcntl.h>
 #include "binder_alloc.h"
 #include "binder_trace.h"
 
@@ -54,6 +57,26 @@ static uint32_t binder_alloc_debug_mask = 0;
 module_param_named(debug_mask, binder_alloc_debug_mask,
 		   uint, 0644);
 
+/* Smallest scatter-gather buffer mapped from the sender, 0 to disable */
+static uint binder_alloc_zero_copy_min = SZ_64K;
+
+module_param_named(zero_copy_min, binder_alloc_zero_copy_min,
+		   uint, 0644);
+
+/**
+ * struct binder_zero_copy - sender pages mapped into a binder buffer
+ * @next:     next range mapped into the same buffer
+ * @start:    page aligned user address of the range in the target
+ * @nr_pages: number of pages in the range
+ * @pages:    pinned sender pages, mapped in place of alloc->pages[]
+ */
+struct binder_zero_copy {
+	struct binder_zero_copy *next;
+	unsigned long start;
+	unsigned int nr_pages;
+	struct page *pages[];
+};
+
 #define binder_alloc_debug(mask, x...) \
 	do { \
 		if (binder_alloc_debug_mask & mask) \
@@ -612,6 +635,110 @@ err_alloc_buf_struct_failed:
 	return ERR_PTR(-ENOMEM);
 }
 
+static void binder_alloc_cache_drain_locked(struct binder_alloc *alloc,
+					    bool disable);
+
+static int binder_alloc_cache_class(size_t size)
+{
+	return max(fls(size - 1) - BINDER_ALLOC_CACHE_MIN_SHIFT, 0);
+}
+
+/*
+ * Fast path for small synchronous transactions: take a recently freed
+ * buffer of the right size class.  It is still in allocated_buffers and
+ * its pages are still mapped, so neither rb tree nor the page range needs
+ * updating and alloc->mutex is not taken.
+ */
+static struct binder_buffer *binder_alloc_cache_get(struct binder_alloc *alloc,
+						    size_t data_size,
+						    size_t offsets_size,
+						    size_t extra_buffers_size,
+						    int pid)
+{
+	struct binder_alloc_cache *cache;
+	struct binder_buffer *buffer = NULL;
+	size_t size;
+	int i;
+
+	size = ALIGN(data_size, sizeof(void *)) +
+		ALIGN(offsets_size, sizeof(void *)) +
+		ALIGN(extra_buffers_size, sizeof(void *));
+	/* Oversized or overflowing requests are left to the slow path */
+	if (data_size > BINDER_ALLOC_CACHE_MAX_SIZE ||
+	    offsets_size > BINDER_ALLOC_CACHE_MAX_SIZE ||
+	    extra_buffers_size > BINDER_ALLOC_CACHE_MAX_SIZE ||
+	    size > BINDER_ALLOC_CACHE_MAX_SIZE)
+		return NULL;
+	size = max(size, sizeof(void *));
+
+	if (!binder_alloc_get_vma(alloc))
+		return NULL;
+
+	cache = &alloc->cache[binder_alloc_cache_class(size)];
+	spin_lock(&alloc->cache_lock);
+	for (i = cache->count - 1; i >= 0; i--) {
+		if (cache->sizes[i] < size)
+			continue;
+		buffer = cache->buffers[i];
+		cache->count--;
+		cache->buffers[i] = cache->buffers[cache->count];
+		cache->sizes[i] = cache->sizes[cache->count];
+		break;
+	}
+	spin_unlock(&alloc->cache_lock);
+	if (!buffer)
+		return NULL;
+
+	binder_alloc_debug(BINDER_DEBUG_BUFFER_ALLOC,
+		     "%d: binder_alloc_buf size %zd got cached %pK\n",
+		      alloc->pid, size, buffer);
+	buffer->data_size = data_size;
+	buffer->offsets_size = offsets_size;
+	buffer->extra_buffers_size = extra_buffers_size;
+	buffer->async_transaction = 0;
+	buffer->pid = pid;
+	buffer->oneway_spam_suspect = false;
+	return buffer;
+}
+
+/*
+ * Cache a freed synchronous buffer for reuse by binder_alloc_cache_get().
+ * Returns false if the buffer has to be freed normally.  Buffers with
+ * sender pages mapped in are never cached: only binder_free_buf_locked()
+ * unmaps those pages and drops their references.
+ */
+static bool binder_alloc_cache_put(struct binder_alloc *alloc,
+				   struct binder_buffer *buffer)
+{
+	struct binder_alloc_cache *cache;
+	size_t buffer_size;
+	bool cached = false;
+
+	if (buffer->async_transaction || buffer->transaction ||
+	    buffer->zero_copy)
+		return false;
+
+	/*
+	 * The buffer following an allocated buffer is never merged away,
+	 * so the size can be read without alloc->mutex and stays valid
+	 * while the buffer sits in the cache.
+	 */
+	buffer_size = binder_alloc_buffer_size(alloc, buffer);
+	if (buffer_size > BINDER_ALLOC_CACHE_MAX_SIZE)
+		return false;
+
+	cache = &alloc->cache[binder_alloc_cache_class(buffer_size)];
+	spin_lock(&alloc->cache_lock);
+	if (!alloc->cache_disabled && cache->count < BINDER_ALLOC_CACHE_DEPTH) {
+		cache->buffers[cache->count] = buffer;
+		cache->sizes[cache->count] = buffer_size;
+		cache->count++;
+		cached = true;
+	}
+	spin_unlock(&alloc->cache_lock);
+	return cached;
+}
+
 /**
  * binder_alloc_new_buf() - Allocate a new binder buffer
  * @alloc:              binder_alloc for this proc
@@ -637,9 +764,24 @@ struct binder_buffer *binder_alloc_new_buf(struct binder_alloc *alloc,
 {
 	struct binder_buffer *buffer;
 
+	if (!is_async) {
+		buffer = binder_alloc_cache_get(alloc, data_size, offsets_size,
+						extra_buffers_size, pid);
+		if (buffer)
+			return buffer;
+	}
+
 	mutex_lock(&alloc->mutex);
 	buffer = binder_alloc_new_buf_locked(alloc, data_size, offsets_size,
 					     extra_buffers_size, is_async, pid);
+	if (PTR_ERR(buffer) == -ENOSPC) {
+		/* Give cached buffers back to the free tree and retry */
+		binder_alloc_cache_drain_locked(alloc, false);
+		buffer = binder_alloc_new_buf_locked(alloc, data_size,
+						     offsets_size,
+						     extra_buffers_size,
+						     is_async, pid);
+	}
 	mutex_unlock(&alloc->mutex);
 	return buffer;
 }
@@ -703,6 +845,10 @@ static void binder_delete_free_buffer(struct binder_alloc *alloc,
 	kmem_cache_free(binder_buffer_pool, buffer);
 }
 
+static void binder_alloc_zero_copy_release(struct binder_alloc *alloc,
+					   struct binder_zero_copy *zc,
+					   bool keep_data);
+
 static void binder_free_buf_locked(struct binder_alloc *alloc,
 				   struct binder_buffer *buffer)
 {
@@ -724,6 +870,13 @@ static void binder_free_buf_locked(struct binder_alloc *alloc,
 	BUG_ON(buffer->user_data < alloc->buffer);
 	BUG_ON(buffer->user_data > alloc->buffer + alloc->buffer_size);
 
+	while (buffer->zero_copy) {
+		struct binder_zero_copy *zc = buffer->zero_copy;
+
+		buffer->zero_copy = zc->next;
+		binder_alloc_zero_copy_release(alloc, zc, false);
+	}
+
 	if (buffer->async_transaction) {
 		alloc->free_async_space += size + sizeof(struct binder_buffer);
 
@@ -759,6 +912,53 @@ static void binder_free_buf_locked(struct binder_alloc *alloc,
 	binder_insert_free_buffer(alloc, buffer);
 }
 
+/*
+ * Free all cached buffers back to the free tree, and with @disable set
+ * stop caching until binder_alloc_cache_enable().  Called with
+ * alloc->mutex held.
+ */
+static void binder_alloc_cache_drain_locked(struct binder_alloc *alloc,
+					    bool disable)
+{
+	struct binder_buffer *buffer;
+	int i;
+
+	for (i = 0; i < BINDER_ALLOC_CACHE_CLASSES; i++) {
+		struct binder_alloc_cache *cache = &alloc->cache[i];
+
+		for (;;) {
+			spin_lock(&alloc->cache_lock);
+			if (disable)
+				alloc->cache_disabled = true;
+			if (!cache->count) {
+				spin_unlock(&alloc->cache_lock);
+				break;
+			}
+			buffer = cache->buffers[--cache->count];
+			spin_unlock(&alloc->cache_lock);
+			binder_free_buf_locked(alloc, buffer);
+		}
+	}
+}
+
+/**
+ * binder_alloc_cache_enable() - turn caching of freed buffers on or off
+ * @alloc:	binder_alloc for this proc
+ * @enable:	%false to free all cached buffers and stop caching
+ */
+void binder_alloc_cache_enable(struct binder_alloc *alloc, bool enable)
+{
+	mutex_lock(&alloc->mutex);
+	if (enable) {
+		spin_lock(&alloc->cache_lock);
+		alloc->cache_disabled = false;
+		spin_unlock(&alloc->cache_lock);
+	} else {
+		binder_alloc_cache_drain_locked(alloc, true);
+	}
+	mutex_unlock(&alloc->mutex);
+}
+
 static void binder_alloc_clear_buf(struct binder_alloc *alloc,
 				   struct binder_buffer *buffer);
 /**
@@ -783,6 +983,8 @@ void binder_alloc_free_buf(struct binder_alloc *alloc,
 		binder_alloc_clear_buf(alloc, buffer);
 		buffer->clear_on_free = false;
 	}
+	if (binder_alloc_cache_put(alloc, buffer))
+		return;
 	mutex_lock(&alloc->mutex);
 	binder_free_buf_locked(alloc, buffer);
 	mutex_unlock(&alloc->mutex);
@@ -869,6 +1071,8 @@ void binder_alloc_deferred_release(struct binder_alloc *alloc)
 	mutex_lock(&alloc->mutex);
 	BUG_ON(alloc->vma);
 
+	binder_alloc_cache_drain_locked(alloc, true);
+
 	while ((n = rb_first(&alloc->allocated_buffers))) {
 		buffer = rb_entry(n, struct binder_buffer, rb_node);
 
@@ -1125,6 +1329,7 @@ void binder_alloc_init(struct binder_alloc *alloc)
 	alloc->pid = current->group_leader->pid;
 	mutex_init(&alloc->mutex);
 	INIT_LIST_HEAD(&alloc->buffers);
+	spin_lock_init(&alloc->cache_lock);
 }
 
 int binder_alloc_shrinker_init(void)
@@ -1207,18 +1412,19 @@ static struct page *binder_alloc_get_page(struct binder_alloc *alloc,
 }
 
 /**
- * binder_alloc_clear_buf() - zero out buffer
+ * binder_alloc_clear_range() - zero out part of a buffer
  * @alloc: binder_alloc for this proc
  * @buffer: binder buffer to be cleared
+ * @buffer_offset: offset into @buffer data
+ * @bytes: bytes to clear
  *
- * memset the given buffer to 0
+ * memset the given range of the buffer's own pages to 0
  */
-static void binder_alloc_clear_buf(struct binder_alloc *alloc,
-				   struct binder_buffer *buffer)
+static void binder_alloc_clear_range(struct binder_alloc *alloc,
+				     struct binder_buffer *buffer,
+				     binder_size_t buffer_offset,
+				     size_t bytes)
 {
-	size_t bytes = binder_alloc_buffer_size(alloc, buffer);
-	binder_size_t buffer_offset = 0;
-
 	while (bytes) {
 		unsigned long size;
 		struct page *page;
@@ -1236,6 +1442,275 @@ static void binder_alloc_clear_buf(struct binder_alloc *alloc,
 	}
 }
 
+/**
+ * binder_alloc_clear_buf() - zero out buffer
+ * @alloc: binder_alloc for this proc
+ * @buffer: binder buffer to be cleared
+ *
+ * memset the given buffer to 0
+ */
+static void binder_alloc_clear_buf(struct binder_alloc *alloc,
+				   struct binder_buffer *buffer)
+{
+	binder_alloc_clear_range(alloc, buffer, 0,
+				 binder_alloc_buffer_size(alloc, buffer));
+}
+
+/*
+ * Point the target's mapping of @nr pages at @start back at the buffer's
+ * own pages.  Called with alloc->mutex and mmap_sem held.
+ */
+static void binder_alloc_restore_pages(struct binder_alloc *alloc,
+				       struct vm_area_struct *vma,
+				       unsigned long start, unsigned int nr)
+{
+	size_t index = (start - (uintptr_t)alloc->buffer) >> PAGE_SHIFT;
+	unsigned int i;
+
+	zap_page_range(vma, start, (unsigned long)nr << PAGE_SHIFT);
+	for (i = 0; i < nr; i++)
+		WARN_ON_ONCE(vm_insert_page(vma, start + i * PAGE_SIZE,
+					    alloc->pages[index + i].page_ptr));
+}
+
+/*
+ * Undo a zero copy mapping and unpin the sender pages.  With @keep_data
+ * the data is first copied into the buffer's own pages, so that the
+ * kernel can modify it.  Called with alloc->mutex held.
+ */
+static void binder_alloc_zero_copy_release(struct binder_alloc *alloc,
+					   struct binder_zero_copy *zc,
+					   bool keep_data)
+{
+	size_t index = (zc->start - (uintptr_t)alloc->buffer) >> PAGE_SHIFT;
+	struct vm_area_struct *vma;
+	struct mm_struct *mm;
+	unsigned int i;
+
+	if (keep_data) {
+		for (i = 0; i < zc->nr_pages; i++)
+			copy_highpage(alloc->pages[index + i].page_ptr,
+				      zc->pages[i]);
+	}
+
+	mm = alloc->vma_vm_mm;
+	if (mm && mmget_not_zero(mm)) {
+		down_read(&mm->mmap_sem);
+		vma = binder_alloc_get_vma(alloc);
+		if (vma && mmget_still_valid(mm))
+			binder_alloc_restore_pages(alloc, vma, zc->start,
+						   zc->nr_pages);
+		up_read(&mm->mmap_sem);
+		mmput(mm);
+	}
+
+	for (i = 0; i < zc->nr_pages; i++)
+		put_page(zc->pages[i]);
+	kfree(zc);
+}
+
+/*
+ * The kernel is about to write to [@buffer_offset, @buffer_offset +
+ * @bytes), e.g. to fix up a pointer in a parent buffer: give every zero
+ * copy range it touches its own pages back.
+ */
+static void binder_alloc_zero_copy_demote(struct binder_alloc *alloc,
+					  struct binder_buffer *buffer,
+					  binder_size_t buffer_offset,
+					  size_t bytes)
+{
+	unsigned long start = (uintptr_t)buffer->user_data + buffer_offset;
+	unsigned long end = start + bytes;
+	struct binder_zero_copy **zcp = &buffer->zero_copy;
+	struct binder_zero_copy *zc;
+
+	mutex_lock(&alloc->mutex);
+	while ((zc = *zcp)) {
+		if (zc->start < end &&
+		    start < zc->start + ((unsigned long)zc->nr_pages << PAGE_SHIFT)) {
+			*zcp = zc->next;
+			binder_alloc_zero_copy_release(alloc, zc, true);
+		} else {
+			zcp = &zc->next;
+		}
+	}
+	mutex_unlock(&alloc->mutex);
+}
+
+/* Sender page backing @buffer_offset if it is zero copy mapped, or NULL */
+static struct page *binder_alloc_zero_copy_page(struct binder_buffer *buffer,
+						binder_size_t buffer_offset)
+{
+	unsigned long addr = (uintptr_t)buffer->user_data + buffer_offset;
+	struct binder_zero_copy *zc;
+
+	for (zc = buffer->zero_copy; zc; zc = zc->next) {
+		if (addr >= zc->start &&
+		    addr < zc->start + ((unsigned long)zc->nr_pages << PAGE_SHIFT))
+			return zc->pages[(addr - zc->start) >> PAGE_SHIFT];
+	}
+	return NULL;
+}
+
+/*
+ * Only pages nobody can change any more may be shared with the target:
+ * those of memfds sealed against writes and size changes.  Sharing
+ * anything else would let the sender change the data after the target
+ * checked it, or truncate the pages from under the target's mapping.
+ */
+#define BINDER_ZERO_COPY_SEALS	(F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE)
+
+static bool binder_alloc_page_sealed(struct page *page)
+{
+	struct address_space *mapping;
+
+	if (PageAnon(page) || PageCompound(page))
+		return false;
+	mapping = READ_ONCE(page->mapping);
+	if (!mapping || !shmem_mapping(mapping))
+		return false;
+	return (SHMEM_I(mapping->host)->seals & BINDER_ZERO_COPY_SEALS) ==
+		BINDER_ZERO_COPY_SEALS;
+}
+
+/*
+ * Pin the sender pages fully covered by [@from, @from + @bytes) and map
+ * them at the same page offsets from @dst in the target.
+ */
+static struct binder_zero_copy *
+binder_alloc_zero_copy_map(struct binder_alloc *alloc, unsigned long dst,
+			   const void __user *from, size_t bytes)
+{
+	unsigned long start = PAGE_ALIGN(dst);
+	unsigned long end = (dst + bytes) & PAGE_MASK;
+	struct binder_zero_copy *zc;
+	struct vm_area_struct *vma;
+	struct mm_struct *mm;
+	unsigned int nr, i;
+	int pinned, ret = -ESRCH;
+
+	if (end <= start)
+		return NULL;
+	nr = (end - start) >> PAGE_SHIFT;
+	zc = kmalloc(sizeof(*zc) + nr * sizeof(zc->pages[0]), GFP_KERNEL);
+	if (!zc)
+		return NULL;
+
+	pinned = get_user_pages_fast((uintptr_t)from + (start - dst), nr, 0,
+				     zc->pages);
+	if (pinned < 0)
+		pinned = 0;
+	if (pinned != nr)
+		goto err_put_pages;
+	for (i = 0; i < nr; i++) {
+		if (!binder_alloc_page_sealed(zc->pages[i]))
+			goto err_put_pages;
+	}
+
+	mutex_lock(&alloc->mutex);
+	mm = alloc->vma_vm_mm;
+	if (mm && mmget_not_zero(mm)) {
+		down_read(&mm->mmap_sem);
+		vma = binder_alloc_get_vma(alloc);
+		if (vma && mmget_still_valid(mm)) {
+			zap_page_range(vma, start, end - start);
+			for (i = 0; i < nr; i++) {
+				ret = vm_insert_page(vma, start + i * PAGE_SIZE,
+						     zc->pages[i]);
+				if (ret) {
+					binder_alloc_restore_pages(alloc, vma,
+								   start, nr);
+					break;
+				}
+			}
+		}
+		up_read(&mm->mmap_sem);
+		mmput(mm);
+	}
+	mutex_unlock(&alloc->mutex);
+	if (ret)
+		goto err_put_pages;
+
+	binder_alloc_debug(BINDER_DEBUG_BUFFER_ALLOC,
+		     "%d: zero copy %u pages at %lx\n", alloc->pid, nr, start);
+	zc->start = start;
+	zc->nr_pages = nr;
+	return zc;
+
+err_put_pages:
+	while (pinned--)
+		put_page(zc->pages[pinned]);
+	kfree(zc);
+	return NULL;
+}
+
+/**
+ * binder_alloc_map_user_to_buffer() - map or copy src user to tgt user
+ * @alloc: binder_alloc for this proc
+ * @buffer: binder buffer to be accessed
+ * @buffer_offset: offset into @buffer data, advanced by any padding used
+ * @space: bytes available at @buffer_offset
+ * @from: userspace pointer to source buffer
+ * @bytes: bytes to copy
+ *
+ * Like binder_alloc_copy_user_to_buffer(), but if the source is large and
+ * its whole pages belong to a write-sealed memfd, those pages are mapped
+ * into the target instead of copied.  The destination is then moved
+ * forward within @space to the page offset of @from, and only the
+ * partial pages at either end are copied.
+ *
+ * Return: bytes remaining to be copied
+ */
+unsigned long
+binder_alloc_map_user_to_buffer(struct binder_alloc *alloc,
+				struct binder_buffer *buffer,
+				binder_size_t *buffer_offset,
+				size_t space,
+				const void __user *from,
+				size_t bytes)
+{
+	unsigned long dst = (uintptr_t)buffer->user_data + *buffer_offset;
+	size_t pad = ((uintptr_t)from - dst) & ~PAGE_MASK;
+	struct binder_zero_copy *zc;
+	size_t head, tail;
+
+	if (!binder_alloc_zero_copy_min || bytes < binder_alloc_zero_copy_min ||
+	    !IS_ALIGNED((uintptr_t)from, sizeof(u64)) ||
+	    space < pad || space - pad < bytes ||
+	    !check_buffer(alloc, buffer, *buffer_offset + pad, bytes))
+		goto copy;
+
+	zc = binder_alloc_zero_copy_map(alloc, dst + pad, from, bytes);
+	if (!zc)
+		goto copy;
+	zc->next = buffer->zero_copy;
+	buffer->zero_copy = zc;
+
+	/*
+	 * The bytes skipped to reach the source page offset, and those up
+	 * to the u64 alignment after the payload, would otherwise show the
+	 * target whatever an earlier transaction left in its buffer.
+	 */
+	binder_alloc_clear_range(alloc, buffer, *buffer_offset, pad);
+	binder_alloc_clear_range(alloc, buffer, *buffer_offset + pad + bytes,
+				 min_t(size_t, ALIGN(bytes, sizeof(u64)) - bytes,
+				       space - pad - bytes));
+
+	*buffer_offset += pad;
+	dst += pad;
+	head = zc->start - dst;
+	tail = dst + bytes - (zc->start + ((unsigned long)zc->nr_pages << PAGE_SHIFT));
+	return binder_alloc_copy_user_to_buffer(alloc, buffer, *buffer_offset,
+						from, head) +
+		binder_alloc_copy_user_to_buffer(alloc, buffer,
+						 *buffer_offset + bytes - tail,
+						 from + bytes - tail, tail);
+
+copy:
+	return binder_alloc_copy_user_to_buffer(alloc, buffer, *buffer_offset,
+						from, bytes);
+}
+
 /**
  * binder_alloc_copy_user_to_buffer() - copy src user to tgt user
  * @alloc: binder_alloc for this proc
@@ -1257,6 +1732,9 @@ binder_alloc_copy_user_to_buffer(struct binder_alloc *alloc,
 {
 	if (!check_buffer(alloc, buffer, buffer_offset, bytes))
 		return bytes;
+	if (buffer->zero_copy)
+		binder_alloc_zero_copy_demote(alloc, buffer, buffer_offset,
+					      bytes);
 
 	while (bytes) {
 		unsigned long size;
@@ -1289,16 +1767,26 @@ static void binder_alloc_do_buffer_copy(struct binder_alloc *alloc,
 {
 	/* All copies must be 32-bit aligned and 32-bit size */
 	BUG_ON(!check_buffer(alloc, buffer, buffer_offset, bytes));
+	if (to_buffer && buffer->zero_copy)
+		binder_alloc_zero_copy_demote(alloc, buffer, buffer_offset,
+					      bytes);
 
 	while (bytes) {
 		unsigned long size;
-		struct page *page;
+		struct page *page = NULL;
 		pgoff_t pgoff;
 		void *tmpptr;
 		void *base_ptr;
 
-		page = binder_alloc_get_page(alloc, buffer,
-					     buffer_offset, &pgoff);
+		if (!to_buffer && buffer->zero_copy)
+			page = binder_alloc_zero_copy_page(buffer,
+							   buffer_offset);
+		if (page)
+			pgoff = (buffer_offset + (uintptr_t)buffer->user_data) &
+				~PAGE_MASK;
+		else
+			page = binder_alloc_get_page(alloc, buffer,
+						     buffer_offset, &pgoff);
 		size = min_t(size_t, bytes, PAGE_SIZE - pgoff);
 		base_ptr = kmap_atomic(page);
 		tmpptr = base_ptr + pgoff;
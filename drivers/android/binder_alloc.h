@@ -26,6 +26,7 @@
 
 extern struct list_lru binder_alloc_lru;
 struct binder_transaction;
+struct binder_zero_copy;
 
 /**
  * struct binder_buffer - buffer used for binder transactions
@@ -45,6 +46,8 @@ struct binder_transaction;
  * @extra_buffers_size: size of space for other objects (like sg lists)
  * @user_data:          user pointer to base of buffer space
  * @pid:                pid to attribute the buffer to (caller)
+ * @zero_copy:          sender pages mapped into this buffer in place of
+ *                      its own, released with the buffer
  *
  * Bookkeeping structure for binder transaction buffers
  */
@@ -67,6 +70,7 @@ struct binder_buffer {
 	size_t extra_buffers_size;
 	void __user *user_data;
 	int    pid;
+	struct binder_zero_copy *zero_copy;
 };
 
 /**
@@ -81,6 +85,27 @@ struct binder_lru_page {
 	struct binder_alloc *alloc;
 };
 
+#define BINDER_ALLOC_CACHE_CLASSES	5
+#define BINDER_ALLOC_CACHE_DEPTH	4
+#define BINDER_ALLOC_CACHE_MIN_SHIFT	7
+#define BINDER_ALLOC_CACHE_MAX_SIZE	\
+	(1U << (BINDER_ALLOC_CACHE_MIN_SHIFT + BINDER_ALLOC_CACHE_CLASSES - 1))
+
+/**
+ * struct binder_alloc_cache - recently freed buffers of one size class
+ * @count:   number of valid entries
+ * @buffers: freed buffers, still in allocated_buffers with their pages
+ *           mapped so they can be handed out again as they are
+ * @sizes:   usable size of each cached buffer
+ *
+ * Class n holds buffers of up to 128 << n bytes.
+ */
+struct binder_alloc_cache {
+	unsigned int count;
+	struct binder_buffer *buffers[BINDER_ALLOC_CACHE_DEPTH];
+	size_t sizes[BINDER_ALLOC_CACHE_DEPTH];
+};
+
 /**
  * struct binder_alloc - per-binder proc state for binder allocator
  * @vma:                vm_area_struct passed to mmap_handler
@@ -101,6 +126,10 @@ struct binder_lru_page {
  * @pages_high:         high watermark of offset in @pages
  * @oneway_spam_detected: %true if oneway spam detection fired, clear that
  * flag once the async buffer has returned to a healthy state
+ * @cache_lock:         protects @cache and @cache_disabled
+ * @cache_disabled:     %true if freed buffers are not to be cached
+ * @cache:              small synchronous buffers freed recently, reused
+ *                      without taking @mutex
  *
  * Bookkeeping structure for per-proc address space management for binder
  * buffers. It is normally initialized during binder_init() and binder_mmap()
@@ -122,6 +151,9 @@ struct binder_alloc {
 	int pid;
 	size_t pages_high;
 	bool oneway_spam_detected;
+	spinlock_t cache_lock;
+	bool cache_disabled;
+	struct binder_alloc_cache cache[BINDER_ALLOC_CACHE_CLASSES];
 };
 
 #ifdef CONFIG_ANDROID_BINDER_IPC_SELFTEST
@@ -146,6 +178,7 @@ binder_alloc_prepare_to_free(struct binder_alloc *alloc,
 			     uintptr_t user_ptr);
 extern void binder_alloc_free_buf(struct binder_alloc *alloc,
 				  struct binder_buffer *buffer);
+extern void binder_alloc_cache_enable(struct binder_alloc *alloc, bool enable);
 extern int binder_alloc_mmap_handler(struct binder_alloc *alloc,
 				     struct vm_area_struct *vma);
 extern void binder_alloc_deferred_release(struct binder_alloc *alloc);
@@ -181,6 +214,14 @@ binder_alloc_copy_user_to_buffer(struct binder_alloc *alloc,
 				 const void __user *from,
 				 size_t bytes);
 
+unsigned long
+binder_alloc_map_user_to_buffer(struct binder_alloc *alloc,
+				struct binder_buffer *buffer,
+				binder_size_t *buffer_offset,
+				size_t space,
+				const void __user *from,
+				size_t bytes);
+
 void binder_alloc_copy_to_buffer(struct binder_alloc *alloc,
 				 struct binder_buffer *buffer,
 				 binder_size_t buffer_offset,
@@ -19,10 +19,13 @@
 
 #include <linux/mm_types.h>
 #include <linux/err.h>
+#include <linux/ktime.h>
 #include "binder_alloc.h"
 
 #define BUFFER_NUM 5
 #define BUFFER_MIN_SIZE (PAGE_SIZE / 8)
+#define BENCH_ITERS 100000
+#define BENCH_SIZE 256
 
 static bool binder_selftest_run = true;
 static int binder_selftest_failures;
@@ -280,6 +283,43 @@ static void binder_selftest_alloc_offset(struct binder_alloc *alloc,
 	}
 }
 
+/**
+ * binder_selftest_bench() - Time alloc and free of a small buffer.
+ * @alloc: Pointer to alloc struct.
+ * @cache: Whether freed buffers are cached.
+ *
+ * With the cache on, every allocation after the first must get back
+ * the buffer freed just before.
+ *
+ * Return: average nanoseconds per alloc/free pair.
+ */
+static u64 binder_selftest_bench(struct binder_alloc *alloc, bool cache)
+{
+	struct binder_buffer *buffer, *prev = NULL;
+	ktime_t start;
+	int i;
+
+	binder_alloc_cache_enable(alloc, cache);
+	start = ktime_get();
+	for (i = 0; i < BENCH_ITERS; i++) {
+		buffer = binder_alloc_new_buf(alloc, BENCH_SIZE, 0, 0, 0, 0);
+		if (IS_ERR(buffer)) {
+			pr_err("bench alloc failed %ld\n", PTR_ERR(buffer));
+			binder_selftest_failures++;
+			return 0;
+		}
+		if (cache && prev && buffer != prev) {
+			pr_err("bench expected cached buffer %pK got %pK\n",
+			       prev, buffer);
+			binder_selftest_failures++;
+		}
+		prev = buffer;
+		binder_alloc_free_buf(alloc, buffer);
+	}
+	return div_u64(ktime_to_ns(ktime_sub(ktime_get(), start)),
+		       BENCH_ITERS);
+}
+
 /**
  * binder_selftest_alloc() - Test alloc and free of buffer pages.
  * @alloc: Pointer to alloc struct.
@@ -287,11 +327,14 @@ static void binder_selftest_alloc_offset(struct binder_alloc *alloc,
  * Allocate BUFFER_NUM buffers to cover all page alignment cases,
  * then free them in all orders possible. Check that pages are
  * correctly allocated, put onto lru when buffers are freed, and
- * are freed when binder_alloc_free_page is called.
+ * are freed when binder_alloc_free_page is called.  The buffer cache
+ * is off for these checks, then small buffer throughput is measured
+ * with it off and on.
  */
 void binder_selftest_alloc(struct binder_alloc *alloc)
 {
 	size_t end_offset[BUFFER_NUM];
+	u64 uncached_ns, cached_ns;
 
 	if (!binder_selftest_run)
 		return;
@@ -299,7 +342,12 @@ void binder_selftest_alloc(struct binder_alloc *alloc)
 	if (!binder_selftest_run || !alloc->vma)
 		goto done;
 	pr_info("STARTED\n");
+	binder_alloc_cache_enable(alloc, false);
 	binder_selftest_alloc_offset(alloc, end_offset, 0);
+	uncached_ns = binder_selftest_bench(alloc, false);
+	cached_ns = binder_selftest_bench(alloc, true);
+	pr_info("%d byte alloc/free: %llu ns uncached, %llu ns cached\n",
+		BENCH_SIZE, uncached_ns, cached_ns);
 	binder_selftest_run = false;
 	if (binder_selftest_failures > 0)
 		pr_info("%d tests FAILED\n", binder_selftest_failures);
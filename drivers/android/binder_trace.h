@@ -156,6 +156,38 @@ TRACE_EVENT(binder_transaction,
 		  __entry->reply, __entry->flags, __entry->code)
 );
 
+TRACE_EVENT(binder_transaction_latency,
+	TP_PROTO(struct binder_transaction *t, struct binder_node *target_node,
+		 struct binder_thread *from, struct binder_thread *to,
+		 u64 latency_ns),
+	TP_ARGS(t, target_node, from, to, latency_ns),
+	TP_STRUCT__entry(
+		__field(int, debug_id)
+		__field(int, target_node)
+		__field(int, from_proc)
+		__field(int, from_thread)
+		__field(int, to_proc)
+		__field(int, to_thread)
+		__field(unsigned int, code)
+		__field(u64, latency_ns)
+	),
+	TP_fast_assign(
+		__entry->debug_id = t->debug_id;
+		__entry->target_node = target_node->debug_id;
+		__entry->from_proc = from->proc->pid;
+		__entry->from_thread = from->pid;
+		__entry->to_proc = to->proc->pid;
+		__entry->to_thread = to->pid;
+		__entry->code = t->code;
+		__entry->latency_ns = latency_ns;
+	),
+	TP_printk("transaction=%d dest_node=%d from %d:%d to %d:%d code=0x%x latency=%llu ns",
+		  __entry->debug_id, __entry->target_node,
+		  __entry->from_proc, __entry->from_thread,
+		  __entry->to_proc, __entry->to_thread,
+		  __entry->code, __entry->latency_ns)
+);
+
 TRACE_EVENT(binder_transaction_received,
 	TP_PROTO(struct binder_transaction *t),
 	TP_ARGS(t),
@@ -566,7 +566,7 @@ static struct sk_buff *receive_small(struct net_device *dev,
 	}
 	rcu_read_unlock();
 
-	skb = build_skb(buf, buflen);
+	skb = napi_build_skb(buf, buflen);
 	if (!skb) {
 		put_page(page);
 		goto err;
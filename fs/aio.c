@@ -36,9 +36,12 @@
 #include <linux/eventfd.h>
 #include <linux/blkdev.h>
 #include <linux/compat.h>
+#include <linux/cred.h>
 #include <linux/migrate.h>
 #include <linux/ramfs.h>
 #include <linux/percpu-refcount.h>
+#include <linux/poll.h>
+#include <linux/refcount.h>
 #include <linux/mount.h>
 
 #include <asm/kmap_types.h>
@@ -91,6 +94,9 @@ struct kioctx {
 
 	unsigned long		user_id;
 
+	/* address space that punted buffered reads run against */
+	struct mm_struct	*mm;
+
 	struct __percpu kioctx_cpu *cpu;
 
 	/*
@@ -171,9 +177,29 @@ struct kioctx {
  */
 #define KIOCB_CANCELLED		((void *) (~0ULL))
 
+struct fsync_iocb {
+	struct work_struct	work;
+	struct file		*file;
+	const struct cred	*creds;
+	bool			datasync;
+};
+
+struct poll_iocb {
+	struct file		*file;
+	struct wait_queue_head	*head;
+	unsigned int		events;
+	bool			cancelled;
+	bool			work_scheduled;
+	bool			work_need_resched;
+	struct wait_queue_entry	wait;
+	struct work_struct	work;
+};
+
 struct aio_kiocb {
 	union {
 		struct kiocb		rw;
+		struct fsync_iocb	fsync;
+		struct poll_iocb	poll;
 	};
 
 	struct kioctx		*ki_ctx;
@@ -190,6 +216,27 @@ struct aio_kiocb {
 	 * this is the underlying eventfd context to deliver events to.
 	 */
 	struct eventfd_ctx	*ki_eventfd;
+
+	/*
+	 * Only IOCB_CMD_POLL uses this, to keep the iocb around while both
+	 * the submitter and the wakeup side may still look at it.  Zero
+	 * means the completion owns the only reference.
+	 */
+	refcount_t		ki_refcnt;
+};
+
+/*
+ * Buffered reads that would block on the page cache are finished from
+ * aio_wq instead of in io_submit(), with a private copy of the iovec.
+ */
+struct aio_read_async {
+	struct work_struct	work;
+	struct aio_kiocb	*iocb;
+	const struct cred	*creds;
+	struct iov_iter		iter;
+	struct iovec		*iov;
+	struct iovec		fast_iov[UIO_FASTIOV];
+	ssize_t			done;
 };
 
 /*------ sysctl variables----*/
@@ -199,6 +246,7 @@ unsigned long aio_max_nr = 0x10000; /* system wide maximum number of aio request
 /*----end sysctl variables---*/
 
 static struct kmem_cache	*kiocb_cachep;
+static struct workqueue_struct	*aio_wq;
 static struct kmem_cache	*kioctx_cachep;
 
 static struct vfsmount *aio_mnt;
@@ -269,6 +317,10 @@ static int __init aio_setup(void)
 	kiocb_cachep = KMEM_CACHE(aio_kiocb, SLAB_HWCACHE_ALIGN|SLAB_PANIC);
 	kioctx_cachep = KMEM_CACHE(kioctx,SLAB_HWCACHE_ALIGN|SLAB_PANIC);
 
+	aio_wq = alloc_workqueue("aio", WQ_UNBOUND, 0);
+	if (!aio_wq)
+		panic("Failed to allocate aio workqueue.");
+
 	pr_debug("sizeof(struct page) = %zu\n", sizeof(struct page));
 
 	return 0;
@@ -761,6 +813,7 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 		return ERR_PTR(-ENOMEM);
 
 	ctx->max_reqs = max_reqs;
+	ctx->mm = mm;
 
 	spin_lock_init(&ctx->ctx_lock);
 	spin_lock_init(&ctx->completion_lock);
@@ -1088,6 +1141,17 @@ out:
 	return ret;
 }
 
+static inline void iocb_put(struct aio_kiocb *iocb)
+{
+	struct kioctx *ctx = iocb->ki_ctx;
+
+	if (refcount_read(&iocb->ki_refcnt) == 0 ||
+	    refcount_dec_and_test(&iocb->ki_refcnt)) {
+		kmem_cache_free(kiocb_cachep, iocb);
+		percpu_ref_put(&ctx->reqs);
+	}
+}
+
 /* aio_complete
  *	Called when the io request on the given iocb is complete.
  */
@@ -1165,8 +1229,6 @@ static void aio_complete(struct aio_kiocb *iocb, long res, long res2)
 		eventfd_ctx_put(iocb->ki_eventfd);
 	}
 
-	kmem_cache_free(kiocb_cachep, iocb);
-
 	/*
 	 * We have to order our ring_info tail store above and test
 	 * of the wait list below outside the wait lock.  This is
@@ -1178,7 +1240,7 @@ static void aio_complete(struct aio_kiocb *iocb, long res, long res2)
 	if (waitqueue_active(&ctx->wait))
 		wake_up(&ctx->wait);
 
-	percpu_ref_put(&ctx->reqs);
+	iocb_put(iocb);
 }
 
 /* aio_read_events_ring
@@ -1533,6 +1595,111 @@ static inline ssize_t aio_rw_ret(struct kiocb *req, ssize_t ret)
 	}
 }
 
+static void aio_read_work(struct work_struct *work)
+{
+	struct aio_read_async *async =
+		container_of(work, struct aio_read_async, work);
+	struct kiocb *req = &async->iocb->rw;
+	struct mm_struct *mm = async->iocb->ki_ctx->mm;
+	const struct cred *old_cred;
+	ssize_t ret = -EFAULT;
+
+	/* The submitter may have exited, its buffers are gone with it */
+	if (mmget_not_zero(mm)) {
+		use_mm(mm);
+		old_cred = override_creds(async->creds);
+		ret = call_read_iter(req->ki_filp, req, &async->iter);
+		revert_creds(old_cred);
+		unuse_mm(mm);
+	} else {
+		mm = NULL;
+	}
+
+	if (async->done)
+		ret = ret < 0 ? async->done : ret + async->done;
+	put_cred(async->creds);
+	if (async->iov != async->fast_iov)
+		kfree(async->iov);
+	kfree(async);
+
+	/*
+	 * Complete before dropping the mm: if ours is the last reference,
+	 * mmput() runs exit_aio(), which waits for this very request.
+	 */
+	aio_rw_ret(req, ret);
+	if (mm)
+		mmput(mm);
+}
+
+/*
+ * Hand the rest of a buffered read to aio_wq.  @done bytes have already
+ * been read (and ki_pos advanced) by the nonblocking attempt.
+ */
+static ssize_t aio_read_punt(struct kiocb *req, struct iov_iter *iter,
+		ssize_t done)
+{
+	struct aio_read_async *async;
+
+	async = kmalloc(sizeof(*async), GFP_KERNEL);
+	if (unlikely(!async))
+		goto out_complete;
+
+	async->iov = async->fast_iov;
+	if (iter->nr_segs > UIO_FASTIOV) {
+		async->iov = kmalloc_array(iter->nr_segs, sizeof(struct iovec),
+					   GFP_KERNEL);
+		if (unlikely(!async->iov)) {
+			kfree(async);
+			goto out_complete;
+		}
+	}
+	memcpy(async->iov, iter->iov, iter->nr_segs * sizeof(struct iovec));
+	async->iter = *iter;
+	async->iter.iov = async->iov;
+	async->iocb = container_of(req, struct aio_kiocb, rw);
+	async->creds = get_current_cred();
+	async->done = done;
+
+	INIT_WORK(&async->work, aio_read_work);
+	queue_work(aio_wq, &async->work);
+	return -EIOCBQUEUED;
+
+out_complete:
+	return aio_rw_ret(req, done ? done : -ENOMEM);
+}
+
+/*
+ * Buffered reads of regular files and block devices can sleep on page
+ * cache misses, which would stall io_submit() and every iocb behind it.
+ * Serve what is cached right away and finish the rest from aio_wq.
+ * IOCB_NOWAIT submitters asked for -EAGAIN instead, so leave those alone.
+ */
+static bool aio_read_may_block(struct kiocb *req)
+{
+	umode_t mode = file_inode(req->ki_filp)->i_mode;
+
+	if (req->ki_flags & (IOCB_DIRECT | IOCB_NOWAIT))
+		return false;
+	return S_ISREG(mode) || S_ISBLK(mode);
+}
+
+static ssize_t aio_read_buffered(struct kiocb *req, struct iov_iter *iter)
+{
+	ssize_t ret = 0;
+
+	if (req->ki_filp->f_mode & FMODE_NOWAIT) {
+		req->ki_flags |= IOCB_NOWAIT;
+		ret = call_read_iter(req->ki_filp, req, iter);
+		req->ki_flags &= ~IOCB_NOWAIT;
+
+		if (ret == -EAGAIN)
+			ret = 0;
+		else if (ret <= 0 || !iov_iter_count(iter))
+			return aio_rw_ret(req, ret);
+	}
+	return aio_read_punt(req, iter, ret);
+}
+
 static ssize_t aio_read(struct kiocb *req, struct iocb *iocb, bool vectored,
 		bool compat)
 {
@@ -1557,8 +1724,12 @@ static ssize_t aio_read(struct kiocb *req, struct iocb *iocb, bool vectored,
 	if (ret)
 		goto out_fput;
 	ret = rw_verify_area(READ, file, &req->ki_pos, iov_iter_count(&iter));
-	if (!ret)
-		ret = aio_rw_ret(req, call_read_iter(file, req, &iter));
+	if (!ret) {
+		if (aio_read_may_block(req))
+			ret = aio_read_buffered(req, &iter);
+		else
+			ret = aio_rw_ret(req, call_read_iter(file, req, &iter));
+	}
 	kfree(iovec);
 out_fput:
 	if (unlikely(ret && ret != -EIOCBQUEUED))
@@ -1612,6 +1783,296 @@ out_fput:
 	return ret;
 }
 
+static void aio_fsync_work(struct work_struct *work)
+{
+	struct fsync_iocb *req = container_of(work, struct fsync_iocb, work);
+	const struct cred *old_cred = override_creds(req->creds);
+	int ret;
+
+	ret = vfs_fsync(req->file, req->datasync);
+	revert_creds(old_cred);
+	put_cred(req->creds);
+	fput(req->file);
+	aio_complete(container_of(req, struct aio_kiocb, fsync), ret, 0);
+}
+
+static int aio_fsync(struct fsync_iocb *req, struct iocb *iocb, bool datasync)
+{
+	if (unlikely(iocb->aio_buf || iocb->aio_offset || iocb->aio_nbytes ||
+			iocb->aio_rw_flags))
+		return -EINVAL;
+
+	req->file = fget(iocb->aio_fildes);
+	if (unlikely(!req->file))
+		return -EBADF;
+	if (unlikely(!req->file->f_op->fsync)) {
+		fput(req->file);
+		return -EINVAL;
+	}
+
+	req->creds = prepare_creds();
+	if (unlikely(!req->creds)) {
+		fput(req->file);
+		return -ENOMEM;
+	}
+
+	req->datasync = datasync;
+	INIT_WORK(&req->work, aio_fsync_work);
+	queue_work(aio_wq, &req->work);
+	return -EIOCBQUEUED;
+}
+
+static void aio_poll_complete(struct aio_kiocb *iocb, unsigned int mask)
+{
+	fput(iocb->poll.file);
+	aio_complete(iocb, mask, 0);
+}
+
+static int aio_poll_cancel(struct kiocb *iocb);
+
+/*
+ * Lock the waitqueue the request is on, if it is still on one.
+ *
+ * A waitqueue may be freed under us once wake_up_pollfree() has run
+ * (binder, signalfd). All its callers RCU-delay the free, so as in
+ * eventpoll: with rcu_read_lock() held, a non-NULL ->head can be locked,
+ * and under the lock a request still on the queue keeps it alive. The
+ * RCU read lock is held as long as the queue lock, in case the caller
+ * removes the last entry.
+ */
+static bool poll_iocb_lock_wq(struct poll_iocb *req)
+{
+	struct wait_queue_head *head;
+
+	rcu_read_lock();
+	head = smp_load_acquire(&req->head);
+	if (head) {
+		spin_lock(&head->lock);
+		if (!list_empty(&req->wait.entry))
+			return true;
+		spin_unlock(&head->lock);
+	}
+	rcu_read_unlock();
+	return false;
+}
+
+static void poll_iocb_unlock_wq(struct poll_iocb *req)
+{
+	spin_unlock(&req->head->lock);
+	rcu_read_unlock();
+}
+
+static void aio_poll_complete_work(struct work_struct *work)
+{
+	struct poll_iocb *req = container_of(work, struct poll_iocb, work);
+	struct aio_kiocb *iocb = container_of(req, struct aio_kiocb, poll);
+	struct poll_table_struct pt = { ._key = req->events };
+	struct kioctx *ctx = iocb->ki_ctx;
+	unsigned int mask = 0;
+
+	if (!READ_ONCE(req->cancelled))
+		mask = req->file->f_op->poll(req->file, &pt) & req->events;
+
+	/*
+	 * Cancellation runs under ctx_lock, so checking ->cancelled and
+	 * going back to waiting under it as well means a cancelled request
+	 * can't be left on the waitqueue. The request stays queued while
+	 * this runs, so no wakeup is lost.
+	 */
+	spin_lock_irq(&ctx->ctx_lock);
+	if (poll_iocb_lock_wq(req)) {
+		if (!mask && !READ_ONCE(req->cancelled)) {
+			/* Spurious wakeup, unless another one came in */
+			if (req->work_need_resched) {
+				schedule_work(&req->work);
+				req->work_need_resched = false;
+			} else {
+				req->work_scheduled = false;
+			}
+			poll_iocb_unlock_wq(req);
+			if (list_empty(&iocb->ki_list)) {
+				list_add_tail(&iocb->ki_list, &ctx->active_reqs);
+				iocb->ki_cancel = aio_poll_cancel;
+			}
+			spin_unlock_irq(&ctx->ctx_lock);
+			return;
+		}
+		list_del_init(&req->wait.entry);
+		poll_iocb_unlock_wq(req);
+	} /* else POLLFREE took the request off its waitqueue, complete it */
+	list_del_init(&iocb->ki_list);
+	spin_unlock_irq(&ctx->ctx_lock);
+
+	aio_poll_complete(iocb, mask);
+}
+
+/* called with ctx_lock held and interrupts disabled */
+static int aio_poll_cancel(struct kiocb *iocb)
+{
+	struct aio_kiocb *aiocb = container_of(iocb, struct aio_kiocb, rw);
+	struct poll_iocb *req = &aiocb->poll;
+
+	if (poll_iocb_lock_wq(req)) {
+		WRITE_ONCE(req->cancelled, true);
+		if (!req->work_scheduled) {
+			schedule_work(&req->work);
+			req->work_scheduled = true;
+		}
+		poll_iocb_unlock_wq(req);
+	} /* else POLLFREE cancelled the request already */
+
+	return 0;
+}
+
+static int aio_poll_wake(struct wait_queue_entry *wait, unsigned mode,
+		int sync, void *key)
+{
+	struct poll_iocb *req = container_of(wait, struct poll_iocb, wait);
+	unsigned long mask = (unsigned long)key;
+
+	/* for instances that pass a key, check for an event match first */
+	if (mask && !(mask & req->events))
+		return 0;
+
+	/*
+	 * Leave the request on the waitqueue: only ->poll() in the work
+	 * knows whether it is ready, and no wakeup may be missed meanwhile.
+	 */
+	if (req->work_scheduled) {
+		req->work_need_resched = true;
+	} else {
+		schedule_work(&req->work);
+		req->work_scheduled = true;
+	}
+
+	/*
+	 * The waitqueue is going away: take the request off it, cancel it
+	 * so the work skips ->poll(), and stop any further use of ->head.
+	 * Clearing ->head must come last, as from then on the work can
+	 * complete and free the request without taking the queue lock.
+	 */
+	if (mask & POLLFREE) {
+		WRITE_ONCE(req->cancelled, true);
+		list_del_init(&req->wait.entry);
+		smp_store_release(&req->head, NULL);
+	}
+	return 1;
+}
+
+struct aio_poll_table {
+	struct poll_table_struct	pt;
+	struct aio_kiocb		*iocb;
+	bool				queued;
+	int				error;
+};
+
+static void aio_poll_queue_proc(struct file *file,
+		struct wait_queue_head *head, struct poll_table_struct *p)
+{
+	struct aio_poll_table *pt = container_of(p, struct aio_poll_table, pt);
+
+	/* multiple wait queues per file are not supported */
+	if (unlikely(pt->queued)) {
+		pt->error = -EINVAL;
+		return;
+	}
+
+	pt->queued = true;
+	pt->error = 0;
+	pt->iocb->poll.head = head;
+	add_wait_queue(head, &pt->iocb->poll.wait);
+}
+
+/*
+ * One-shot readiness notification, completed with the ready POLL* mask in
+ * io_event.res.  Together with nonblocking recv/send this gives sockets
+ * and pipes the same submit/reap loop as files.
+ */
+static int aio_poll(struct aio_kiocb *aiocb, struct iocb *iocb)
+{
+	struct kioctx *ctx = aiocb->ki_ctx;
+	struct poll_iocb *req = &aiocb->poll;
+	struct aio_poll_table apt;
+	struct file *file;
+	unsigned int mask;
+	bool on_queue;
+
+	/* reject any unknown events outside the normal event mask. */
+	if ((u16)iocb->aio_buf != iocb->aio_buf)
+		return -EINVAL;
+	/* reject fields that are not defined for poll */
+	if (iocb->aio_offset || iocb->aio_nbytes || iocb->aio_rw_flags)
+		return -EINVAL;
+
+	req->file = fget(iocb->aio_fildes);
+	if (unlikely(!req->file))
+		return -EBADF;
+	if (unlikely(!req->file->f_op->poll)) {
+		fput(req->file);
+		return -EINVAL;
+	}
+
+	INIT_WORK(&req->work, aio_poll_complete_work);
+	req->events = iocb->aio_buf | POLLERR | POLLHUP;
+	req->head = NULL;
+	req->cancelled = false;
+	req->work_scheduled = false;
+	req->work_need_resched = false;
+
+	apt.pt._qproc = aio_poll_queue_proc;
+	apt.pt._key = req->events;
+	apt.iocb = aiocb;
+	apt.queued = false;
+	apt.error = -EINVAL; /* no waitqueue: same as no poll support */
+
+	/* initialized the list so that we can do list_empty checks */
+	INIT_LIST_HEAD(&req->wait.entry);
+	init_waitqueue_func_entry(&req->wait, aio_poll_wake);
+
+	/*
+	 * One reference for the completion, one for us: once we are on the
+	 * waitqueue the request may complete under our feet.  The extra file
+	 * reference keeps ->head alive for the same reason.
+	 */
+	refcount_set(&aiocb->ki_refcnt, 2);
+	file = get_file(req->file);
+
+	mask = file->f_op->poll(file, &apt.pt) & req->events;
+	if (unlikely(!apt.queued))
+		goto out;
+
+	spin_lock_irq(&ctx->ctx_lock);
+	on_queue = poll_iocb_lock_wq(req);
+	if (!on_queue || req->work_scheduled) {
+		/* aio_poll_complete_work() owns the request now */
+		mask = 0;
+		apt.error = 0;
+	} else if (mask || apt.error) {
+		/* ready already, or unusable: we are done either way */
+		list_del_init(&req->wait.entry);
+		list_del_init(&aiocb->ki_list);
+	} else if (list_empty(&aiocb->ki_list)) {
+		/* actually waiting for an event */
+		list_add_tail(&aiocb->ki_list, &ctx->active_reqs);
+		aiocb->ki_cancel = aio_poll_cancel;
+	}
+	if (on_queue)
+		poll_iocb_unlock_wq(req);
+	spin_unlock_irq(&ctx->ctx_lock);
+
+out:
+	fput(file);
+	if (unlikely(apt.error)) {
+		fput(req->file);
+		return apt.error;
+	}
+
+	if (mask)
+		aio_poll_complete(aiocb, mask);
+	iocb_put(aiocb);
+	return 0;
+}
+
 static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 			 struct iocb *iocb, bool compat)
 {
@@ -1675,6 +2136,15 @@ static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 	case IOCB_CMD_PWRITEV:
 		ret = aio_write(&req->rw, iocb, true, compat);
 		break;
+	case IOCB_CMD_FSYNC:
+		ret = aio_fsync(&req->fsync, iocb, false);
+		break;
+	case IOCB_CMD_FDSYNC:
+		ret = aio_fsync(&req->fsync, iocb, true);
+		break;
+	case IOCB_CMD_POLL:
+		ret = aio_poll(req, iocb);
+		break;
 	default:
 		pr_debug("invalid aio operation %d\n", iocb->aio_lio_opcode);
 		ret = -EINVAL;
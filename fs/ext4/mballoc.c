@@ -880,7 +880,7 @@ static int ext4_mb_init_cache(struct page *page, char *incore, gfp_t gfp)
 			bh[i] = NULL;
 			continue;
 		}
-		bh[i] = ext4_read_block_bitmap_nowait(sb, group);
+		bh[i] = ext4_read_block_bitmap_nowait(sb, group, false);
 		if (IS_ERR(bh[i])) {
 			err = PTR_ERR(bh[i]);
 			bh[i] = NULL;
@@ -2062,8 +2062,10 @@ static int ext4_mb_good_group(struct ext4_allocation_context *ac,
 				ext4_group_t group, int cr)
 {
 	unsigned free, fragments;
-	int flex_size = ext4_flex_bg_size(EXT4_SB(ac->ac_sb));
-	struct ext4_group_info *grp = ext4_get_group_info(ac->ac_sb, group);
+	struct super_block *sb = ac->ac_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int flex_size = ext4_flex_bg_size(sbi);
+	struct ext4_group_info *grp = ext4_get_group_info(sb, group);
 
 	BUG_ON(cr < 0 || cr >= 4);
 
@@ -2078,7 +2080,26 @@ static int ext4_mb_good_group(struct ext4_allocation_context *ac,
 
 	/* We only do this if the grp has never been initialized */
 	if (unlikely(EXT4_MB_GRP_NEED_INIT(grp))) {
-		int ret = ext4_mb_init_group(ac->ac_sb, group, GFP_NOFS);
+		struct ext4_group_desc *gdp = ext4_get_group_desc(sb, group,
+								  NULL);
+		int ret;
+
+		/*
+		 * cr=0/1 is an optimistic search for good chunks that is
+		 * only cheap with the buddy already in memory, so it does
+		 * not read bitmaps in; the group is loaded by the first
+		 * pass that would actually allocate from it.  The first
+		 * group of a flex_bg is still loaded so that metadata
+		 * keeps landing there, and BLOCK_UNINIT groups cost no
+		 * I/O to initialize.
+		 */
+		if (cr < 2 &&
+		    (!sbi->s_log_groups_per_flex ||
+		     (group & ((1 << sbi->s_log_groups_per_flex) - 1)) != 0) &&
+		    !(ext4_has_group_desc_csum(sb) &&
+		      (gdp->bg_flags & cpu_to_le16(EXT4_BG_BLOCK_UNINIT))))
+			return 0;
+		ret = ext4_mb_init_group(sb, group, GFP_NOFS);
 		if (ret)
 			return ret;
 	}
@@ -2122,10 +2143,84 @@ static int ext4_mb_good_group(struct ext4_allocation_context *ac,
 	return 0;
 }
 
+/*
+ * Start reading the block bitmaps of up to @nr groups from @group on, so
+ * that the reads are in flight together instead of being issued one by
+ * one as the allocator reaches each group.  @cnt is increased by the
+ * number of reads submitted.  Returns the group after the last one
+ * looked at.
+ */
+static ext4_group_t ext4_mb_prefetch(struct super_block *sb,
+				     ext4_group_t group, unsigned int nr,
+				     unsigned int *cnt)
+{
+	ext4_group_t ngroups = ext4_get_groups_count(sb);
+	struct buffer_head *bh;
+	struct blk_plug plug;
+
+	blk_start_plug(&plug);
+	while (nr-- > 0) {
+		struct ext4_group_desc *gdp = ext4_get_group_desc(sb, group,
+								  NULL);
+		struct ext4_group_info *grp = ext4_get_group_info(sb, group);
+
+		/*
+		 * Only groups with free blocks are worth reading, and
+		 * BLOCK_UNINIT ones need no I/O.  Each group is prefetched
+		 * at most once, which also saves the getblk() lookup.
+		 */
+		if (EXT4_MB_GRP_NEED_INIT(grp) &&
+		    ext4_free_group_clusters(sb, gdp) > 0 &&
+		    !(ext4_has_group_desc_csum(sb) &&
+		      (gdp->bg_flags & cpu_to_le16(EXT4_BG_BLOCK_UNINIT))) &&
+		    !EXT4_MB_GRP_TEST_AND_SET_READ(grp)) {
+			bh = ext4_read_block_bitmap_nowait(sb, group, true);
+			if (!IS_ERR_OR_NULL(bh)) {
+				if (!buffer_uptodate(bh))
+					(*cnt)++;
+				brelse(bh);
+			}
+		}
+		if (++group >= ngroups)
+			group = 0;
+	}
+	blk_finish_plug(&plug);
+	return group;
+}
+
+/*
+ * Build the buddies of the @nr groups before @group whose bitmaps were
+ * prefetched, now that their reads have had time to complete.
+ */
+static void ext4_mb_prefetch_fini(struct super_block *sb, ext4_group_t group,
+				  unsigned int nr)
+{
+	while (nr-- > 0) {
+		struct ext4_group_desc *gdp;
+		struct ext4_group_info *grp;
+
+		if (!group)
+			group = ext4_get_groups_count(sb);
+		group--;
+		gdp = ext4_get_group_desc(sb, group, NULL);
+		grp = ext4_get_group_info(sb, group);
+
+		if (EXT4_MB_GRP_NEED_INIT(grp) &&
+		    ext4_free_group_clusters(sb, gdp) > 0 &&
+		    !(ext4_has_group_desc_csum(sb) &&
+		      (gdp->bg_flags & cpu_to_le16(EXT4_BG_BLOCK_UNINIT)))) {
+			if (ext4_mb_init_group(sb, group, GFP_NOFS))
+				break;
+		}
+	}
+}
+
 static noinline_for_stack int
 ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 {
 	ext4_group_t ngroups, group, i;
+	ext4_group_t prefetch_grp = 0;
+	unsigned int nr = 0, prefetch_ios = 0;
 	int cr;
 	int err = 0, first_err = 0;
 	struct ext4_sb_info *sbi;
@@ -2195,6 +2290,7 @@ repeat:
 		 * from the goal value specified
 		 */
 		group = ac->ac_g_ex.fe_group;
+		prefetch_grp = group;
 
 		for (i = 0; i < ngroups; group++, i++) {
 			int ret = 0;
@@ -2206,6 +2302,28 @@ repeat:
 			if (group >= ngroups)
 				group = 0;
 
+			/*
+			 * Keep a window of bitmap reads in flight ahead of
+			 * the scan.  cr=0/1 passes are limited to
+			 * s_mb_prefetch_limit reads, since they would
+			 * otherwise load many groups they then skip.
+			 */
+			if (prefetch_grp == group && sbi->s_mb_prefetch &&
+			    (cr > 1 || prefetch_ios < sbi->s_mb_prefetch_limit)) {
+				unsigned int curr_ios = prefetch_ios;
+
+				nr = sbi->s_mb_prefetch;
+				if (ext4_has_feature_flex_bg(sb)) {
+					nr = 1 << sbi->s_log_groups_per_flex;
+					nr -= group & (nr - 1);
+					nr = min(nr, sbi->s_mb_prefetch);
+				}
+				prefetch_grp = ext4_mb_prefetch(sb, group, nr,
+								&prefetch_ios);
+				if (prefetch_ios == curr_ios)
+					nr = 0;
+			}
+
 			/* This now checks without needing the buddy page */
 			ret = ext4_mb_good_group(ac, group, cr);
 			if (ret <= 0) {
@@ -2278,6 +2396,9 @@ repeat:
 out:
 	if (!err && ac->ac_status != AC_STATUS_FOUND && first_err)
 		err = first_err;
+	/* Build the buddies of prefetched groups the scan did not reach */
+	if (nr)
+		ext4_mb_prefetch_fini(sb, prefetch_grp, nr);
 	return err;
 }
 
@@ -2757,6 +2878,24 @@ int ext4_mb_init(struct super_block *sb)
 		sbi->s_mb_group_prealloc = roundup(
 			sbi->s_mb_group_prealloc, sbi->s_stripe);
 	}
+	/*
+	 * Prefetch a whole flex group at a time, which is laid out to be
+	 * read by a single I/O.  cr=0/1 only saves CPU, so it stops
+	 * prefetching after s_mb_prefetch_limit reads and makes do with
+	 * what is in memory.
+	 */
+	if (ext4_has_feature_flex_bg(sb) &&
+	    sbi->s_es->s_log_groups_per_flex > 0 &&
+	    sbi->s_es->s_log_groups_per_flex < 32)
+		sbi->s_mb_prefetch = min_t(unsigned int,
+				1U << sbi->s_es->s_log_groups_per_flex,
+				BLK_MAX_SEGMENT_SIZE >> (sb->s_blocksize_bits - 9));
+	else
+		sbi->s_mb_prefetch = MB_DEFAULT_PREFETCH;
+	sbi->s_mb_prefetch = min(sbi->s_mb_prefetch,
+				 ext4_get_groups_count(sb));
+	sbi->s_mb_prefetch_limit = min(sbi->s_mb_prefetch * 4,
+				       ext4_get_groups_count(sb));
 
 	sbi->s_locality_groups = alloc_percpu(struct ext4_locality_group);
 	if (sbi->s_locality_groups == NULL) {
@@ -77,6 +77,11 @@ do {									\
  */
 #define MB_DEFAULT_GROUP_PREALLOC	512
 
+/*
+ * groups whose block bitmaps are read ahead together without flex_bg
+ */
+#define MB_DEFAULT_PREFETCH		32
+
 
 struct ext4_free_data {
 	/* this links the free block information from sb_info */
@@ -2456,9 +2456,10 @@ void ext4_group_desc_csum_set(struct super_block *sb, __u32 block_group,
 }
 
 /* Called at mount-time, super-block is locked */
-static int ext4_check_descriptors(struct super_block *sb,
-				  ext4_fsblk_t sb_block,
-				  ext4_group_t *first_not_zeroed)
+static int ext4_check_descriptor_range(struct super_block *sb,
+				       ext4_fsblk_t sb_block,
+				       ext4_group_t start, ext4_group_t end,
+				       ext4_group_t *first_not_zeroed)
 {
 	struct ext4_sb_info *sbi = EXT4_SB(sb);
 	ext4_fsblk_t first_block = le32_to_cpu(sbi->s_es->s_first_data_block);
@@ -2472,10 +2473,10 @@ static int ext4_check_descriptors(struct super_block *sb,
 
 	if (ext4_has_feature_flex_bg(sb))
 		flexbg_flag = 1;
+	else
+		first_block += (ext4_fsblk_t)start * EXT4_BLOCKS_PER_GROUP(sb);
 
-	ext4_debug("Checking group descriptors");
-
-	for (i = 0; i < sbi->s_groups_count; i++) {
+	for (i = start; i < end; i++) {
 		struct ext4_group_desc *gdp = ext4_get_group_desc(sb, i, NULL);
 
 		if (i == sbi->s_groups_count - 1 || flexbg_flag)
@@ -2570,11 +2571,81 @@ static int ext4_check_descriptors(struct super_block *sb,
 		if (!flexbg_flag)
 			first_block += EXT4_BLOCKS_PER_GROUP(sb);
 	}
-	if (NULL != first_not_zeroed)
-		*first_not_zeroed = grp;
+	*first_not_zeroed = grp;
 	return 1;
 }
 
+/*
+ * Descriptors of different groups are checked independently, so on large
+ * filesystems the groups are split into ranges of at least
+ * EXT4_DESC_CHECK_GROUPS and checked concurrently on the unbound workqueue.
+ */
+#define EXT4_DESC_CHECK_GROUPS	1024
+
+struct ext4_desc_check {
+	struct work_struct work;
+	struct super_block *sb;
+	ext4_fsblk_t sb_block;
+	ext4_group_t start;
+	ext4_group_t end;
+	ext4_group_t first_not_zeroed;
+	int ret;
+};
+
+static void ext4_check_descriptors_work(struct work_struct *work)
+{
+	struct ext4_desc_check *dc = container_of(work, struct ext4_desc_check,
+						  work);
+
+	dc->ret = ext4_check_descriptor_range(dc->sb, dc->sb_block, dc->start,
+					      dc->end, &dc->first_not_zeroed);
+}
+
+static int ext4_check_descriptors(struct super_block *sb,
+				  ext4_fsblk_t sb_block,
+				  ext4_group_t *first_not_zeroed)
+{
+	ext4_group_t ngroups = EXT4_SB(sb)->s_groups_count;
+	ext4_group_t grp = ngroups, per;
+	struct ext4_desc_check *dc;
+	unsigned int nr, i;
+	int ret = 1;
+
+	ext4_debug("Checking group descriptors");
+
+	nr = min_t(unsigned int, num_online_cpus(),
+		   DIV_ROUND_UP(ngroups, EXT4_DESC_CHECK_GROUPS));
+	dc = nr > 1 ? kcalloc(nr, sizeof(*dc), GFP_KERNEL) : NULL;
+	if (!dc)
+		return ext4_check_descriptor_range(sb, sb_block, 0, ngroups,
+						   first_not_zeroed);
+
+	per = DIV_ROUND_UP(ngroups, nr);
+	for (i = 0; i < nr; i++) {
+		dc[i].sb = sb;
+		dc[i].sb_block = sb_block;
+		dc[i].start = min(i * per, ngroups);
+		dc[i].end = min(dc[i].start + per, ngroups);
+		INIT_WORK(&dc[i].work, ext4_check_descriptors_work);
+		if (i)
+			queue_work(system_unbound_wq, &dc[i].work);
+	}
+	/* The mounting task checks the first range itself */
+	ext4_check_descriptors_work(&dc[0].work);
+
+	for (i = 0; i < nr; i++) {
+		if (i)
+			flush_work(&dc[i].work);
+		if (!dc[i].ret)
+			ret = 0;
+		grp = min(grp, dc[i].first_not_zeroed);
+	}
+	kfree(dc);
+
+	*first_not_zeroed = grp;
+	return ret;
+}
+
 /* ext4_orphan_cleanup() walks a singly-linked list of inodes (starting at
  * the superblock) which were deleted from all directories, but held open by
  * a process at the time of a crash.  We walk the list and try to delete these
@@ -3613,6 +3684,7 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 	int err = 0;
 	unsigned int journal_ioprio = DEFAULT_JOURNAL_IOPRIO;
 	ext4_group_t first_not_zeroed;
+	ktime_t mount_start = ktime_get();
 
 	if ((data && !orig_data) || !sbi)
 		goto out_free_base;
@@ -4586,6 +4658,8 @@ no_journal:
 			 (int) sizeof(sbi->s_es->s_mount_opts),
 			 sbi->s_es->s_mount_opts,
 			 *sbi->s_es->s_mount_opts ? "; " : "", orig_data);
+	ext4_msg(sb, KERN_DEBUG, "mounted %u groups in %lld us",
+		 sbi->s_groups_count, ktime_us_delta(ktime_get(), mount_start));
 
 	if (es->s_error_count)
 		mod_timer(&sbi->s_err_report, jiffies + 300*HZ); /* 5 minutes */
@@ -10,6 +10,7 @@
 
 #include <linux/init.h>
 #include <linux/module.h>
+#include <linux/seq_file.h>
 
 #define FUSE_CTL_SUPER_MAGIC 0x65735543
 
@@ -19,17 +20,22 @@
  */
 static struct super_block *fuse_control_sb;
 
-static struct fuse_conn *fuse_ctl_file_conn_get(struct file *file)
+static struct fuse_conn *fuse_ctl_inode_conn_get(struct inode *inode)
 {
 	struct fuse_conn *fc;
 	mutex_lock(&fuse_mutex);
-	fc = file_inode(file)->i_private;
+	fc = inode->i_private;
 	if (fc)
 		fc = fuse_conn_get(fc);
 	mutex_unlock(&fuse_mutex);
 	return fc;
 }
 
+static struct fuse_conn *fuse_ctl_file_conn_get(struct file *file)
+{
+	return fuse_ctl_inode_conn_get(file_inode(file));
+}
+
 static ssize_t fuse_conn_abort_write(struct file *file, const char __user *buf,
 				     size_t count, loff_t *ppos)
 {
@@ -170,6 +176,56 @@ static ssize_t fuse_conn_congestion_threshold_write(struct file *file,
 	return ret;
 }
 
+static int fuse_conn_queues_show(struct seq_file *m, void *v)
+{
+	struct fuse_conn *fc = fuse_ctl_inode_conn_get(file_inode(m->file));
+	int cpu;
+
+	if (!fc)
+		return 0;
+
+	if (fc->cpu_queues) {
+		for_each_possible_cpu(cpu) {
+			struct fuse_cpu_queue *cq;
+
+			cq = per_cpu_ptr(fc->cpu_queues, cpu);
+			spin_lock(&cq->iq.waitq.lock);
+			seq_printf(m, "cpu%d bound %u queued %lu dispatched %lu fallback %lu\n",
+				   cpu, cq->nr_bound, cq->queued,
+				   cq->dispatched, cq->fallback);
+			spin_unlock(&cq->iq.waitq.lock);
+		}
+	}
+	fuse_conn_put(fc);
+
+	return 0;
+}
+
+static int fuse_conn_queues_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, fuse_conn_queues_show, NULL);
+}
+
+static int fuse_conn_pages_show(struct seq_file *m, void *v)
+{
+	struct fuse_conn *fc = fuse_ctl_inode_conn_get(file_inode(m->file));
+
+	if (!fc)
+		return 0;
+
+	seq_printf(m, "moved %lu\ncopied %lu\n",
+		   atomic_long_read(&fc->pages_moved),
+		   atomic_long_read(&fc->pages_copied));
+	fuse_conn_put(fc);
+
+	return 0;
+}
+
+static int fuse_conn_pages_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, fuse_conn_pages_show, NULL);
+}
+
 static const struct file_operations fuse_ctl_abort_ops = {
 	.open = nonseekable_open,
 	.write = fuse_conn_abort_write,
@@ -182,6 +238,20 @@ static const struct file_operations fuse_ctl_waiting_ops = {
 	.llseek = no_llseek,
 };
 
+static const struct file_operations fuse_ctl_queues_ops = {
+	.open = fuse_conn_queues_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static const struct file_operations fuse_ctl_pages_ops = {
+	.open = fuse_conn_pages_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static const struct file_operations fuse_conn_max_background_ops = {
 	.open = nonseekable_open,
 	.read = fuse_conn_max_background_read,
@@ -264,7 +334,11 @@ int fuse_ctl_add_conn(struct fuse_conn *fc)
 				 1, NULL, &fuse_conn_max_background_ops) ||
 	    !fuse_ctl_add_dentry(parent, fc, "congestion_threshold",
 				 S_IFREG | 0600, 1, NULL,
-				 &fuse_conn_congestion_threshold_ops))
+				 &fuse_conn_congestion_threshold_ops) ||
+	    !fuse_ctl_add_dentry(parent, fc, "queues", S_IFREG | 0400, 1,
+				 NULL, &fuse_ctl_queues_ops) ||
+	    !fuse_ctl_add_dentry(parent, fc, "pages", S_IFREG | 0400, 1,
+				 NULL, &fuse_ctl_pages_ops))
 		goto err;
 
 	return 0;
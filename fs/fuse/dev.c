@@ -23,6 +23,7 @@
 #include <linux/splice.h>
 #include <linux/sched.h>
 #include <linux/freezer.h>
+#include <linux/percpu.h>
 
 MODULE_ALIAS_MISCDEV(FUSE_MINOR);
 MODULE_ALIAS("devname:fuse");
@@ -330,11 +331,69 @@ static void queue_request(struct fuse_iqueue *fiq, struct fuse_req *req)
 {
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
+	req->fiq = fiq;
 	list_add_tail(&req->list, &fiq->pending);
 	wake_up_locked(&fiq->waitq);
 	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
 }
 
+static struct fuse_cpu_queue *fuse_iqueue_to_cpu(struct fuse_conn *fc,
+						 struct fuse_iqueue *fiq)
+{
+	if (fiq == &fc->iq)
+		return NULL;
+	return container_of(fiq, struct fuse_cpu_queue, iq);
+}
+
+/*
+ * Select the input queue for a new request and return it locked.
+ *
+ * If the daemon has bound devices to the submitting CPU, the request
+ * goes to that CPU's queue, where it is picked up by a daemon thread
+ * running on the same CPU.  Fall back to the shared queue if no device
+ * is bound to this CPU, or if all its readers are busy while a reader
+ * of the shared queue is idle.
+ */
+static struct fuse_iqueue *fuse_lock_iqueue(struct fuse_conn *fc)
+{
+	struct fuse_cpu_queue __percpu *queues = READ_ONCE(fc->cpu_queues);
+
+	if (queues) {
+		struct fuse_cpu_queue *cq = raw_cpu_ptr(queues);
+
+		spin_lock(&cq->iq.waitq.lock);
+		if (cq->nr_bound && cq->iq.connected &&
+		    (waitqueue_active(&cq->iq.waitq) ||
+		     !waitqueue_active(&fc->iq.waitq))) {
+			cq->queued++;
+			return &cq->iq;
+		}
+		cq->fallback++;
+		spin_unlock(&cq->iq.waitq.lock);
+	}
+	spin_lock(&fc->iq.waitq.lock);
+	return &fc->iq;
+}
+
+/*
+ * Lock the input queue the request was queued on.  req->fiq may change
+ * while the request is pending, but only with both the old and the new
+ * queue locked, so it is stable once the lock is held.
+ */
+static struct fuse_iqueue *fuse_req_lock_iqueue(struct fuse_conn *fc,
+						struct fuse_req *req)
+{
+	struct fuse_iqueue *fiq;
+
+	for (;;) {
+		fiq = READ_ONCE(req->fiq) ?: &fc->iq;
+		spin_lock(&fiq->waitq.lock);
+		if (likely(fiq == (req->fiq ?: &fc->iq)))
+			return fiq;
+		spin_unlock(&fiq->waitq.lock);
+	}
+}
+
 void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 		       u64 nodeid, u64 nlookup)
 {
@@ -360,12 +419,12 @@ static void flush_bg_queue(struct fuse_conn *fc)
 	while (fc->active_background < fc->max_background &&
 	       !list_empty(&fc->bg_queue)) {
 		struct fuse_req *req;
-		struct fuse_iqueue *fiq = &fc->iq;
+		struct fuse_iqueue *fiq;
 
 		req = list_entry(fc->bg_queue.next, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
-		spin_lock(&fiq->waitq.lock);
+		fiq = fuse_lock_iqueue(fc);
 		req->in.h.unique = fuse_get_unique(fiq);
 		queue_request(fiq, req);
 		spin_unlock(&fiq->waitq.lock);
@@ -382,12 +441,12 @@ static void flush_bg_queue(struct fuse_conn *fc)
  */
 static void request_end(struct fuse_conn *fc, struct fuse_req *req)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 
 	if (test_and_set_bit(FR_FINISHED, &req->flags))
 		goto put_request;
 
-	spin_lock(&fiq->waitq.lock);
+	fiq = fuse_req_lock_iqueue(fc, req);
 	list_del_init(&req->intr_entry);
 	spin_unlock(&fiq->waitq.lock);
 	WARN_ON(test_bit(FR_PENDING, &req->flags));
@@ -425,9 +484,10 @@ put_request:
 	fuse_put_request(fc, req);
 }
 
-static void queue_interrupt(struct fuse_iqueue *fiq, struct fuse_req *req)
+static void queue_interrupt(struct fuse_conn *fc, struct fuse_req *req)
 {
-	spin_lock(&fiq->waitq.lock);
+	struct fuse_iqueue *fiq = fuse_req_lock_iqueue(fc, req);
+
 	if (test_bit(FR_FINISHED, &req->flags)) {
 		spin_unlock(&fiq->waitq.lock);
 		return;
@@ -442,7 +502,7 @@ static void queue_interrupt(struct fuse_iqueue *fiq, struct fuse_req *req)
 
 static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 	int err;
 
 	if (!fc->no_interrupt) {
@@ -456,7 +516,7 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 		/* matches barrier in fuse_dev_do_read() */
 		smp_mb__after_atomic();
 		if (test_bit(FR_SENT, &req->flags))
-			queue_interrupt(fiq, req);
+			queue_interrupt(fc, req);
 	}
 
 	if (!test_bit(FR_FORCE, &req->flags)) {
@@ -466,7 +526,7 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 		if (!err)
 			return;
 
-		spin_lock(&fiq->waitq.lock);
+		fiq = fuse_req_lock_iqueue(fc, req);
 		/* Request is not yet in userspace, bail out */
 		if (test_bit(FR_PENDING, &req->flags)) {
 			list_del(&req->list);
@@ -489,10 +549,10 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 
 static void __fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 
 	BUG_ON(test_bit(FR_BACKGROUND, &req->flags));
-	spin_lock(&fiq->waitq.lock);
+	fiq = fuse_lock_iqueue(fc);
 	if (!fiq->connected) {
 		spin_unlock(&fiq->waitq.lock);
 		req->out.h.error = -ENOTCONN;
@@ -715,6 +775,9 @@ struct fuse_copy_state {
 	unsigned len;
 	unsigned offset;
 	unsigned move_pages:1;
+	unsigned page_cache:1;
+	unsigned long pages_moved;
+	unsigned long pages_copied;
 };
 
 static void fuse_copy_init(struct fuse_copy_state *cs, int write,
@@ -847,7 +910,23 @@ static int fuse_check_page(struct page *page)
 	return 0;
 }
 
-static int fuse_try_move_page(struct fuse_copy_state *cs, struct page **pagep)
+/*
+ * Can the page cache page be replaced with one donated by the daemon?
+ */
+static bool fuse_page_replaceable(struct page *page)
+{
+	return !page_mapped(page) && !page_has_private(page) &&
+	       !PageDirty(page) && !PageWriteback(page) &&
+	       !PageMlocked(page);
+}
+
+/*
+ * Replace *pagep with the page in the next pipe buffer.  A short buffer is
+ * only accepted if it holds all of the remaining @count bytes and the rest
+ * of the page may be zeroed.
+ */
+static int fuse_try_move_page(struct fuse_copy_state *cs, struct page **pagep,
+			      unsigned count, int zeroing)
 {
 	int err;
 	struct page *oldpage = *pagep;
@@ -871,7 +950,8 @@ static int fuse_try_move_page(struct fuse_copy_state *cs, struct page **pagep)
 	cs->pipebufs++;
 	cs->nr_segs--;
 
-	if (cs->len != PAGE_SIZE)
+	if (cs->len != PAGE_SIZE &&
+	    !(zeroing && buf->offset == 0 && cs->len == count))
 		goto out_fallback;
 
 	if (pipe_buf_steal(cs->pipe, buf) != 0)
@@ -887,6 +967,9 @@ static int fuse_try_move_page(struct fuse_copy_state *cs, struct page **pagep)
 	if (fuse_check_page(newpage) != 0)
 		goto out_fallback_unlock;
 
+	if (cs->len < PAGE_SIZE)
+		zero_user_segment(newpage, cs->len, PAGE_SIZE);
+
 	/*
 	 * This is a new and locked page, it shouldn't be mapped or
 	 * have any special flags on it
@@ -918,12 +1001,17 @@ static int fuse_try_move_page(struct fuse_copy_state *cs, struct page **pagep)
 	pipe_buf_release(cs->pipe, buf);
 
 	err = 0;
-	spin_lock(&cs->req->waitq.lock);
-	if (test_bit(FR_ABORTED, &cs->req->flags))
-		err = -ENOENT;
-	else
+	if (cs->req) {
+		spin_lock(&cs->req->waitq.lock);
+		if (test_bit(FR_ABORTED, &cs->req->flags))
+			err = -ENOENT;
+		else
+			*pagep = newpage;
+		spin_unlock(&cs->req->waitq.lock);
+	} else {
+		/* Notification, there is no request to abort */
 		*pagep = newpage;
-	spin_unlock(&cs->req->waitq.lock);
+	}
 
 	if (err) {
 		unlock_page(newpage);
@@ -1002,11 +1090,17 @@ static int fuse_copy_page(struct fuse_copy_state *cs, struct page **pagep,
 		if (cs->write && cs->pipebufs && page) {
 			return fuse_ref_page(cs, page, offset, count);
 		} else if (!cs->len) {
-			if (cs->move_pages && page &&
-			    offset == 0 && count == PAGE_SIZE) {
-				err = fuse_try_move_page(cs, pagep);
-				if (err <= 0)
+			if (cs->move_pages && page && offset == 0 &&
+			    (count == PAGE_SIZE || zeroing) &&
+			    fuse_page_replaceable(page)) {
+				err = fuse_try_move_page(cs, pagep, count,
+							 zeroing);
+				if (err < 0)
 					return err;
+				if (!err) {
+					cs->pages_moved++;
+					return 0;
+				}
 			} else {
 				err = fuse_copy_fill(cs);
 				if (err)
@@ -1021,8 +1115,11 @@ static int fuse_copy_page(struct fuse_copy_state *cs, struct page **pagep,
 		} else
 			offset += fuse_copy_do(cs, NULL, &count);
 	}
-	if (page && !cs->write)
+	if (page && !cs->write) {
 		flush_dcache_page(page);
+		if (cs->page_cache)
+			cs->pages_copied++;
+	}
 	return 0;
 }
 
@@ -1259,7 +1356,8 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 {
 	ssize_t err;
 	struct fuse_conn *fc = fud->fc;
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq = READ_ONCE(fud->fiq);
+	struct fuse_cpu_queue *cq = fuse_iqueue_to_cpu(fc, fiq);
 	struct fuse_pqueue *fpq = &fud->pq;
 	struct fuse_req *req;
 	struct fuse_in *in;
@@ -1306,6 +1404,8 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	req = list_entry(fiq->pending.next, struct fuse_req, list);
 	clear_bit(FR_PENDING, &req->flags);
 	list_del_init(&req->list);
+	if (cq)
+		cq->dispatched++;
 	spin_unlock(&fiq->waitq.lock);
 
 	in = &req->in;
@@ -1360,7 +1460,7 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	/* matches barrier in request_wait_answer() */
 	smp_mb__after_atomic();
 	if (test_bit(FR_INTERRUPTED, &req->flags))
-		queue_interrupt(fiq, req);
+		queue_interrupt(fc, req);
 	fuse_put_request(fc, req);
 
 	return reqsize;
@@ -1654,6 +1754,7 @@ static int fuse_notify_store(struct fuse_conn *fc, unsigned int size,
 	}
 
 	num = outarg.size;
+	cs->page_cache = 1;
 	while (num) {
 		struct page *page;
 		unsigned int this_num;
@@ -1807,8 +1908,9 @@ copy_finish:
 static int fuse_notify(struct fuse_conn *fc, enum fuse_notify_code code,
 		       unsigned int size, struct fuse_copy_state *cs)
 {
-	/* Don't try to move pages (yet) */
-	cs->move_pages = 0;
+	/* Only stored data goes to the page cache */
+	if (code != FUSE_NOTIFY_STORE)
+		cs->move_pages = 0;
 
 	switch (code) {
 	case FUSE_NOTIFY_POLL:
@@ -1870,6 +1972,15 @@ static int copy_out_args(struct fuse_copy_state *cs, struct fuse_out *out,
 			      out->page_zeroing);
 }
 
+static void fuse_account_pages(struct fuse_conn *fc,
+			       struct fuse_copy_state *cs)
+{
+	if (cs->pages_moved)
+		atomic_long_add(cs->pages_moved, &fc->pages_moved);
+	if (cs->pages_copied)
+		atomic_long_add(cs->pages_copied, &fc->pages_copied);
+}
+
 /*
  * Write a single reply to a request.  First the header is copied from
  * the write buffer.  The request is then searched on the processing
@@ -1903,6 +2014,7 @@ static ssize_t fuse_dev_do_write(struct fuse_dev *fud,
 	 */
 	if (!oh.unique) {
 		err = fuse_notify(fc, oh.error, nbytes - sizeof(oh), cs);
+		fuse_account_pages(fc, cs);
 		return err ? err : nbytes;
 	}
 
@@ -1933,7 +2045,7 @@ static ssize_t fuse_dev_do_write(struct fuse_dev *fud,
 		if (oh.error == -ENOSYS)
 			fc->no_interrupt = 1;
 		else if (oh.error == -EAGAIN)
-			queue_interrupt(&fc->iq, req);
+			queue_interrupt(fc, req);
 		fuse_put_request(fc, req);
 
 		fuse_copy_finish(cs);
@@ -1948,6 +2060,7 @@ static ssize_t fuse_dev_do_write(struct fuse_dev *fud,
 	cs->req = req;
 	if (!req->out.page_replace)
 		cs->move_pages = 0;
+	cs->page_cache = req->out.page_replace;
 
 	err = copy_out_args(cs, &req->out, nbytes);
 	if (req->in.h.opcode == FUSE_CANONICAL_PATH) {
@@ -1969,6 +2082,7 @@ static ssize_t fuse_dev_do_write(struct fuse_dev *fud,
 	spin_unlock(&fpq->lock);
 
 	request_end(fc, req);
+	fuse_account_pages(fc, cs);
 
 	return err ? err : nbytes;
 
@@ -2091,7 +2205,7 @@ static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 	if (!fud)
 		return POLLERR;
 
-	fiq = &fud->fc->iq;
+	fiq = READ_ONCE(fud->fiq);
 	poll_wait(file, &fiq->waitq, wait);
 
 	spin_lock(&fiq->waitq.lock);
@@ -2136,6 +2250,26 @@ static void end_polls(struct fuse_conn *fc)
 	}
 }
 
+/*
+ * Disconnect an input queue, moving its pending requests to @to_end
+ */
+static void fuse_abort_iqueue(struct fuse_iqueue *fiq,
+			      struct list_head *to_end)
+{
+	struct fuse_req *req;
+
+	spin_lock(&fiq->waitq.lock);
+	fiq->connected = 0;
+	list_for_each_entry(req, &fiq->pending, list)
+		clear_bit(FR_PENDING, &req->flags);
+	list_splice_tail_init(&fiq->pending, to_end);
+	while (forget_pending(fiq))
+		kfree(dequeue_forget(fiq, 1, NULL));
+	wake_up_all_locked(&fiq->waitq);
+	spin_unlock(&fiq->waitq.lock);
+	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+}
+
 /*
  * Abort all requests.
  *
@@ -2156,8 +2290,6 @@ static void end_polls(struct fuse_conn *fc)
  */
 void fuse_abort_conn(struct fuse_conn *fc, bool is_abort)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
-
 	/* @fs.sec -- d7bd5cc97a05d48e04defc719fbaffefdd4e6f22 -- */
 	ST_LOG("<%s> dev = %u:%u  fuse abort all requests",
 			__func__, MAJOR(fc->dev), MINOR(fc->dev));
@@ -2195,16 +2327,15 @@ void fuse_abort_conn(struct fuse_conn *fc, bool is_abort)
 		fc->max_background = UINT_MAX;
 		flush_bg_queue(fc);
 
-		spin_lock(&fiq->waitq.lock);
-		fiq->connected = 0;
-		list_splice_init(&fiq->pending, &to_end2);
-		list_for_each_entry(req, &to_end2, list)
-			clear_bit(FR_PENDING, &req->flags);
-		while (forget_pending(fiq))
-			kfree(dequeue_forget(fiq, 1, NULL));
-		wake_up_all_locked(&fiq->waitq);
-		spin_unlock(&fiq->waitq.lock);
-		kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+		fuse_abort_iqueue(&fc->iq, &to_end2);
+		if (fc->cpu_queues) {
+			int cpu;
+
+			for_each_possible_cpu(cpu)
+				fuse_abort_iqueue(
+					&per_cpu_ptr(fc->cpu_queues, cpu)->iq,
+					&to_end2);
+		}
 		end_polls(fc);
 		wake_up_all(&fc->blocked_waitq);
 		spin_unlock(&fc->lock);
@@ -2228,6 +2359,33 @@ void fuse_wait_aborted(struct fuse_conn *fc)
 	wait_event(fc->blocked_waitq, atomic_read(&fc->num_waiting) == 0);
 }
 
+/*
+ * Drop the binding of a device to its CPU queue.  When the last device
+ * bound to the queue goes away, hand pending requests over to the shared
+ * queue so that they are not stranded.
+ */
+static void fuse_dev_unbind_cpu(struct fuse_dev *fud)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_cpu_queue *cq = fuse_iqueue_to_cpu(fc, fud->fiq);
+	struct fuse_req *req;
+
+	if (!cq)
+		return;
+
+	spin_lock(&cq->iq.waitq.lock);
+	if (!--cq->nr_bound && !list_empty(&cq->iq.pending)) {
+		spin_lock(&fc->iq.waitq.lock);
+		list_for_each_entry(req, &cq->iq.pending, list)
+			req->fiq = &fc->iq;
+		list_splice_tail_init(&cq->iq.pending, &fc->iq.pending);
+		wake_up_all_locked(&fc->iq.waitq);
+		spin_unlock(&fc->iq.waitq.lock);
+	}
+	spin_unlock(&cq->iq.waitq.lock);
+	fud->fiq = &fc->iq;
+}
+
 int fuse_dev_release(struct inode *inode, struct file *file)
 {
 	struct fuse_dev *fud = fuse_get_dev(file);
@@ -2243,6 +2401,7 @@ int fuse_dev_release(struct inode *inode, struct file *file)
 		spin_unlock(&fpq->lock);
 
 		end_requests(fc, &to_end);
+		fuse_dev_unbind_cpu(fud);
 
 		/* Are we the last open device? */
 		if (atomic_dec_and_test(&fc->dev_count)) {
@@ -2283,11 +2442,68 @@ static int fuse_device_clone(struct fuse_conn *fc, struct file *new)
 	return 0;
 }
 
+/*
+ * Bind a device to the input queue of @cpu.  Reads from the device then
+ * only return requests submitted on that CPU.  The daemon is expected to
+ * read the device from a thread pinned to the same CPU, and to keep at
+ * least one reader on an unbound device for forgets and fallback.
+ */
+static int fuse_dev_bind_cpu(struct fuse_dev *fud, u32 cpu)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_cpu_queue __percpu *queues;
+	struct fuse_cpu_queue *cq;
+	int err;
+
+	if (cpu >= nr_cpu_ids || !cpu_possible(cpu))
+		return -EINVAL;
+
+	mutex_lock(&fuse_mutex);
+	err = -EBUSY;
+	if (fud->fiq != &fc->iq)
+		goto out_unlock;
+
+	queues = fc->cpu_queues;
+	if (!queues) {
+		err = -ENOMEM;
+		queues = fuse_cpu_queues_alloc();
+		if (!queues)
+			goto out_unlock;
+
+		/* fuse_abort_conn() walks the queues under fc->lock */
+		spin_lock(&fc->lock);
+		if (fc->connected)
+			WRITE_ONCE(fc->cpu_queues, queues);
+		spin_unlock(&fc->lock);
+		if (!fc->cpu_queues) {
+			free_percpu(queues);
+			err = -ENOTCONN;
+			goto out_unlock;
+		}
+	}
+
+	cq = per_cpu_ptr(queues, cpu);
+	err = -ENOTCONN;
+	spin_lock(&cq->iq.waitq.lock);
+	if (cq->iq.connected) {
+		cq->nr_bound++;
+		WRITE_ONCE(fud->fiq, &cq->iq);
+		err = 0;
+	}
+	spin_unlock(&cq->iq.waitq.lock);
+
+ out_unlock:
+	mutex_unlock(&fuse_mutex);
+	return err;
+}
+
 static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 			   unsigned long arg)
 {
 	int res;
 	int oldfd;
+	u32 cpu;
+	struct fuse_passthrough_dir pdir;
 	struct fuse_dev *fud = NULL;
 
 	switch (cmd) {
@@ -2325,6 +2541,24 @@ static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 				res = fuse_passthrough_open(fud, oldfd);
 		}
 		break;
+	case FUSE_DEV_IOC_BIND_CPU:
+		res = -EFAULT;
+		if (!get_user(cpu, (__u32 __user *)arg)) {
+			res = -EINVAL;
+			fud = fuse_get_dev(file);
+			if (fud)
+				res = fuse_dev_bind_cpu(fud, cpu);
+		}
+		break;
+	case FUSE_DEV_IOC_PASSTHROUGH_DIR:
+		res = -EFAULT;
+		if (!copy_from_user(&pdir, (void __user *)arg, sizeof(pdir))) {
+			res = -EINVAL;
+			fud = fuse_get_dev(file);
+			if (fud)
+				res = fuse_passthrough_dir(fud, &pdir);
+		}
+		break;
 	default:
 		res = -ENOTTY;
 		break;
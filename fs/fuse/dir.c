@@ -154,6 +154,18 @@ static void fuse_lookup_init(struct fuse_conn *fc, struct fuse_args *args,
 	args->out.args[0].value = outarg;
 }
 
+int fuse_lookup_nodeid(struct fuse_conn *fc, u64 nodeid,
+		       const struct qstr *name, struct fuse_entry_out *outarg)
+{
+	FUSE_ARGS(args);
+
+	if (name->len > FUSE_NAME_MAX)
+		return -ENAMETOOLONG;
+
+	fuse_lookup_init(fc, &args, nodeid, name, outarg);
+	return fuse_simple_request(fc, &args);
+}
+
 u64 fuse_get_attr_version(struct fuse_conn *fc)
 {
 	u64 curr_version;
@@ -181,12 +193,25 @@ u64 fuse_get_attr_version(struct fuse_conn *fc)
 static int fuse_dentry_revalidate(struct dentry *entry, unsigned int flags)
 {
 	struct inode *inode;
+	struct inode *dir;
 	struct dentry *parent;
 	struct fuse_conn *fc;
 	struct fuse_inode *fi;
 	int ret;
 
 	inode = d_inode_rcu(entry);
+	if (inode && fuse_is_backing(inode))
+		return fuse_passthrough_revalidate(entry, flags);
+
+	/*
+	 * Entries below an approved directory that were instantiated through
+	 * the daemon (e.g. by create) are dropped, so that the next lookup
+	 * resolves them in the backing directory.
+	 */
+	dir = d_inode_rcu(READ_ONCE(entry->d_parent));
+	if (inode && dir && get_fuse_inode(dir)->backing_root)
+		goto invalid;
+
 	if (inode && fuse_is_bad(inode))
 		goto invalid;
 	else if (time_before64(fuse_dentry_time(entry), get_jiffies_64()) ||
@@ -276,6 +301,13 @@ static void fuse_dentry_canonical_path(const struct path *path, struct path *can
 	int err;
 	char *path_name;
 
+	/* The backing path is what the daemon would have resolved to */
+	if (fuse_is_backing(inode)) {
+		*canonical_path = get_fuse_inode(inode)->backing_path;
+		path_get(canonical_path);
+		return;
+	}
+
 	req = fuse_get_req(fc, 1);
 	err = PTR_ERR(req);
 	if (IS_ERR(req))
@@ -429,6 +461,9 @@ static struct dentry *fuse_lookup(struct inode *dir, struct dentry *entry,
 	if (fuse_is_bad(dir))
 		return ERR_PTR(-EIO);
 
+	if (get_fuse_inode(dir)->backing_root)
+		return fuse_passthrough_lookup(dir, entry, flags);
+
 	locked = fuse_lock_inode(dir);
 	err = fuse_lookup_name(dir->i_sb, get_node_id(dir), &entry->d_name,
 			       &outarg, &inode);
@@ -1047,7 +1082,7 @@ int fuse_reverse_inval_entry(struct super_block *sb, u64 parent_nodeid,
 	struct dentry *dir;
 	struct dentry *entry;
 
-	parent = ilookup5(sb, parent_nodeid, fuse_inode_eq, &parent_nodeid);
+	parent = fuse_ilookup(sb, parent_nodeid);
 	if (!parent)
 		return -ENOENT;
 
@@ -1434,6 +1469,9 @@ static int fuse_readdir(struct file *file, struct dir_context *ctx)
 	if (fuse_is_bad(inode))
 		return -EIO;
 
+	if (test_bit(FUSE_I_PASSTHROUGH_DIR, &get_fuse_inode(inode)->state))
+		return fuse_passthrough_readdir(file, ctx);
+
 	req = fuse_get_req(fc, 1);
 	if (IS_ERR(req))
 		return PTR_ERR(req);
@@ -1979,3 +2017,156 @@ void fuse_init_symlink(struct inode *inode)
 {
 	inode->i_op = &fuse_symlink_inode_operations;
 }
+
+/*
+ * Operations that change the namespace or attributes of backing inodes
+ * still go through the daemon, which needs the nodeid of the parent (or of
+ * the entry itself).
+ */
+static int fuse_backing_materialize_parent(struct dentry *entry)
+{
+	return fuse_passthrough_materialize(entry->d_parent);
+}
+
+static int fuse_backing_create(struct inode *dir, struct dentry *entry,
+			       umode_t mode, bool excl)
+{
+	int err = fuse_backing_materialize_parent(entry);
+
+	return err ? err : fuse_create(dir, entry, mode, excl);
+}
+
+static int fuse_backing_atomic_open(struct inode *dir, struct dentry *entry,
+				    struct file *file, unsigned flags,
+				    umode_t mode, int *opened)
+{
+	int err = fuse_backing_materialize_parent(entry);
+
+	return err ? err : fuse_atomic_open(dir, entry, file, flags, mode,
+					    opened);
+}
+
+static int fuse_backing_mknod(struct inode *dir, struct dentry *entry,
+			      umode_t mode, dev_t rdev)
+{
+	int err = fuse_backing_materialize_parent(entry);
+
+	return err ? err : fuse_mknod(dir, entry, mode, rdev);
+}
+
+static int fuse_backing_mkdir(struct inode *dir, struct dentry *entry,
+			      umode_t mode)
+{
+	int err = fuse_backing_materialize_parent(entry);
+
+	return err ? err : fuse_mkdir(dir, entry, mode);
+}
+
+static int fuse_backing_symlink(struct inode *dir, struct dentry *entry,
+				const char *link)
+{
+	int err = fuse_backing_materialize_parent(entry);
+
+	return err ? err : fuse_symlink(dir, entry, link);
+}
+
+static int fuse_backing_unlink(struct inode *dir, struct dentry *entry)
+{
+	int err = fuse_backing_materialize_parent(entry);
+
+	return err ? err : fuse_unlink(dir, entry);
+}
+
+static int fuse_backing_rmdir(struct inode *dir, struct dentry *entry)
+{
+	int err = fuse_backing_materialize_parent(entry);
+
+	return err ? err : fuse_rmdir(dir, entry);
+}
+
+static int fuse_backing_rename(struct inode *olddir, struct dentry *oldent,
+			       struct inode *newdir, struct dentry *newent,
+			       unsigned int flags)
+{
+	int err = fuse_backing_materialize_parent(oldent);
+
+	if (!err)
+		err = fuse_backing_materialize_parent(newent);
+
+	return err ? err : fuse_rename2(olddir, oldent, newdir, newent, flags);
+}
+
+static int fuse_backing_link(struct dentry *entry, struct inode *newdir,
+			     struct dentry *newent)
+{
+	int err = fuse_passthrough_materialize(entry);
+
+	if (!err)
+		err = fuse_backing_materialize_parent(newent);
+
+	return err ? err : fuse_link(entry, newdir, newent);
+}
+
+static int fuse_backing_setattr(struct dentry *entry, struct iattr *attr)
+{
+	int err = fuse_passthrough_materialize(entry);
+
+	if (err)
+		return err;
+
+	/* Backing files are not open in the daemon */
+	attr->ia_valid &= ~ATTR_FILE;
+	err = fuse_setattr(entry, attr);
+	fuse_backing_copy_attr(d_inode(entry));
+
+	return err;
+}
+
+static const struct inode_operations fuse_backing_dir_inode_operations = {
+	.lookup		= fuse_lookup,
+	.mkdir		= fuse_backing_mkdir,
+	.symlink	= fuse_backing_symlink,
+	.unlink		= fuse_backing_unlink,
+	.rmdir		= fuse_backing_rmdir,
+	.rename		= fuse_backing_rename,
+	.link		= fuse_backing_link,
+	.setattr	= fuse_backing_setattr,
+	.create		= fuse_backing_create,
+	.atomic_open	= fuse_backing_atomic_open,
+	.mknod		= fuse_backing_mknod,
+	.permission	= fuse_passthrough_permission,
+	.getattr	= fuse_passthrough_getattr,
+	.listxattr	= fuse_listxattr,
+};
+
+static const struct inode_operations fuse_backing_common_inode_operations = {
+	.setattr	= fuse_backing_setattr,
+	.permission	= fuse_passthrough_permission,
+	.getattr	= fuse_passthrough_getattr,
+	.listxattr	= fuse_listxattr,
+};
+
+static const struct inode_operations fuse_backing_symlink_inode_operations = {
+	.setattr	= fuse_backing_setattr,
+	.get_link	= fuse_passthrough_get_link,
+	.getattr	= fuse_passthrough_getattr,
+	.listxattr	= fuse_listxattr,
+};
+
+void fuse_init_backing(struct inode *inode, dev_t rdev)
+{
+	umode_t mode = inode->i_mode;
+
+	if (S_ISDIR(mode)) {
+		inode->i_op = &fuse_backing_dir_inode_operations;
+		inode->i_fop = &fuse_backing_dir_operations;
+	} else if (S_ISLNK(mode)) {
+		inode->i_op = &fuse_backing_symlink_inode_operations;
+	} else {
+		inode->i_op = &fuse_backing_common_inode_operations;
+		if (S_ISREG(mode))
+			inode->i_fop = &fuse_backing_file_operations;
+		else
+			init_special_inode(inode, mode, rdev);
+	}
+}
@@ -45,7 +45,7 @@
 #define FUSE_NAME_MAX 1024
 
 /** Number of dentries for each connection in the control filesystem */
-#define FUSE_CTL_NUM_DENTRIES 5
+#define FUSE_CTL_NUM_DENTRIES 7
 
 /** Number of page pointers embedded in fuse_req */
 #define FUSE_REQ_INLINE_PAGES 1
@@ -115,6 +115,21 @@ struct fuse_inode {
 
 	/** Lock for serializing lookup and readdir for back compatibility*/
 	struct mutex mutex;
+
+	/** Backing file or directory for metadata passthrough */
+	struct path backing_path;
+
+	/** Approved subtree this inode belongs to, NULL if none */
+	struct fuse_backing_root *backing_root;
+
+	/** Owner derived from the path, see fuse_backing_derive() */
+	kuid_t backing_uid;
+
+	/** sdcardfs-style permission class of the path */
+	u8 backing_perm;
+
+	/** Below Android/, where "other" access is removed */
+	bool backing_under_android;
 };
 
 /** FUSE inode state bits */
@@ -129,6 +144,8 @@ enum {
 	FUSE_I_BAD,
 	/** Can be filled in by open, to use direct I/O on this file. */
 	FUSE_I_ATTR_FORCE_SYNC,
+	/** Directory approved by the daemon for metadata passthrough */
+	FUSE_I_PASSTHROUGH_DIR,
 };
 
 struct fuse_conn;
@@ -144,6 +161,34 @@ struct fuse_passthrough {
 	struct cred *cred;
 };
 
+/**
+ * Directory subtree approved by the daemon for metadata passthrough.
+ * Lookups and getattr below it are served from the backing filesystem,
+ * with owner and mode derived the same way as sdcardfs does.
+ */
+struct fuse_backing_root {
+	/** Held by the approved directory and by each backing inode */
+	refcount_t count;
+
+	/** Credentials of the daemon, used to access the backing tree */
+	struct cred *cred;
+
+	/** Owner of the approved directory, inherited below it */
+	kuid_t uid;
+
+	/** Group of backing inodes, made per user as sdcardfs get_gid() */
+	kgid_t gid;
+
+	/** Permission bits removed from backing inodes */
+	umode_t mask;
+
+	/** The group is sdcard_rw, which leaves Android/ searchable */
+	bool sdcard_rw;
+
+	/** Set once the daemon revokes the approval */
+	bool revoked;
+};
+
 /** FUSE specific file data */
 struct fuse_file {
 	/** Fuse connection for this file */
@@ -410,6 +455,9 @@ struct fuse_req {
 
 	/** Request is stolen from fuse_file->reserved_req */
 	struct file *stolen_file;
+
+	/** Input queue the request was queued on, NULL if never queued */
+	struct fuse_iqueue *fiq;
 };
 
 struct fuse_iqueue {
@@ -439,6 +487,31 @@ struct fuse_iqueue {
 	struct fasync_struct *fasync;
 };
 
+/**
+ * Per-CPU input queue.
+ *
+ * Used once the daemon binds /dev/fuse clones to CPUs with
+ * FUSE_DEV_IOC_BIND_CPU.  Requests are then queued on the submitting
+ * CPU's queue and read by the daemon threads serving that CPU.  Members
+ * other than iq are protected by iq.waitq.lock.
+ */
+struct fuse_cpu_queue {
+	/** Input queue for requests submitted on this CPU */
+	struct fuse_iqueue iq;
+
+	/** Number of fuse_dev's bound to this queue */
+	unsigned nr_bound;
+
+	/** Number of requests queued here */
+	unsigned long queued;
+
+	/** Number of requests read by the daemon from this queue */
+	unsigned long dispatched;
+
+	/** Number of requests sent to the shared queue instead */
+	unsigned long fallback;
+};
+
 struct fuse_pqueue {
 	/** Connection established */
 	unsigned connected;
@@ -463,6 +536,9 @@ struct fuse_dev {
 	/** Processing queue */
 	struct fuse_pqueue pq;
 
+	/** Input queue read by this device (fc->iq unless bound to a CPU) */
+	struct fuse_iqueue *fiq;
+
 	/** list entry on fc->devices */
 	struct list_head entry;
 };
@@ -507,6 +583,9 @@ struct fuse_conn {
 	/** Input queue */
 	struct fuse_iqueue iq;
 
+	/** Per-CPU input queues, NULL until a device is bound to a CPU */
+	struct fuse_cpu_queue __percpu *cpu_queues;
+
 	/** The next unique kernel file handle */
 	u64 khctr;
 
@@ -671,6 +750,12 @@ struct fuse_conn {
 	/** The number of requests waiting for completion */
 	atomic_t num_waiting;
 
+	/** Page cache pages donated by the daemon through splice */
+	atomic_long_t pages_moved;
+
+	/** Page cache pages copied from replies and store notifications */
+	atomic_long_t pages_copied;
+
 	/** Negotiated minor version */
 	unsigned minor;
 
@@ -756,6 +841,11 @@ extern const struct dentry_operations fuse_root_dentry_operations;
  */
 int fuse_inode_eq(struct inode *inode, void *_nodeidp);
 
+/**
+ * Find the inode with the given nodeid, including backing inodes
+ */
+struct inode *fuse_ilookup(struct super_block *sb, u64 nodeid);
+
 /**
  * Get a filled in inode
  */
@@ -939,6 +1029,11 @@ void fuse_conn_put(struct fuse_conn *fc);
 struct fuse_dev *fuse_dev_alloc(struct fuse_conn *fc);
 void fuse_dev_free(struct fuse_dev *fud);
 
+/**
+ * Allocate and initialize per-CPU input queues
+ */
+struct fuse_cpu_queue __percpu *fuse_cpu_queues_alloc(void);
+
 /**
  * Add connection to control filesystem
  */
@@ -1093,5 +1188,44 @@ void fuse_passthrough_release(struct fuse_passthrough *passthrough);
 ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to);
 ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *from);
 ssize_t fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+int fuse_passthrough_dir(struct fuse_dev *fud,
+			 const struct fuse_passthrough_dir *arg);
+void fuse_passthrough_evict_inode(struct inode *inode);
+struct dentry *fuse_passthrough_lookup(struct inode *dir, struct dentry *entry,
+				       unsigned int flags);
+int fuse_passthrough_revalidate(struct dentry *entry, unsigned int flags);
+int fuse_passthrough_getattr(const struct path *path, struct kstat *stat,
+			     u32 request_mask, unsigned int flags);
+int fuse_passthrough_permission(struct inode *inode, int mask);
+const char *fuse_passthrough_get_link(struct dentry *dentry,
+				      struct inode *inode,
+				      struct delayed_call *done);
+int fuse_passthrough_readdir(struct file *file, struct dir_context *ctx);
+int fuse_passthrough_materialize(struct dentry *entry);
+void fuse_backing_copy_attr(struct inode *inode);
+extern const struct file_operations fuse_backing_file_operations;
+extern const struct file_operations fuse_backing_dir_operations;
+
+/**
+ * Is the inode served from the backing filesystem of an approved directory?
+ */
+static inline bool fuse_is_backing(struct inode *inode)
+{
+	struct fuse_inode *fi = get_fuse_inode(inode);
+
+	return fi->backing_root &&
+	       !test_bit(FUSE_I_PASSTHROUGH_DIR, &fi->state);
+}
+
+/**
+ * Initialize operations on an inode served from the backing filesystem
+ */
+void fuse_init_backing(struct inode *inode, dev_t rdev);
+
+/**
+ * Send a LOOKUP without instantiating an inode for the result
+ */
+int fuse_lookup_nodeid(struct fuse_conn *fc, u64 nodeid,
+		       const struct qstr *name, struct fuse_entry_out *outarg);
 
 #endif /* _FS_FUSE_I_H */
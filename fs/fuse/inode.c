@@ -22,6 +22,7 @@
 #include <linux/exportfs.h>
 #include <linux/posix_acl.h>
 #include <linux/pid_namespace.h>
+#include <linux/percpu.h>
 
 MODULE_AUTHOR("Miklos Szeredi <miklos@szeredi.hu>");
 MODULE_DESCRIPTION("Filesystem in Userspace");
@@ -101,6 +102,9 @@ static struct inode *fuse_alloc_inode(struct super_block *sb)
 	INIT_LIST_HEAD(&fi->writepages);
 	init_waitqueue_head(&fi->page_waitq);
 	mutex_init(&fi->mutex);
+	fi->backing_path.mnt = NULL;
+	fi->backing_path.dentry = NULL;
+	fi->backing_root = NULL;
 	fi->forget = fuse_alloc_forget();
 	if (!fi->forget) {
 		kmem_cache_free(fuse_inode_cachep, inode);
@@ -133,9 +137,14 @@ static void fuse_evict_inode(struct inode *inode)
 	if (inode->i_sb->s_flags & MS_ACTIVE) {
 		struct fuse_conn *fc = get_fuse_conn(inode);
 		struct fuse_inode *fi = get_fuse_inode(inode);
-		fuse_queue_forget(fc, fi->forget, fi->nodeid, fi->nlookup);
-		fi->forget = NULL;
+		/* Backing inodes that were never materialized have no nodeid */
+		if (fi->nodeid) {
+			fuse_queue_forget(fc, fi->forget, fi->nodeid,
+					  fi->nlookup);
+			fi->forget = NULL;
+		}
 	}
+	fuse_passthrough_evict_inode(inode);
 }
 
 static int fuse_remount_fs(struct super_block *sb, int *flags, char *data)
@@ -282,12 +291,34 @@ static void fuse_init_inode(struct inode *inode, struct fuse_attr *attr)
 int fuse_inode_eq(struct inode *inode, void *_nodeidp)
 {
 	u64 nodeid = *(u64 *) _nodeidp;
-	if (get_node_id(inode) == nodeid)
+	if (get_node_id(inode) == nodeid && !fuse_is_backing(inode))
 		return 1;
 	else
 		return 0;
 }
 
+static int fuse_backing_eq(struct inode *inode, void *_nodeidp)
+{
+	u64 nodeid = *(u64 *) _nodeidp;
+
+	return get_node_id(inode) == nodeid && fuse_is_backing(inode);
+}
+
+/*
+ * Backing inodes are rehashed by their nodeid once they are materialized,
+ * but fuse_inode_eq() skips them so that fuse_iget() never reuses one.
+ */
+struct inode *fuse_ilookup(struct super_block *sb, u64 nodeid)
+{
+	struct inode *inode;
+
+	inode = ilookup5(sb, nodeid, fuse_inode_eq, &nodeid);
+	if (!inode)
+		inode = ilookup5(sb, nodeid, fuse_backing_eq, &nodeid);
+
+	return inode;
+}
+
 static int fuse_inode_set(struct inode *inode, void *_nodeidp)
 {
 	u64 nodeid = *(u64 *) _nodeidp;
@@ -338,12 +369,14 @@ int fuse_reverse_inval_inode(struct super_block *sb, u64 nodeid,
 	pgoff_t pg_start;
 	pgoff_t pg_end;
 
-	inode = ilookup5(sb, nodeid, fuse_inode_eq, &nodeid);
+	inode = fuse_ilookup(sb, nodeid);
 	if (!inode)
 		return -ENOENT;
 
 	fuse_invalidate_attr(inode);
 	forget_all_cached_acls(inode);
+	if (fuse_is_backing(inode))
+		fuse_backing_copy_attr(inode);
 	if (offset >= 0) {
 		pg_start = offset >> PAGE_SHIFT;
 		if (len <= 0)
@@ -592,6 +625,28 @@ static void fuse_iqueue_init(struct fuse_iqueue *fiq)
 	fiq->connected = 1;
 }
 
+struct fuse_cpu_queue __percpu *fuse_cpu_queues_alloc(void)
+{
+	struct fuse_cpu_queue __percpu *queues;
+	int cpu;
+
+	queues = alloc_percpu(struct fuse_cpu_queue);
+	if (!queues)
+		return NULL;
+
+	for_each_possible_cpu(cpu) {
+		struct fuse_cpu_queue *cq = per_cpu_ptr(queues, cpu);
+
+		fuse_iqueue_init(&cq->iq);
+		/*
+		 * Keep unique IDs of different queues apart, so that the
+		 * daemon never sees the same ID twice for live requests.
+		 */
+		cq->iq.reqctr = (u64)(cpu + 1) << 48;
+	}
+	return queues;
+}
+
 static void fuse_pqueue_init(struct fuse_pqueue *fpq)
 {
 	memset(fpq, 0, sizeof(struct fuse_pqueue));
@@ -617,6 +672,8 @@ void fuse_conn_init(struct fuse_conn *fc, struct user_namespace *user_ns)
 	INIT_LIST_HEAD(&fc->devices);
 	idr_init(&fc->passthrough_req);
 	atomic_set(&fc->num_waiting, 0);
+	atomic_long_set(&fc->pages_moved, 0);
+	atomic_long_set(&fc->pages_copied, 0);
 	fc->max_background = FUSE_DEFAULT_MAX_BACKGROUND;
 	fc->congestion_threshold = FUSE_DEFAULT_CONGESTION_THRESHOLD;
 	fc->khctr = 0;
@@ -636,6 +693,7 @@ void fuse_conn_put(struct fuse_conn *fc)
 	if (refcount_dec_and_test(&fc->count)) {
 		if (fc->destroy_req)
 			fuse_request_free(fc->destroy_req);
+		free_percpu(fc->cpu_queues);
 		put_pid_ns(fc->pid_ns);
 		put_user_ns(fc->user_ns);
 		fc->release(fc);
@@ -1053,6 +1111,7 @@ struct fuse_dev *fuse_dev_alloc(struct fuse_conn *fc)
 	fud = kzalloc(sizeof(struct fuse_dev), GFP_KERNEL);
 	if (fud) {
 		fud->fc = fuse_conn_get(fc);
+		fud->fiq = &fc->iq;
 		fuse_pqueue_init(&fud->pq);
 
 		spin_lock(&fc->lock);
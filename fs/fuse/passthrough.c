@@ -5,6 +5,7 @@
 #include <linux/file.h>
 #include <linux/fuse.h>
 #include <linux/idr.h>
+#include <linux/namei.h>
 #include <linux/uio.h>
 
 #define PASSTHROUGH_IOCB_MASK                                                  \
@@ -304,3 +305,706 @@ void fuse_passthrough_release(struct fuse_passthrough *passthrough)
 		passthrough->cred = NULL;
 	}
 }
+
+/*
+ * Metadata passthrough.
+ *
+ * Once the daemon approves a directory with FUSE_DEV_IOC_PASSTHROUGH_DIR,
+ * lookup, getattr, readdir and open below it are resolved against the
+ * backing directory without a round trip.  Backing inodes have no nodeid
+ * until an operation that must go through the daemon needs one; the entry
+ * is then looked up by name ("materialized") and rehashed by that nodeid,
+ * so that inode notifications from the daemon reach it.  Owner and mode
+ * are derived the same way as sdcardfs derives them.
+ */
+
+/* Android ids, as in fs/sdcardfs/multiuser.h */
+#define FUSE_AID_SDCARD_RW	1015
+#define FUSE_AID_USER_OFFSET	100000
+#define FUSE_AID_APP_START	10000
+#define FUSE_AID_APP_END	19999
+
+/* Permission classes, the subset of sdcardfs perm_t below a user's root */
+enum {
+	FUSE_PERM_INHERIT,
+	FUSE_PERM_ROOT,
+	FUSE_PERM_ANDROID,
+	FUSE_PERM_ANDROID_DATA,
+	FUSE_PERM_ANDROID_OBB,
+	FUSE_PERM_ANDROID_MEDIA,
+	FUSE_PERM_ANDROID_PACKAGE,
+	FUSE_PERM_ANDROID_PACKAGE_CACHE,
+};
+
+static void fuse_backing_root_put(struct fuse_backing_root *root)
+{
+	if (root && refcount_dec_and_test(&root->count)) {
+		if (root->cred)
+			put_cred(root->cred);
+		kfree(root);
+	}
+}
+
+static bool fuse_backing_name_eq(const struct qstr *name, const char *str)
+{
+	return name->len == strlen(str) &&
+	       !strncasecmp(name->name, str, name->len);
+}
+
+static bool fuse_backing_uid_is_app(kuid_t uid)
+{
+	uid_t appid = from_kuid(&init_user_ns, uid) % FUSE_AID_USER_OFFSET;
+
+	return appid >= FUSE_AID_APP_START && appid <= FUSE_AID_APP_END;
+}
+
+/*
+ * Derive the permission class and owner of @inode from its parent @dir,
+ * like sdcardfs get_derived_permission_new().  sdcardfs takes the uid of
+ * a package directory from its package list; here the owner the daemon
+ * gave the backing directory is used instead, when it is an app uid.
+ */
+static void fuse_backing_derive(struct inode *dir, struct inode *inode,
+				const struct qstr *name)
+{
+	struct fuse_inode *dfi = get_fuse_inode(dir);
+	struct fuse_inode *fi = get_fuse_inode(inode);
+	struct inode *lower = d_inode(fi->backing_path.dentry);
+	bool under_android = dfi->backing_under_android;
+	kuid_t uid = dfi->backing_uid;
+	u8 perm = FUSE_PERM_INHERIT;
+
+	/* Files don't get special labels */
+	if (!S_ISDIR(lower->i_mode))
+		goto out;
+
+	switch (dfi->backing_perm) {
+	case FUSE_PERM_ROOT:
+		if (fuse_backing_name_eq(name, "Android")) {
+			perm = FUSE_PERM_ANDROID;
+			under_android = true;
+		}
+		break;
+	case FUSE_PERM_ANDROID:
+		if (fuse_backing_name_eq(name, "data") ||
+		    fuse_backing_name_eq(name, "sandbox"))
+			perm = FUSE_PERM_ANDROID_DATA;
+		else if (fuse_backing_name_eq(name, "obb"))
+			perm = FUSE_PERM_ANDROID_OBB;
+		else if (fuse_backing_name_eq(name, "media"))
+			perm = FUSE_PERM_ANDROID_MEDIA;
+		break;
+	case FUSE_PERM_ANDROID_DATA:
+	case FUSE_PERM_ANDROID_OBB:
+	case FUSE_PERM_ANDROID_MEDIA:
+		perm = FUSE_PERM_ANDROID_PACKAGE;
+		if (fuse_backing_uid_is_app(lower->i_uid))
+			uid = lower->i_uid;
+		break;
+	case FUSE_PERM_ANDROID_PACKAGE:
+		if (fuse_backing_name_eq(name, "cache"))
+			perm = FUSE_PERM_ANDROID_PACKAGE_CACHE;
+		break;
+	}
+out:
+	fi->backing_perm = perm;
+	fi->backing_uid = uid;
+	fi->backing_under_android = under_android;
+}
+
+/* Mode as sdcardfs get_mode() presents it */
+static umode_t fuse_backing_mode(struct fuse_inode *fi, umode_t lower_mode)
+{
+	struct fuse_backing_root *root = fi->backing_root;
+	umode_t visible_mode = 0775 & ~root->mask;
+	umode_t owner_mode = lower_mode & 0700;
+	umode_t filtered_mode;
+
+	/*
+	 * Only apps of this user belong below Android/; sdcard_rw keeps +x
+	 * for the default view.
+	 */
+	if (fi->backing_under_android)
+		visible_mode &= root->sdcard_rw ? ~0006 : ~0007;
+
+	filtered_mode = visible_mode &
+			(owner_mode | (owner_mode >> 3) | (owner_mode >> 6));
+
+	return (lower_mode & S_IFMT) | filtered_mode;
+}
+
+void fuse_backing_copy_attr(struct inode *inode)
+{
+	struct fuse_conn *fc = get_fuse_conn(inode);
+	struct fuse_inode *fi = get_fuse_inode(inode);
+	struct inode *lower = d_inode(fi->backing_path.dentry);
+
+	/* fc->lock orders this against fuse_change_attributes() */
+	spin_lock(&fc->lock);
+	inode->i_mode = fuse_backing_mode(fi, lower->i_mode);
+	inode->i_uid = fi->backing_uid;
+	inode->i_gid = fi->backing_root->gid;
+	set_nlink(inode, lower->i_nlink);
+	inode->i_atime = lower->i_atime;
+	inode->i_mtime = lower->i_mtime;
+	inode->i_ctime = lower->i_ctime;
+	inode->i_blocks = lower->i_blocks;
+	i_size_write(inode, i_size_read(lower));
+	spin_unlock(&fc->lock);
+}
+
+static int fuse_backing_test(struct inode *inode, void *data)
+{
+	struct path *path = data;
+
+	return fuse_is_backing(inode) &&
+	       get_fuse_inode(inode)->backing_path.dentry == path->dentry;
+}
+
+struct fuse_backing_iget_args {
+	struct path path;
+	struct fuse_backing_root *root;
+};
+
+static int fuse_backing_set(struct inode *inode, void *data)
+{
+	struct fuse_backing_iget_args *args = data;
+	struct fuse_inode *fi = get_fuse_inode(inode);
+
+	fi->backing_path = args->path;
+	path_get(&fi->backing_path);
+	fi->backing_root = args->root;
+	refcount_inc(&args->root->count);
+
+	return 0;
+}
+
+/*
+ * A materialized inode is hashed by its nodeid and no longer found here.
+ * That only matters while its dentry is unhashed but still in use, e.g.
+ * by an open file, and such an inode is stale anyway.
+ */
+static struct inode *fuse_backing_iget(struct inode *dir,
+				       const struct qstr *name,
+				       const struct path *path)
+{
+	struct fuse_conn *fc = get_fuse_conn(dir);
+	struct fuse_backing_iget_args args = {
+		.path = *path,
+		.root = get_fuse_inode(dir)->backing_root,
+	};
+	struct inode *lower = d_inode(path->dentry);
+	struct inode *inode;
+
+	inode = iget5_locked(dir->i_sb, lower->i_ino, fuse_backing_test,
+			     fuse_backing_set, &args);
+	if (!inode)
+		return ERR_PTR(-ENOMEM);
+
+	/* The entry may have moved since, so derive again on every lookup */
+	spin_lock(&fc->lock);
+	fuse_backing_derive(dir, inode, name);
+	spin_unlock(&fc->lock);
+
+	if (inode->i_state & I_NEW) {
+		inode->i_ino = lower->i_ino;
+		inode->i_generation = lower->i_generation;
+		inode->i_flags |= S_NOATIME | S_NOCMTIME;
+		fuse_backing_copy_attr(inode);
+		fuse_init_backing(inode, lower->i_rdev);
+		unlock_new_inode(inode);
+	} else {
+		fuse_backing_copy_attr(inode);
+	}
+
+	return inode;
+}
+
+void fuse_passthrough_evict_inode(struct inode *inode)
+{
+	struct fuse_inode *fi = get_fuse_inode(inode);
+
+	if (fi->backing_path.dentry) {
+		path_put(&fi->backing_path);
+		fi->backing_path.dentry = NULL;
+	}
+	fuse_backing_root_put(fi->backing_root);
+	fi->backing_root = NULL;
+}
+
+struct dentry *fuse_passthrough_lookup(struct inode *dir, struct dentry *entry,
+				       unsigned int flags)
+{
+	struct fuse_inode *dfi = get_fuse_inode(dir);
+	struct fuse_backing_root *root = dfi->backing_root;
+	struct inode *inode = NULL;
+	const struct cred *old_cred;
+	struct dentry *lower;
+	struct dentry *newent;
+
+	if (root->revoked)
+		return ERR_PTR(-ESTALE);
+
+	old_cred = override_creds(root->cred);
+	lower = lookup_one_len_unlocked(entry->d_name.name,
+					dfi->backing_path.dentry,
+					entry->d_name.len);
+	revert_creds(old_cred);
+	if (IS_ERR(lower))
+		return ERR_CAST(lower);
+
+	if (d_is_positive(lower)) {
+		struct path path = {
+			.mnt = dfi->backing_path.mnt,
+			.dentry = lower,
+		};
+
+		inode = fuse_backing_iget(dir, &entry->d_name, &path);
+	}
+	dput(lower);
+	if (IS_ERR(inode))
+		return ERR_CAST(inode);
+
+	newent = d_splice_alias(inode, entry);
+	if (IS_ERR(newent))
+		return newent;
+
+	/*
+	 * Positive entries are revalidated against the backing dentry,
+	 * negative ones are looked up again in the backing directory.
+	 */
+	fuse_invalidate_entry_cache(newent ? newent : entry);
+
+	return newent;
+}
+
+int fuse_passthrough_revalidate(struct dentry *entry, unsigned int flags)
+{
+	struct fuse_inode *fi = get_fuse_inode(d_inode_rcu(entry));
+	struct dentry *lower = fi->backing_path.dentry;
+	struct dentry *parent = READ_ONCE(entry->d_parent);
+	struct inode *dir = d_inode_rcu(parent);
+	int ret;
+
+	if (READ_ONCE(fi->backing_root->revoked) || !dir ||
+	    d_unhashed(lower) || d_is_negative(lower))
+		return 0;
+
+	spin_lock(&lower->d_lock);
+	ret = lower->d_parent == get_fuse_inode(dir)->backing_path.dentry &&
+	      lower->d_name.len == entry->d_name.len &&
+	      !memcmp(lower->d_name.name, entry->d_name.name,
+		      entry->d_name.len);
+	spin_unlock(&lower->d_lock);
+
+	return ret;
+}
+
+int fuse_passthrough_getattr(const struct path *path, struct kstat *stat,
+			     u32 request_mask, unsigned int flags)
+{
+	struct inode *inode = d_inode(path->dentry);
+	struct fuse_inode *fi = get_fuse_inode(inode);
+	const struct cred *old_cred;
+	int err;
+
+	if (!fuse_allow_current_process(get_fuse_conn(inode)))
+		return -EACCES;
+
+	old_cred = override_creds(fi->backing_root->cred);
+	err = vfs_getattr(&fi->backing_path, stat, request_mask, flags);
+	revert_creds(old_cred);
+	if (err)
+		return err;
+
+	fuse_backing_copy_attr(inode);
+	stat->dev = inode->i_sb->s_dev;
+	stat->ino = inode->i_ino;
+	stat->mode = inode->i_mode;
+	stat->uid = inode->i_uid;
+	stat->gid = inode->i_gid;
+
+	return 0;
+}
+
+int fuse_passthrough_permission(struct inode *inode, int mask)
+{
+	if (!fuse_allow_current_process(get_fuse_conn(inode)))
+		return -EACCES;
+
+	return generic_permission(inode, mask);
+}
+
+const char *fuse_passthrough_get_link(struct dentry *dentry,
+				      struct inode *inode,
+				      struct delayed_call *done)
+{
+	struct fuse_inode *fi = get_fuse_inode(inode);
+	const struct cred *old_cred;
+	const char *link;
+
+	if (!dentry)
+		return ERR_PTR(-ECHILD);
+
+	old_cred = override_creds(fi->backing_root->cred);
+	link = vfs_get_link(fi->backing_path.dentry, done);
+	revert_creds(old_cred);
+
+	return link;
+}
+
+static int fuse_backing_open_lower(struct inode *inode, struct file *file,
+				   struct fuse_file *ff)
+{
+	struct fuse_inode *fi = get_fuse_inode(inode);
+	struct fuse_backing_root *root = fi->backing_root;
+	struct file *lower;
+
+	lower = dentry_open(&fi->backing_path,
+			    file->f_flags & ~(O_CREAT | O_EXCL | O_NOCTTY |
+					      O_TRUNC),
+			    root->cred);
+	if (IS_ERR(lower))
+		return PTR_ERR(lower);
+
+	ff->passthrough.filp = lower;
+	ff->passthrough.cred = get_new_cred(root->cred);
+
+	return 0;
+}
+
+/*
+ * Read the approved directory itself from the backing directory.  The
+ * backing directory is opened on first use and released together with
+ * the fuse file.
+ */
+int fuse_passthrough_readdir(struct file *file, struct dir_context *ctx)
+{
+	struct inode *inode = file_inode(file);
+	struct fuse_file *ff = file->private_data;
+	struct file *lower = ff->passthrough.filp;
+	const struct cred *old_cred;
+	int err;
+
+	/* The approved directory may have been pointed elsewhere since */
+	if (lower &&
+	    lower->f_path.dentry != get_fuse_inode(inode)->backing_path.dentry) {
+		fuse_passthrough_release(&ff->passthrough);
+		lower = NULL;
+	}
+
+	if (!lower) {
+		err = fuse_backing_open_lower(inode, file, ff);
+		if (err)
+			return err;
+		lower = ff->passthrough.filp;
+	}
+
+	old_cred = override_creds(ff->passthrough.cred);
+	err = 0;
+	if (lower->f_pos != ctx->pos) {
+		loff_t pos = vfs_llseek(lower, ctx->pos, SEEK_SET);
+
+		if (pos < 0)
+			err = pos;
+	}
+	if (!err)
+		err = iterate_dir(lower, ctx);
+	revert_creds(old_cred);
+
+	return err;
+}
+
+static int fuse_backing_open(struct inode *inode, struct file *file)
+{
+	struct fuse_file *ff;
+	int err;
+
+	if (get_fuse_inode(inode)->backing_root->revoked)
+		return -ESTALE;
+
+	ff = fuse_file_alloc(get_fuse_conn(inode));
+	if (!ff)
+		return -ENOMEM;
+
+	err = fuse_backing_open_lower(inode, file, ff);
+	if (err) {
+		fuse_file_free(ff);
+		return err;
+	}
+
+	file->private_data = ff;
+
+	return 0;
+}
+
+static int fuse_backing_release(struct inode *inode, struct file *file)
+{
+	struct fuse_file *ff = file->private_data;
+
+	fuse_passthrough_release(&ff->passthrough);
+	fuse_file_free(ff);
+
+	return 0;
+}
+
+static loff_t fuse_backing_llseek(struct file *file, loff_t offset, int whence)
+{
+	fuse_backing_copy_attr(file_inode(file));
+
+	return generic_file_llseek(file, offset, whence);
+}
+
+static int fuse_backing_fsync(struct file *file, loff_t start, loff_t end,
+			      int datasync)
+{
+	struct fuse_file *ff = file->private_data;
+
+	return vfs_fsync_range(ff->passthrough.filp, start, end, datasync);
+}
+
+static ssize_t fuse_backing_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	return fuse_passthrough_read_iter(iocb, to);
+}
+
+static ssize_t fuse_backing_write_iter(struct kiocb *iocb,
+				       struct iov_iter *from)
+{
+	return fuse_passthrough_write_iter(iocb, from);
+}
+
+static int fuse_backing_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	return fuse_passthrough_mmap(file, vma);
+}
+
+const struct file_operations fuse_backing_file_operations = {
+	.llseek		= fuse_backing_llseek,
+	.read_iter	= fuse_backing_read_iter,
+	.write_iter	= fuse_backing_write_iter,
+	.mmap		= fuse_backing_mmap,
+	.open		= fuse_backing_open,
+	.release	= fuse_backing_release,
+	.fsync		= fuse_backing_fsync,
+	.splice_read	= generic_file_splice_read,
+};
+
+const struct file_operations fuse_backing_dir_operations = {
+	.llseek		= generic_file_llseek,
+	.read		= generic_read_dir,
+	.iterate_shared	= fuse_passthrough_readdir,
+	.open		= fuse_backing_open,
+	.release	= fuse_backing_release,
+	.fsync		= fuse_backing_fsync,
+};
+
+/*
+ * Give @entry a nodeid by looking it up in its (materialized) parent.
+ */
+static int fuse_backing_materialize_one(struct dentry *parent,
+					struct dentry *entry)
+{
+	struct inode *inode = d_inode(entry);
+	struct fuse_inode *fi = get_fuse_inode(inode);
+	struct fuse_conn *fc = get_fuse_conn(inode);
+	struct fuse_forget_link *forget;
+	struct fuse_entry_out outarg;
+	struct name_snapshot name;
+	struct qstr qname;
+	int err;
+
+	forget = fuse_alloc_forget();
+	if (!forget)
+		return -ENOMEM;
+
+	take_dentry_name_snapshot(&name, entry);
+	qname.name = name.name;
+	qname.len = strlen(name.name);
+	err = fuse_lookup_nodeid(fc, get_node_id(d_inode(parent)), &qname,
+				 &outarg);
+	release_dentry_name_snapshot(&name);
+	if (!err && !outarg.nodeid)
+		err = -ENOENT;
+	if (err) {
+		kfree(forget);
+		return err;
+	}
+
+	spin_lock(&fc->lock);
+	if (!fi->nodeid && !((outarg.attr.mode ^ inode->i_mode) & S_IFMT)) {
+		fi->nodeid = outarg.nodeid;
+		fi->nlookup = 1;
+		outarg.nodeid = 0;
+	}
+	spin_unlock(&fc->lock);
+
+	if (!outarg.nodeid) {
+		/* Let notifications for the new nodeid find the inode */
+		remove_inode_hash(inode);
+		__insert_inode_hash(inode, fi->nodeid);
+		kfree(forget);
+		return 0;
+	}
+
+	/* Lost a race with another materialization, or type changed */
+	fuse_queue_forget(fc, forget, outarg.nodeid, 1);
+
+	return fi->nodeid ? 0 : -ESTALE;
+}
+
+int fuse_passthrough_materialize(struct dentry *entry)
+{
+	struct dentry *dentry;
+	struct dentry *parent;
+	int err = 0;
+
+	while (!err && !get_node_id(d_inode(entry))) {
+		/* Find the topmost ancestor without a nodeid */
+		dentry = dget(entry);
+		for (;;) {
+			parent = dget_parent(dentry);
+			if (get_node_id(d_inode(parent)))
+				break;
+			dput(dentry);
+			dentry = parent;
+		}
+		err = fuse_backing_materialize_one(parent, dentry);
+		dput(parent);
+		dput(dentry);
+	}
+
+	return err;
+}
+
+static struct dentry *fuse_passthrough_dir_alias(struct fuse_conn *fc,
+						 u64 nodeid)
+{
+	struct inode *inode;
+	struct dentry *dentry;
+
+	inode = ilookup5(fc->sb, nodeid, fuse_inode_eq, &nodeid);
+	if (!inode)
+		return ERR_PTR(-ENOENT);
+
+	dentry = d_find_alias(inode);
+	iput(inode);
+	if (!dentry)
+		return ERR_PTR(-ENOENT);
+
+	if (!d_is_dir(dentry) || fuse_is_backing(d_inode(dentry))) {
+		dput(dentry);
+		return ERR_PTR(-ENOTDIR);
+	}
+
+	return dentry;
+}
+
+int fuse_passthrough_dir(struct fuse_dev *fud,
+			 const struct fuse_passthrough_dir *arg)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_backing_root *root = NULL;
+	struct fuse_backing_root *old_root;
+	struct path path = {};
+	struct path old_path;
+	struct dentry *dentry;
+	struct fuse_inode *fi;
+	struct inode *inode;
+	int err;
+
+	if (!fc->passthrough)
+		return -EPERM;
+
+	if (arg->fd >= 0) {
+		struct file *filp = fget(arg->fd);
+
+		if (!filp)
+			return -EBADF;
+
+		path = filp->f_path;
+		path_get(&path);
+		fput(filp);
+
+		err = -ENOTDIR;
+		if (!d_is_dir(path.dentry))
+			goto out_put_path;
+
+		err = -EINVAL;
+		if (path.dentry->d_sb->s_stack_depth >=
+		    FILESYSTEM_MAX_STACK_DEPTH)
+			goto out_put_path;
+
+		root = kzalloc(sizeof(*root), GFP_KERNEL);
+		err = -ENOMEM;
+		if (!root)
+			goto out_put_path;
+
+		refcount_set(&root->count, 1);
+		root->cred = prepare_creds();
+		root->uid = make_kuid(fc->user_ns, arg->uid);
+		root->sdcard_rw = arg->gid == FUSE_AID_SDCARD_RW;
+		if (root->sdcard_rw)
+			root->gid = make_kgid(fc->user_ns, arg->gid);
+		else
+			root->gid = make_kgid(fc->user_ns,
+				arg->uid / FUSE_AID_USER_OFFSET *
+				FUSE_AID_USER_OFFSET +
+				arg->gid % FUSE_AID_USER_OFFSET);
+		root->mask = arg->mask & 0777;
+		err = -EINVAL;
+		if (!root->cred || !uid_valid(root->uid) ||
+		    !gid_valid(root->gid))
+			goto out_put_root;
+	}
+
+	down_read(&fc->killsb);
+	dentry = ERR_PTR(-ENOENT);
+	if (fc->sb)
+		dentry = fuse_passthrough_dir_alias(fc, arg->nodeid);
+	if (IS_ERR(dentry)) {
+		up_read(&fc->killsb);
+		err = PTR_ERR(dentry);
+		goto out_put_root;
+	}
+
+	inode = d_inode(dentry);
+	fi = get_fuse_inode(inode);
+
+	inode_lock(inode);
+	old_root = fi->backing_root;
+	old_path = fi->backing_path;
+	if (old_root)
+		old_root->revoked = true;
+	fi->backing_root = root;
+	fi->backing_path = path;
+	if (root) {
+		/* The approved directory is the top of a user's storage */
+		fi->backing_perm = FUSE_PERM_ROOT;
+		fi->backing_uid = root->uid;
+		fi->backing_under_android = false;
+		set_bit(FUSE_I_PASSTHROUGH_DIR, &fi->state);
+	} else {
+		clear_bit(FUSE_I_PASSTHROUGH_DIR, &fi->state);
+	}
+	inode_unlock(inode);
+
+	/* Drop entries resolved through the daemon or the old backing dir */
+	shrink_dcache_parent(dentry);
+	dput(dentry);
+	up_read(&fc->killsb);
+
+	if (old_root) {
+		path_put(&old_path);
+		fuse_backing_root_put(old_root);
+	}
+
+	return 0;
+
+out_put_root:
+	fuse_backing_root_put(root);
+out_put_path:
+	path_put(&path);
+
+	return err;
+}
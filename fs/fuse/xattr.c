@@ -116,6 +116,12 @@ ssize_t fuse_listxattr(struct dentry *entry, char *list, size_t size)
 	if (fuse_is_bad(inode))
 		return -EIO;
 
+	if (!get_node_id(inode)) {
+		ret = fuse_passthrough_materialize(entry);
+		if (ret)
+			return ret;
+	}
+
 	if (!fuse_allow_current_process(fc))
 		return -EACCES;
 
@@ -177,13 +183,33 @@ int fuse_removexattr(struct inode *inode, const char *name)
 	return err;
 }
 
+/*
+ * Backing inodes get a nodeid only when the daemon has to be asked
+ */
+static int fuse_xattr_materialize(struct dentry *dentry, struct inode *inode)
+{
+	if (get_node_id(inode))
+		return 0;
+
+	if (!dentry)
+		return -EOPNOTSUPP;
+
+	return fuse_passthrough_materialize(dentry);
+}
+
 static int fuse_xattr_get(const struct xattr_handler *handler,
 			 struct dentry *dentry, struct inode *inode,
 			 const char *name, void *value, size_t size)
 {
+	int err;
+
 	if (fuse_is_bad(inode))
 		return -EIO;
 
+	err = fuse_xattr_materialize(dentry, inode);
+	if (err)
+		return err;
+
 	return fuse_getxattr(inode, name, value, size);
 }
 
@@ -192,9 +218,15 @@ static int fuse_xattr_set(const struct xattr_handler *handler,
 			  const char *name, const void *value, size_t size,
 			  int flags)
 {
+	int err;
+
 	if (fuse_is_bad(inode))
 		return -EIO;
 
+	err = fuse_xattr_materialize(dentry, inode);
+	if (err)
+		return err;
+
 	if (!value)
 		return fuse_removexattr(inode, name);
 
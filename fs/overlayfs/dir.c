@@ -584,6 +584,106 @@ static int ovl_symlink(struct inode *dir, struct dentry *dentry,
 	return ovl_create_object(dentry, S_IFLNK, 0, link);
 }
 
+static char *ovl_get_redirect(struct dentry *dentry, bool samedir)
+{
+	char *buf, *ret;
+	struct dentry *d, *tmp;
+	int buflen = ovl_redirect_max + 1;
+
+	if (samedir) {
+		ret = kstrndup(dentry->d_name.name, dentry->d_name.len,
+			       GFP_KERNEL);
+		goto out;
+	}
+
+	buf = ret = kmalloc(buflen, GFP_KERNEL);
+	if (!buf)
+		goto out;
+
+	buflen--;
+	buf[buflen] = '\0';
+	for (d = dget(dentry); !IS_ROOT(d);) {
+		const char *name;
+		int thislen;
+
+		spin_lock(&d->d_lock);
+		name = ovl_dentry_get_redirect(d);
+		if (name) {
+			thislen = strlen(name);
+		} else {
+			name = d->d_name.name;
+			thislen = d->d_name.len;
+		}
+
+		/* If path is too long, fall back to userspace move */
+		if (thislen + (name[0] != '/') > buflen) {
+			ret = ERR_PTR(-EXDEV);
+			spin_unlock(&d->d_lock);
+			goto out_put;
+		}
+
+		buflen -= thislen;
+		memcpy(&buf[buflen], name, thislen);
+		tmp = dget_dlock(d->d_parent);
+		spin_unlock(&d->d_lock);
+
+		dput(d);
+		d = tmp;
+
+		/* Absolute redirect: finished */
+		if (buf[buflen] == '/')
+			break;
+		buflen--;
+		buf[buflen] = '/';
+	}
+	ret = kstrdup(&buf[buflen], GFP_KERNEL);
+out_put:
+	dput(d);
+	kfree(buf);
+out:
+	return ret ? ret : ERR_PTR(-ENOMEM);
+}
+
+static int ovl_set_redirect(struct dentry *dentry, bool samedir)
+{
+	int err;
+	const char *redirect = ovl_dentry_get_redirect(dentry);
+
+	if (redirect && (samedir || redirect[0] == '/'))
+		return 0;
+
+	redirect = ovl_get_redirect(dentry, samedir);
+	if (IS_ERR(redirect))
+		return PTR_ERR(redirect);
+
+	err = ovl_check_setxattr(dentry, ovl_dentry_upper(dentry),
+				 OVL_XATTR_REDIRECT,
+				 redirect, strlen(redirect), -EXDEV);
+	if (!err) {
+		spin_lock(&dentry->d_lock);
+		ovl_dentry_set_redirect(dentry, redirect);
+		spin_unlock(&dentry->d_lock);
+	} else {
+		kfree(redirect);
+		pr_warn_ratelimited("overlay: failed to set redirect (%i)\n", err);
+		/* Fall back to userspace copy-up */
+		err = -EXDEV;
+	}
+	return err;
+}
+
+static int ovl_set_link_redirect(struct dentry *dentry)
+{
+	const struct cred *old_cred;
+	int err;
+
+	old_cred = ovl_override_creds(dentry->d_sb);
+	err = ovl_set_redirect(dentry, false);
+	revert_creds(old_cred);
+
+	return err;
+}
+
 static int ovl_link(struct dentry *old, struct inode *newdir,
 		    struct dentry *new)
 {
@@ -603,6 +703,12 @@ static int ovl_link(struct dentry *old, struct inode *newdir,
 	if (err)
 		goto out_drop_write;
 
+	/* The new name must lead back to the data too */
+	if (ovl_is_metacopy_dentry(old)) {
+		err = ovl_set_link_redirect(old);
+		if (err)
+			goto out_drop_write;
+	}
 
 	err = ovl_nlink_start(old, &locked);
 	if (err)
@@ -810,94 +916,6 @@ static bool ovl_can_move(struct dentry *dentry)
 		!d_is_dir(dentry) || !ovl_type_merge_or_lower(dentry);
 }
 
-static char *ovl_get_redirect(struct dentry *dentry, bool samedir)
-{
-	char *buf, *ret;
-	struct dentry *d, *tmp;
-	int buflen = ovl_redirect_max + 1;
-
-	if (samedir) {
-		ret = kstrndup(dentry->d_name.name, dentry->d_name.len,
-			       GFP_KERNEL);
-		goto out;
-	}
-
-	buf = ret = kmalloc(buflen, GFP_KERNEL);
-	if (!buf)
-		goto out;
-
-	buflen--;
-	buf[buflen] = '\0';
-	for (d = dget(dentry); !IS_ROOT(d);) {
-		const char *name;
-		int thislen;
-
-		spin_lock(&d->d_lock);
-		name = ovl_dentry_get_redirect(d);
-		if (name) {
-			thislen = strlen(name);
-		} else {
-			name = d->d_name.name;
-			thislen = d->d_name.len;
-		}
-
-		/* If path is too long, fall back to userspace move */
-		if (thislen + (name[0] != '/') > buflen) {
-			ret = ERR_PTR(-EXDEV);
-			spin_unlock(&d->d_lock);
-			goto out_put;
-		}
-
-		buflen -= thislen;
-		memcpy(&buf[buflen], name, thislen);
-		tmp = dget_dlock(d->d_parent);
-		spin_unlock(&d->d_lock);
-
-		dput(d);
-		d = tmp;
-
-		/* Absolute redirect: finished */
-		if (buf[buflen] == '/')
-			break;
-		buflen--;
-		buf[buflen] = '/';
-	}
-	ret = kstrdup(&buf[buflen], GFP_KERNEL);
-out_put:
-	dput(d);
-	kfree(buf);
-out:
-	return ret ? ret : ERR_PTR(-ENOMEM);
-}
-
-static int ovl_set_redirect(struct dentry *dentry, bool samedir)
-{
-	int err;
-	const char *redirect = ovl_dentry_get_redirect(dentry);
-
-	if (redirect && (samedir || redirect[0] == '/'))
-		return 0;
-
-	redirect = ovl_get_redirect(dentry, samedir);
-	if (IS_ERR(redirect))
-		return PTR_ERR(redirect);
-
-	err = ovl_check_setxattr(dentry, ovl_dentry_upper(dentry),
-				 OVL_XATTR_REDIRECT,
-				 redirect, strlen(redirect), -EXDEV);
-	if (!err) {
-		spin_lock(&dentry->d_lock);
-		ovl_dentry_set_redirect(dentry, redirect);
-		spin_unlock(&dentry->d_lock);
-	} else {
-		kfree(redirect);
-		pr_warn_ratelimited("overlay: failed to set redirect (%i)\n", err);
-		/* Fall back to userspace copy-up */
-		err = -EXDEV;
-	}
-	return err;
-}
-
 static int ovl_rename(struct inode *olddir, struct dentry *old,
 		      struct inode *newdir, struct dentry *new,
 		      unsigned int flags)
@@ -1045,23 +1063,25 @@ static int ovl_rename(struct inode *olddir, struct dentry *old,
 	if (olddentry->d_inode == newdentry->d_inode)
 		goto out_dput;
 
+	/*
+	 * Merge dirs and metacopy files find their lower layers by name, so
+	 * they need a redirect to the old name.
+	 */
 	err = 0;
-	if (is_dir) {
-		if (ovl_type_merge_or_lower(old))
-			err = ovl_set_redirect(old, samedir);
-		else if (!old_opaque && ovl_type_merge(new->d_parent))
-			err = ovl_set_opaque_xerr(old, olddentry, -EXDEV);
-		if (err)
-			goto out_dput;
-	}
-	if (!overwrite && new_is_dir) {
-		if (ovl_type_merge_or_lower(new))
-			err = ovl_set_redirect(new, samedir);
-		else if (!new_opaque && ovl_type_merge(old->d_parent))
-			err = ovl_set_opaque_xerr(new, newdentry, -EXDEV);
-		if (err)
-			goto out_dput;
-	}
+	if (ovl_type_merge_or_lower(old))
+		err = ovl_set_redirect(old, samedir);
+	else if (is_dir && !old_opaque && ovl_type_merge(new->d_parent))
+		err = ovl_set_opaque_xerr(old, olddentry, -EXDEV);
+	if (err)
+		goto out_dput;
+
+	if (!overwrite && ovl_type_merge_or_lower(new))
+		err = ovl_set_redirect(new, samedir);
+	else if (!overwrite && new_is_dir && !new_opaque &&
+		 ovl_type_merge(old->d_parent))
+		err = ovl_set_opaque_xerr(new, newdentry, -EXDEV);
+	if (err)
+		goto out_dput;
 
 	err = ovl_do_rename(old_upperdir->d_inode, olddentry,
 			    new_upperdir->d_inode, newdentry, flags);
@@ -39,7 +39,10 @@ int ovl_setattr(struct dentry *dentry, struct iattr *attr)
 	if (err)
 		goto out;
 
-	err = ovl_copy_up(dentry);
+	if (attr->ia_valid & ATTR_SIZE)
+		err = ovl_copy_up_with_data(dentry);
+	else
+		err = ovl_copy_up(dentry);
 	if (!err) {
 		upperdentry = ovl_dentry_upper(dentry);
 
@@ -67,6 +70,7 @@ int ovl_getattr(const struct path *path, struct kstat *stat,
 	struct path realpath;
 	const struct cred *old_cred;
 	bool is_dir = S_ISDIR(dentry->d_inode->i_mode);
+	bool metacopy_blocks = ovl_is_metacopy_dentry(dentry);
 	int err;
 
 	type = ovl_path_real(dentry, &realpath);
@@ -75,6 +79,18 @@ int ovl_getattr(const struct path *path, struct kstat *stat,
 	if (err)
 		goto out;
 
+	/* A metacopy file is sparse; report the blocks of its data file */
+	if (metacopy_blocks && (request_mask & STATX_BLOCKS)) {
+		struct kstat datastat;
+
+		ovl_path_lowerdata(dentry, &realpath);
+		err = vfs_getattr(&realpath, &datastat, STATX_BLOCKS, flags);
+		if (err)
+			goto out;
+
+		stat->blocks = datastat.blocks;
+	}
+
 	/*
 	 * When all layers are on the same fs, all real inode number are
 	 * unique, so we use the overlay st_dev, which is friendly to du -x.
@@ -336,14 +352,14 @@ struct posix_acl *ovl_get_acl(struct inode *inode, int type)
 
 static bool ovl_open_need_copy_up(struct dentry *dentry, int flags)
 {
-	if (ovl_dentry_upper(dentry) &&
-	    ovl_dentry_has_upper_alias(dentry))
+	if (special_file(d_inode(dentry)->i_mode))
 		return false;
 
-	if (special_file(d_inode(dentry)->i_mode))
+	if (!ovl_open_flags_need_data(flags))
 		return false;
 
-	if (!(OPEN_FMODE(flags) & FMODE_WRITE) && !(flags & O_TRUNC))
+	/* A metacopy upper still needs its data copied up */
+	if (ovl_already_copied_up(dentry, flags))
 		return false;
 
 	return true;
@@ -660,7 +676,7 @@ static bool ovl_hash_bylower(struct super_block *sb, struct dentry *upper,
 }
 
 struct inode *ovl_get_inode(struct dentry *dentry, struct dentry *upperdentry,
-			    struct dentry *index)
+			    struct dentry *index, bool metacopy)
 {
 	struct super_block *sb = dentry->d_sb;
 	struct dentry *lowerdentry = ovl_dentry_lower(dentry);
@@ -712,6 +728,8 @@ struct inode *ovl_get_inode(struct dentry *dentry, struct dentry *upperdentry,
 			goto out_nomem;
 	}
 	ovl_fill_inode(inode, realinode->i_mode, realinode->i_rdev);
+	if (upperdentry && metacopy)
+		ovl_set_flag(OVL_METACOPY, inode);
 	ovl_inode_init(inode, upperdentry, lowerdentry);
 
 	if (upperdentry && ovl_is_impuredir(upperdentry))
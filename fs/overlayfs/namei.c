@@ -23,6 +23,7 @@ struct ovl_lookup_data {
 	bool opaque;
 	bool stop;
 	bool last;
+	bool metacopy;
 	char *redirect;
 };
 
@@ -198,6 +199,30 @@ static bool ovl_is_opaquedir(struct dentry *dentry)
 	return ovl_check_dir_xattr(dentry, OVL_XATTR_OPAQUE);
 }
 
+/*
+ * Returns 1 if @dentry is a metadata only copy up, 0 if not and negative
+ * errno on failure to read the xattr.
+ */
+int ovl_check_metacopy_xattr(struct dentry *dentry)
+{
+	ssize_t res;
+
+	/* Only regular files can have metacopy xattr */
+	if (!S_ISREG(d_inode(dentry)->i_mode))
+		return 0;
+
+	res = ovl_vfs_getxattr(dentry, OVL_XATTR_METACOPY, NULL, 0);
+	if (res < 0) {
+		if (res == -ENODATA || res == -EOPNOTSUPP)
+			return 0;
+		pr_warn_ratelimited("overlayfs: failed to get metacopy (%zi)\n",
+				    res);
+		return res;
+	}
+
+	return 1;
+}
+
 static int ovl_lookup_single(struct dentry *base, struct ovl_lookup_data *d,
 			     const char *name, unsigned int namelen,
 			     size_t prelen, const char *post,
@@ -226,17 +251,35 @@ static int ovl_lookup_single(struct dentry *base, struct ovl_lookup_data *d,
 		d->stop = d->opaque = true;
 		goto put_and_out;
 	}
-	if (!d_can_lookup(this)) {
+	/* The layer above was a metacopy, so this must hold its data */
+	if (!post[0] && d->metacopy && !d_is_reg(this)) {
 		d->stop = true;
-		if (d->is_dir)
+		goto put_and_out;
+	}
+	if (!d_can_lookup(this)) {
+		/* A non-dir in the middle of a redirect path ends the lookup */
+		if (d->is_dir || post[0]) {
+			d->stop = true;
 			goto put_and_out;
-		goto out;
+		}
+		err = ovl_check_metacopy_xattr(this);
+		if (err < 0)
+			goto out_err;
+
+		/* Keep looking in lower layers for the data of a metacopy */
+		d->metacopy = err;
+		d->stop = !d->metacopy;
+		if (!d->metacopy || d->last)
+			goto out;
+		goto redirect;
 	}
-	d->is_dir = true;
+	if (!post[0])
+		d->is_dir = true;
 	if (!d->last && ovl_is_opaquedir(this)) {
 		d->stop = d->opaque = true;
 		goto out;
 	}
+redirect:
 	err = ovl_check_redirect(this, d, prelen, post);
 	if (err)
 		goto out_err;
@@ -599,6 +642,7 @@ struct dentry *ovl_lookup(struct inode *dir, struct dentry *dentry,
 	unsigned int ctr = 0;
 	struct inode *inode = NULL;
 	bool upperopaque = false;
+	bool uppermetacopy = false;
 	char *upperredirect = NULL;
 	struct dentry *this;
 	unsigned int i;
@@ -609,6 +653,7 @@ struct dentry *ovl_lookup(struct inode *dir, struct dentry *dentry,
 		.opaque = false,
 		.stop = false,
 		.last = !poe->numlower,
+		.metacopy = false,
 		.redirect = NULL,
 	};
 
@@ -627,7 +672,7 @@ struct dentry *ovl_lookup(struct inode *dir, struct dentry *dentry,
 			err = -EREMOTE;
 			goto out;
 		}
-		if (upperdentry && !d.is_dir) {
+		if (upperdentry && !d.is_dir && !d.metacopy) {
 			BUG_ON(!d.stop || d.redirect);
 			/*
 			 * Lookup copy up origin by decoding origin file handle.
@@ -654,6 +699,7 @@ struct dentry *ovl_lookup(struct inode *dir, struct dentry *dentry,
 				poe = roe;
 		}
 		upperopaque = d.opaque;
+		uppermetacopy = upperdentry && d.metacopy;
 	}
 
 	if (!d.stop && poe->numlower) {
@@ -694,8 +740,29 @@ struct dentry *ovl_lookup(struct inode *dir, struct dentry *dentry,
 		}
 	}
 
+	/* Metacopy whose data was not found in any lower layer */
+	if (d.metacopy) {
+		err = -EIO;
+		pr_warn_ratelimited("overlayfs: no data for metacopy file (%pd2)\n",
+				    dentry);
+		goto out_put;
+	}
+
+	/*
+	 * Following a metacopy into a lower layer is like following a
+	 * redirect: only do it when the feature was asked for.
+	 */
+	if ((uppermetacopy || (!d.is_dir && ctr > 1)) &&
+	    !ofs->config.metacopy) {
+		err = -EPERM;
+		pr_warn_ratelimited("overlayfs: refusing to follow metacopy (%pd2), mount with metacopy=on\n",
+				    dentry);
+		goto out_put;
+	}
+
 	/* Lookup index by lower inode and verify it matches upper inode */
-	if (ctr && !d.is_dir && ovl_indexdir(dentry->d_sb)) {
+	if (ctr && !d.is_dir && !uppermetacopy &&
+	    ovl_indexdir(dentry->d_sb)) {
 		struct dentry *origin = stack[0].dentry;
 
 		index = ovl_lookup_index(dentry, upperdentry, origin);
@@ -721,7 +788,8 @@ struct dentry *ovl_lookup(struct inode *dir, struct dentry *dentry,
 		upperdentry = dget(index);
 
 	if (upperdentry || ctr) {
-		inode = ovl_get_inode(dentry, upperdentry, index);
+		inode = ovl_get_inode(dentry, upperdentry, index,
+				      uppermetacopy);
 		err = PTR_ERR(inode);
 		if (IS_ERR(inode))
 			goto out_free_oe;
@@ -112,10 +112,12 @@ enum ovl_path_type ovl_path_type(struct dentry *dentry)
 
 		/*
 		 * Non-dir dentry can hold lower dentry of its copy up origin.
+		 * A metacopy upper is merged with the lower holding its data.
 		 */
 		if (oe->numlower) {
 			type |= __OVL_PATH_ORIGIN;
-			if (d_is_dir(dentry))
+			if (d_is_dir(dentry) ||
+			    !ovl_has_upperdata(d_inode(dentry)))
 				type |= __OVL_PATH_MERGE;
 		}
 	} else {
@@ -140,6 +142,18 @@ void ovl_path_lower(struct dentry *dentry, struct path *path)
 	*path = oe->numlower ? oe->lowerstack[0] : (struct path) { };
 }
 
+/*
+ * For a non-dir, the last lower layer holds the data. The ones above it, if
+ * any, are metacopy files from a lower overlay that only hold metadata.
+ */
+void ovl_path_lowerdata(struct dentry *dentry, struct path *path)
+{
+	struct ovl_entry *oe = dentry->d_fsdata;
+
+	*path = oe->numlower ? oe->lowerstack[oe->numlower - 1] :
+			       (struct path) { };
+}
+
 enum ovl_path_type ovl_path_real(struct dentry *dentry, struct path *path)
 {
 	enum ovl_path_type type = ovl_path_type(dentry);
@@ -164,6 +178,13 @@ struct dentry *ovl_dentry_lower(struct dentry *dentry)
 	return oe->numlower ? oe->lowerstack[0].dentry : NULL;
 }
 
+struct dentry *ovl_dentry_lowerdata(struct dentry *dentry)
+{
+	struct ovl_entry *oe = dentry->d_fsdata;
+
+	return oe->numlower ? oe->lowerstack[oe->numlower - 1].dentry : NULL;
+}
+
 struct dentry *ovl_dentry_real(struct dentry *dentry)
 {
 	return ovl_dentry_upper(dentry) ?: ovl_dentry_lower(dentry);
@@ -322,13 +343,79 @@ struct file *ovl_path_open(struct path *path, int flags)
 	return dentry_open(path, flags | O_NOATIME, current_cred());
 }
 
-int ovl_copy_up_start(struct dentry *dentry)
+bool ovl_has_upperdata(struct inode *inode)
+{
+	if (!ovl_inode_upper(inode))
+		return false;
+
+	/* Pairs with smp_wmb() in ovl_inode_update() */
+	smp_rmb();
+	if (ovl_test_flag(OVL_METACOPY, inode))
+		return false;
+
+	/*
+	 * Pairs with smp_mb__before_atomic() in ovl_set_upperdata(): if the
+	 * cleared flag is visible, so is the data copied up before it.
+	 */
+	smp_rmb();
+	return true;
+}
+
+void ovl_set_upperdata(struct inode *inode)
+{
+	smp_mb__before_atomic();
+	ovl_clear_flag(OVL_METACOPY, inode);
+}
+
+/* Is the data of this dentry in a layer below its metadata? */
+bool ovl_is_metacopy_dentry(struct dentry *dentry)
+{
+	struct ovl_entry *oe = dentry->d_fsdata;
+
+	if (!d_is_reg(dentry))
+		return false;
+
+	if (ovl_dentry_upper(dentry))
+		return !ovl_has_upperdata(d_inode(dentry));
+
+	return oe->numlower > 1;
+}
+
+bool ovl_dentry_needs_data_copy_up(struct dentry *dentry, int flags)
+{
+	if (!d_is_reg(dentry) || !ovl_open_flags_need_data(flags))
+		return false;
+
+	return !ovl_has_upperdata(d_inode(dentry));
+}
+
+bool ovl_already_copied_up(struct dentry *dentry, int flags)
+{
+	/*
+	 * Check if copy-up has happened as well as for upper alias (in
+	 * case of hard links) is there.
+	 *
+	 * Both checks are lockless:
+	 *  - false negatives: will recheck under oi->lock
+	 *  - false positives:
+	 *    + ovl_dentry_upper() uses memory barriers to ensure the
+	 *      upper dentry is up-to-date
+	 *    + ovl_dentry_has_upper_alias() relies on locking of
+	 *      upper parent i_rwsem to prevent reordering copy-up
+	 *      with rename.
+	 */
+	return ovl_dentry_upper(dentry) &&
+	       ovl_dentry_has_upper_alias(dentry) &&
+	       !ovl_dentry_needs_data_copy_up(dentry, flags);
+}
+
+int ovl_copy_up_start(struct dentry *dentry, int flags)
 {
 	struct ovl_inode *oi = OVL_I(d_inode(dentry));
 	int err;
 
 	err = mutex_lock_interruptible(&oi->lock);
-	if (!err && ovl_dentry_has_upper_alias(dentry)) {
+	if (!err && ovl_already_copied_up(dentry, flags)) {
 		err = 1; /* Already copied up */
 		mutex_unlock(&oi->lock);
 	}
@@ -115,6 +115,8 @@ static int sdcardfs_d_revalidate(struct dentry *dentry, unsigned int flags)
 		if (!data || data->abandoned) {
 			err = 0;
 		}
+		if (err)
+			fixup_stale_perms(dentry, data);
 		if (data)
 			data_put(data);
 		iput(inode);
@@ -54,6 +54,21 @@ void setup_derived_state(struct inode *inode, perm_t perm, userid_t userid,
 #endif
 }
 
+/* d_uid of an app directory, as given by the current package list */
+static void derive_package_uid(struct sdcardfs_inode_data *data,
+		struct sdcardfs_inode_data *parent_data,
+		const struct qstr *name)
+{
+	struct qstr key = QSTR_INIT(name->name, name->len);
+	appid_t appid;
+
+	data->gen = packagelist_generation();
+	packagelist_hash_name(&key);
+	appid = get_appid_hashed(&key);
+	if (appid != 0 && !is_excluded_hashed(&key, parent_data->userid))
+		data->d_uid = multiuser_get_uid(parent_data->userid, appid);
+}
+
 /* While renaming, there is a point where we want the path from dentry,
  * but the name from newdentry
  */
@@ -64,7 +79,6 @@ void get_derived_permission_inode_new(struct dentry *parent,
 	struct sdcardfs_inode_info *info = SDCARDFS_I(inode);
 	struct sdcardfs_inode_info *parent_info = SDCARDFS_I(d_inode(parent));
 	struct sdcardfs_inode_data *parent_data = parent_info->data;
-	appid_t appid;
 	unsigned long user_num;
 	int err;
 	struct qstr q_Android = QSTR_LITERAL("Android");
@@ -147,10 +161,7 @@ void get_derived_permission_inode_new(struct dentry *parent,
 	case PERM_ANDROID_DATA:
 	case PERM_ANDROID_MEDIA:
 		info->data->perm = PERM_ANDROID_PACKAGE;
-		appid = get_appid(name->name);
-		if (appid != 0 && !is_excluded(name->name, parent_data->userid))
-			info->data->d_uid =
-				multiuser_get_uid(parent_data->userid, appid);
+		derive_package_uid(info->data, parent_data, name);
 		break;
 	case PERM_ANDROID_PACKAGE:
 		if (qstr_case_eq(name, &q_cache)) {
@@ -189,10 +200,7 @@ void get_derived_permission_inode_new(struct dentry *parent,
 		break;
 	case PERM_KNOX_ANDROID_DATA:
 		info->data->perm = PERM_KNOX_ANDROID_PACKAGE;
-		appid = get_appid(name->name);
-		if (appid != 0 && !is_excluded(name->name, parent_data->userid))
-			info->data->d_uid =
-				multiuser_get_uid(parent_data->userid, appid);
+		derive_package_uid(info->data, parent_data, name);
 		break;
 	case PERM_KNOX_ANDROID_SHARED:
 	case PERM_KNOX_ANDROID_PACKAGE:
@@ -330,67 +338,47 @@ retry_deleg:
 	sdcardfs_put_lower_path(dentry, &path);
 }
 
-static int descendant_may_need_fixup(struct sdcardfs_inode_data *data,
-		struct limit_search *limit)
-{
-	if (data->perm == PERM_ROOT)
-		return (limit->flags & BY_USERID) ?
-				data->userid == limit->userid : 1;
-	if (data->perm == PERM_PRE_ROOT || data->perm == PERM_ANDROID)
-		return 1;
-	return 0;
-}
-
-static int needs_fixup(perm_t perm)
+static bool derived_from_packagelist(perm_t perm)
 {
-	if (perm == PERM_ANDROID_DATA || perm == PERM_ANDROID_OBB
-			|| perm == PERM_ANDROID_MEDIA)
-		return 1;
-	return 0;
+	if (perm == PERM_ANDROID_PACKAGE)
+		return true;
+#if defined(CONFIG_SDCARD_FS_SUPPORT_KNOX)
+	if (perm == PERM_KNOX_ANDROID_PACKAGE)
+		return true;
+#endif
+	return false;
 }
 
-static void __fixup_perms_recursive(struct dentry *dentry, struct limit_search *limit, int depth)
+/*
+ * Re-derive the app directory that @dentry takes its ownership from, if the
+ * package list changed since it was derived. Walks up at most to the
+ * PERM_ANDROID_PACKAGE node owning the top data, so access through a cwd or
+ * an open directory below it sees the update too.
+ *
+ * @top is the top data of @dentry's inode. The caller holds a reference.
+ */
+void fixup_stale_perms(struct dentry *dentry, struct sdcardfs_inode_data *top)
 {
-	struct dentry *child;
-	struct sdcardfs_inode_info *info;
+	struct dentry *owner, *parent;
 
-	/*
-	 * All paths will terminate their recursion on hitting PERM_ANDROID_OBB,
-	 * PERM_ANDROID_MEDIA, or PERM_ANDROID_DATA. This happens at a depth of
-	 * at most 3.
-	 */
-	WARN(depth > 3, "%s: Max expected depth exceeded!\n", __func__);
-	spin_lock_nested(&dentry->d_lock, depth);
-	if (!d_inode(dentry)) {
-		spin_unlock(&dentry->d_lock);
+	if (!derived_from_packagelist(top->perm) || top->abandoned ||
+			READ_ONCE(top->gen) == packagelist_generation())
 		return;
-	}
-	info = SDCARDFS_I(d_inode(dentry));
 
-	if (needs_fixup(info->data->perm)) {
-		list_for_each_entry(child, &dentry->d_subdirs, d_child) {
-			spin_lock_nested(&child->d_lock, depth + 1);
-			if (!(limit->flags & BY_NAME) || qstr_case_eq(&child->d_name, &limit->name)) {
-				if (d_inode(child)) {
-					get_derived_permission(dentry, child);
-					fixup_tmp_permissions(d_inode(child));
-					spin_unlock(&child->d_lock);
-					break;
-				}
-			}
-			spin_unlock(&child->d_lock);
-		}
-	} else if (descendant_may_need_fixup(info->data, limit)) {
-		list_for_each_entry(child, &dentry->d_subdirs, d_child) {
-			__fixup_perms_recursive(child, limit, depth + 1);
-		}
+	owner = dget(dentry);
+	while (SDCARDFS_I(d_inode(owner))->data != top) {
+		if (IS_ROOT(owner))
+			goto out_put;
+		parent = dget_parent(owner);
+		dput(owner);
+		owner = parent;
 	}
-	spin_unlock(&dentry->d_lock);
-}
-
-void fixup_perms_recursive(struct dentry *dentry, struct limit_search *limit)
-{
-	__fixup_perms_recursive(dentry, limit, 0);
+	parent = dget_parent(owner);
+	get_derived_permission(parent, owner);
+	fixup_tmp_permissions(d_inode(owner));
+	dput(parent);
+out_put:
+	dput(owner);
 }
 
 /* main function for updating derived permission */
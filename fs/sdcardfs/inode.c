@@ -735,16 +735,13 @@ out_err:
 	return err;
 }
 
-static int sdcardfs_fillattr(struct vfsmount *mnt, struct inode *inode,
+static void sdcardfs_fillattr(struct vfsmount *mnt, struct inode *inode,
+				struct sdcardfs_inode_data *top,
 				struct kstat *lower_stat, struct kstat *stat)
 {
 	struct sdcardfs_inode_info *info = SDCARDFS_I(inode);
-	struct sdcardfs_inode_data *top = top_data_get(info);
 	struct super_block *sb = inode->i_sb;
 
-	if (!top)
-		return -EINVAL;
-
 	stat->dev = inode->i_sb->s_dev;
 	stat->ino = inode->i_ino;
 	stat->mode = (inode->i_mode  & S_IFMT) | get_mode(mnt, info, top);
@@ -758,14 +755,13 @@ static int sdcardfs_fillattr(struct vfsmount *mnt, struct inode *inode,
 	stat->ctime = lower_stat->ctime;
 	stat->blksize = lower_stat->blksize;
 	stat->blocks = lower_stat->blocks;
-	data_put(top);
-	return 0;
 }
 static int sdcardfs_getattr(const struct path *path, struct kstat *stat,
 				u32 request_mask, unsigned int flags)
 {
 	struct vfsmount *mnt = path->mnt;
 	struct dentry *dentry = path->dentry;
+	struct sdcardfs_inode_data *top;
 	struct kstat lower_stat;
 	struct path lower_path;
 	struct dentry *parent;
@@ -778,15 +774,21 @@ static int sdcardfs_getattr(const struct path *path, struct kstat *stat,
 	}
 	dput(parent);
 
+	top = top_data_get(SDCARDFS_I(d_inode(dentry)));
+	if (!top)
+		return -EINVAL;
+
+	fixup_stale_perms(dentry, top);
 	sdcardfs_get_lower_path(dentry, &lower_path);
 	err = vfs_getattr(&lower_path, &lower_stat, request_mask, flags);
 	if (err)
 		goto out;
 	sdcardfs_copy_and_fix_attrs(d_inode(dentry),
 			      d_inode(lower_path.dentry));
-	err = sdcardfs_fillattr(mnt, d_inode(dentry), &lower_stat, stat);
+	sdcardfs_fillattr(mnt, d_inode(dentry), top, &lower_stat, stat);
 out:
 	sdcardfs_put_lower_path(dentry, &lower_path);
+	data_put(top);
 	return err;
 }
 
@@ -45,6 +45,8 @@ static DEFINE_HASHTABLE(ext_to_groupid, 8);
 
 static struct kmem_cache *hashtable_entry_cachep;
 
+atomic_t packagelist_gen = ATOMIC_INIT(0);
+
 static unsigned int full_name_case_hash(const void *salt, const unsigned char *name, unsigned int len)
 {
 	unsigned long hash = init_name_hash(salt);
@@ -96,6 +98,17 @@ appid_t get_appid(const char *key)
 }
 EXPORT_SYMBOL(get_appid);
 
+/* Fill in key->hash so one key can be reused across several lookups */
+void packagelist_hash_name(struct qstr *key)
+{
+	key->hash = full_name_case_hash(0, key->name, key->len);
+}
+
+appid_t get_appid_hashed(const struct qstr *key)
+{
+	return __get_appid(key);
+}
+
 static appid_t __get_ext_gid(const struct qstr *key)
 {
 	struct hashtable_entry *hash_cur;
@@ -146,6 +159,11 @@ appid_t is_excluded(const char *key, userid_t user)
 	return __is_excluded(&q, user);
 }
 
+appid_t is_excluded_hashed(const struct qstr *key, userid_t user)
+{
+	return __is_excluded(key, user);
+}
+
 /* Kernel has already enforced everything we returned through
  * derive_permissions_locked(), so this is used to lock down access
  * even further, such as enforcing that apps hold sdcard_rw.
@@ -250,44 +268,16 @@ static int insert_userid_exclude_entry_locked(const struct qstr *key, userid_t v
 	return 0;
 }
 
-static void fixup_all_perms_name(const struct qstr *key)
-{
-	struct sdcardfs_sb_info *sbinfo;
-	struct limit_search limit = {
-		.flags = BY_NAME,
-		.name = QSTR_INIT(key->name, key->len),
-	};
-	list_for_each_entry(sbinfo, &sdcardfs_super_list, list) {
-		if (sbinfo_has_sdcard_magic(sbinfo))
-			fixup_perms_recursive(sbinfo->sb->s_root, &limit);
-	}
-}
-
-static void fixup_all_perms_name_userid(const struct qstr *key, userid_t userid)
-{
-	struct sdcardfs_sb_info *sbinfo;
-	struct limit_search limit = {
-		.flags = BY_NAME | BY_USERID,
-		.name = QSTR_INIT(key->name, key->len),
-		.userid = userid,
-	};
-	list_for_each_entry(sbinfo, &sdcardfs_super_list, list) {
-		if (sbinfo_has_sdcard_magic(sbinfo))
-			fixup_perms_recursive(sbinfo->sb->s_root, &limit);
-	}
-}
-
-static void fixup_all_perms_userid(userid_t userid)
+/*
+ * Derived permissions are not walked and fixed up here. Bumping the
+ * generation marks every package directory stale, and it is re-derived
+ * on the next revalidate or getattr that goes through it.
+ * Called with sdcardfs_super_list_lock held, after the tables are updated.
+ */
+static void packagelist_changed(void)
 {
-	struct sdcardfs_sb_info *sbinfo;
-	struct limit_search limit = {
-		.flags = BY_USERID,
-		.userid = userid,
-	};
-	list_for_each_entry(sbinfo, &sdcardfs_super_list, list) {
-		if (sbinfo_has_sdcard_magic(sbinfo))
-			fixup_perms_recursive(sbinfo->sb->s_root, &limit);
-	}
+	smp_mb__before_atomic();
+	atomic_inc(&packagelist_gen);
 }
 
 static int insert_packagelist_entry(const struct qstr *key, appid_t value)
@@ -297,7 +287,7 @@ static int insert_packagelist_entry(const struct qstr *key, appid_t value)
 	mutex_lock(&sdcardfs_super_list_lock);
 	err = insert_packagelist_appid_entry_locked(key, value);
 	if (!err)
-		fixup_all_perms_name(key);
+		packagelist_changed();
 	mutex_unlock(&sdcardfs_super_list_lock);
 
 	return err;
@@ -321,7 +311,7 @@ static int insert_userid_exclude_entry(const struct qstr *key, userid_t value)
 	mutex_lock(&sdcardfs_super_list_lock);
 	err = insert_userid_exclude_entry_locked(key, value);
 	if (!err)
-		fixup_all_perms_name_userid(key, value);
+		packagelist_changed();
 	mutex_unlock(&sdcardfs_super_list_lock);
 
 	return err;
@@ -362,7 +352,7 @@ static void remove_packagelist_entry(const struct qstr *key)
 {
 	mutex_lock(&sdcardfs_super_list_lock);
 	remove_packagelist_entry_locked(key);
-	fixup_all_perms_name(key);
+	packagelist_changed();
 	mutex_unlock(&sdcardfs_super_list_lock);
 }
 
@@ -411,7 +401,7 @@ static void remove_userid_all_entry(userid_t userid)
 {
 	mutex_lock(&sdcardfs_super_list_lock);
 	remove_userid_all_entry_locked(userid);
-	fixup_all_perms_userid(userid);
+	packagelist_changed();
 	mutex_unlock(&sdcardfs_super_list_lock);
 }
 
@@ -435,7 +425,7 @@ static void remove_userid_exclude_entry(const struct qstr *key, userid_t userid)
 {
 	mutex_lock(&sdcardfs_super_list_lock);
 	remove_userid_exclude_entry_locked(key, userid);
-	fixup_all_perms_name_userid(key, userid);
+	packagelist_changed();
 	mutex_unlock(&sdcardfs_super_list_lock);
 }
 
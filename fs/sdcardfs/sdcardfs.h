@@ -196,6 +196,8 @@ struct sdcardfs_inode_data {
 #if defined(CONFIG_SDCARD_FS_SUPPORT_KNOX)
 	bool under_knox;
 #endif
+	/* packagelist generation d_uid was derived at */
+	unsigned int gen;
 };
 
 /* sdcardfs inode data in memory */
@@ -538,22 +540,32 @@ extern struct mutex sdcardfs_super_list_lock;
 extern struct list_head sdcardfs_super_list;
 
 /* for packagelist.c */
+extern atomic_t packagelist_gen;
 extern appid_t get_appid(const char *app_name);
 extern appid_t get_ext_gid(const char *app_name);
 extern appid_t is_excluded(const char *app_name, userid_t userid);
+extern void packagelist_hash_name(struct qstr *key);
+extern appid_t get_appid_hashed(const struct qstr *key);
+extern appid_t is_excluded_hashed(const struct qstr *key, userid_t userid);
 extern int check_caller_access_to_name(struct inode *parent_node, const struct qstr *name);
 extern int packagelist_init(void);
 extern void packagelist_exit(void);
 
-/* for derived_perm.c */
-#define BY_NAME		(1 << 0)
-#define BY_USERID	(1 << 1)
-struct limit_search {
-	unsigned int flags;
-	struct qstr name;
-	userid_t userid;
-};
+/*
+ * Every change to the package tables bumps packagelist_gen. Derived state
+ * that depends on them records the generation it was computed at, and is
+ * recomputed lazily once it falls behind.
+ */
+static inline unsigned int packagelist_generation(void)
+{
+	unsigned int gen = atomic_read(&packagelist_gen);
+
+	/* pairs with smp_mb__before_atomic() in packagelist_changed() */
+	smp_rmb();
+	return gen;
+}
 
+/* for derived_perm.c */
 extern void setup_derived_state(struct inode *inode, perm_t perm,
 			userid_t userid, uid_t uid);
 extern void get_derived_permission(struct dentry *parent, struct dentry *dentry);
@@ -561,7 +573,8 @@ extern void get_derived_permission_new(struct dentry *parent,
 		struct dentry *dentry, const struct qstr *name);
 extern void get_derived_permission_inode_new(struct dentry *parent,
 		struct inode *inode, const struct qstr *name);
-extern void fixup_perms_recursive(struct dentry *dentry, struct limit_search *limit);
+extern void fixup_stale_perms(struct dentry *dentry,
+		struct sdcardfs_inode_data *top);
 
 extern void update_derived_permission_lock(struct dentry *dentry,
 		struct inode *inode);
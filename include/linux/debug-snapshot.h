@@ -14,17 +14,95 @@
 #ifndef DEBUG_SNAPSHOT_H
 #define DEBUG_SNAPSHOT_H
 
+/**
+ * dsslog_flag - added log information supported.
+ * @DSS_FLAG_REQ: Generally, marking starting request something
+ * @DSS_FLAG_IN: Generally, marking into the function
+ * @DSS_FLAG_ON: Generally, marking the status not in, not out
+ * @DSS_FLAG_OUT: Generally, marking come out the function
+ * @DSS_FLAG_SOFTIRQ: Marking to pass the softirq function
+ * @DSS_FLAG_SOFTIRQ_HI_TASKLET: Marking to pass the tasklet function
+ * @DSS_FLAG_SOFTIRQ_TASKLET: Marking to pass the tasklet function
+ */
+enum dsslog_flag {
+	DSS_FLAG_REQ			= 0,
+	DSS_FLAG_IN			= 1,
+	DSS_FLAG_ON			= 2,
+	DSS_FLAG_OUT			= 3,
+	DSS_FLAG_SOFTIRQ		= 10000,
+	DSS_FLAG_SOFTIRQ_HI_TASKLET	= 10100,
+	DSS_FLAG_SOFTIRQ_TASKLET	= 10200,
+	DSS_FLAG_CALL_TIMER_FN		= 20000,
+	DSS_FLAG_SMP_CALL_FN		= 30000,
+};
+
 #ifdef CONFIG_DEBUG_SNAPSHOT
 #include <asm/ptrace.h>
 #include <linux/bug.h>
+#include <linux/jump_label.h>
 #include "debug-snapshot-binder.h"
 
+/*
+ * Hot kevent hooks are gated by one static key per event type, so a
+ * disabled event costs a nop at the call site. The keys follow the
+ * "base" and "log_kevents" enables and the per type mask in sysfs.
+ */
+enum dss_kevent_key {
+	DSS_KEY_TASK,
+	DSS_KEY_WORK,
+	DSS_KEY_CPUIDLE,
+	DSS_KEY_IRQ,
+	DSS_KEY_SOFTIRQ,
+	DSS_KEY_SPINLOCK,
+	DSS_KEY_CLK,
+	DSS_KEY_HRTIMER,
+	DSS_KEY_REG,
+	DSS_KEY_NR,
+};
+
+extern struct static_key_false dss_kevent_key[DSS_KEY_NR];
+
+#define dbg_snapshot_kevent_on(key)	\
+	static_branch_unlikely(&dss_kevent_key[key])
+
 /* mandatory */
-extern void dbg_snapshot_task(int cpu, void *v_task);
-extern void dbg_snapshot_work(void *worker, void *v_task, void *fn, int en);
-extern void dbg_snapshot_cpuidle(char *modes, unsigned state, int diff, int en);
+extern void __dbg_snapshot_task(int cpu, void *v_task);
+extern void __dbg_snapshot_work(void *worker, void *v_task, void *fn, int en);
+extern void __dbg_snapshot_cpuidle(char *modes, unsigned state, int diff, int en);
 extern void dbg_snapshot_suspend(char *log, void *fn, void *dev, int state, int en);
-extern void dbg_snapshot_irq(int irq, void *fn, void *val, unsigned long long time, int en);
+extern void __dbg_snapshot_irq(int irq, void *fn, void *val, unsigned long long time, int en);
+
+static inline void dbg_snapshot_task(int cpu, void *v_task)
+{
+	if (dbg_snapshot_kevent_on(DSS_KEY_TASK))
+		__dbg_snapshot_task(cpu, v_task);
+}
+
+static inline void dbg_snapshot_work(void *worker, void *v_task, void *fn, int en)
+{
+	if (dbg_snapshot_kevent_on(DSS_KEY_WORK))
+		__dbg_snapshot_work(worker, v_task, fn, en);
+}
+
+static inline void dbg_snapshot_cpuidle(char *modes, unsigned state, int diff, int en)
+{
+	if (dbg_snapshot_kevent_on(DSS_KEY_CPUIDLE))
+		__dbg_snapshot_cpuidle(modes, state, diff, en);
+}
+
+/* softirq, tasklet, timer and smp call hooks pass a DSS_FLAG_* as irq */
+static inline bool dbg_snapshot_irq_on(int irq)
+{
+	if (irq >= DSS_FLAG_SOFTIRQ)
+		return dbg_snapshot_kevent_on(DSS_KEY_SOFTIRQ);
+	return dbg_snapshot_kevent_on(DSS_KEY_IRQ);
+}
+
+static inline void dbg_snapshot_irq(int irq, void *fn, void *val, unsigned long long time, int en)
+{
+	if (dbg_snapshot_irq_on(irq))
+		__dbg_snapshot_irq(irq, fn, val, time, en);
+}
 extern void dbg_snapshot_print_notifier_call(void **nl, unsigned long func, int en);
 extern int dbg_snapshot_try_enable(const char *name, unsigned long long duration);
 extern int dbg_snapshot_set_enable(const char *name, int en);
@@ -61,7 +139,10 @@ extern void dbg_snapshot_dump_sfr(void);
 extern int dbg_snapshot_hook_pmsg(char *buffer, size_t count);
 extern void dbg_snapshot_save_log(int cpu, unsigned long where);
 extern void dbg_snapshot_scratch_clear(void);
-#define dbg_snapshot_irq_var(v)   do {    v = cpu_clock(raw_smp_processor_id());  \
+#define dbg_snapshot_irq_var(v)   do {					\
+	v = (dbg_snapshot_kevent_on(DSS_KEY_IRQ) ||				\
+	     dbg_snapshot_kevent_on(DSS_KEY_SOFTIRQ)) ?				\
+		cpu_clock(raw_smp_processor_id()) : 0;				\
 				  } while(0)
 /* option */
 #ifdef CONFIG_DEBUG_SNAPSHOT_ACPM
@@ -99,7 +180,13 @@ extern void dbg_snapshot_irqs_disabled(unsigned long flags);
 #endif
 
 #ifdef CONFIG_DEBUG_SNAPSHOT_HRTIMER
-extern void dbg_snapshot_hrtimer(void *timer, s64 *now, void *fn, int en);
+extern void __dbg_snapshot_hrtimer(void *timer, s64 *now, void *fn, int en);
+
+static inline void dbg_snapshot_hrtimer(void *timer, s64 *now, void *fn, int en)
+{
+	if (dbg_snapshot_kevent_on(DSS_KEY_HRTIMER))
+		__dbg_snapshot_hrtimer(timer, now, fn, en);
+}
 #else
 #define dbg_snapshot_hrtimer(a,b,c,d)	do { } while(0)
 #endif
@@ -121,20 +208,38 @@ extern void dbg_snapshot_spi(struct spi_controller *ctlr, struct spi_message *cu
 #endif
 
 #ifdef CONFIG_DEBUG_SNAPSHOT_REG
-extern void dbg_snapshot_reg(unsigned int read, size_t val, size_t reg, int en);
+extern void __dbg_snapshot_reg(unsigned int read, size_t val, size_t reg, int en);
+
+static inline void dbg_snapshot_reg(unsigned int read, size_t val, size_t reg, int en)
+{
+	if (dbg_snapshot_kevent_on(DSS_KEY_REG))
+		__dbg_snapshot_reg(read, val, reg, en);
+}
 #else
 #define dbg_snapshot_reg(a,b,c,d)		do { } while(0)
 #endif
 
 #ifdef CONFIG_DEBUG_SNAPSHOT_SPINLOCK
-extern void dbg_snapshot_spinlock(void *lock, int en);
+extern void __dbg_snapshot_spinlock(void *lock, int en);
+
+static inline void dbg_snapshot_spinlock(void *lock, int en)
+{
+	if (dbg_snapshot_kevent_on(DSS_KEY_SPINLOCK))
+		__dbg_snapshot_spinlock(lock, en);
+}
 #else
 #define dbg_snapshot_spinlock(a,b)		do { } while(0)
 #endif
 
 #ifdef CONFIG_DEBUG_SNAPSHOT_CLK
 struct clk;
-extern void dbg_snapshot_clk(void *clock, const char *func_name, unsigned long arg, int mode);
+extern void __dbg_snapshot_clk(void *clock, const char *func_name, unsigned long arg, int mode);
+
+static inline void dbg_snapshot_clk(void *clock, const char *func_name, unsigned long arg, int mode)
+{
+	if (dbg_snapshot_kevent_on(DSS_KEY_CLK))
+		__dbg_snapshot_clk(clock, func_name, arg, mode);
+}
 #else
 #define dbg_snapshot_clk(a,b,c,d)		do { } while(0)
 #endif
@@ -283,28 +388,6 @@ extern struct blocking_notifier_head pm_chain_head;
 extern struct atomic_notifier_head itmon_notifier_list;
 #endif
 
-/**
- * dsslog_flag - added log information supported.
- * @DSS_FLAG_REQ: Generally, marking starting request something
- * @DSS_FLAG_IN: Generally, marking into the function
- * @DSS_FLAG_ON: Generally, marking the status not in, not out
- * @DSS_FLAG_OUT: Generally, marking come out the function
- * @DSS_FLAG_SOFTIRQ: Marking to pass the softirq function
- * @DSS_FLAG_SOFTIRQ_HI_TASKLET: Marking to pass the tasklet function
- * @DSS_FLAG_SOFTIRQ_TASKLET: Marking to pass the tasklet function
- */
-enum dsslog_flag {
-	DSS_FLAG_REQ			= 0,
-	DSS_FLAG_IN			= 1,
-	DSS_FLAG_ON			= 2,
-	DSS_FLAG_OUT			= 3,
-	DSS_FLAG_SOFTIRQ		= 10000,
-	DSS_FLAG_SOFTIRQ_HI_TASKLET	= 10100,
-	DSS_FLAG_SOFTIRQ_TASKLET	= 10200,
-	DSS_FLAG_CALL_TIMER_FN		= 20000,
-	DSS_FLAG_SMP_CALL_FN		= 30000,
-};
-
 enum dsslog_freq_flag {
 	DSS_FLAG_LIT = 0,
 	DSS_FLAG_BIG,
@@ -39,6 +39,8 @@ struct rw_semaphore {
 	 */
 	struct task_struct *owner;
 #endif
+	/* the lock is handed off to the writer at the head of the queue */
+	int handoff;
 
 #ifdef CONFIG_FAST_TRACK
 	struct task_struct *ftt_dep_task;
@@ -50,16 +50,18 @@ struct udp_sock {
 	__u8		 encap_type;	/* Is this an Encapsulation socket? */
 	unsigned char	 no_check6_tx:1,/* Send zero UDP6 checksums on TX? */
 			 no_check6_rx:1,/* Allow zero UDP6 checksums on RX? */
-			 encap_enabled:1;/* This socket enabled encap
+			 encap_enabled:1,/* This socket enabled encap
 					  * processing; UDP tunnels and
 					  * different encapsulation layers set
 					  * this
 					  */
+			 gro_enabled:1;	/* Can accept GRO packets */
 	/*
 	 * Following member retains the information to create a UDP header
 	 * when the socket is uncorked.
 	 */
 	__u16		 len;		/* total length of pending frames */
+	__u16		 gso_size;	/* UDP_SEGMENT, 0 if off */
 	/*
 	 * Fields specific to UDP-Lite.
 	 */
@@ -92,6 +94,8 @@ struct udp_sock {
 	int		forward_deficit;
 };
 
+#define UDP_MAX_SEGMENTS	(1 << 6UL)
+
 static inline struct udp_sock *udp_sk(const struct sock *sk)
 {
 	return (struct udp_sock *)sk;
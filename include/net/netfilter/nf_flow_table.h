@@ -0,0 +1,122 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _NF_FLOW_TABLE_H
+#define _NF_FLOW_TABLE_H
+
+#include <linux/in.h>
+#include <linux/in6.h>
+#include <linux/netdevice.h>
+#include <linux/rhashtable.h>
+#include <linux/rcupdate.h>
+#include <linux/workqueue.h>
+#include <net/dst.h>
+#include <net/netfilter/nf_conntrack_tuple.h>
+
+struct nf_conn;
+struct nf_hook_state;
+
+/* Software fast path for established connections.
+ *
+ * Once a connection is established, its two conntrack tuples are copied
+ * into a flow table together with the route and NAT mapping of each
+ * direction. A netdev ingress hook looks up every packet there and, on
+ * a hit, mangles and transmits it right away, skipping conntrack, the
+ * iptables chains and the routing lookup. Anything the fast path does
+ * not understand is left to the classic forwarding path.
+ */
+struct nf_flowtable {
+	struct rhashtable		rhashtable;
+	struct delayed_work		gc_work;
+};
+
+enum flow_offload_tuple_dir {
+	FLOW_OFFLOAD_DIR_ORIGINAL = IP_CT_DIR_ORIGINAL,
+	FLOW_OFFLOAD_DIR_REPLY = IP_CT_DIR_REPLY,
+	FLOW_OFFLOAD_DIR_MAX = IP_CT_DIR_MAX
+};
+
+struct flow_offload_tuple {
+	union {
+		struct in_addr		src_v4;
+		struct in6_addr		src_v6;
+	};
+	union {
+		struct in_addr		dst_v4;
+		struct in6_addr		dst_v6;
+	};
+	struct {
+		__be16			src_port;
+		__be16			dst_port;
+	};
+
+	int				iifidx;
+
+	u8				l3proto;
+	u8				l4proto;
+	/* All fields above are the lookup key. */
+	u8				dir;
+
+	u16				mtu;
+	int				oifidx;
+	u32				dst_cookie;
+
+	struct dst_entry		*dst_cache;
+};
+
+struct flow_offload_tuple_rhash {
+	struct rhash_head		node;
+	struct flow_offload_tuple	tuple;
+};
+
+#define FLOW_OFFLOAD_SNAT	0x1
+#define FLOW_OFFLOAD_DNAT	0x2
+#define FLOW_OFFLOAD_TEARDOWN	0x4
+
+struct flow_offload {
+	struct flow_offload_tuple_rhash	tuplehash[FLOW_OFFLOAD_DIR_MAX];
+	struct nf_conn			*ct;
+	u32				flags;
+	u32				timeout;
+	struct rcu_head			rcu_head;
+};
+
+/* Idle time after which a flow is handed back to conntrack */
+#define NF_FLOW_TIMEOUT (30 * HZ)
+
+struct nf_flow_route {
+	struct {
+		struct dst_entry	*dst;
+		int			ifindex;
+	} tuple[FLOW_OFFLOAD_DIR_MAX];
+};
+
+struct flow_offload *flow_offload_alloc(struct nf_conn *ct,
+					struct nf_flow_route *route);
+void flow_offload_free(struct flow_offload *flow);
+
+int flow_offload_add(struct nf_flowtable *flow_table, struct flow_offload *flow);
+struct flow_offload_tuple_rhash *flow_offload_lookup(struct nf_flowtable *flow_table,
+						     struct flow_offload_tuple *tuple);
+void flow_offload_teardown(struct flow_offload *flow);
+
+int nf_flow_table_init(struct nf_flowtable *flow_table);
+void nf_flow_table_free(struct nf_flowtable *flow_table);
+void nf_flow_table_cleanup(struct nf_flowtable *flow_table,
+			   struct net_device *dev);
+
+int nf_flow_snat_port(const struct flow_offload *flow,
+		      struct sk_buff *skb, unsigned int thoff,
+		      u8 protocol, enum flow_offload_tuple_dir dir);
+int nf_flow_dnat_port(const struct flow_offload *flow,
+		      struct sk_buff *skb, unsigned int thoff,
+		      u8 protocol, enum flow_offload_tuple_dir dir);
+
+struct flow_ports {
+	__be16 source, dest;
+};
+
+unsigned int nf_flow_offload_ip_hook(void *priv, struct sk_buff *skb,
+				     const struct nf_hook_state *state);
+unsigned int nf_flow_offload_ipv6_hook(void *priv, struct sk_buff *skb,
+				       const struct nf_hook_state *state);
+
+#endif /* _NF_FLOW_TABLE_H */
@@ -788,6 +788,25 @@ struct fuse_notify_retrieve_in {
 /* 127 is reserved for the V1 interface implementation in Android (deprecated) */
 /* 126 is reserved for the V2 interface implementation in Android */
 #define FUSE_DEV_IOC_PASSTHROUGH_OPEN	_IOW(FUSE_DEV_IOC_MAGIC, 126, __u32)
+#define FUSE_DEV_IOC_BIND_CPU		_IOW(FUSE_DEV_IOC_MAGIC, 125, __u32)
+#define FUSE_DEV_IOC_PASSTHROUGH_DIR	_IOW(FUSE_DEV_IOC_MAGIC, 124, \
+					     struct fuse_passthrough_dir)
+
+/*
+ * Approve metadata passthrough below directory @nodeid, served from the
+ * directory open at @fd, which is treated as the top of the storage of
+ * the Android user @uid belongs to.  Entries are owned by @uid, except
+ * for app directories below Android/, and grouped by @gid of that user;
+ * owner and mode are derived like sdcardfs with the bits in @mask
+ * removed.  A negative @fd revokes the approval.
+ */
+struct fuse_passthrough_dir {
+	uint64_t	nodeid;
+	int32_t		fd;
+	uint32_t	uid;
+	uint32_t	gid;
+	uint32_t	mask;
+};
 
 struct fuse_lseek_in {
 	uint64_t	fh;
@@ -279,6 +279,8 @@ enum
 	LINUX_MIB_TCPMTUPFAIL,			/* TCPMTUPFail */
 	LINUX_MIB_TCPMTUPSUCCESS,		/* TCPMTUPSuccess */
 	LINUX_MIB_TCPWQUEUETOOBIG,		/* TCPWqueueTooBig */
+	LINUX_MIB_TCPZEROCOPYRX,		/* TCPZeroCopyRx */
+	LINUX_MIB_TCPZEROCOPYRXCOPIED,		/* TCPZeroCopyRxCopied */
 	__LINUX_MIB_MAX
 };
 
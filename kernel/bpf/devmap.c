@@ -29,6 +29,11 @@
  * until all bits are cleared indicating outstanding flush operations have
  * completed.
  *
+ * Generic XDP has no driver side queue to defer to, so redirected skbs are
+ * parked in a small per-cpu bulk queue of the bpf_dtab_netdev instead and
+ * handed to the device together by the same flush operation. Skbs still
+ * queued when an entry is removed are dropped when it is freed.
+ *
  * BPF syscalls may race with BPF program calls on any of the update, delete
  * or lookup operations. As noted above the xchg() operation also keep the
  * netdev_map consistent in this case. From the devmap side BPF programs
@@ -49,14 +54,23 @@
  */
 #include <linux/bpf.h>
 #include <linux/filter.h>
+#include <linux/netdevice.h>
 
 #define DEV_CREATE_FLAG_MASK \
 	(BPF_F_NUMA_NODE | BPF_F_RDONLY | BPF_F_WRONLY)
 
+#define DEV_MAP_BULK_SIZE 16
+
+struct xdp_bulk_queue {
+	struct sk_buff *q[DEV_MAP_BULK_SIZE];
+	unsigned int count;
+};
+
 struct bpf_dtab_netdev {
 	struct net_device *dev;
 	struct bpf_dtab *dtab;
 	unsigned int bit;
+	struct xdp_bulk_queue __percpu *bulkq;
 	struct rcu_head rcu;
 };
 
@@ -104,6 +118,8 @@ static struct bpf_map *dev_map_alloc(union bpf_attr *attr)
 	/* make sure page count doesn't overflow */
 	cost = (u64) dtab->map.max_entries * sizeof(struct bpf_dtab_netdev *);
 	cost += dev_map_bitmap_size(attr) * num_possible_cpus();
+	cost += (u64) dtab->map.max_entries * sizeof(struct xdp_bulk_queue) *
+		num_possible_cpus();
 	if (cost >= U32_MAX - PAGE_SIZE)
 		goto free_dtab;
 
@@ -140,6 +156,26 @@ free_dtab:
 	return ERR_PTR(err);
 }
 
+static void bq_drop_all(struct xdp_bulk_queue *bq)
+{
+	unsigned int i;
+
+	for (i = 0; i < bq->count; i++)
+		kfree_skb(bq->q[i]);
+	bq->count = 0;
+}
+
+static void dev_map_free_entry(struct bpf_dtab_netdev *dev)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		bq_drop_all(per_cpu_ptr(dev->bulkq, cpu));
+	free_percpu(dev->bulkq);
+	dev_put(dev->dev);
+	kfree(dev);
+}
+
 static void dev_map_free(struct bpf_map *map)
 {
 	struct bpf_dtab *dtab = container_of(map, struct bpf_dtab, map);
@@ -181,8 +217,7 @@ static void dev_map_free(struct bpf_map *map)
 		if (!dev)
 			continue;
 
-		dev_put(dev->dev);
-		kfree(dev);
+		dev_map_free_entry(dev);
 	}
 
 	free_percpu(dtab->flush_needed);
@@ -215,12 +250,20 @@ void __dev_map_insert_ctx(struct bpf_map *map, u32 bit)
 	__set_bit(bit, bitmap);
 }
 
+static void bq_xmit_all(struct bpf_dtab_netdev *dev,
+			struct xdp_bulk_queue *bq)
+{
+	generic_xdp_tx_bulk(dev->dev, bq->q, bq->count);
+	bq->count = 0;
+}
+
 /* __dev_map_flush is called from xdp_do_flush_map() which _must_ be signaled
  * from the driver before returning from its napi->poll() routine. The poll()
  * routine is called either from busy_poll context or net_rx_action signaled
  * from NET_RX_SOFTIRQ. Either way the poll routine must complete before the
  * net device can be torn down. On devmap tear down we ensure the ctx bitmap
  * is zeroed before completing to ensure all flush operations have completed.
+ * Generic XDP relies on net_rx_action() doing the flush for it.
  */
 void __dev_map_flush(struct bpf_map *map)
 {
@@ -228,8 +271,10 @@ void __dev_map_flush(struct bpf_map *map)
 	unsigned long *bitmap = this_cpu_ptr(dtab->flush_needed);
 	u32 bit;
 
+	rcu_read_lock();
 	for_each_set_bit(bit, bitmap, map->max_entries) {
 		struct bpf_dtab_netdev *dev = READ_ONCE(dtab->netdev_map[bit]);
+		struct xdp_bulk_queue *bq;
 		struct net_device *netdev;
 
 		/* This is possible if the dev entry is removed by user space
@@ -239,10 +284,44 @@ void __dev_map_flush(struct bpf_map *map)
 			continue;
 
 		__clear_bit(bit, bitmap);
+		bq = this_cpu_ptr(dev->bulkq);
+		if (bq->count)
+			bq_xmit_all(dev, bq);
+
 		netdev = dev->dev;
-		if (likely(netdev->netdev_ops->ndo_xdp_flush))
+		if (netdev->netdev_ops->ndo_xdp_flush)
 			netdev->netdev_ops->ndo_xdp_flush(netdev);
 	}
+	rcu_read_unlock();
+}
+
+/* Queue a generic XDP skb for the device at @key. Must run in softirq
+ * context and not in a hardirq nested in it, which serializes it against
+ * __dev_map_flush() and the tx locks bq_xmit_all() takes on this cpu, and
+ * under the same rcu_read_lock() as the program that picked @key; the
+ * caller has already validated the device and set skb->dev, so an entry
+ * replaced in between is treated as a failed redirect.
+ */
+int dev_map_generic_redirect(struct bpf_map *map, u32 key, struct sk_buff *skb)
+{
+	struct bpf_dtab *dtab = container_of(map, struct bpf_dtab, map);
+	struct bpf_dtab_netdev *dev;
+	struct xdp_bulk_queue *bq;
+
+	if (key >= map->max_entries)
+		return -EINVAL;
+
+	dev = READ_ONCE(dtab->netdev_map[key]);
+	if (unlikely(!dev || dev->dev != skb->dev))
+		return -EINVAL;
+
+	bq = this_cpu_ptr(dev->bulkq);
+	if (unlikely(bq->count == DEV_MAP_BULK_SIZE))
+		bq_xmit_all(dev, bq);
+
+	bq->q[bq->count++] = skb;
+	__dev_map_insert_ctx(map, key);
+	return 0;
 }
 
 /* rcu_read_lock (from syscall and BPF contexts) ensures that if a delete and/or
@@ -268,19 +347,22 @@ static void *dev_map_lookup_elem(struct bpf_map *map, void *key)
 	return dev ? &dev->ifindex : NULL;
 }
 
+/* Generic XDP sets flush bits for devices without ndo_xdp_flush as well,
+ * so the bits are cleared unconditionally or dev_map_free() would wait on
+ * them forever.
+ */
 static void dev_map_flush_old(struct bpf_dtab_netdev *dev)
 {
-	if (dev->dev->netdev_ops->ndo_xdp_flush) {
-		struct net_device *fl = dev->dev;
-		unsigned long *bitmap;
-		int cpu;
+	struct net_device *fl = dev->dev;
+	unsigned long *bitmap;
+	int cpu;
 
-		for_each_online_cpu(cpu) {
-			bitmap = per_cpu_ptr(dev->dtab->flush_needed, cpu);
-			__clear_bit(dev->bit, bitmap);
+	for_each_online_cpu(cpu) {
+		bitmap = per_cpu_ptr(dev->dtab->flush_needed, cpu);
+		__clear_bit(dev->bit, bitmap);
 
+		if (fl->netdev_ops->ndo_xdp_flush)
 			fl->netdev_ops->ndo_xdp_flush(dev->dev);
-		}
 	}
 }
 
@@ -290,8 +372,7 @@ static void __dev_map_entry_free(struct rcu_head *rcu)
 
 	dev = container_of(rcu, struct bpf_dtab_netdev, rcu);
 	dev_map_flush_old(dev);
-	dev_put(dev->dev);
-	kfree(dev);
+	dev_map_free_entry(dev);
 }
 
 static int dev_map_delete_elem(struct bpf_map *map, void *key)
@@ -341,8 +422,17 @@ static int dev_map_update_elem(struct bpf_map *map, void *key, void *value,
 		if (!dev)
 			return -ENOMEM;
 
+		dev->bulkq = __alloc_percpu_gfp(sizeof(*dev->bulkq),
+						sizeof(void *),
+						GFP_ATOMIC | __GFP_NOWARN);
+		if (!dev->bulkq) {
+			kfree(dev);
+			return -ENOMEM;
+		}
+
 		dev->dev = dev_get_by_index(net, ifindex);
 		if (!dev->dev) {
+			free_percpu(dev->bulkq);
 			kfree(dev);
 			return -EINVAL;
 		}
@@ -38,6 +38,7 @@
 #include <linux/moduleparam.h>
 #include <linux/delay.h>
 #include <linux/slab.h>
+#include <linux/sched/clock.h>
 #include <linux/percpu-rwsem.h>
 #include <linux/torture.h>
 
@@ -54,6 +55,8 @@ torture_param(int, onoff_interval, 0,
 torture_param(int, shuffle_interval, 3,
 	     "Number of jiffies between shuffles, 0=disable");
 torture_param(int, shutdown_secs, 0, "Shutdown time (j), <= zero to disable.");
+torture_param(bool, short_hold, false,
+	     "Hold rwsem_lock for microseconds rather than milliseconds");
 torture_param(int, stat_interval, 60,
 	     "Number of seconds between stats printk()s");
 torture_param(int, stutter, 5, "Number of jiffies to run/halt test, 0=disable");
@@ -72,9 +75,14 @@ static struct task_struct **reader_tasks;
 static bool lock_is_write_held;
 static bool lock_is_read_held;
 
+/* Acquisition latency histogram, bucket n counts latencies below 2^n ns. */
+#define LOCK_LAT_BUCKETS	32
+
 struct lock_stress_stats {
 	long n_lock_fail;
 	long n_lock_acquired;
+	u64 lat_max;
+	long lat_hist[LOCK_LAT_BUCKETS];
 };
 
 int torture_runnable = IS_ENABLED(MODULE);
@@ -541,6 +549,18 @@ static void torture_rwsem_write_delay(struct torture_random_state *trsp)
 {
 	const unsigned long longdelay_ms = 100;
 
+	/*
+	 * mmap_sem-like pattern: short writers, with an occasional long
+	 * one standing in for a large munmap().
+	 */
+	if (short_hold) {
+		if (!(torture_random(trsp) % (cxt.nrealwriters_stress * 100)))
+			udelay(200);
+		else
+			udelay(5);
+		return;
+	}
+
 	/* We want a long delay occasionally to force massive contention.  */
 	if (!(torture_random(trsp) %
 	      (cxt.nrealwriters_stress * 2000 * longdelay_ms)))
@@ -568,6 +588,12 @@ static void torture_rwsem_read_delay(struct torture_random_state *trsp)
 {
 	const unsigned long longdelay_ms = 100;
 
+	/* A page fault holds mmap_sem for read for a few microseconds. */
+	if (short_hold) {
+		udelay(2);
+		return;
+	}
+
 	/* We want a long delay occasionally to force massive contention.  */
 	if (!(torture_random(trsp) %
 	      (cxt.nrealwriters_stress * 2000 * longdelay_ms)))
@@ -638,6 +664,18 @@ static struct lock_torture_ops percpu_rwsem_lock_ops = {
 	.name		= "percpu_rwsem_lock"
 };
 
+/*
+ * Account the time taken to acquire the lock since @start.
+ */
+static void lock_torture_record_lat(struct lock_stress_stats *statp, u64 start)
+{
+	u64 lat = local_clock() - start;
+
+	statp->lat_hist[min(fls64(lat), LOCK_LAT_BUCKETS - 1)]++;
+	if (statp->lat_max < lat)
+		statp->lat_max = lat;
+}
+
 /*
  * Lock torture writer kthread.  Repeatedly acquires and releases
  * the lock, checking for duplicate acquisitions.
@@ -646,6 +684,7 @@ static int lock_torture_writer(void *arg)
 {
 	struct lock_stress_stats *lwsp = arg;
 	static DEFINE_TORTURE_RANDOM(rand);
+	u64 start;
 
 	VERBOSE_TOROUT_STRING("lock_torture_writer task started");
 	set_user_nice(current, MAX_NICE);
@@ -655,7 +694,9 @@ static int lock_torture_writer(void *arg)
 			schedule_timeout_uninterruptible(1);
 
 		cxt.cur_ops->task_boost(&rand);
+		start = local_clock();
 		cxt.cur_ops->writelock();
+		lock_torture_record_lat(lwsp, start);
 		if (WARN_ON_ONCE(lock_is_write_held))
 			lwsp->n_lock_fail++;
 		lock_is_write_held = 1;
@@ -683,6 +724,7 @@ static int lock_torture_reader(void *arg)
 {
 	struct lock_stress_stats *lrsp = arg;
 	static DEFINE_TORTURE_RANDOM(rand);
+	u64 start;
 
 	VERBOSE_TOROUT_STRING("lock_torture_reader task started");
 	set_user_nice(current, MAX_NICE);
@@ -691,7 +733,9 @@ static int lock_torture_reader(void *arg)
 		if ((torture_random(&rand) & 0xfffff) == 0)
 			schedule_timeout_uninterruptible(1);
 
+		start = local_clock();
 		cxt.cur_ops->readlock();
+		lock_torture_record_lat(lrsp, start);
 		lock_is_read_held = 1;
 		if (WARN_ON_ONCE(lock_is_write_held))
 			lrsp->n_lock_fail++; /* rare, but... */
@@ -714,9 +758,12 @@ static void __torture_print_stats(char *page,
 				  struct lock_stress_stats *statp, bool write)
 {
 	bool fail = 0;
-	int i, n_stress;
+	int b, i, n_stress;
 	long max = 0, min = statp ? statp[0].n_lock_acquired : 0;
-	long long sum = 0;
+	long long sum = 0, below = 0;
+	long hist[LOCK_LAT_BUCKETS] = { 0 };
+	int p50 = 0, p99 = 0, p999 = 0;
+	u64 lat_max = 0;
 
 	n_stress = write ? cxt.nrealwriters_stress : cxt.nrealreaders_stress;
 	for (i = 0; i < n_stress; i++) {
@@ -727,12 +774,31 @@ static void __torture_print_stats(char *page,
 			max = statp[i].n_lock_acquired;
 		if (min > statp[i].n_lock_acquired)
 			min = statp[i].n_lock_acquired;
+		if (lat_max < statp[i].lat_max)
+			lat_max = statp[i].lat_max;
+		for (b = 0; b < LOCK_LAT_BUCKETS; b++)
+			hist[b] += statp[i].lat_hist[b];
+	}
+
+	/* Percentiles are reported as the power-of-two bound of their bucket. */
+	for (b = 0; b < LOCK_LAT_BUCKETS; b++) {
+		below += hist[b];
+		if (!p50 && below * 2 >= sum)
+			p50 = b;
+		if (!p99 && below * 100 >= sum * 99)
+			p99 = b;
+		if (!p999 && below * 1000 >= sum * 999)
+			p999 = b;
 	}
 	page += sprintf(page,
 			"%s:  Total: %lld  Max/Min: %ld/%ld %s  Fail: %d %s\n",
 			write ? "Writes" : "Reads ",
 			sum, max, min, max / 2 > min ? "???" : "",
 			fail, fail ? "!!!" : "");
+	page += sprintf(page,
+			"%s:  Latency p50/p99/p99.9 < %llu/%llu/%llu ns  Max: %llu ns\n",
+			write ? "Writes" : "Reads ",
+			1ULL << p50, 1ULL << p99, 1ULL << p999, lat_max);
 	if (fail)
 		atomic_inc(&cxt.n_lock_torture_errors);
 }
@@ -802,11 +868,11 @@ lock_torture_print_module_parms(struct lock_torture_ops *cur_ops,
 				const char *tag)
 {
 	pr_alert("%s" TORTURE_FLAG
-		 "--- %s%s: nwriters_stress=%d nreaders_stress=%d stat_interval=%d verbose=%d shuffle_interval=%d stutter=%d shutdown_secs=%d onoff_interval=%d onoff_holdoff=%d\n",
+		 "--- %s%s: nwriters_stress=%d nreaders_stress=%d stat_interval=%d verbose=%d shuffle_interval=%d stutter=%d shutdown_secs=%d onoff_interval=%d onoff_holdoff=%d short_hold=%d\n",
 		 torture_type, tag, cxt.debug_lock ? " [debug]": "",
 		 cxt.nrealwriters_stress, cxt.nrealreaders_stress, stat_interval,
 		 verbose, shuffle_interval, stutter, shutdown_secs,
-		 onoff_interval, onoff_holdoff);
+		 onoff_interval, onoff_holdoff, short_hold);
 }
 
 static void lock_torture_cleanup(void)
@@ -939,6 +1005,9 @@ static int __init lock_torture_init(void)
 		for (i = 0; i < cxt.nrealwriters_stress; i++) {
 			cxt.lwsa[i].n_lock_fail = 0;
 			cxt.lwsa[i].n_lock_acquired = 0;
+			cxt.lwsa[i].lat_max = 0;
+			memset(cxt.lwsa[i].lat_hist, 0,
+			       sizeof(cxt.lwsa[i].lat_hist));
 		}
 	}
 
@@ -970,6 +1039,9 @@ static int __init lock_torture_init(void)
 			for (i = 0; i < cxt.nrealreaders_stress; i++) {
 				cxt.lrsa[i].n_lock_fail = 0;
 				cxt.lrsa[i].n_lock_acquired = 0;
+				cxt.lrsa[i].lat_max = 0;
+				memset(cxt.lrsa[i].lat_hist, 0,
+				       sizeof(cxt.lrsa[i].lat_hist));
 			}
 		}
 	}
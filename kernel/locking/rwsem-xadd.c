@@ -9,6 +9,9 @@
  *
  * Optimistic spinning by Tim Chen <tim.c.chen@intel.com>
  * and Davidlohr Bueso <davidlohr@hp.com>. Based on mutexes.
+ *
+ * Reader optimistic spinning and writer handoff based on the work of
+ * Waiman Long <longman@redhat.com>.
  */
 #include <linux/rwsem.h>
 #include <linux/init.h>
@@ -21,6 +24,7 @@
 #include <linux/sec_debug.h>
 
 #include "rwsem.h"
+#include "lock_events.h"
 
 /*
  * Guide to the rw_semaphore's count field for common values.
@@ -69,8 +73,22 @@
  *	 are only waiters but none active (5th case above), and attempt to
  *	 steal the lock.
  *
+ * Note: A reader that fails the fastpath because a writer holds the lock
+ *	 keeps its ACTIVE_BIAS while it spins on a running writer owner, so
+ *	 it owns the lock as soon as the count turns positive again.
+ *
+ *	 Lock stealing can starve the writer at the head of the queue. Once
+ *	 it has waited for RWSEM_WAIT_TIMEOUT, it sets sem->handoff, and
+ *	 from then on neither spinning nor other queued writers may take
+ *	 the lock while it is free, so it goes to the head waiter.
  */
 
+/*
+ * Minimum time a writer at the head of the queue waits before it asks
+ * for the lock to be handed off to it (4ms, rounded up to a jiffy).
+ */
+#define RWSEM_WAIT_TIMEOUT	DIV_ROUND_UP(HZ, 250)
+
 /*
  * Initialize an rwsem:
  */
@@ -94,6 +112,7 @@ void __init_rwsem(struct rw_semaphore *sem, const char *name,
 #ifdef CONFIG_RWSEM_PRIO_AWARE
 	sem->m_count = 0;
 #endif
+	sem->handoff = 0;
 #ifdef CONFIG_FAST_TRACK
 	sem->ftt_dep_task = NULL;
 #endif
@@ -144,6 +163,7 @@ static void __rwsem_mark_wake(struct rw_semaphore *sem,
 			 * will notice the queued writer.
 			 */
 			wake_q_add(wake_q, waiter->task);
+			lockevent_inc(rwsem_wake_writer);
 		}
 
 		return;
@@ -235,9 +255,12 @@ static void __rwsem_mark_wake(struct rw_semaphore *sem,
 		wake_q_add(wake_q, tsk);
 		/* wake_q_add() already take the task ref */
 		put_task_struct(tsk);
+		lockevent_inc(rwsem_wake_reader);
 	}
 }
 
+static bool rwsem_optimistic_spin_read(struct rw_semaphore *sem);
+
 /*
  * Wait for the read lock to be granted
  */
@@ -249,6 +272,12 @@ __rwsem_down_read_failed_common(struct rw_semaphore *sem, int state)
 	DEFINE_WAKE_Q(wake_q);
 	bool is_first_waiter = false;
 
+	/* wait for a running writer to release the lock */
+	if (rwsem_optimistic_spin_read(sem)) {
+		lockevent_inc(rwsem_opt_rlock);
+		return sem;
+	}
+
 	waiter.task = current;
 	waiter.type = RWSEM_WAITING_FOR_READ;
 
@@ -295,16 +324,19 @@ __rwsem_down_read_failed_common(struct rw_semaphore *sem, int state)
 			break;
 		}
 		schedule();
+		lockevent_inc(rwsem_sleep_reader);
 	}
 
 	__set_current_state(TASK_RUNNING);
 	sec_debug_wtsk_clear_data();
+	lockevent_inc(rwsem_rlock);
 	return sem;
 out_nolock:
 	list_del(&waiter.list);
 	if (list_empty(&sem->wait_list))
 		atomic_long_add(-RWSEM_WAITING_BIAS, &sem->count);
 	raw_spin_unlock_irq(&sem->wait_lock);
+	lockevent_inc(rwsem_rlock_fail);
 	__set_current_state(TASK_RUNNING);
 	sec_debug_wtsk_clear_data();
 	return ERR_PTR(-EINTR);
@@ -324,12 +356,20 @@ rwsem_down_read_failed_killable(struct rw_semaphore *sem)
 }
 EXPORT_SYMBOL(rwsem_down_read_failed_killable);
 
+static inline bool rwsem_first_waiter(struct rw_semaphore *sem,
+				      struct rwsem_waiter *waiter)
+{
+	return list_first_entry(&sem->wait_list, struct rwsem_waiter,
+				list) == waiter;
+}
+
 /*
  * This function must be called with the sem->wait_lock held to prevent
  * race conditions between checking the rwsem wait list and setting the
  * sem->count accordingly.
  */
-static inline bool rwsem_try_write_lock(long count, struct rw_semaphore *sem)
+static inline bool rwsem_try_write_lock(long count, struct rw_semaphore *sem,
+					struct rwsem_waiter *waiter)
 {
 	/*
 	 * Avoid trying to acquire write lock if count isn't RWSEM_WAITING_BIAS.
@@ -337,6 +377,10 @@ static inline bool rwsem_try_write_lock(long count, struct rw_semaphore *sem)
 	if (count != RWSEM_WAITING_BIAS)
 		return false;
 
+	/* a handed off lock may only be taken by the first waiter */
+	if (sem->handoff && !rwsem_first_waiter(sem, waiter))
+		return false;
+
 	/*
 	 * Acquire the lock by trying to set it to ACTIVE_WRITE_BIAS. If there
 	 * are other tasks on the wait list, we need to add on WAITING_BIAS.
@@ -366,6 +410,10 @@ static inline bool rwsem_try_write_lock_unqueued(struct rw_semaphore *sem)
 		if (!(count == 0 || count == RWSEM_WAITING_BIAS))
 			return false;
 
+		/* don't steal a lock handed off to the first waiter */
+		if (count == RWSEM_WAITING_BIAS && READ_ONCE(sem->handoff))
+			return false;
+
 		old = atomic_long_cmpxchg_acquire(&sem->count, count,
 				      count + RWSEM_ACTIVE_WRITE_BIAS);
 		if (old == count) {
@@ -384,7 +432,7 @@ static inline bool rwsem_can_spin_on_owner(struct rw_semaphore *sem)
 
 	BUILD_BUG_ON(!rwsem_has_anonymous_owner(RWSEM_OWNER_UNKNOWN));
 
-	if (need_resched())
+	if (need_resched() || READ_ONCE(sem->handoff))
 		return false;
 
 	rcu_read_lock();
@@ -478,6 +526,10 @@ static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
 			break;
 		}
 
+		/* the lock goes to a starved waiter, stop spinning */
+		if (READ_ONCE(sem->handoff))
+			break;
+
 		/*
 		 * When there's no owner, we might have preempted between the
 		 * owner acquiring the lock and setting the owner field. If
@@ -496,6 +548,43 @@ static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
 		cpu_relax();
 	}
 	osq_unlock(&sem->osq);
+	lockevent_cond_inc(rwsem_opt_fail, !taken);
+done:
+	preempt_enable();
+	return taken;
+}
+
+/*
+ * Spin for the read lock while a running writer owns it.
+ *
+ * The reader's ACTIVE_BIAS from the fastpath stays in the count while
+ * it spins, so when the writer releases the lock with no one queued the
+ * count turns positive and the reader holds the lock already. Readers
+ * don't queue on the osq: they don't compete with each other, and all
+ * of them get the lock at once. If waiters are queued, the reader goes
+ * to the slowpath as before, keeping the queue order.
+ */
+static bool rwsem_optimistic_spin_read(struct rw_semaphore *sem)
+{
+	bool taken = false;
+
+	preempt_disable();
+
+	if (!rwsem_can_spin_on_owner(sem))
+		goto done;
+
+	while (rwsem_spin_on_owner(sem)) {
+		if (atomic_long_read_acquire(&sem->count) > 0) {
+			taken = true;
+			break;
+		}
+		cpu_relax();
+	}
+
+	/* the writer may have handed the lock over to readers */
+	if (!taken && atomic_long_read_acquire(&sem->count) > 0)
+		taken = true;
+	lockevent_cond_inc(rwsem_opt_fail, !taken);
 done:
 	preempt_enable();
 	return taken;
@@ -515,6 +604,11 @@ static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
 	return false;
 }
 
+static bool rwsem_optimistic_spin_read(struct rw_semaphore *sem)
+{
+	return false;
+}
+
 static inline bool rwsem_has_spinner(struct rw_semaphore *sem)
 {
 	return false;
@@ -533,13 +627,16 @@ __rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
 	struct rw_semaphore *ret = sem;
 	DEFINE_WAKE_Q(wake_q);
 	bool is_first_waiter = false;
+	bool handoff_set = false;
 
 	/* undo write bias from down_write operation, stop active locking */
 	count = atomic_long_sub_return(RWSEM_ACTIVE_WRITE_BIAS, &sem->count);
 
 	/* do optimistic spinning and steal lock if possible */
-	if (rwsem_optimistic_spin(sem))
+	if (rwsem_optimistic_spin(sem)) {
+		lockevent_inc(rwsem_opt_wlock);
 		return sem;
+	}
 
 	/*
 	 * Optimistic spinning failed, proceed to the slowpath
@@ -547,6 +644,7 @@ __rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
 	 */
 	waiter.task = current;
 	waiter.type = RWSEM_WAITING_FOR_WRITE;
+	waiter.timeout = jiffies + RWSEM_WAIT_TIMEOUT;
 
 	raw_spin_lock_irq(&sem->wait_lock);
 
@@ -597,16 +695,36 @@ __rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
 	sec_debug_wtsk_set_data(DTYPE_RWSEM, (void *)sem);
 	set_current_state(state);
 	while (true) {
-		if (rwsem_try_write_lock(count, sem))
+		if (rwsem_try_write_lock(count, sem, &waiter))
 			break;
+
+		if (sem->handoff && !handoff_set) {
+			/*
+			 * The lock is free but handed off to the first
+			 * waiter, which may have missed the wakeup to a
+			 * spinner that gave up. Make sure it runs.
+			 */
+			if (count == RWSEM_WAITING_BIAS)
+				__rwsem_mark_wake(sem, RWSEM_WAKE_ANY, &wake_q);
+		} else if (!handoff_set && rwsem_first_waiter(sem, &waiter) &&
+			   time_after(jiffies, waiter.timeout)) {
+			/* we waited long enough, stop lock stealing */
+			WRITE_ONCE(sem->handoff, 1);
+			handoff_set = true;
+			lockevent_inc(rwsem_wlock_handoff);
+		}
 		raw_spin_unlock_irq(&sem->wait_lock);
 
+		wake_up_q(&wake_q);
+		wake_q_init(&wake_q);
+
 		/* Block until there are no active lockers. */
 		do {
 			if (signal_pending_state(state, current))
 				goto out_nolock;
 
 			schedule();
+			lockevent_inc(rwsem_sleep_writer);
 			set_current_state(state);
 		} while ((count = atomic_long_read(&sem->count)) & RWSEM_ACTIVE_MASK);
 
@@ -615,7 +733,10 @@ __rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
 	__set_current_state(TASK_RUNNING);
 	sec_debug_wtsk_clear_data();
 	list_del(&waiter.list);
+	if (handoff_set)
+		WRITE_ONCE(sem->handoff, 0);
 	raw_spin_unlock_irq(&sem->wait_lock);
+	lockevent_inc(rwsem_wlock);
 
 	return ret;
 
@@ -624,6 +745,9 @@ out_nolock:
 	sec_debug_wtsk_clear_data();
 	raw_spin_lock_irq(&sem->wait_lock);
 	list_del(&waiter.list);
+	if (handoff_set)
+		WRITE_ONCE(sem->handoff, 0);
+	lockevent_inc(rwsem_wlock_fail);
 	if (list_empty(&sem->wait_list))
 		atomic_long_add(-RWSEM_WAITING_BIAS, &sem->count);
 	else
@@ -29,6 +29,7 @@ struct rwsem_waiter {
 	struct list_head list;
 	struct task_struct *task;
 	enum rwsem_waiter_type type;
+	unsigned long timeout;	/* writers: when to ask for a handoff */
 };
 
 #ifdef CONFIG_RWSEM_SPIN_ON_OWNER
@@ -115,6 +116,7 @@ static inline bool rwsem_list_add_per_prio(struct rwsem_waiter *waiter_in,
 	 *	list.
 	 *	If preempt count is exceed RWSEM_MAX_PREEMPT_ALLOWED,
 	 *	use simple fifo until wait list is empty.
+	 * 3:	Never queue ahead of a writer the lock is handed off to.
 	 */
 	if (list_empty(head)) {
 		list_add_tail(&waiter_in->list, head);
@@ -123,7 +125,8 @@ static inline bool rwsem_list_add_per_prio(struct rwsem_waiter *waiter_in,
 	}
 
 	if (waiter_in->task->prio < DEFAULT_PRIO
-		&& sem->m_count < RWSEM_MAX_PREEMPT_ALLOWED) {
+		&& sem->m_count < RWSEM_MAX_PREEMPT_ALLOWED
+		&& !sem->handoff) {
 
 		list_for_each(pos, head) {
 			waiter = list_entry(pos, struct rwsem_waiter, list);
@@ -6,6 +6,7 @@
 #include <linux/trace_events.h>
 #include <linux/ring_buffer.h>
 #include <linux/trace_clock.h>
+#include <linux/trace_mmap.h>
 #include <linux/sched/clock.h>
 #include <linux/trace_seq.h>
 #include <linux/spinlock.h>
@@ -22,7 +23,9 @@
 #include <linux/hash.h>
 #include <linux/list.h>
 #include <linux/cpu.h>
+#include <linux/mm.h>
 
+#include <asm/cacheflush.h>
 #include <asm/local.h>
 
 static void update_pages_handler(struct work_struct *work);
@@ -302,6 +305,7 @@ struct buffer_page {
 	unsigned	 read;		/* index for next read */
 	local_t		 entries;	/* entries on this page */
 	unsigned long	 real_end;	/* real end of data */
+	unsigned	 id;		/* ID for external mapping */
 	struct buffer_data_page *page;	/* Actual data page */
 };
 
@@ -469,6 +473,12 @@ struct ring_buffer_per_cpu {
 	struct completion		update_done;
 
 	struct rb_irq_work		irq_work;
+
+	/* user space mapping, see ring_buffer_map() */
+	struct mutex			mapping_lock;
+	unsigned long			*subbuf_ids;	/* ID to data page */
+	struct trace_buffer_meta	*meta_page;
+	unsigned int			mapped;
 };
 
 struct ring_buffer {
@@ -1223,6 +1233,7 @@ rb_allocate_cpu_buffer(struct ring_buffer *buffer, long nr_pages, int cpu)
 	init_irq_work(&cpu_buffer->irq_work.work, rb_wake_up_waiters);
 	init_waitqueue_head(&cpu_buffer->irq_work.waiters);
 	init_waitqueue_head(&cpu_buffer->irq_work.full_waiters);
+	mutex_init(&cpu_buffer->mapping_lock);
 
 	bpage = kzalloc_node(ALIGN(sizeof(*bpage), cache_line_size()),
 			    GFP_KERNEL, cpu_to_node(cpu));
@@ -1610,6 +1621,21 @@ static void update_pages_handler(struct work_struct *work)
 	complete(&cpu_buffer->update_done);
 }
 
+/* Mapped buffers can not change their pages under the user */
+static bool rb_buffer_mapped(struct ring_buffer *buffer, int cpu_id)
+{
+	int cpu;
+
+	if (cpu_id != RING_BUFFER_ALL_CPUS)
+		return buffer->buffers[cpu_id]->mapped;
+
+	for_each_buffer_cpu(buffer, cpu) {
+		if (buffer->buffers[cpu]->mapped)
+			return true;
+	}
+	return false;
+}
+
 /**
  * ring_buffer_resize - resize the ring buffer
  * @buffer: the buffer to resize.
@@ -1657,6 +1683,12 @@ int ring_buffer_resize(struct ring_buffer *buffer, unsigned long size,
 	/* prevent another thread from changing buffer sizes */
 	mutex_lock(&buffer->mutex);
 
+	/* mapped pages must stay where user space expects them */
+	if (rb_buffer_mapped(buffer, cpu_id)) {
+		mutex_unlock(&buffer->mutex);
+		return -EBUSY;
+	}
+
 	if (cpu_id == RING_BUFFER_ALL_CPUS) {
 		/* calculate the pages to update */
 		for_each_buffer_cpu(buffer, cpu) {
@@ -1839,10 +1871,13 @@ static __always_inline unsigned rb_page_commit(struct buffer_page *bpage)
 	return local_read(&bpage->page->commit);
 }
 
-/* Size is determined by what has been committed */
+/*
+ * Size is determined by what has been committed. A mapped reader page
+ * may carry the missed events flags, see ring_buffer_map_get_reader().
+ */
 static __always_inline unsigned rb_page_size(struct buffer_page *bpage)
 {
-	return rb_page_commit(bpage);
+	return rb_page_commit(bpage) & ~RB_MISSED_FLAGS;
 }
 
 static __always_inline unsigned
@@ -3020,7 +3055,7 @@ static bool rb_per_cpu_empty(struct ring_buffer_per_cpu *cpu_buffer)
 	if (unlikely(!head))
 		return true;
 
-	return reader->read == rb_page_commit(reader) &&
+	return reader->read == rb_page_size(reader) &&
 		(commit == reader ||
 		 (commit == head &&
 		  head->read == rb_page_commit(commit)));
@@ -3446,7 +3481,7 @@ int ring_buffer_iter_empty(struct ring_buffer_iter *iter)
 	return ((iter->head_page == commit_page && iter->head == commit) ||
 		(iter->head_page == reader && commit_page == head_page &&
 		 head_page->read == commit &&
-		 iter->head == rb_page_commit(cpu_buffer->reader_page)));
+		 iter->head == rb_page_size(cpu_buffer->reader_page)));
 }
 EXPORT_SYMBOL_GPL(ring_buffer_iter_empty);
 
@@ -3645,6 +3680,23 @@ rb_get_reader_page(struct ring_buffer_per_cpu *cpu_buffer)
 	return reader;
 }
 
+/* Must be called with the reader_lock held */
+static void rb_update_meta_page(struct ring_buffer_per_cpu *cpu_buffer)
+{
+	struct trace_buffer_meta *meta = cpu_buffer->meta_page;
+
+	meta->reader.read = cpu_buffer->reader_page->read;
+	meta->reader.id = cpu_buffer->reader_page->id;
+	meta->reader.lost_events = cpu_buffer->lost_events;
+
+	meta->entries = local_read(&cpu_buffer->entries);
+	meta->overrun = local_read(&cpu_buffer->overrun);
+	meta->read = cpu_buffer->read;
+
+	/* Some archs do not have data cache coherency between kernel and user-space */
+	flush_dcache_page(virt_to_page(cpu_buffer->reader_page->page));
+}
+
 static void rb_advance_reader(struct ring_buffer_per_cpu *cpu_buffer)
 {
 	struct ring_buffer_event *event;
@@ -4246,6 +4298,9 @@ void ring_buffer_reset_cpu(struct ring_buffer *buffer, int cpu)
 
 	arch_spin_unlock(&cpu_buffer->lock);
 
+	if (cpu_buffer->mapped)
+		rb_update_meta_page(cpu_buffer);
+
  out:
 	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
 
@@ -4351,6 +4406,10 @@ int ring_buffer_swap_cpu(struct ring_buffer *buffer_a,
 	if (cpu_buffer_a->nr_pages != cpu_buffer_b->nr_pages)
 		goto out;
 
+	ret = -EBUSY;
+	if (READ_ONCE(cpu_buffer_a->mapped) || READ_ONCE(cpu_buffer_b->mapped))
+		goto out;
+
 	ret = -EAGAIN;
 
 	if (atomic_read(&buffer_a->record_disabled))
@@ -4555,6 +4614,12 @@ int ring_buffer_read_page(struct ring_buffer *buffer,
 
 	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
 
+	/* swapping pages would pull them out from under the user mapping */
+	if (cpu_buffer->mapped) {
+		ret = -EBUSY;
+		goto out_unlock;
+	}
+
 	reader = rb_get_reader_page(cpu_buffer);
 	if (!reader)
 		goto out_unlock;
@@ -4684,6 +4749,330 @@ int ring_buffer_read_page(struct ring_buffer *buffer,
 }
 EXPORT_SYMBOL_GPL(ring_buffer_read_page);
 
+/*
+ * Give every sub-buffer, the reader page included, a stable ID that is
+ * also its index in the user mapping after the meta page. IDs follow the
+ * buffer_page through reader swaps, so user space only needs the ID of
+ * the current reader to find its data.
+ */
+static void rb_setup_ids_meta_page(struct ring_buffer_per_cpu *cpu_buffer,
+				   unsigned long *subbuf_ids)
+{
+	struct trace_buffer_meta *meta = cpu_buffer->meta_page;
+	unsigned int nr_subbufs = cpu_buffer->nr_pages + 1;
+	struct buffer_page *first_subbuf, *subbuf;
+	int id = 0;
+
+	subbuf_ids[id] = (unsigned long)cpu_buffer->reader_page->page;
+	cpu_buffer->reader_page->id = id++;
+
+	first_subbuf = subbuf = rb_set_head_page(cpu_buffer);
+	do {
+		if (RB_WARN_ON(cpu_buffer, id >= nr_subbufs))
+			break;
+
+		subbuf_ids[id] = (unsigned long)subbuf->page;
+		subbuf->id = id;
+
+		rb_inc_page(cpu_buffer, &subbuf);
+		id++;
+	} while (subbuf != first_subbuf);
+
+	cpu_buffer->subbuf_ids = subbuf_ids;
+
+	meta->meta_page_size = PAGE_SIZE;
+	meta->meta_struct_len = sizeof(*meta);
+	meta->nr_subbufs = nr_subbufs;
+	meta->subbuf_size = PAGE_SIZE;
+
+	rb_update_meta_page(cpu_buffer);
+}
+
+static int __rb_map_vma(struct ring_buffer_per_cpu *cpu_buffer,
+			struct vm_area_struct *vma)
+{
+	unsigned long nr_pages = cpu_buffer->nr_pages + 2;
+	unsigned long pgoff = vma->vm_pgoff;
+	unsigned long i;
+	int err;
+
+	if (vma->vm_flags & (VM_WRITE | VM_EXEC) ||
+	    !(vma->vm_flags & VM_MAYSHARE))
+		return -EPERM;
+
+	if (!vma_pages(vma) || pgoff >= nr_pages ||
+	    vma_pages(vma) > nr_pages - pgoff)
+		return -EINVAL;
+
+	vma->vm_flags |= VM_DONTCOPY | VM_DONTEXPAND | VM_DONTDUMP;
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	for (i = 0; i < vma_pages(vma); i++, pgoff++) {
+		void *addr;
+
+		if (!pgoff)
+			addr = cpu_buffer->meta_page;
+		else
+			addr = (void *)cpu_buffer->subbuf_ids[pgoff - 1];
+
+		err = vm_insert_page(vma, vma->vm_start + i * PAGE_SIZE,
+				     virt_to_page(addr));
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+/**
+ * ring_buffer_map - map a per cpu buffer into user space
+ * @buffer: the buffer to map
+ * @cpu: the cpu buffer to map
+ * @vma: the read-only, shared vma to fill
+ *
+ * The meta page (struct trace_buffer_meta) goes at page offset 0 and
+ * the sub-buffers follow in ID order. While a cpu buffer is mapped it
+ * can not be resized, swapped or read with ring_buffer_read_page(), as
+ * all of those move data pages around. Consumers hand out new data with
+ * ring_buffer_map_get_reader() and read it in place.
+ *
+ * Returns 0 on success, a negative errno otherwise.
+ */
+int ring_buffer_map(struct ring_buffer *buffer, int cpu,
+		    struct vm_area_struct *vma)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	unsigned long flags, *subbuf_ids;
+	int err = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&cpu_buffer->mapping_lock);
+
+	if (cpu_buffer->mapped) {
+		err = __rb_map_vma(cpu_buffer, vma);
+		if (!err)
+			cpu_buffer->mapped++;
+		mutex_unlock(&cpu_buffer->mapping_lock);
+		return err;
+	}
+
+	/* prevent another thread from changing buffer sizes */
+	mutex_lock(&buffer->mutex);
+
+	cpu_buffer->meta_page = (void *)get_zeroed_page(GFP_KERNEL);
+	if (!cpu_buffer->meta_page) {
+		err = -ENOMEM;
+		goto unlock;
+	}
+
+	subbuf_ids = kcalloc(cpu_buffer->nr_pages + 1, sizeof(*subbuf_ids),
+			     GFP_KERNEL);
+	if (!subbuf_ids) {
+		err = -ENOMEM;
+		goto free_meta;
+	}
+
+	/* Lock all readers to block any page swap until the mapping is done */
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	rb_setup_ids_meta_page(cpu_buffer, subbuf_ids);
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	err = __rb_map_vma(cpu_buffer, vma);
+	if (err) {
+		cpu_buffer->subbuf_ids = NULL;
+		kfree(subbuf_ids);
+		goto free_meta;
+	}
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	cpu_buffer->mapped = 1;
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	goto unlock;
+
+ free_meta:
+	free_page((unsigned long)cpu_buffer->meta_page);
+	cpu_buffer->meta_page = NULL;
+ unlock:
+	mutex_unlock(&buffer->mutex);
+	mutex_unlock(&cpu_buffer->mapping_lock);
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map);
+
+/**
+ * ring_buffer_map_dup - account for a copy of an existing mapping
+ * @buffer: the mapped buffer
+ * @cpu: the mapped cpu buffer
+ *
+ * For vm_operations_struct::open, when an already mapped vma is split
+ * or moved. Each call is balanced by ring_buffer_unmap().
+ */
+void ring_buffer_map_dup(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&cpu_buffer->mapping_lock);
+	if (!WARN_ON(!cpu_buffer->mapped))
+		cpu_buffer->mapped++;
+	mutex_unlock(&cpu_buffer->mapping_lock);
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map_dup);
+
+/**
+ * ring_buffer_unmap - drop a user space mapping of a per cpu buffer
+ * @buffer: the mapped buffer
+ * @cpu: the mapped cpu buffer
+ *
+ * The meta page is freed once the last mapping goes away. The data
+ * pages stay with the ring buffer; vm_insert_page() holds its own
+ * reference on them for as long as they are mapped.
+ */
+int ring_buffer_unmap(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	unsigned long flags;
+	int err = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&cpu_buffer->mapping_lock);
+
+	if (!cpu_buffer->mapped) {
+		err = -ENODEV;
+		goto out;
+	} else if (cpu_buffer->mapped > 1) {
+		cpu_buffer->mapped--;
+		goto out;
+	}
+
+	mutex_lock(&buffer->mutex);
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	cpu_buffer->mapped = 0;
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	kfree(cpu_buffer->subbuf_ids);
+	cpu_buffer->subbuf_ids = NULL;
+	free_page((unsigned long)cpu_buffer->meta_page);
+	cpu_buffer->meta_page = NULL;
+
+	mutex_unlock(&buffer->mutex);
+ out:
+	mutex_unlock(&cpu_buffer->mapping_lock);
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_unmap);
+
+/**
+ * ring_buffer_map_get_reader - hand out new data to a mapped consumer
+ * @buffer: the mapped buffer
+ * @cpu: the mapped cpu buffer
+ *
+ * If the writer added events to the current reader page since the last
+ * call, those are handed out. Otherwise the reader page is swapped with
+ * the next page of the ring, exactly as a consuming read would, and its
+ * content is handed out. Either way the meta page describes the result:
+ * the data sits in sub-buffer reader.id between reader.read and the
+ * page's commit. Nothing is copied.
+ *
+ * Returns 0 on success, -ENODEV if the cpu buffer is not mapped.
+ */
+int ring_buffer_map_get_reader(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	unsigned long missed_events = 0;
+	struct buffer_page *reader;
+	unsigned long flags;
+	unsigned int start;
+	int err = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&cpu_buffer->mapping_lock);
+
+	if (!cpu_buffer->mapped) {
+		err = -ENODEV;
+		goto out;
+	}
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+
+	reader = cpu_buffer->reader_page;
+	if (reader->read >= rb_page_size(reader)) {
+		/* the user is done with this page, move on to the next */
+		reader = rb_get_reader_page(cpu_buffer);
+		if (!reader) {
+			/* nothing new, hand out an empty range */
+			reader = cpu_buffer->reader_page;
+			goto update;
+		}
+
+		if (reader != cpu_buffer->commit_page)
+			missed_events = cpu_buffer->lost_events;
+	}
+
+	/* everything up to the current commit now belongs to the user */
+	start = reader->read;
+	while (reader->read < rb_page_size(reader))
+		rb_advance_reader(cpu_buffer);
+	cpu_buffer->lost_events = 0;
+
+	/*
+	 * Flag the lost events only once the page is consumed: the flags
+	 * live in the commit field, which the reader no longer looks at.
+	 */
+	if (missed_events) {
+		struct buffer_data_page *bpage = reader->page;
+		unsigned int commit;
+
+		/*
+		 * Use the real_end for the data size, so there may be room
+		 * to store the lost events on the page, the same way
+		 * ring_buffer_read_page() does.
+		 */
+		if (reader->real_end)
+			local_set(&bpage->commit, reader->real_end);
+
+		commit = rb_page_size(reader);
+		if (BUF_PAGE_SIZE - commit >= sizeof(missed_events)) {
+			memcpy(&bpage->data[commit], &missed_events,
+			       sizeof(missed_events));
+			local_add(RB_MISSED_STORED, &bpage->commit);
+		}
+		local_add(RB_MISSED_EVENTS, &bpage->commit);
+		/* real_end may be short of the padding that was consumed */
+		reader->read = commit;
+	}
+
+	rb_update_meta_page(cpu_buffer);
+	cpu_buffer->meta_page->reader.read = start;
+	cpu_buffer->meta_page->reader.lost_events = missed_events;
+	goto unlock;
+
+ update:
+	rb_update_meta_page(cpu_buffer);
+ unlock:
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+ out:
+	mutex_unlock(&cpu_buffer->mapping_lock);
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map_get_reader);
+
 /*
  * We only allocate new buffers, never free them if the CPU goes down.
  * If we were to free the buffer, then the user would lose any trace that was in
@@ -59,8 +59,16 @@ MODULE_PARM_DESC(producer_fifo, "fifo prio for producer");
 module_param(consumer_fifo, int, 0644);
 MODULE_PARM_DESC(consumer_fifo, "fifo prio for consumer");
 
+static int consumer_mode;
+module_param(consumer_mode, int, 0644);
+MODULE_PARM_DESC(consumer_mode, "0: alternate events and pages, 1: events, 2: pages");
+
 static int read_events;
 
+/* consumer side cost: payload read and time spent reading it */
+static unsigned long long read_bytes;
+static u64 read_time;
+
 static int test_error;
 
 #define TEST_ERROR()				\
@@ -98,6 +106,7 @@ static enum event_status read_event(int cpu)
 	}
 
 	read++;
+	read_bytes += ring_buffer_event_length(event);
 	return EVENT_FOUND;
 }
 
@@ -121,6 +130,7 @@ static enum event_status read_page(int cpu)
 		rpage = bpage;
 		/* The commit may have missed event flags set, clear them */
 		commit = local_read(&rpage->commit) & 0xfffff;
+		read_bytes += commit;
 		for (i = 0; i < commit && !test_error ; i += inc) {
 
 			if (i >= (PAGE_SIZE - offsetof(struct rb_page, data))) {
@@ -181,15 +191,21 @@ static enum event_status read_page(int cpu)
 static void ring_buffer_consumer(void)
 {
 	/* toggle between reading pages and events */
-	read_events ^= 1;
+	if (consumer_mode)
+		read_events = consumer_mode == 1;
+	else
+		read_events ^= 1;
 
 	read = 0;
+	read_bytes = 0;
+	read_time = 0;
 	/*
 	 * Continue running until the producer specifically asks to stop
 	 * and is ready for the completion.
 	 */
 	while (!READ_ONCE(reader_finish)) {
 		int found = 1;
+		u64 start = ktime_get_ns();
 
 		while (found && !test_error) {
 			int cpu;
@@ -211,6 +227,7 @@ static void ring_buffer_consumer(void)
 
 			}
 		}
+		read_time += ktime_get_ns() - start;
 
 		/* Wait till the producer wakes us up when there is more data
 		 * available or when the producer wants us to finish reading.
@@ -328,6 +345,15 @@ static void ring_buffer_producer(void)
 	else
 		trace_printk("Read:     %ld  (by %s)\n", read,
 			read_events ? "events" : "pages");
+	if (!disable_reader) {
+		/* usecs the consumer was busy and the payload it moved */
+		trace_printk("Consumer: %llu bytes in %llu usecs\n",
+			     read_bytes, div_u64(read_time, NSEC_PER_USEC));
+		if (read_time)
+			trace_printk("Consumer: %llu KB per sec\n",
+				     div64_u64(read_bytes * (NSEC_PER_SEC / 1024),
+					       read_time));
+	}
 	trace_printk("Entries:  %lld\n", entries);
 	trace_printk("Total:    %lld\n", entries + overruns + read);
 	trace_printk("Missed:   %ld\n", missed);
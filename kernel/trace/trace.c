@@ -41,6 +41,7 @@
 #include <linux/nmi.h>
 #include <linux/fs.h>
 #include <linux/trace.h>
+#include <linux/trace_mmap.h>
 #include <linux/sched/rt.h>
 
 #include "trace.h"
@@ -959,6 +960,10 @@ int tracing_alloc_snapshot_instance(struct trace_array *tr)
 
 	if (!tr->allocated_snapshot) {
 
+		/* a snapshot would swap the buffers under a user mapping */
+		if (tr->mapped)
+			return -EBUSY;
+
 		/* allocate spare buffer */
 		ret = resize_buffer_duplicate_size(&tr->max_buffer,
 				   &tr->trace_buffer, RING_BUFFER_ALL_CPUS);
@@ -6906,12 +6911,92 @@ out:
 	return ret;
 }
 
+static long tracing_buffers_ioctl(struct file *file, unsigned int cmd,
+				  unsigned long arg)
+{
+	struct ftrace_buffer_info *info = file->private_data;
+	struct trace_iterator *iter = &info->iter;
+
+	if (cmd != TRACE_MMAP_IOCTL_GET_READER)
+		return -ENOTTY;
+
+	return ring_buffer_map_get_reader(iter->trace_buffer->buffer,
+					  iter->cpu_file);
+}
+
+static void tracing_buffers_mmap_open(struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = vma->vm_file->private_data;
+	struct trace_iterator *iter = &info->iter;
+
+	ring_buffer_map_dup(iter->trace_buffer->buffer, iter->cpu_file);
+
+	mutex_lock(&trace_types_lock);
+	iter->tr->mapped++;
+	mutex_unlock(&trace_types_lock);
+}
+
+static void tracing_buffers_mmap_close(struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = vma->vm_file->private_data;
+	struct trace_iterator *iter = &info->iter;
+
+	WARN_ON(ring_buffer_unmap(iter->trace_buffer->buffer, iter->cpu_file));
+
+	mutex_lock(&trace_types_lock);
+	iter->tr->mapped--;
+	mutex_unlock(&trace_types_lock);
+}
+
+static const struct vm_operations_struct tracing_buffers_vmops = {
+	.open		= tracing_buffers_mmap_open,
+	.close		= tracing_buffers_mmap_close,
+};
+
+/*
+ * Zero-copy consumer: the meta page and the sub-buffers of this cpu are
+ * mapped read-only and TRACE_MMAP_IOCTL_GET_READER hands out new data in
+ * place. See include/uapi/linux/trace_mmap.h for the layout.
+ */
+static int tracing_buffers_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = filp->private_data;
+	struct trace_iterator *iter = &info->iter;
+	int ret = 0;
+
+	if (iter->cpu_file == RING_BUFFER_ALL_CPUS)
+		return -EINVAL;
+
+	mutex_lock(&trace_types_lock);
+
+#ifdef CONFIG_TRACER_MAX_TRACE
+	/* the snapshot swaps the buffers under the mapping */
+	if (iter->tr->allocated_snapshot || iter->tr->current_trace->use_max_tr) {
+		ret = -EBUSY;
+		goto out;
+	}
+#endif
+
+	ret = ring_buffer_map(iter->trace_buffer->buffer, iter->cpu_file, vma);
+	if (ret)
+		goto out;
+
+	iter->tr->mapped++;
+	vma->vm_ops = &tracing_buffers_vmops;
+ out:
+	mutex_unlock(&trace_types_lock);
+
+	return ret;
+}
+
 static const struct file_operations tracing_buffers_fops = {
 	.open		= tracing_buffers_open,
 	.read		= tracing_buffers_read,
 	.poll		= tracing_buffers_poll,
 	.release	= tracing_buffers_release,
 	.splice_read	= tracing_buffers_splice_read,
+	.unlocked_ioctl	= tracing_buffers_ioctl,
+	.mmap		= tracing_buffers_mmap,
 	.llseek		= no_llseek,
 };
 
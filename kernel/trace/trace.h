@@ -218,6 +218,8 @@ struct trace_array {
 	struct trace_buffer	max_buffer;
 	bool			allocated_snapshot;
 #endif
+	/* user mappings of the trace_buffer, see tracing_buffers_mmap() */
+	unsigned int		mapped;
 #if defined(CONFIG_TRACER_MAX_TRACE) || defined(CONFIG_HWLAT_TRACER)
 	unsigned long		max_latency;
 #endif
@@ -11,6 +11,24 @@ static struct task_struct *bm_event_thread;
 
 static char bm_str[BENCHMARK_EVENT_STRLEN] = "START";
 
+/*
+ * Extra threads that only hit the tracepoint, one per cpu. With a hist
+ * trigger attached to the event they show how aggregation scales when
+ * the same keys are hit from many cpus at once.
+ */
+static unsigned int hammer_threads;
+module_param(hammer_threads, uint, 0644);
+MODULE_PARM_DESC(hammer_threads, "# of cpus also hitting the event when enabled");
+
+static DEFINE_PER_CPU(struct task_struct *, bm_hammer_thread);
+static DEFINE_PER_CPU(u64, bm_hammer_cnt);
+static char bm_hammer_str[BENCHMARK_EVENT_STRLEN] = "HAMMER";
+
+/* events per second of all benchmark threads, updated once a second */
+static u64 bm_rate_start;
+static u64 bm_rate_cnt;
+static u64 bm_eps;
+
 static u64 bm_total;
 static u64 bm_totalsq;
 static u64 bm_last;
@@ -24,6 +42,30 @@ static unsigned int bm_std;
 
 static bool ok_to_run;
 
+static void trace_benchmark_update_rate(void)
+{
+	u64 now = ktime_get_ns();
+	u64 cnt = bm_cnt;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		cnt += READ_ONCE(per_cpu(bm_hammer_cnt, cpu));
+
+	if (!bm_rate_start) {
+		bm_rate_start = now;
+		bm_rate_cnt = cnt;
+		return;
+	}
+
+	if (now - bm_rate_start < NSEC_PER_SEC)
+		return;
+
+	bm_eps = div64_u64((cnt - bm_rate_cnt) * NSEC_PER_SEC,
+			   now - bm_rate_start);
+	bm_rate_start = now;
+	bm_rate_cnt = cnt;
+}
+
 /*
  * This gets called in a loop recording the time it took to write
  * the tracepoint. What it writes is the time statistics of the last
@@ -59,6 +101,9 @@ static void trace_do_benchmark(void)
 
 	delta = stop - start;
 
+	if (!(bm_cnt & 1023))
+		trace_benchmark_update_rate();
+
 	/*
 	 * The first read is cold cached, keep it separate from the
 	 * other calculations.
@@ -84,8 +129,9 @@ static void trace_do_benchmark(void)
 	 */
 	if (bm_cnt > UINT_MAX) {
 		scnprintf(bm_str, BENCHMARK_EVENT_STRLEN,
-		    "last=%llu first=%llu max=%llu min=%llu ** avg=%u std=%d std^2=%lld",
-			  bm_last, bm_first, bm_max, bm_min, bm_avg, bm_std, bm_stddev);
+		    "last=%llu first=%llu max=%llu min=%llu ** avg=%u std=%d std^2=%lld eps=%llu",
+			  bm_last, bm_first, bm_max, bm_min, bm_avg, bm_std, bm_stddev,
+			  bm_eps);
 		return;
 	}
 
@@ -136,8 +182,8 @@ static void trace_do_benchmark(void)
 	}
 
 	scnprintf(bm_str, BENCHMARK_EVENT_STRLEN,
-		  "last=%llu first=%llu max=%llu min=%llu avg=%u std=%d std^2=%lld",
-		  bm_last, bm_first, bm_max, bm_min, avg, std, stddev);
+		  "last=%llu first=%llu max=%llu min=%llu avg=%u std=%d std^2=%lld eps=%llu",
+		  bm_last, bm_first, bm_max, bm_min, avg, std, stddev, bm_eps);
 
 	bm_std = std;
 	bm_avg = avg;
@@ -171,6 +217,65 @@ static int benchmark_event_kthread(void *arg)
 	return 0;
 }
 
+static int benchmark_hammer_kthread(void *arg)
+{
+	u64 *cnt = arg;
+
+	/* sleep a bit to make sure the tracepoint gets activated */
+	msleep(100);
+
+	while (!kthread_should_stop()) {
+		if (trace_benchmark_event_enabled() && tracing_is_on()) {
+			local_irq_disable();
+			trace_benchmark_event(bm_hammer_str);
+			local_irq_enable();
+			WRITE_ONCE(*cnt, *cnt + 1);
+		}
+
+		/* see benchmark_event_kthread() */
+		cond_resched_rcu_qs();
+	}
+
+	return 0;
+}
+
+static void trace_benchmark_stop_hammers(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct task_struct *t = per_cpu(bm_hammer_thread, cpu);
+
+		if (t)
+			kthread_stop(t);
+		per_cpu(bm_hammer_thread, cpu) = NULL;
+		per_cpu(bm_hammer_cnt, cpu) = 0;
+	}
+}
+
+static void trace_benchmark_start_hammers(void)
+{
+	unsigned int nr = 0;
+	int cpu;
+
+	for_each_online_cpu(cpu) {
+		struct task_struct *t;
+
+		if (nr++ >= hammer_threads)
+			break;
+
+		t = kthread_create_on_cpu(benchmark_hammer_kthread,
+					  per_cpu_ptr(&bm_hammer_cnt, cpu),
+					  cpu, "event_hammer/%u");
+		if (IS_ERR(t)) {
+			pr_warning("trace benchmark failed to create hammer thread\n");
+			break;
+		}
+		per_cpu(bm_hammer_thread, cpu) = t;
+		wake_up_process(t);
+	}
+}
+
 /*
  * When the benchmark tracepoint is enabled, it calls this
  * function and the thread that calls the tracepoint is created.
@@ -189,6 +294,8 @@ int trace_benchmark_reg(void)
 		return PTR_ERR(bm_event_thread);
 	}
 
+	trace_benchmark_start_hammers();
+
 	return 0;
 }
 
@@ -202,6 +309,7 @@ void trace_benchmark_unreg(void)
 	if (!bm_event_thread)
 		return;
 
+	trace_benchmark_stop_hammers();
 	kthread_stop(bm_event_thread);
 	bm_event_thread = NULL;
 
@@ -212,6 +320,9 @@ void trace_benchmark_unreg(void)
 	bm_max = 0;
 	bm_min = 0;
 	bm_cnt = 0;
+	bm_rate_start = 0;
+	bm_rate_cnt = 0;
+	bm_eps = 0;
 	/* These don't need to be reset but reset them anyway */
 	bm_first = 0;
 	bm_std = 0;
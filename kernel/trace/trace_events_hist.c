@@ -1080,8 +1080,8 @@ static void hist_trigger_show(struct seq_file *m,
 	}
 
 	seq_printf(m, "\nTotals:\n    Hits: %llu\n    Entries: %u\n    Dropped: %llu\n",
-		   (u64)atomic64_read(&hist_data->map->hits),
-		   n_entries, (u64)atomic64_read(&hist_data->map->drops));
+		   tracing_map_read_hits(hist_data->map),
+		   n_entries, tracing_map_read_drops(hist_data->map));
 }
 
 static int hist_show(struct seq_file *m, void *v)
@@ -43,10 +43,16 @@
  * Add n to sum i associated with the specified tracing_map_elt
  * instance.  The index i is the index returned by the call to
  * tracing_map_add_sum_field() when the tracing map was set up.
+ *
+ * Only the current cpu's copy of the sum is updated, so this must be
+ * called with preemption disabled, as it is from a trigger.
  */
 void tracing_map_update_sum(struct tracing_map_elt *elt, unsigned int i, u64 n)
 {
-	atomic64_add(n, &elt->fields[i].sum);
+	struct tracing_map_array *sums;
+
+	sums = elt->map->cpu_sums[smp_processor_id()];
+	local64_add(n, &TRACING_MAP_SUMS(sums, elt->idx)[i]);
 }
 
 /**
@@ -59,11 +65,62 @@ void tracing_map_update_sum(struct tracing_map_elt *elt, unsigned int i, u64 n)
  * call to tracing_map_add_sum_field() when the tracing map was set
  * up.
  *
+ * The per-cpu copies of the sum are merged on the way, so the result
+ * is only exact once the writers are quiet.
+ *
  * Return: The sum associated with field i for elt.
  */
 u64 tracing_map_read_sum(struct tracing_map_elt *elt, unsigned int i)
 {
-	return (u64)atomic64_read(&elt->fields[i].sum);
+	u64 sum = (u64)atomic64_read(&elt->fields[i].sum);
+	int cpu;
+
+	if (elt->idx < 0)
+		return sum;
+
+	for_each_possible_cpu(cpu) {
+		struct tracing_map_array *sums = elt->map->cpu_sums[cpu];
+
+		sum += local64_read(&TRACING_MAP_SUMS(sums, elt->idx)[i]);
+	}
+
+	return sum;
+}
+
+/**
+ * tracing_map_read_hits - Return the number of hits of a tracing_map
+ * @map: The tracing_map
+ *
+ * Return: The number of successful insertions and lookups, summed
+ * over all cpus.
+ */
+u64 tracing_map_read_hits(struct tracing_map *map)
+{
+	u64 hits = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		hits += local64_read(&per_cpu_ptr(map->stats, cpu)->hits);
+
+	return hits;
+}
+
+/**
+ * tracing_map_read_drops - Return the number of drops of a tracing_map
+ * @map: The tracing_map
+ *
+ * Return: The number of insertions that failed because the map was
+ * full, summed over all cpus.
+ */
+u64 tracing_map_read_drops(struct tracing_map *map)
+{
+	u64 drops = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		drops += local64_read(&per_cpu_ptr(map->stats, cpu)->drops);
+
+	return drops;
 }
 
 int tracing_map_cmp_string(void *val_a, void *val_b)
@@ -320,6 +377,7 @@ static struct tracing_map_elt *tracing_map_elt_alloc(struct tracing_map *map)
 		return ERR_PTR(-ENOMEM);
 
 	elt->map = map;
+	elt->idx = -1;
 
 	elt->key = kzalloc(map->key_size, GFP_KERNEL);
 	if (!elt->key) {
@@ -393,6 +451,44 @@ static int tracing_map_alloc_elts(struct tracing_map *map)
 			*(TRACING_MAP_ELT(map->elts, i)) = NULL;
 			tracing_map_free_elts(map);
 
+			return -ENOMEM;
+		}
+		(*(TRACING_MAP_ELT(map->elts, i)))->idx = i;
+	}
+
+	return 0;
+}
+
+static void tracing_map_free_cpu_sums(struct tracing_map *map)
+{
+	int cpu;
+
+	if (!map->cpu_sums)
+		return;
+
+	for_each_possible_cpu(cpu)
+		tracing_map_array_free(map->cpu_sums[cpu]);
+
+	kfree(map->cpu_sums);
+	map->cpu_sums = NULL;
+}
+
+static int tracing_map_alloc_cpu_sums(struct tracing_map *map)
+{
+	int cpu;
+
+	map->cpu_sums = kcalloc(nr_cpu_ids, sizeof(*map->cpu_sums),
+				GFP_KERNEL);
+	if (!map->cpu_sums)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		map->cpu_sums[cpu] =
+			tracing_map_array_alloc(map->max_elts,
+						map->n_fields * sizeof(local64_t));
+		if (!map->cpu_sums[cpu]) {
+			tracing_map_free_cpu_sums(map);
+
 			return -ENOMEM;
 		}
 	}
@@ -428,7 +524,7 @@ __tracing_map_insert(struct tracing_map *map, void *key, bool lookup_only)
 
 		if (test_key && test_key == key_hash && entry->val &&
 		    keys_match(key, entry->val->key, map->key_size)) {
-			atomic64_inc(&map->hits);
+			local64_inc(&this_cpu_ptr(map->stats)->hits);
 			return entry->val;
 		}
 
@@ -441,14 +537,14 @@ __tracing_map_insert(struct tracing_map *map, void *key, bool lookup_only)
 
 				elt = get_free_elt(map);
 				if (!elt) {
-					atomic64_inc(&map->drops);
+					local64_inc(&this_cpu_ptr(map->stats)->drops);
 					entry->key = 0;
 					break;
 				}
 
 				memcpy(elt->key, key, map->key_size);
 				entry->val = elt;
-				atomic64_inc(&map->hits);
+				local64_inc(&this_cpu_ptr(map->stats)->hits);
 
 				return entry->val;
 			}
@@ -540,8 +636,10 @@ void tracing_map_destroy(struct tracing_map *map)
 		return;
 
 	tracing_map_free_elts(map);
+	tracing_map_free_cpu_sums(map);
 
 	tracing_map_array_free(map->map);
+	free_percpu(map->stats);
 	kfree(map);
 }
 
@@ -559,10 +657,17 @@ void tracing_map_destroy(struct tracing_map *map)
 void tracing_map_clear(struct tracing_map *map)
 {
 	unsigned int i;
+	int cpu;
 
 	atomic_set(&map->next_elt, -1);
-	atomic64_set(&map->hits, 0);
-	atomic64_set(&map->drops, 0);
+
+	for_each_possible_cpu(cpu) {
+		struct tracing_map_cpu_stats *stats = per_cpu_ptr(map->stats, cpu);
+
+		local64_set(&stats->hits, 0);
+		local64_set(&stats->drops, 0);
+		tracing_map_array_clear(map->cpu_sums[cpu]);
+	}
 
 	tracing_map_array_clear(map->map);
 
@@ -651,6 +756,10 @@ struct tracing_map *tracing_map_create(unsigned int map_bits,
 
 	map->private_data = private_data;
 
+	map->stats = alloc_percpu(struct tracing_map_cpu_stats);
+	if (!map->stats)
+		goto free;
+
 	map->map = tracing_map_array_alloc(map->map_size,
 					   sizeof(struct tracing_map_entry));
 	if (!map->map)
@@ -694,10 +803,16 @@ int tracing_map_init(struct tracing_map *map)
 	if (map->n_fields < 2)
 		return -EINVAL; /* need at least 1 key and 1 val */
 
-	err = tracing_map_alloc_elts(map);
+	err = tracing_map_alloc_cpu_sums(map);
 	if (err)
 		return err;
 
+	err = tracing_map_alloc_elts(map);
+	if (err) {
+		tracing_map_free_cpu_sums(map);
+		return err;
+	}
+
 	tracing_map_clear(map);
 
 	return err;
@@ -717,11 +832,9 @@ static int cmp_entries_dup(const struct tracing_map_sort_entry **a,
 static int cmp_entries_sum(const struct tracing_map_sort_entry **a,
 			   const struct tracing_map_sort_entry **b)
 {
-	const struct tracing_map_elt *elt_a, *elt_b;
+	struct tracing_map_elt *elt_a, *elt_b;
 	struct tracing_map_sort_key *sort_key;
-	struct tracing_map_field *field;
-	tracing_map_cmp_fn_t cmp_fn;
-	void *val_a, *val_b;
+	u64 val_a, val_b;
 	int ret = 0;
 
 	elt_a = (*a)->elt;
@@ -729,13 +842,11 @@ static int cmp_entries_sum(const struct tracing_map_sort_entry **a,
 
 	sort_key = &elt_a->map->sort_key;
 
-	field = &elt_a->fields[sort_key->field_idx];
-	cmp_fn = field->cmp_fn;
-
-	val_a = &elt_a->fields[sort_key->field_idx].sum;
-	val_b = &elt_b->fields[sort_key->field_idx].sum;
+	/* merge the per-cpu sums, the cmp_fn of a sum field can't do that */
+	val_a = tracing_map_read_sum(elt_a, sort_key->field_idx);
+	val_b = tracing_map_read_sum(elt_b, sort_key->field_idx);
 
-	ret = cmp_fn(val_a, val_b);
+	ret = tracing_map_cmp_u64(&val_a, &val_b);
 	if (sort_key->descending)
 		ret = -ret;
 
@@ -832,7 +943,7 @@ static struct tracing_map_elt *copy_elt(struct tracing_map_elt *elt)
 
 	for (i = 0; i < elt->map->n_fields; i++) {
 		atomic64_set(&dup_elt->fields[i].sum,
-			     atomic64_read(&elt->fields[i].sum));
+			     tracing_map_read_sum(elt, i));
 		dup_elt->fields[i].cmp_fn = elt->fields[i].cmp_fn;
 	}
 
@@ -859,7 +970,7 @@ static int merge_dup(struct tracing_map_sort_entry **sort_entries,
 	elt = sort_entries[dup]->elt;
 
 	for (i = 0; i < elt->map->n_fields; i++)
-		atomic64_add(atomic64_read(&elt->fields[i].sum),
+		atomic64_add(tracing_map_read_sum(elt, i),
 			     &target_elt->fields[i].sum);
 
 	sort_entries[dup]->dup = true;
@@ -2,6 +2,8 @@
 #ifndef __TRACING_MAP_H
 #define __TRACING_MAP_H
 
+#include <asm/local64.h>
+
 #define TRACING_MAP_BITS_DEFAULT	11
 #define TRACING_MAP_BITS_MAX		17
 #define TRACING_MAP_BITS_MIN		7
@@ -124,6 +126,19 @@ typedef int (*tracing_map_cmp_fn_t) (void *val_a, void *val_b);
  * user, tracing_map_sort_entry objects contain a number of additional
  * fields which are used for caching and internal purposes and can
  * safely be ignored.
+ *
+ * Sums are not kept in the tracing_map_elts themselves.  Every hit
+ * would otherwise write the same cache line from every cpu hitting
+ * that key.  Instead, tracing_map_init() allocates one tracing_map_array
+ * of sum rows per possible cpu (the cpu_sums field of struct
+ * tracing_map), each holding one row of n_fields local64_t counters per
+ * pooled element, indexed by the element's 'idx'.
+ * tracing_map_update_sum() only touches the current cpu's row, and the
+ * hits and drops statistics are per-cpu as well.  Readers merge the
+ * rows: tracing_map_read_sum() adds up all cpus, and the sorting code
+ * merges sums on the fly the same way it merges duplicate keys.  The
+ * 'sum' field of a tracing_map_elt is only used by the element copies
+ * made for sorting, which are not part of the pool.
 */
 
 struct tracing_map_field {
@@ -139,6 +154,7 @@ struct tracing_map_elt {
 	struct tracing_map_field	*fields;
 	void				*key;
 	void				*private_data;
+	int				idx;	/* row in cpu_sums, -1 for copies */
 };
 
 struct tracing_map_entry {
@@ -177,6 +193,14 @@ struct tracing_map_array {
 #define TRACING_MAP_ELT(array, idx)					\
 	((struct tracing_map_elt **)TRACING_MAP_ARRAY_ELT(array, idx))
 
+#define TRACING_MAP_SUMS(array, idx)					\
+	((local64_t *)TRACING_MAP_ARRAY_ELT(array, idx))
+
+struct tracing_map_cpu_stats {
+	local64_t			hits;
+	local64_t			drops;
+};
+
 struct tracing_map {
 	unsigned int			key_size;
 	unsigned int			map_bits;
@@ -185,6 +209,7 @@ struct tracing_map {
 	atomic_t			next_elt;
 	struct tracing_map_array	*elts;
 	struct tracing_map_array	*map;
+	struct tracing_map_array	**cpu_sums;
 	const struct tracing_map_ops	*ops;
 	void				*private_data;
 	struct tracing_map_field	fields[TRACING_MAP_FIELDS_MAX];
@@ -192,8 +217,7 @@ struct tracing_map {
 	int				key_idx[TRACING_MAP_KEYS_MAX];
 	unsigned int			n_keys;
 	struct tracing_map_sort_key	sort_key;
-	atomic64_t			hits;
-	atomic64_t			drops;
+	struct tracing_map_cpu_stats __percpu *stats;
 };
 
 /**
@@ -268,6 +292,8 @@ extern int tracing_map_cmp_none(void *val_a, void *val_b);
 extern void tracing_map_update_sum(struct tracing_map_elt *elt,
 				   unsigned int i, u64 n);
 extern u64 tracing_map_read_sum(struct tracing_map_elt *elt, unsigned int i);
+extern u64 tracing_map_read_hits(struct tracing_map *map);
+extern u64 tracing_map_read_drops(struct tracing_map *map);
 extern void tracing_map_set_field_descr(struct tracing_map *map,
 					unsigned int i,
 					unsigned int key_offset,
@@ -26,6 +26,14 @@
 extern void (*arm_pm_restart)(char str, const char *cmd);
 
 extern void dbg_snapshot_init_log_idx(void);
+extern void dbg_snapshot_update_kevent_keys(int en);
+extern ssize_t dbg_snapshot_show_kevent_mask(char *buf, size_t size);
+extern int dbg_snapshot_toggle_kevent(const char *name);
+#ifdef CONFIG_DEBUG_SNAPSHOT_COMPACT
+extern void dbg_snapshot_init_compact(void);
+#else
+static inline void dbg_snapshot_init_compact(void) {}
+#endif
 extern void dbg_snapshot_init_utils(void);
 extern void dbg_snapshot_init_helper(void);
 extern void __iomem *dbg_snapshot_get_base_vaddr(void);
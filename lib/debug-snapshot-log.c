@@ -37,6 +37,13 @@
 #include <linux/irqdesc.h>
 #include <linux/nmi.h>
 #include <linux/sec_debug.h>
+#include <linux/hash.h>
+#include <linux/jump_label.h>
+#include <linux/workqueue.h>
+#include <linux/debugfs.h>
+#include <linux/mm.h>
+#include <asm/sections.h>
+#include <asm/unaligned.h>
 
 struct dbg_snapshot_lastinfo {
 #ifdef CONFIG_DEBUG_SNAPSHOT_FREQ
@@ -173,9 +180,93 @@ static char *dss_freq_name[] = {
 #endif
 
 /*  Internal interface variable */
+#ifdef CONFIG_DEBUG_SNAPSHOT_KEVENT_EXPORT
+/* mapped to user space, so it must not share a page with anything else */
+static union {
+	struct dbg_snapshot_log_idx idx;
+	u8 pad[PAGE_ALIGN(sizeof(struct dbg_snapshot_log_idx))];
+} dss_idx_page __page_aligned_bss;
+#define dss_idx		(dss_idx_page.idx)
+#else
 static struct dbg_snapshot_log_idx dss_idx;
+#endif
 static struct dbg_snapshot_lastinfo dss_lastinfo;
 
+struct static_key_false dss_kevent_key[DSS_KEY_NR] = {
+	[0 ... DSS_KEY_NR - 1] = STATIC_KEY_FALSE_INIT,
+};
+
+static const char * const dss_kevent_key_name[DSS_KEY_NR] = {
+	[DSS_KEY_TASK]		= "task",
+	[DSS_KEY_WORK]		= "work",
+	[DSS_KEY_CPUIDLE]	= "cpuidle",
+	[DSS_KEY_IRQ]		= "irq",
+	[DSS_KEY_SOFTIRQ]	= "softirq",
+	[DSS_KEY_SPINLOCK]	= "spinlock",
+	[DSS_KEY_CLK]		= "clk",
+	[DSS_KEY_HRTIMER]	= "hrtimer",
+	[DSS_KEY_REG]		= "reg",
+};
+
+static unsigned long dss_kevent_mask = (1UL << DSS_KEY_NR) - 1;
+
+/*
+ * Static keys can only be flipped from sleepable context, while the
+ * enables change from panic, oops and watchdog paths too. The hooks keep
+ * their runtime check, so a key left on after a disable only costs the
+ * call: disables never touch the keys, and enables flip them from a work
+ * item rather than in the caller's context.
+ */
+static void dbg_snapshot_kevent_key_work(struct work_struct *work)
+{
+	struct dbg_snapshot_item *item = &dss_items[dss_desc.kevents_num];
+	bool on = dss_base.enabled && item->entry.enabled;
+	int i;
+
+	for (i = 0; i < DSS_KEY_NR; i++) {
+		if (on && test_bit(i, &dss_kevent_mask))
+			static_branch_enable(&dss_kevent_key[i]);
+		else
+			static_branch_disable(&dss_kevent_key[i]);
+	}
+}
+
+static DECLARE_WORK(dss_kevent_key_wk, dbg_snapshot_kevent_key_work);
+
+void dbg_snapshot_update_kevent_keys(int en)
+{
+	if (!en || oops_in_progress)
+		return;
+	schedule_work(&dss_kevent_key_wk);
+}
+
+ssize_t dbg_snapshot_show_kevent_mask(char *buf, size_t size)
+{
+	ssize_t n = 0;
+	int i;
+
+	for (i = 0; i < DSS_KEY_NR; i++)
+		n += scnprintf(buf + n, size - n, "%-12s : %sable\n",
+			       dss_kevent_key_name[i],
+			       test_bit(i, &dss_kevent_mask) ? "en" : "dis");
+	return n;
+}
+
+int dbg_snapshot_toggle_kevent(const char *name)
+{
+	int i;
+
+	for (i = 0; i < DSS_KEY_NR; i++) {
+		if (!strcmp(dss_kevent_key_name[i], name)) {
+			change_bit(i, &dss_kevent_mask);
+			/* Only reached from sysfs, so flip the key here. */
+			dbg_snapshot_kevent_key_work(NULL);
+			return 0;
+		}
+	}
+	return -EINVAL;
+}
+
 void __init dbg_snapshot_init_log_idx(void)
 {
 	int i;
@@ -618,12 +709,177 @@ static inline void arch_local_irq_restore(unsigned long flags)
 }
 #endif
 
-void dbg_snapshot_task(int cpu, void *v_task)
+#ifdef CONFIG_DEBUG_SNAPSHOT_COMPACT
+static inline bool dss_comm_equal(const char *a, const char *b)
+{
+	return get_unaligned((u64 *)a) == get_unaligned((u64 *)b) &&
+	       get_unaligned((u64 *)(a + 8)) == get_unaligned((u64 *)(b + 8));
+}
+
+/*
+ * Racing cpus may update the same slot; the pid is invalidated around
+ * the copy so the decoder skips a slot caught halfway.
+ */
+static void dss_compact_intern(struct task_struct *task)
+{
+	struct dss_compact_comm *c;
+
+	c = &dss_log->compact.comm[hash_32(task->pid, DSS_COMPACT_COMM_BITS)];
+	if (likely(READ_ONCE(c->pid) == task->pid &&
+		   dss_comm_equal(c->comm, task->comm)))
+		return;
+
+	WRITE_ONCE(c->pid, -1);
+	smp_wmb();
+	memcpy(c->comm, task->comm, TASK_COMM_LEN);
+	smp_wmb();
+	WRITE_ONCE(c->pid, task->pid);
+}
+
+/*
+ * Must be called with interrupts disabled. @len is the payload length in
+ * words; the record is published by the update of the block's used count.
+ */
+static u32 *dss_compact_reserve(int cpu, unsigned int type,
+				unsigned int len, unsigned int flag)
+{
+	struct dss_compact_ring *ring = &dss_log->compact.ring[cpu];
+	struct dss_compact_block *blk = &ring->block[ring->cur];
+	struct dss_compact_rec *rec;
+	u64 now = cpu_clock(cpu);
+	u64 delta = now - ring->last_time;
+
+	len = sizeof(*rec) + len * sizeof(u32);
+	if (unlikely(blk->used + len > sizeof(blk->data) ||
+		     now < ring->last_time || delta > U32_MAX)) {
+		ring->cur = (ring->cur + 1) & (DSS_COMPACT_BLOCK_NUM - 1);
+		blk = &ring->block[ring->cur];
+		blk->used = 0;
+		blk->base_time = now;
+		blk->seq = ++ring->seq;
+		delta = 0;
+	}
+
+	rec = (struct dss_compact_rec *)&blk->data[blk->used];
+	rec->type = type;
+	rec->len = len;
+	rec->flag = flag;
+	rec->delta = delta;
+	ring->last_time = now;
+	blk->used += len;
+
+	return rec->data;
+}
+
+static inline void dss_compact_put64(u32 *data, u64 val)
+{
+	data[0] = lower_32_bits(val);
+	data[1] = upper_32_bits(val);
+}
+
+static void dss_compact_task(int cpu, struct task_struct *task)
+{
+	unsigned long flags = pure_arch_local_irq_save();
+	u32 *data;
+
+	dss_compact_intern(task);
+	data = dss_compact_reserve(cpu, DSS_CREC_TASK, 1, 0);
+	data[0] = task->pid;
+	pure_arch_local_irq_restore(flags);
+}
+
+static void dss_compact_work(struct task_struct *task, void *fn, int en)
+{
+	unsigned long flags = pure_arch_local_irq_save();
+	u32 *data;
+
+	dss_compact_intern(task);
+	data = dss_compact_reserve(raw_smp_processor_id(), DSS_CREC_WORK, 3, en);
+	data[0] = task->pid;
+	dss_compact_put64(&data[1], (unsigned long)fn);
+	pure_arch_local_irq_restore(flags);
+}
+
+static void dss_compact_irq(int cpu, int irq, void *fn, u64 latency, int en)
+{
+	u32 *data;
+
+	data = dss_compact_reserve(cpu, DSS_CREC_IRQ, 4, en);
+	data[0] = irq;
+	data[1] = min_t(u64, latency, U32_MAX);
+	dss_compact_put64(&data[2], (unsigned long)fn);
+}
+
+static void dss_compact_spinlock(void *lock, int en)
+{
+	unsigned long flags = pure_arch_local_irq_save();
+	u32 *data;
+
+	data = dss_compact_reserve(raw_smp_processor_id(), DSS_CREC_SPINLOCK,
+				   2, en);
+	dss_compact_put64(data, (unsigned long)lock);
+	pure_arch_local_irq_restore(flags);
+}
+
+static void dss_compact_clk(void *clock, const char *func_name,
+			    unsigned long arg, int mode)
+{
+	unsigned long flags = pure_arch_local_irq_save();
+	u32 *data;
+
+	data = dss_compact_reserve(raw_smp_processor_id(), DSS_CREC_CLK,
+				   5, mode);
+	data[0] = arg;
+	dss_compact_put64(&data[1], (unsigned long)clock);
+	dss_compact_put64(&data[3], (unsigned long)func_name);
+	pure_arch_local_irq_restore(flags);
+}
+
+void __init dbg_snapshot_init_compact(void)
+{
+	struct dss_compact_log *log = &dss_log->compact;
+
+	memset(log, 0, sizeof(*log));
+	memset(log->comm, 0xff, sizeof(log->comm));
+	log->version = DSS_COMPACT_VERSION;
+	log->nr_cpus = DSS_NR_CPUS;
+	log->block_sz = DSS_COMPACT_BLOCK_SZ;
+	log->block_num = DSS_COMPACT_BLOCK_NUM;
+	log->comm_num = DSS_COMPACT_COMM_NUM;
+	log->text_base = (unsigned long)_text;
+	smp_wmb();
+	log->magic = DSS_COMPACT_MAGIC;
+}
+
+/*
+ * Live view of the compact log for tools/debug-snapshot/dss-decode; the
+ * same bytes are found in a ramdump at the compact member of the kevents
+ * region.
+ */
+static struct debugfs_blob_wrapper dss_compact_blob;
+
+static void __init dbg_snapshot_compact_debugfs_init(struct dentry *root)
+{
+	dss_compact_blob.data = &dss_log->compact;
+	dss_compact_blob.size = sizeof(dss_log->compact);
+	debugfs_create_blob("compact", 0400, root, &dss_compact_blob);
+}
+#else
+static inline void dbg_snapshot_compact_debugfs_init(struct dentry *root)
+{
+}
+#endif
+
+void __dbg_snapshot_task(int cpu, void *v_task)
 {
 	struct dbg_snapshot_item *item = &dss_items[dss_desc.kevents_num];
 
 	if (unlikely(!dss_base.enabled || !item->entry.enabled))
 		return;
+#ifdef CONFIG_DEBUG_SNAPSHOT_COMPACT
+	dss_compact_task(cpu, v_task);
+	return;
+#endif
 	{
 		unsigned long i = atomic_inc_return(&dss_idx.task_log_idx[cpu]) &
 				    (ARRAY_SIZE(dss_log->task[0]) - 1);
@@ -638,13 +894,16 @@ void dbg_snapshot_task(int cpu, void *v_task)
 	}
 }
 
-void dbg_snapshot_work(void *worker, void *v_task, void *fn, int en)
+void __dbg_snapshot_work(void *worker, void *v_task, void *fn, int en)
 {
 	struct dbg_snapshot_item *item = &dss_items[dss_desc.kevents_num];
 
 	if (unlikely(!dss_base.enabled || !item->entry.enabled))
 		return;
-
+#ifdef CONFIG_DEBUG_SNAPSHOT_COMPACT
+	dss_compact_work(v_task, fn, en);
+	return;
+#endif
 	{
 		int cpu = raw_smp_processor_id();
 		unsigned long i = atomic_inc_return(&dss_idx.work_log_idx[cpu]) &
@@ -659,7 +918,7 @@ void dbg_snapshot_work(void *worker, void *v_task, void *fn, int en)
 	}
 }
 
-void dbg_snapshot_cpuidle(char *modes, unsigned state, int diff, int en)
+void __dbg_snapshot_cpuidle(char *modes, unsigned state, int diff, int en)
 {
 	struct dbg_snapshot_item *item = &dss_items[dss_desc.kevents_num];
 
@@ -870,7 +1129,7 @@ void dbg_snapshot_thermal(void *data, unsigned int temp, char *name, unsigned in
 }
 #endif
 
-void dbg_snapshot_irq(int irq, void *fn, void *val, unsigned long long start_time, int en)
+void __dbg_snapshot_irq(int irq, void *fn, void *val, unsigned long long start_time, int en)
 {
 	struct dbg_snapshot_item *item = &dss_items[dss_desc.kevents_num];
 	unsigned long flags;
@@ -890,6 +1149,11 @@ void dbg_snapshot_irq(int irq, void *fn, void *val, unsigned long long start_tim
 			start_time = time;
 
 		latency = time - start_time;
+#ifdef CONFIG_DEBUG_SNAPSHOT_COMPACT
+		dss_compact_irq(cpu, irq, fn, latency, en);
+		pure_arch_local_irq_restore(flags);
+		return;
+#endif
 		i = atomic_inc_return(&dss_idx.irq_log_idx[cpu]) &
 				(ARRAY_SIZE(dss_log->irq[0]) - 1);
 
@@ -905,12 +1169,16 @@ void dbg_snapshot_irq(int irq, void *fn, void *val, unsigned long long start_tim
 }
 
 #ifdef CONFIG_DEBUG_SNAPSHOT_SPINLOCK
-void dbg_snapshot_spinlock(void *v_lock, int en)
+void __dbg_snapshot_spinlock(void *v_lock, int en)
 {
 	struct dbg_snapshot_item *item = &dss_items[dss_desc.kevents_num];
 
 	if (unlikely(!dss_base.enabled || !item->entry.enabled))
 		return;
+#ifdef CONFIG_DEBUG_SNAPSHOT_COMPACT
+	dss_compact_spinlock(v_lock, en);
+	return;
+#endif
 	{
 		int cpu = raw_smp_processor_id();
 		unsigned index = atomic_inc_return(&dss_idx.spinlock_log_idx[cpu]);
@@ -980,12 +1248,16 @@ void dbg_snapshot_irqs_disabled(unsigned long flags)
 #endif
 
 #ifdef CONFIG_DEBUG_SNAPSHOT_CLK
-void dbg_snapshot_clk(void *clock, const char *func_name, unsigned long arg, int mode)
+void __dbg_snapshot_clk(void *clock, const char *func_name, unsigned long arg, int mode)
 {
 	struct dbg_snapshot_item *item = &dss_items[dss_desc.kevents_num];
 
 	if (unlikely(!dss_base.enabled || !item->entry.enabled))
 		return;
+#ifdef CONFIG_DEBUG_SNAPSHOT_COMPACT
+	dss_compact_clk(clock, func_name, arg, mode);
+	return;
+#endif
 	{
 		int cpu = raw_smp_processor_id();
 		unsigned long i = atomic_inc_return(&dss_idx.clk_log_idx) &
@@ -1180,7 +1452,7 @@ void dbg_snapshot_dm(int type, unsigned long min, unsigned long max, s32 wait_t,
 #endif
 
 #ifdef CONFIG_DEBUG_SNAPSHOT_HRTIMER
-void dbg_snapshot_hrtimer(void *timer, s64 *now, void *fn, int en)
+void __dbg_snapshot_hrtimer(void *timer, s64 *now, void *fn, int en)
 {
 	struct dbg_snapshot_item *item = &dss_items[dss_desc.kevents_num];
 
@@ -1344,7 +1616,7 @@ out:
 	return paddr | (vaddr & UL(SZ_4K - 1));
 }
 
-void dbg_snapshot_reg(unsigned int read, size_t val, size_t reg, int en)
+void __dbg_snapshot_reg(unsigned int read, size_t val, size_t reg, int en)
 {
 	struct dbg_snapshot_item *item = &dss_items[dss_desc.kevents_num];
 	int cpu = raw_smp_processor_id();
@@ -1651,3 +1923,196 @@ void dbg_snapshot_get_softlockup_info(unsigned int cpu, void *info)
 		sl_info->sl_type = SL_UNKNOWN_STUCK;
 }
 #endif
+
+#ifdef CONFIG_DEBUG_SNAPSHOT_KEVENT_EXPORT
+static struct dss_export_info *dss_export;
+static size_t dss_export_log_size;
+
+#define DSS_EXPORT_FIELD(type, member, fkind)				\
+	{								\
+		.name = #member,					\
+		.offset = offsetof(type, member),			\
+		.size = sizeof(((type *)0)->member),			\
+		.kind = fkind,						\
+	}
+
+static const struct dss_export_field dss_task_fields[] = {
+	DSS_EXPORT_FIELD(struct __task_log, time, DSS_FIELD_UINT),
+	DSS_EXPORT_FIELD(struct __task_log, pid, DSS_FIELD_SINT),
+	DSS_EXPORT_FIELD(struct __task_log, task_comm, DSS_FIELD_STR),
+};
+
+static const struct dss_export_field dss_work_fields[] = {
+	DSS_EXPORT_FIELD(struct __work_log, time, DSS_FIELD_UINT),
+	DSS_EXPORT_FIELD(struct __work_log, fn, DSS_FIELD_PTR),
+	DSS_EXPORT_FIELD(struct __work_log, task_comm, DSS_FIELD_STR),
+	DSS_EXPORT_FIELD(struct __work_log, en, DSS_FIELD_SINT),
+};
+
+static const struct dss_export_field dss_irq_fields[] = {
+	DSS_EXPORT_FIELD(struct __irq_log, time, DSS_FIELD_UINT),
+	DSS_EXPORT_FIELD(struct __irq_log, irq, DSS_FIELD_SINT),
+	DSS_EXPORT_FIELD(struct __irq_log, fn, DSS_FIELD_PTR),
+	DSS_EXPORT_FIELD(struct __irq_log, latency, DSS_FIELD_UINT),
+	DSS_EXPORT_FIELD(struct __irq_log, en, DSS_FIELD_SINT),
+};
+
+static const struct dss_export_field dss_cpuidle_fields[] = {
+	DSS_EXPORT_FIELD(struct __cpuidle_log, time, DSS_FIELD_UINT),
+	DSS_EXPORT_FIELD(struct __cpuidle_log, state, DSS_FIELD_UINT),
+	DSS_EXPORT_FIELD(struct __cpuidle_log, delta, DSS_FIELD_SINT),
+	DSS_EXPORT_FIELD(struct __cpuidle_log, en, DSS_FIELD_SINT),
+};
+
+#ifdef CONFIG_DEBUG_SNAPSHOT_FREQ
+static const struct dss_export_field dss_freq_fields[] = {
+	DSS_EXPORT_FIELD(struct __freq_log, time, DSS_FIELD_UINT),
+	DSS_EXPORT_FIELD(struct __freq_log, cpu, DSS_FIELD_SINT),
+	DSS_EXPORT_FIELD(struct __freq_log, freq_type, DSS_FIELD_SINT),
+	DSS_EXPORT_FIELD(struct __freq_log, old_freq, DSS_FIELD_UINT),
+	DSS_EXPORT_FIELD(struct __freq_log, target_freq, DSS_FIELD_UINT),
+	DSS_EXPORT_FIELD(struct __freq_log, en, DSS_FIELD_SINT),
+};
+#endif
+
+static void __init dss_export_add_ring(const char *name, size_t base, u32 nr,
+				   u32 size, u32 nr_rings, size_t last,
+				   const struct dss_export_field *field,
+				   u32 nr_fields)
+{
+	struct dss_export_ring *ring = &dss_export->ring[dss_export->nr_rings++];
+
+	strlcpy(ring->name, name, sizeof(ring->name));
+	ring->base = PAGE_SIZE + sizeof(dss_idx_page) + base;
+	ring->nr = nr;
+	ring->size = size;
+	ring->nr_rings = nr_rings;
+	ring->last = PAGE_SIZE + last;
+	ring->nr_fields = nr_fields;
+	memcpy(ring->field, field, nr_fields * sizeof(*field));
+}
+
+#define DSS_EXPORT_PER_CPU(member, fields)				\
+	dss_export_add_ring(#member, offsetof(struct dbg_snapshot_log, member),	\
+			ARRAY_SIZE(dss_log->member[0]),			\
+			sizeof(dss_log->member[0][0]), DSS_NR_CPUS,	\
+			offsetof(struct dbg_snapshot_log_idx, member##_log_idx), \
+			fields, ARRAY_SIZE(fields))
+
+static int __init dss_export_init(void)
+{
+	struct dbg_snapshot_item *item = &dss_items[dss_desc.kevents_num];
+
+	dss_export = (void *)get_zeroed_page(GFP_KERNEL);
+	if (!dss_export)
+		return -ENOMEM;
+
+	dss_export_log_size = min_t(size_t, item->entry.size,
+				    PAGE_ALIGN(sizeof(struct dbg_snapshot_log)));
+
+	dss_export->magic = DSS_EXPORT_MAGIC;
+	dss_export->version = DSS_EXPORT_VERSION;
+	dss_export->nr_cpus = DSS_NR_CPUS;
+	dss_export->map_size = PAGE_SIZE + sizeof(dss_idx_page) +
+			       dss_export_log_size;
+
+	DSS_EXPORT_PER_CPU(task, dss_task_fields);
+	DSS_EXPORT_PER_CPU(work, dss_work_fields);
+	DSS_EXPORT_PER_CPU(irq, dss_irq_fields);
+	DSS_EXPORT_PER_CPU(cpuidle, dss_cpuidle_fields);
+#ifdef CONFIG_DEBUG_SNAPSHOT_FREQ
+	dss_export_add_ring("freq", offsetof(struct dbg_snapshot_log, freq),
+			ARRAY_SIZE(dss_log->freq), sizeof(dss_log->freq[0]), 1,
+			offsetof(struct dbg_snapshot_log_idx, freq_log_idx),
+			dss_freq_fields, ARRAY_SIZE(dss_freq_fields));
+#endif
+	return 0;
+}
+
+/*
+ * Layout: info page, producer indices, then the kevents log with the
+ * same non-cacheable attributes as the kernel mapping of it.
+ * Everything is read-only; readers detect overwritten entries themselves
+ * by comparing the counters they have seen against the ring size.
+ */
+static int dss_export_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct dbg_snapshot_item *item = &dss_items[dss_desc.kevents_num];
+	unsigned long addr = vma->vm_start;
+	unsigned long size = vma->vm_end - vma->vm_start;
+	int ret;
+
+	if (vma->vm_pgoff || size != dss_export->map_size)
+		return -EINVAL;
+	if (vma->vm_flags & (VM_WRITE | VM_EXEC))
+		return -EPERM;
+
+	vma->vm_flags &= ~(VM_MAYWRITE | VM_MAYEXEC);
+	vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+
+	ret = remap_pfn_range(vma, addr, virt_to_phys(dss_export) >> PAGE_SHIFT,
+			      PAGE_SIZE, vma->vm_page_prot);
+	if (ret)
+		return ret;
+	addr += PAGE_SIZE;
+
+	ret = remap_pfn_range(vma, addr, __pa_symbol(&dss_idx_page) >> PAGE_SHIFT,
+			      sizeof(dss_idx_page), vma->vm_page_prot);
+	if (ret)
+		return ret;
+	addr += sizeof(dss_idx_page);
+
+	return remap_pfn_range(vma, addr, item->entry.paddr >> PAGE_SHIFT,
+			       dss_export_log_size,
+			       pgprot_writecombine(vma->vm_page_prot));
+}
+
+static ssize_t dss_export_read(struct file *file, char __user *buf,
+			       size_t len, loff_t *offset)
+{
+	return simple_read_from_buffer(buf, len, offset, dss_export,
+				       sizeof(*dss_export));
+}
+
+static const struct file_operations dss_export_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = dss_export_read,
+	.mmap = dss_export_mmap,
+	.llseek = default_llseek,
+};
+
+static void __init dbg_snapshot_export_debugfs_init(struct dentry *root)
+{
+	if (dss_export_init())
+		return;
+
+	debugfs_create_file("kevents", 0400, root, NULL, &dss_export_fops);
+}
+#else
+static inline void dbg_snapshot_export_debugfs_init(struct dentry *root)
+{
+}
+#endif
+
+#if defined(CONFIG_DEBUG_SNAPSHOT_COMPACT) || defined(CONFIG_DEBUG_SNAPSHOT_KEVENT_EXPORT)
+static int __init dbg_snapshot_debugfs_init(void)
+{
+	struct dentry *root;
+
+	if (!dss_log)
+		return 0;
+
+	root = debugfs_create_dir("debug-snapshot", NULL);
+	if (!root) {
+		pr_err("Failed to create debug-snapshot debugfs\n");
+		return 0;
+	}
+
+	dbg_snapshot_compact_debugfs_init(root);
+	dbg_snapshot_export_debugfs_init(root);
+
+	return 0;
+}
+late_initcall(dbg_snapshot_debugfs_init);
+#endif
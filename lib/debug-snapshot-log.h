@@ -70,6 +70,121 @@
 #define DSS_OFFSET_PANIC_STRING		(0xC00)
 #define DSS_OFFSET_SPARE_BASE		(DSS_HEADER_TOTAL_SZ)
 
+#ifdef CONFIG_DEBUG_SNAPSHOT_COMPACT
+/*
+ * Compact kevent format, used for task, work, irq, spinlock and clk
+ * events instead of the wide per type arrays. Each cpu owns a ring of
+ * fixed size blocks; a block starts with an absolute time and holds
+ * variable length records timestamped relative to the previous one, so
+ * every block can be decoded on its own after the ring wraps. Comms are
+ * interned by pid in a shared table instead of being copied per record.
+ * tools/debug-snapshot/dss-decode.c must be kept in sync with this.
+ */
+#define DSS_COMPACT_MAGIC		0x44535343	/* "DSSC" */
+#define DSS_COMPACT_VERSION		1
+#define DSS_COMPACT_BLOCK_SZ		SZ_1K
+#define DSS_COMPACT_BLOCK_NUM		16
+#define DSS_COMPACT_COMM_BITS		8
+#define DSS_COMPACT_COMM_NUM		(1 << DSS_COMPACT_COMM_BITS)
+
+enum dss_compact_type {
+	DSS_CREC_TASK = 1,	/* pid */
+	DSS_CREC_WORK,		/* pid, fn */
+	DSS_CREC_IRQ,		/* irq, latency, fn */
+	DSS_CREC_SPINLOCK,	/* lock */
+	DSS_CREC_CLK,		/* arg, clk, f_name */
+};
+
+struct dss_compact_rec {
+	u8 type;
+	u8 len;		/* whole record in bytes, a multiple of 4 */
+	u16 flag;	/* DSS_FLAG_IN/OUT/ON or the clk mode */
+	u32 delta;	/* ns since the previous record of the block */
+	u32 data[0];	/* 64 bit values are stored low word first */
+};
+
+struct dss_compact_block {
+	u64 base_time;	/* cpu_clock() of the first record */
+	u32 seq;	/* per cpu block sequence number, 0 if never used */
+	u32 used;	/* bytes of records in data[] */
+	u8 data[DSS_COMPACT_BLOCK_SZ - 16];
+};
+
+struct dss_compact_ring {
+	u64 last_time;
+	u32 seq;
+	u32 cur;
+	struct dss_compact_block block[DSS_COMPACT_BLOCK_NUM];
+};
+
+struct dss_compact_comm {
+	s32 pid;	/* -1 while being updated */
+	char comm[TASK_COMM_LEN];
+};
+
+struct dss_compact_log {
+	u32 magic;
+	u32 version;
+	u32 nr_cpus;
+	u32 block_sz;
+	u32 block_num;
+	u32 comm_num;
+	u64 text_base;	/* runtime address of _text, for symbol lookup */
+	struct dss_compact_comm comm[DSS_COMPACT_COMM_NUM];
+	struct dss_compact_ring ring[DSS_NR_CPUS];
+};
+#endif
+
+#ifdef CONFIG_DEBUG_SNAPSHOT_KEVENT_EXPORT
+/*
+ * Self-describing layout of the mmap()able kevents file, so that user
+ * space does not depend on the config specific struct dbg_snapshot_log.
+ * The mapping is the info page, then the producer index page(s), then
+ * the kevents log itself. Each ring entry for counter c sits at
+ * (c & (nr - 1)); counters are bumped before the entry is written.
+ * tools/debug-snapshot/dss-stream.c must be kept in sync with this.
+ */
+#define DSS_EXPORT_MAGIC		0x4453534b	/* "DSSK" */
+#define DSS_EXPORT_VERSION		1
+#define DSS_EXPORT_MAX_RINGS		8
+#define DSS_EXPORT_MAX_FIELDS		8
+
+enum dss_export_kind {
+	DSS_FIELD_UINT,
+	DSS_FIELD_SINT,
+	DSS_FIELD_PTR,
+	DSS_FIELD_STR,
+};
+
+struct dss_export_field {
+	char name[12];
+	u16 offset;
+	u8 size;
+	u8 kind;
+};
+
+struct dss_export_ring {
+	char name[16];
+	u64 base;	/* offset of the first ring in the mapping */
+	u32 nr;		/* entries per ring, a power of two */
+	u32 size;	/* bytes per entry */
+	u32 nr_rings;	/* one per cpu, or a single shared ring */
+	u32 last;	/* offset of the first u32 counter in the mapping */
+	u32 nr_fields;
+	u32 pad;
+	struct dss_export_field field[DSS_EXPORT_MAX_FIELDS];
+};
+
+struct dss_export_info {
+	u32 magic;
+	u32 version;
+	u32 nr_cpus;
+	u32 nr_rings;
+	u64 map_size;
+	struct dss_export_ring ring[DSS_EXPORT_MAX_RINGS];
+};
+#endif
+
 struct dbg_snapshot_log {
 	struct __task_log {
 		unsigned long long time;
@@ -334,6 +449,9 @@ struct dbg_snapshot_log {
 		void *caller[DSS_CALLSTACK_MAX_NUM];
 	} printk[DSS_API_MAX_NUM];
 #endif
+#ifdef CONFIG_DEBUG_SNAPSHOT_COMPACT
+	struct dss_compact_log compact;
+#endif
 };
 
 #endif
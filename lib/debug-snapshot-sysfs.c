@@ -96,6 +96,31 @@ static ssize_t dss_enable_store(struct kobject *kobj,
 	return count;
 }
 
+static ssize_t dss_kevents_show(struct kobject *kobj,
+				struct kobj_attribute *attr, char *buf)
+{
+	return dbg_snapshot_show_kevent_mask(buf, PAGE_SIZE);
+}
+
+static ssize_t dss_kevents_store(struct kobject *kobj,
+				struct kobj_attribute *attr,
+				const char *buf, size_t count)
+{
+	char *name;
+
+	name = (char *)kstrndup(buf, count, GFP_KERNEL);
+	if (!name)
+		return count;
+
+	name[count - 1] = '\0';
+
+	if (dbg_snapshot_toggle_kevent(name))
+		pr_info("echo name > kevents\n");
+
+	kfree(name);
+	return count;
+}
+
 static ssize_t dss_callstack_show(struct kobject *kobj,
 				struct kobj_attribute *attr, char *buf)
 {
@@ -277,6 +302,9 @@ static ssize_t dss_reg_exlist_store(struct kobject *kobj,
 static struct kobj_attribute dss_enable_attr =
 __ATTR(enabled, 0644, dss_enable_show, dss_enable_store);
 
+static struct kobj_attribute dss_kevents_attr =
+__ATTR(kevents, 0644, dss_kevents_show, dss_kevents_store);
+
 static struct kobj_attribute dss_callstack_attr =
 __ATTR(callstack, 0644, dss_callstack_show, dss_callstack_store);
 
@@ -300,6 +328,7 @@ __ATTR(exlist_reg, 0644, dss_reg_exlist_show, dss_reg_exlist_store);
 
 static struct attribute *dss_sysfs_attrs[] = {
 	&dss_enable_attr.attr,
+	&dss_kevents_attr.attr,
 	&dss_callstack_attr.attr,
 	&dss_irqlog_attr.attr,
 #ifdef CONFIG_DEBUG_SNAPSHOT_IRQ_EXIT
@@ -200,6 +200,7 @@ int dbg_snapshot_set_enable(const char *name, int en)
 			}
 		}
 	}
+	dbg_snapshot_update_kevent_keys(en);
 	return 0;
 }
 EXPORT_SYMBOL(dbg_snapshot_set_enable);
@@ -224,6 +225,7 @@ int dbg_snapshot_try_enable(const char *name, unsigned long long duration)
 				time = local_clock() - item->time;
 				if (time > duration) {
 					item->entry.enabled = true;
+					dbg_snapshot_update_kevent_keys(true);
 					ret = 1;
 				} else
 					ret = 0;
@@ -848,6 +850,7 @@ static int __init dbg_snapshot_init(void)
 	 */
 		dbg_snapshot_init_log_idx();
 		dbg_snapshot_fixmap();
+		dbg_snapshot_init_compact();
 		dbg_snapshot_init_dt();
 		dbg_snapshot_init_helper();
 		dbg_snapshot_init_utils();
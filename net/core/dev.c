@@ -3998,6 +3998,46 @@ void generic_xdp_tx(struct sk_buff *skb, struct bpf_prog *xdp_prog)
 }
 EXPORT_SYMBOL_GPL(generic_xdp_tx);
 
+/* Send a batch of generic XDP skbs queued for @dev, taking the tx lock once
+ * per run of skbs that share a queue and only ringing the doorbell for the
+ * last skb of each run.
+ */
+void generic_xdp_tx_bulk(struct net_device *dev, struct sk_buff **skbs,
+			 unsigned int count)
+{
+	struct netdev_queue *txq;
+	unsigned int i, n;
+	int cpu, rc;
+
+	for (i = 0; i < count; i++)
+		netdev_pick_tx(dev, skbs[i], NULL);
+
+	cpu = smp_processor_id();
+	for (i = 0; i < count; i = n) {
+		u16 qidx = skb_get_queue_mapping(skbs[i]);
+
+		txq = netdev_get_tx_queue(dev, qidx);
+		HARD_TX_LOCK(dev, txq, cpu);
+		for (n = i; n < count; n++) {
+			struct sk_buff *skb = skbs[n];
+			bool more;
+
+			if (skb_get_queue_mapping(skb) != qidx)
+				break;
+
+			more = n + 1 < count &&
+			       skb_get_queue_mapping(skbs[n + 1]) == qidx;
+			if (!netif_xmit_stopped(txq)) {
+				rc = netdev_start_xmit(skb, dev, txq, more);
+				if (dev_xmit_complete(rc))
+					continue;
+			}
+			kfree_skb(skb);
+		}
+		HARD_TX_UNLOCK(dev, txq);
+	}
+}
+
 static struct static_key generic_xdp_needed __read_mostly;
 
 int do_xdp_generic(struct bpf_prog *xdp_prog, struct sk_buff *skb)
@@ -4013,7 +4053,7 @@ int do_xdp_generic(struct bpf_prog *xdp_prog, struct sk_buff *skb)
 							      xdp_prog);
 				if (err)
 					goto out_redir;
-			/* fallthru to submit skb */
+				break;
 			case XDP_TX:
 				generic_xdp_tx(skb, xdp_prog);
 				break;
@@ -4941,7 +4981,7 @@ static void napi_skb_free_stolen_head(struct sk_buff *skb)
 {
 	skb_dst_drop(skb);
 	secpath_reset(skb);
-	kmem_cache_free(skbuff_head_cache, skb);
+	napi_skb_cache_put(skb);
 }
 
 static gro_result_t napi_skb_finish(gro_result_t ret, struct sk_buff *skb)
@@ -5715,6 +5755,7 @@ static __latent_entropy void net_rx_action(struct softirq_action *h)
 
 	net_rps_action_and_irq_enable(sd);
 out:
+	xdp_do_flush_map();
 	__kfree_skb_flush();
 }
 
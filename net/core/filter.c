@@ -2587,6 +2587,15 @@ err:
 }
 EXPORT_SYMBOL_GPL(xdp_do_redirect);
 
+/* Consumes the skb on success. Redirects through a devmap are queued and
+ * sent in bulk by xdp_do_flush_map(); when the caller is not a NAPI poll
+ * loop, the raised NET_RX_SOFTIRQ makes net_rx_action() do the flush.
+ * The per-cpu queues are only safe against that flush when the caller is
+ * the softirq itself. netif_rx_ni() from process context, and netif_rx()
+ * from a hardirq - even one that interrupted net_rx_action(), which still
+ * counts as serving a softirq - could interleave with it on the same cpu
+ * or take a tx lock the interrupted softirq holds, so those send directly.
+ */
 int xdp_do_generic_redirect(struct net_device *dev, struct sk_buff *skb,
 			    struct bpf_prog *xdp_prog)
 {
@@ -2629,8 +2638,24 @@ int xdp_do_generic_redirect(struct net_device *dev, struct sk_buff *skb,
 	}
 
 	skb->dev = fwd;
-	map ? _trace_xdp_redirect_map(dev, xdp_prog, fwd, map, index)
-		: _trace_xdp_redirect(dev, xdp_prog, index);
+	if (map && in_serving_softirq() && !in_irq()) {
+		if (ri->map_to_flush && ri->map_to_flush != map)
+			xdp_do_flush_map();
+
+		err = dev_map_generic_redirect(map, index, skb);
+		if (unlikely(err))
+			goto err;
+
+		if (!ri->map_to_flush) {
+			ri->map_to_flush = map;
+			raise_softirq(NET_RX_SOFTIRQ);
+		}
+		_trace_xdp_redirect_map(dev, xdp_prog, fwd, map, index);
+	} else {
+		map ? _trace_xdp_redirect_map(dev, xdp_prog, fwd, map, index)
+			: _trace_xdp_redirect(dev, xdp_prog, index);
+		generic_xdp_tx(skb, xdp_prog);
+	}
 	return 0;
 err:
 	map ? _trace_xdp_redirect_map_err(dev, xdp_prog, fwd, map, index, err)
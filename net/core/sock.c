@@ -1158,13 +1158,21 @@ set_rcvbuf:
 		break;
 
 	case SO_ZEROCOPY:
-		if (sk->sk_family != PF_INET && sk->sk_family != PF_INET6)
+		if (sk->sk_family == PF_UNIX) {
+			/* unix_dgram_sendmsg(), i.e. SOCK_DGRAM and SEQPACKET */
+			if (sk->sk_type == SOCK_STREAM)
+				ret = -ENOTSUPP;
+		} else if (sk->sk_family != PF_INET &&
+			   sk->sk_family != PF_INET6) {
 			ret = -ENOTSUPP;
-		else if (sk->sk_protocol != IPPROTO_TCP)
+		} else if (sk->sk_protocol != IPPROTO_TCP) {
 			ret = -ENOTSUPP;
-		else if (sk->sk_state != TCP_CLOSE)
+		} else if (sk->sk_state != TCP_CLOSE) {
 			ret = -EBUSY;
-		else if (val < 0 || val > 1)
+		}
+		if (ret)
+			break;
+		if (val < 0 || val > 1)
 			ret = -EINVAL;
 		else
 			sock_valbool_flag(sk, SOCK_ZEROCOPY, valbool);
@@ -300,6 +300,8 @@ static const struct snmp_mib snmp4_net_list[] = {
 	SNMP_MIB_ITEM("TCPMTUPFail", LINUX_MIB_TCPMTUPFAIL),
 	SNMP_MIB_ITEM("TCPMTUPSuccess", LINUX_MIB_TCPMTUPSUCCESS),
 	SNMP_MIB_ITEM("TCPWqueueTooBig", LINUX_MIB_TCPWQUEUETOOBIG),
+	SNMP_MIB_ITEM("TCPZeroCopyRx", LINUX_MIB_TCPZEROCOPYRX),
+	SNMP_MIB_ITEM("TCPZeroCopyRxCopied", LINUX_MIB_TCPZEROCOPYRXCOPIED),
 	SNMP_MIB_SENTINEL
 };
 
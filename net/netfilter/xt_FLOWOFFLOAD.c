@@ -0,0 +1,373 @@
+/*
+ * Xtables target to move established connections to the flow table
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/netfilter.h>
+#include <linux/netdevice.h>
+#include <linux/skbuff.h>
+#include <linux/tcp.h>
+#include <linux/netfilter/x_tables.h>
+#include <linux/netfilter/xt_FLOWOFFLOAD.h>
+#include <net/ip.h>
+#include <net/ipv6.h>
+#include <net/netfilter/nf_conntrack.h>
+#include <net/netfilter/nf_conntrack_helper.h>
+#include <net/netfilter/nf_flow_table.h>
+
+/* One flow table, filled from the FORWARD chain of all namespaces and
+ * consulted by an ingress hook on every device a flow goes through.
+ * Hooks are registered on first use of a device, from a work item since
+ * the target runs in softirq context, and removed with the device.
+ */
+static struct nf_flowtable nf_flowtable;
+
+struct xt_flowoffload_hook {
+	struct hlist_node	list;
+	struct nf_hook_ops	ops;
+	struct net		*net;
+	bool			registered;
+};
+
+static HLIST_HEAD(hooks);
+static DEFINE_SPINLOCK(hooks_lock);
+static DEFINE_MUTEX(hooks_mutex);
+static struct work_struct hook_work;
+
+static unsigned int
+xt_flowoffload_net_hook(void *priv, struct sk_buff *skb,
+			const struct nf_hook_state *state)
+{
+	switch (skb->protocol) {
+	case htons(ETH_P_IP):
+		return nf_flow_offload_ip_hook(priv, skb, state);
+	case htons(ETH_P_IPV6):
+		return nf_flow_offload_ipv6_hook(priv, skb, state);
+	}
+
+	return NF_ACCEPT;
+}
+
+static struct xt_flowoffload_hook *
+xt_flowoffload_find_hook(const struct net_device *dev)
+{
+	struct xt_flowoffload_hook *hook;
+
+	hlist_for_each_entry(hook, &hooks, list) {
+		if (hook->ops.dev == dev)
+			return hook;
+	}
+
+	return NULL;
+}
+
+static void xt_flowoffload_check_device(struct net_device *dev)
+{
+	struct xt_flowoffload_hook *hook;
+
+	if (!dev)
+		return;
+
+	spin_lock_bh(&hooks_lock);
+	if (xt_flowoffload_find_hook(dev))
+		goto out;
+
+	hook = kzalloc(sizeof(*hook), GFP_ATOMIC);
+	if (!hook)
+		goto out;
+
+	hook->ops.pf = NFPROTO_NETDEV;
+	hook->ops.hooknum = NF_NETDEV_INGRESS;
+	hook->ops.priority = 10;
+	hook->ops.priv = &nf_flowtable;
+	hook->ops.hook = xt_flowoffload_net_hook;
+	hook->ops.dev = dev;
+	hook->net = dev_net(dev);
+
+	hlist_add_head(&hook->list, &hooks);
+	schedule_work(&hook_work);
+out:
+	spin_unlock_bh(&hooks_lock);
+}
+
+static void xt_flowoffload_hook_work(struct work_struct *work)
+{
+	struct xt_flowoffload_hook *hook;
+
+	mutex_lock(&hooks_mutex);
+restart:
+	spin_lock_bh(&hooks_lock);
+	hlist_for_each_entry(hook, &hooks, list) {
+		if (hook->registered)
+			continue;
+
+		hook->registered = true;
+		spin_unlock_bh(&hooks_lock);
+
+		if (nf_register_net_hook(hook->net, &hook->ops)) {
+			spin_lock_bh(&hooks_lock);
+			hlist_del(&hook->list);
+			spin_unlock_bh(&hooks_lock);
+			kfree(hook);
+		}
+		goto restart;
+	}
+	spin_unlock_bh(&hooks_lock);
+	mutex_unlock(&hooks_mutex);
+}
+
+static void xt_flowoffload_unregister_hook(struct net_device *dev)
+{
+	struct xt_flowoffload_hook *hook;
+
+	mutex_lock(&hooks_mutex);
+	spin_lock_bh(&hooks_lock);
+	hook = xt_flowoffload_find_hook(dev);
+	if (hook)
+		hlist_del(&hook->list);
+	spin_unlock_bh(&hooks_lock);
+
+	if (hook) {
+		if (hook->registered)
+			nf_unregister_net_hook(hook->net, &hook->ops);
+		kfree(hook);
+	}
+	mutex_unlock(&hooks_mutex);
+}
+
+static bool xt_flowoffload_skip(struct sk_buff *skb, u8 family)
+{
+	if (skb_sec_path(skb))
+		return true;
+
+	if (family == NFPROTO_IPV4) {
+		const struct ip_options *opt = &(IPCB(skb)->opt);
+
+		if (unlikely(opt->optlen))
+			return true;
+	}
+
+	return false;
+}
+
+/* Route for the reply direction, towards the original sender */
+static int
+xt_flowoffload_route(struct sk_buff *skb, const struct nf_conn *ct,
+		     const struct xt_action_param *par,
+		     struct nf_flow_route *route, enum ip_conntrack_dir dir)
+{
+	struct dst_entry *this_dst = skb_dst(skb);
+	struct dst_entry *other_dst = NULL;
+	const struct nf_afinfo *afinfo;
+	struct flowi fl;
+
+	memset(&fl, 0, sizeof(fl));
+	switch (xt_family(par)) {
+	case NFPROTO_IPV4:
+		fl.u.ip4.daddr = ct->tuplehash[dir].tuple.src.u3.ip;
+		fl.u.ip4.flowi4_oif = xt_in(par)->ifindex;
+		break;
+	case NFPROTO_IPV6:
+		fl.u.ip6.saddr = ct->tuplehash[dir].tuple.dst.u3.in6;
+		fl.u.ip6.daddr = ct->tuplehash[dir].tuple.src.u3.in6;
+		fl.u.ip6.flowi6_oif = xt_in(par)->ifindex;
+		break;
+	}
+
+	afinfo = nf_get_afinfo(xt_family(par));
+	if (!afinfo)
+		return -ENOENT;
+
+	afinfo->route(xt_net(par), &other_dst, &fl, false);
+	if (!other_dst)
+		return -ENOENT;
+
+	route->tuple[dir].dst		= this_dst;
+	route->tuple[dir].ifindex	= xt_in(par)->ifindex;
+	route->tuple[!dir].dst		= other_dst;
+	route->tuple[!dir].ifindex	= xt_out(par)->ifindex;
+
+	return 0;
+}
+
+static unsigned int
+flowoffload_tg(struct sk_buff *skb, const struct xt_action_param *par)
+{
+	struct nf_flow_route route;
+	enum ip_conntrack_info ctinfo;
+	enum ip_conntrack_dir dir;
+	struct flow_offload *flow;
+	struct tcphdr _tcph, *tcph;
+	struct nf_conn *ct;
+
+	if (xt_flowoffload_skip(skb, xt_family(par)))
+		return XT_CONTINUE;
+
+	ct = nf_ct_get(skb, &ctinfo);
+	if (!ct)
+		return XT_CONTINUE;
+
+	switch (ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple.dst.protonum) {
+	case IPPROTO_TCP:
+		if (ct->proto.tcp.state != TCP_CONNTRACK_ESTABLISHED)
+			return XT_CONTINUE;
+
+		tcph = skb_header_pointer(skb, par->thoff,
+					  sizeof(_tcph), &_tcph);
+		if (unlikely(!tcph || tcph->fin || tcph->rst))
+			return XT_CONTINUE;
+		break;
+	case IPPROTO_UDP:
+		break;
+	default:
+		return XT_CONTINUE;
+	}
+
+	/* Helpers and sequence adjustment need to see every packet */
+	if (nfct_help(ct) || test_bit(IPS_SEQ_ADJUST_BIT, &ct->status))
+		return XT_CONTINUE;
+
+	if (ctinfo == IP_CT_NEW || ctinfo == IP_CT_RELATED ||
+	    !test_bit(IPS_ASSURED_BIT, &ct->status))
+		return XT_CONTINUE;
+
+	if (test_and_set_bit(IPS_OFFLOAD_BIT, &ct->status))
+		return XT_CONTINUE;
+
+	dir = CTINFO2DIR(ctinfo);
+
+	if (xt_flowoffload_route(skb, ct, par, &route, dir) < 0)
+		goto err_flow_route;
+
+	flow = flow_offload_alloc(ct, &route);
+	if (!flow)
+		goto err_flow_alloc;
+
+	if (flow_offload_add(&nf_flowtable, flow) < 0)
+		goto err_flow_add;
+
+	xt_flowoffload_check_device(xt_in(par));
+	xt_flowoffload_check_device(xt_out(par));
+
+	dst_release(route.tuple[!dir].dst);
+
+	return XT_CONTINUE;
+
+err_flow_add:
+	flow_offload_free(flow);
+err_flow_alloc:
+	dst_release(route.tuple[!dir].dst);
+err_flow_route:
+	clear_bit(IPS_OFFLOAD_BIT, &ct->status);
+
+	return XT_CONTINUE;
+}
+
+static int flowoffload_chk(const struct xt_tgchk_param *par)
+{
+	const struct xt_flowoffload_target_info *info = par->targinfo;
+
+	if (info->flags & ~XT_FLOWOFFLOAD_MASK)
+		return -EINVAL;
+
+	return nf_ct_netns_get(par->net, par->family);
+}
+
+static void flowoffload_destroy(const struct xt_tgdtor_param *par)
+{
+	nf_ct_netns_put(par->net, par->family);
+}
+
+static struct xt_target offload_tg_reg __read_mostly = {
+	.family		= NFPROTO_UNSPEC,
+	.name		= "FLOWOFFLOAD",
+	.revision	= 0,
+	.targetsize	= sizeof(struct xt_flowoffload_target_info),
+	.usersize	= sizeof(struct xt_flowoffload_target_info),
+	.checkentry	= flowoffload_chk,
+	.destroy	= flowoffload_destroy,
+	.target		= flowoffload_tg,
+	.table		= "filter",
+	.hooks		= 1 << NF_INET_FORWARD,
+	.me		= THIS_MODULE,
+};
+
+static int flow_offload_netdev_event(struct notifier_block *this,
+				     unsigned long event, void *ptr)
+{
+	struct net_device *dev = netdev_notifier_info_to_dev(ptr);
+
+	switch (event) {
+	case NETDEV_DOWN:
+		nf_flow_table_cleanup(&nf_flowtable, dev);
+		break;
+	case NETDEV_UNREGISTER:
+		nf_flow_table_cleanup(&nf_flowtable, dev);
+		xt_flowoffload_unregister_hook(dev);
+		break;
+	}
+
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block flow_offload_netdev_notifier = {
+	.notifier_call	= flow_offload_netdev_event,
+};
+
+static int __init xt_flowoffload_tg_init(void)
+{
+	int ret;
+
+	INIT_WORK(&hook_work, xt_flowoffload_hook_work);
+
+	ret = nf_flow_table_init(&nf_flowtable);
+	if (ret)
+		return ret;
+
+	ret = register_netdevice_notifier(&flow_offload_netdev_notifier);
+	if (ret)
+		goto err_notifier;
+
+	ret = xt_register_target(&offload_tg_reg);
+	if (ret)
+		goto err_target;
+
+	return 0;
+
+err_target:
+	unregister_netdevice_notifier(&flow_offload_netdev_notifier);
+err_notifier:
+	nf_flow_table_free(&nf_flowtable);
+	return ret;
+}
+
+static void __exit xt_flowoffload_tg_exit(void)
+{
+	struct xt_flowoffload_hook *hook;
+	struct hlist_node *n;
+
+	xt_unregister_target(&offload_tg_reg);
+	unregister_netdevice_notifier(&flow_offload_netdev_notifier);
+	cancel_work_sync(&hook_work);
+
+	hlist_for_each_entry_safe(hook, n, &hooks, list) {
+		hlist_del(&hook->list);
+		if (hook->registered)
+			nf_unregister_net_hook(hook->net, &hook->ops);
+		kfree(hook);
+	}
+
+	nf_flow_table_free(&nf_flowtable);
+}
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Xtables: move established connections to the flow table");
+MODULE_ALIAS("ipt_FLOWOFFLOAD");
+MODULE_ALIAS("ip6t_FLOWOFFLOAD");
+module_init(xt_flowoffload_tg_init);
+module_exit(xt_flowoffload_tg_exit);
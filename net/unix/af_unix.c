@@ -1601,8 +1601,10 @@ static int unix_dgram_sendmsg(struct socket *sock, struct msghdr *msg,
 	struct sk_buff *skb;
 	long timeo;
 	struct scm_cookie scm;
+	struct ubuf_info *uarg = NULL;
 	int data_len = 0;
 	int sk_locked;
+	bool zc = false;
 
 	wait_for_unix_gc();
 	err = scm_send(sock, msg, &scm, false);
@@ -1634,7 +1636,29 @@ static int unix_dgram_sendmsg(struct socket *sock, struct msghdr *msg,
 	if (len > sk->sk_sndbuf - 32)
 		goto out;
 
-	if (len > SKB_MAX_ALLOC) {
+	/*
+	 * MSG_ZEROCOPY: queue the sender's pinned pages instead of a copy,
+	 * so the only copy left is the receiver's.  Completion is reported
+	 * on the sender's error queue once the receiver has consumed the
+	 * skb.  The pages stay charged to our sk_wmem_alloc and to
+	 * RLIMIT_MEMLOCK until then, so a peer that never reads can't pin
+	 * more than we could have queued anyway.
+	 */
+	if ((msg->msg_flags & MSG_ZEROCOPY) && len &&
+	    sock_flag(sk, SOCK_ZEROCOPY)) {
+		err = -ENOBUFS;
+		uarg = sock_zerocopy_alloc(sk, len);
+		if (!uarg)
+			goto out;
+
+		/* Messages that don't fit in the frags are copied */
+		zc = iov_iter_npages(&msg->msg_iter, MAX_SKB_FRAGS + 1) <=
+		     MAX_SKB_FRAGS;
+		if (!zc)
+			uarg->zerocopy = 0;
+	}
+
+	if (!zc && len > SKB_MAX_ALLOC) {
 		data_len = min_t(size_t,
 				 len - SKB_MAX_ALLOC,
 				 MAX_SKB_FRAGS * PAGE_SIZE);
@@ -1643,7 +1667,7 @@ static int unix_dgram_sendmsg(struct socket *sock, struct msghdr *msg,
 		BUILD_BUG_ON(SKB_MAX_ALLOC < PAGE_SIZE);
 	}
 
-	skb = sock_alloc_send_pskb(sk, len - data_len, data_len,
+	skb = sock_alloc_send_pskb(sk, zc ? 0 : len - data_len, data_len,
 				   msg->msg_flags & MSG_DONTWAIT, &err,
 				   PAGE_ALLOC_COSTLY_ORDER);
 	if (skb == NULL)
@@ -1653,12 +1677,17 @@ static int unix_dgram_sendmsg(struct socket *sock, struct msghdr *msg,
 	if (err < 0)
 		goto out_free;
 
-	skb_put(skb, len - data_len);
-	skb->data_len = data_len;
-	skb->len = len;
-	err = skb_copy_datagram_from_iter(skb, 0, &msg->msg_iter, len);
+	if (zc) {
+		err = __zerocopy_sg_from_iter(sk, skb, &msg->msg_iter, len);
+	} else {
+		skb_put(skb, len - data_len);
+		skb->data_len = data_len;
+		skb->len = len;
+		err = skb_copy_datagram_from_iter(skb, 0, &msg->msg_iter, len);
+	}
 	if (err)
 		goto out_free;
+	skb_zcopy_set(skb, uarg);
 
 	timeo = sock_sndtimeo(sk, msg->msg_flags & MSG_DONTWAIT);
 
@@ -1772,6 +1801,7 @@ restart_locked:
 	unix_state_unlock(other);
 	other->sk_data_ready(other);
 	sock_put(other);
+	sock_zerocopy_put(uarg);
 	scm_destroy(&scm);
 	return len;
 
@@ -1784,6 +1814,11 @@ out_free:
 out:
 	if (other)
 		sock_put(other);
+	/* a filtered message still counts as sent */
+	if (err >= 0)
+		sock_zerocopy_put(uarg);
+	else
+		sock_zerocopy_put_abort(uarg);
 	scm_destroy(&scm);
 	return err;
 }
@@ -2032,7 +2067,7 @@ static int unix_seqpacket_recvmsg(struct socket *sock, struct msghdr *msg,
 {
 	struct sock *sk = sock->sk;
 
-	if (sk->sk_state != TCP_ESTABLISHED)
+	if (sk->sk_state != TCP_ESTABLISHED && !(flags & MSG_ERRQUEUE))
 		return -ENOTCONN;
 
 	return unix_dgram_recvmsg(sock, msg, size, flags);
@@ -2063,6 +2098,11 @@ static int unix_dgram_recvmsg(struct socket *sock, struct msghdr *msg,
 	if (flags&MSG_OOB)
 		goto out;
 
+	/* MSG_ZEROCOPY completions */
+	if (flags & MSG_ERRQUEUE)
+		return sock_recv_errqueue(sk, msg, size, SOL_SOCKET,
+					  SO_ZEROCOPY);
+
 	timeo = sock_rcvtimeo(sk, flags & MSG_DONTWAIT);
 
 	do {
@@ -0,0 +1,389 @@
+// SPDX-License-Identifier: GPL-2.0 OR MIT
+/*
+ * Copyright (C) 2015-2019 Jason A. Donenfeld <Jason@zx2c4.com>. All Rights Reserved.
+ *
+ * This is an implementation of the ChaCha20Poly1305 AEAD construction.
+ *
+ * Information: https://tools.ietf.org/html/rfc8439
+ */
+
+#include <zinc/chacha20poly1305.h>
+#include <zinc/chacha20.h>
+#include <zinc/poly1305.h>
+#include "selftest/run.h"
+
+#include <asm/unaligned.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/mm.h>
+#include <crypto/algapi.h> // For crypto_xor_cpy.
+#include <crypto/scatterwalk.h>
+
+static const u8 pad0[CHACHA20_BLOCK_SIZE] = { 0 };
+
+/* Data is run through ChaCha20 and Poly1305 in chunks of this size, so that
+ * the second pass reads what the first one left in L1 instead of walking
+ * the whole packet twice. It is a whole number of blocks that still lets
+ * the SIMD implementations take their wide paths.
+ */
+enum { CHACHA20POLY1305_CHUNK_SIZE = CHACHA20_BLOCK_SIZE * 8 };
+
+static inline void
+__chacha20poly1305_encrypt(u8 *dst, const u8 *src, const size_t src_len,
+			   const u8 *ad, const size_t ad_len, const u64 nonce,
+			   const u8 key[CHACHA20POLY1305_KEY_SIZE],
+			   simd_context_t *simd_context)
+{
+	struct poly1305_ctx poly1305_state;
+	struct chacha20_ctx chacha20_state;
+	union {
+		u8 block0[POLY1305_KEY_SIZE];
+		__le64 lens[2];
+	} b = { { 0 } };
+	size_t off, l;
+
+	chacha20_init(&chacha20_state, key, nonce);
+	chacha20(&chacha20_state, b.block0, b.block0, sizeof(b.block0),
+		 simd_context);
+	poly1305_init(&poly1305_state, b.block0);
+
+	poly1305_update(&poly1305_state, ad, ad_len, simd_context);
+	poly1305_update(&poly1305_state, pad0, (0x10 - ad_len) & 0xf,
+			simd_context);
+
+	for (off = 0; off < src_len; off += l) {
+		l = min_t(size_t, src_len - off, CHACHA20POLY1305_CHUNK_SIZE);
+		chacha20(&chacha20_state, dst + off, src + off, l,
+			 simd_context);
+		poly1305_update(&poly1305_state, dst + off, l, simd_context);
+	}
+	poly1305_update(&poly1305_state, pad0, (0x10 - src_len) & 0xf,
+			simd_context);
+
+	b.lens[0] = cpu_to_le64(ad_len);
+	b.lens[1] = cpu_to_le64(src_len);
+	poly1305_update(&poly1305_state, (u8 *)b.lens, sizeof(b.lens),
+			simd_context);
+
+	poly1305_final(&poly1305_state, dst + src_len, simd_context);
+
+	memzero_explicit(&chacha20_state, sizeof(chacha20_state));
+	memzero_explicit(&b, sizeof(b));
+}
+
+void chacha20poly1305_encrypt(u8 *dst, const u8 *src, const size_t src_len,
+			      const u8 *ad, const size_t ad_len,
+			      const u64 nonce,
+			      const u8 key[CHACHA20POLY1305_KEY_SIZE])
+{
+	simd_context_t simd_context;
+
+	simd_get(&simd_context);
+	__chacha20poly1305_encrypt(dst, src, src_len, ad, ad_len, nonce, key,
+				   &simd_context);
+	simd_put(&simd_context);
+}
+
+struct chacha20poly1305_sg_state {
+	struct poly1305_ctx poly1305;
+	struct chacha20_ctx chacha20;
+	u8 stream[CHACHA20_BLOCK_SIZE];
+	size_t partial;
+};
+
+/* En- or decrypts one mapped piece of a scatterlist in place, in chunks.
+ * Encryption authenticates each chunk right after ChaCha20 wrote it, and
+ * decryption right before ChaCha20 reads it. @last says that the piece
+ * ends the message, so it may end in a partial block. Otherwise a partial
+ * block at the end is finished off from st->stream by the next piece.
+ */
+static void chacha20poly1305_crypt_piece(struct chacha20poly1305_sg_state *st,
+					 u8 *addr, size_t length, bool last,
+					 bool encrypt,
+					 simd_context_t *simd_context)
+{
+	size_t l;
+
+	for (; length; addr += l, length -= l) {
+		if (unlikely(st->partial)) {
+			l = min(length, CHACHA20_BLOCK_SIZE - st->partial);
+			if (!encrypt)
+				poly1305_update(&st->poly1305, addr, l,
+						simd_context);
+			crypto_xor(addr, st->stream + st->partial, l);
+			st->partial = (st->partial + l) &
+				      (CHACHA20_BLOCK_SIZE - 1);
+		} else if (likely(length >= CHACHA20_BLOCK_SIZE || last)) {
+			l = min_t(size_t, length, CHACHA20POLY1305_CHUNK_SIZE);
+			if (!last)
+				l &= ~(CHACHA20_BLOCK_SIZE - 1);
+			if (!encrypt)
+				poly1305_update(&st->poly1305, addr, l,
+						simd_context);
+			chacha20(&st->chacha20, addr, addr, l, simd_context);
+		} else {
+			l = length;
+			chacha20(&st->chacha20, st->stream, pad0,
+				 CHACHA20_BLOCK_SIZE, simd_context);
+			if (!encrypt)
+				poly1305_update(&st->poly1305, addr, l,
+						simd_context);
+			crypto_xor(addr, st->stream, l);
+			st->partial = l;
+		}
+		if (encrypt)
+			poly1305_update(&st->poly1305, addr, l, simd_context);
+	}
+}
+
+/* Common part of the scatterlist variants: the @src_len bytes of data are
+ * en- or decrypted in place and @mac receives the computed tag. Encryption
+ * stores it after the data in @src, decryption copies the tag found there
+ * to @read_mac for the caller to compare.
+ */
+static void chacha20poly1305_crypt_sg(struct scatterlist *src,
+				      const size_t src_len, const u8 *ad,
+				      const size_t ad_len, const u64 nonce,
+				      const u8 key[CHACHA20POLY1305_KEY_SIZE],
+				      bool encrypt, u8 mac[POLY1305_MAC_SIZE],
+				      u8 *read_mac,
+				      simd_context_t *simd_context)
+{
+	struct chacha20poly1305_sg_state st;
+	struct sg_mapping_iter miter;
+	ssize_t sl;
+	union {
+		u8 block0[POLY1305_KEY_SIZE];
+		__le64 lens[2];
+	} b = { { 0 } };
+
+	chacha20_init(&st.chacha20, key, nonce);
+	chacha20(&st.chacha20, b.block0, b.block0, sizeof(b.block0),
+		 simd_context);
+	poly1305_init(&st.poly1305, b.block0);
+	st.partial = 0;
+
+	poly1305_update(&st.poly1305, ad, ad_len, simd_context);
+	poly1305_update(&st.poly1305, pad0, (0x10 - ad_len) & 0xf,
+			simd_context);
+
+	sg_miter_start(&miter, src, sg_nents(src),
+		       SG_MITER_TO_SG | SG_MITER_ATOMIC);
+	for (sl = src_len; sl > 0 && sg_miter_next(&miter);
+	     sl -= miter.length) {
+		size_t length = min_t(size_t, sl, miter.length);
+
+		chacha20poly1305_crypt_piece(&st, miter.addr, length,
+					     length == sl, encrypt,
+					     simd_context);
+		simd_relax(simd_context);
+	}
+
+	poly1305_update(&st.poly1305, pad0, (0x10 - src_len) & 0xf,
+			simd_context);
+
+	b.lens[0] = cpu_to_le64(ad_len);
+	b.lens[1] = cpu_to_le64(src_len);
+	poly1305_update(&st.poly1305, (u8 *)b.lens, sizeof(b.lens),
+			simd_context);
+	poly1305_final(&st.poly1305, mac, simd_context);
+
+	/* The tag directly follows the data, usually in the same piece. */
+	if (likely(sl <= -POLY1305_MAC_SIZE)) {
+		u8 *tag = miter.addr + miter.length + sl;
+
+		if (encrypt)
+			memcpy(tag, mac, POLY1305_MAC_SIZE);
+		else
+			memcpy(read_mac, tag, POLY1305_MAC_SIZE);
+	}
+	sg_miter_stop(&miter);
+	if (unlikely(sl > -POLY1305_MAC_SIZE))
+		scatterwalk_map_and_copy(encrypt ? mac : read_mac, src,
+					 src_len, POLY1305_MAC_SIZE, encrypt);
+
+	memzero_explicit(&st, sizeof(st));
+	memzero_explicit(&b, sizeof(b));
+}
+
+bool chacha20poly1305_encrypt_sg_inplace(struct scatterlist *src,
+					 const size_t src_len,
+					 const u8 *ad, const size_t ad_len,
+					 const u64 nonce,
+					 const u8 key[CHACHA20POLY1305_KEY_SIZE],
+					 simd_context_t *simd_context)
+{
+	u8 mac[POLY1305_MAC_SIZE];
+
+	if (WARN_ON(src_len > INT_MAX))
+		return false;
+
+	chacha20poly1305_crypt_sg(src, src_len, ad, ad_len, nonce, key, true,
+				  mac, NULL, simd_context);
+	memzero_explicit(mac, sizeof(mac));
+	return true;
+}
+
+static inline bool
+__chacha20poly1305_decrypt(u8 *dst, const u8 *src, const size_t src_len,
+			   const u8 *ad, const size_t ad_len, const u64 nonce,
+			   const u8 key[CHACHA20POLY1305_KEY_SIZE],
+			   simd_context_t *simd_context)
+{
+	struct poly1305_ctx poly1305_state;
+	struct chacha20_ctx chacha20_state;
+	size_t dst_len;
+	int ret;
+	union {
+		u8 block0[POLY1305_KEY_SIZE];
+		u8 mac[POLY1305_MAC_SIZE];
+		__le64 lens[2];
+	} b = { { 0 } };
+
+	if (unlikely(src_len < POLY1305_MAC_SIZE))
+		return false;
+
+	chacha20_init(&chacha20_state, key, nonce);
+	chacha20(&chacha20_state, b.block0, b.block0, sizeof(b.block0),
+		 simd_context);
+	poly1305_init(&poly1305_state, b.block0);
+
+	poly1305_update(&poly1305_state, ad, ad_len, simd_context);
+	poly1305_update(&poly1305_state, pad0, (0x10 - ad_len) & 0xf,
+			simd_context);
+
+	/* Nothing is written to @dst before the tag has been checked. */
+	dst_len = src_len - POLY1305_MAC_SIZE;
+	poly1305_update(&poly1305_state, src, dst_len, simd_context);
+	poly1305_update(&poly1305_state, pad0, (0x10 - dst_len) & 0xf,
+			simd_context);
+
+	b.lens[0] = cpu_to_le64(ad_len);
+	b.lens[1] = cpu_to_le64(dst_len);
+	poly1305_update(&poly1305_state, (u8 *)b.lens, sizeof(b.lens),
+			simd_context);
+
+	poly1305_final(&poly1305_state, b.mac, simd_context);
+
+	ret = crypto_memneq(b.mac, src + dst_len, POLY1305_MAC_SIZE);
+	if (likely(!ret))
+		chacha20(&chacha20_state, dst, src, dst_len, simd_context);
+
+	memzero_explicit(&chacha20_state, sizeof(chacha20_state));
+	memzero_explicit(&b, sizeof(b));
+
+	return !ret;
+}
+
+bool chacha20poly1305_decrypt(u8 *dst, const u8 *src, const size_t src_len,
+			      const u8 *ad, const size_t ad_len,
+			      const u64 nonce,
+			      const u8 key[CHACHA20POLY1305_KEY_SIZE])
+{
+	simd_context_t simd_context;
+	bool ret;
+
+	simd_get(&simd_context);
+	ret = __chacha20poly1305_decrypt(dst, src, src_len, ad, ad_len, nonce,
+					 key, &simd_context);
+	simd_put(&simd_context);
+	return ret;
+}
+
+bool chacha20poly1305_decrypt_sg_inplace(struct scatterlist *src,
+					 size_t src_len,
+					 const u8 *ad, const size_t ad_len,
+					 const u64 nonce,
+					 const u8 key[CHACHA20POLY1305_KEY_SIZE],
+					 simd_context_t *simd_context)
+{
+	struct {
+		u8 read_mac[POLY1305_MAC_SIZE];
+		u8 computed_mac[POLY1305_MAC_SIZE];
+	} b;
+	bool ret;
+
+	if (unlikely(src_len < POLY1305_MAC_SIZE || WARN_ON(src_len > INT_MAX)))
+		return false;
+
+	/* The data is decrypted in place before the tag is checked, so on
+	 * failure the caller must drop it.
+	 */
+	chacha20poly1305_crypt_sg(src, src_len - POLY1305_MAC_SIZE, ad,
+				  ad_len, nonce, key, false, b.computed_mac,
+				  b.read_mac, simd_context);
+	ret = !crypto_memneq(b.read_mac, b.computed_mac, POLY1305_MAC_SIZE);
+
+	memzero_explicit(&b, sizeof(b));
+	return ret;
+}
+
+void xchacha20poly1305_encrypt(u8 *dst, const u8 *src, const size_t src_len,
+			       const u8 *ad, const size_t ad_len,
+			       const u8 nonce[XCHACHA20POLY1305_NONCE_SIZE],
+			       const u8 key[CHACHA20POLY1305_KEY_SIZE])
+{
+	simd_context_t simd_context;
+	u32 derived_key[CHACHA20_KEY_WORDS] __aligned(16);
+
+	simd_get(&simd_context);
+	hchacha20(derived_key, nonce, key, &simd_context);
+	cpu_to_le32_array(derived_key, ARRAY_SIZE(derived_key));
+	__chacha20poly1305_encrypt(dst, src, src_len, ad, ad_len,
+				   get_unaligned_le64(nonce + 16),
+				   (u8 *)derived_key, &simd_context);
+	memzero_explicit(derived_key, CHACHA20POLY1305_KEY_SIZE);
+	simd_put(&simd_context);
+}
+
+bool xchacha20poly1305_decrypt(u8 *dst, const u8 *src, const size_t src_len,
+			       const u8 *ad, const size_t ad_len,
+			       const u8 nonce[XCHACHA20POLY1305_NONCE_SIZE],
+			       const u8 key[CHACHA20POLY1305_KEY_SIZE])
+{
+	bool ret;
+	simd_context_t simd_context;
+	u32 derived_key[CHACHA20_KEY_WORDS] __aligned(16);
+
+	simd_get(&simd_context);
+	hchacha20(derived_key, nonce, key, &simd_context);
+	cpu_to_le32_array(derived_key, ARRAY_SIZE(derived_key));
+	ret = __chacha20poly1305_decrypt(dst, src, src_len, ad, ad_len,
+					 get_unaligned_le64(nonce + 16),
+					 (u8 *)derived_key, &simd_context);
+	memzero_explicit(derived_key, CHACHA20POLY1305_KEY_SIZE);
+	simd_put(&simd_context);
+	return ret;
+}
+
+#include "selftest/chacha20poly1305.c"
+
+static bool bench __initdata = false;
+
+#ifndef COMPAT_ZINC_IS_A_MODULE
+int __init chacha20poly1305_mod_init(void)
+#else
+static int __init mod_init(void)
+#endif
+{
+	if (!selftest_run("chacha20poly1305", chacha20poly1305_selftest,
+			  NULL, 0))
+		return -ENOTRECOVERABLE;
+	if (bench)
+		chacha20poly1305_bench();
+	return 0;
+}
+
+#ifdef COMPAT_ZINC_IS_A_MODULE
+static void __exit mod_exit(void)
+{
+}
+
+module_param(bench, bool, 0);
+module_init(mod_init);
+module_exit(mod_exit);
+MODULE_LICENSE("GPL v2");
+MODULE_DESCRIPTION("ChaCha20Poly1305 AEAD construction");
+MODULE_AUTHOR("Jason A. Donenfeld <Jason@zx2c4.com>");
+#endif
@@ -0,0 +1,293 @@
+// SPDX-License-Identifier: GPL-2.0 OR MIT
+/*
+ * Copyright (C) 2015-2019 Jason A. Donenfeld <Jason@zx2c4.com>. All Rights Reserved.
+ */
+
+/* The primitives are checked against known answers by their own
+ * self-tests. What is checked here is the chunked scatterlist code: for
+ * every length and every way of splitting the buffer, it has to produce
+ * exactly what the contiguous code produces, and tampering with any part
+ * of the message has to be caught.
+ */
+
+#include <linux/math64.h>
+#include <linux/scatterlist.h>
+#include <linux/slab.h>
+#include <linux/timex.h>
+
+static const size_t chacha20poly1305_test_lens[] __initconst = {
+	0, 1, 15, 16, 17, 63, 64, 65, 191, 192, 511, 512, 513, 576, 1023,
+	1024, 1025, 1420, 1500, 4096, 4097
+};
+
+/* Pieces the scatterlist is cut into, repeated until the buffer is used
+ * up. The tag ends up in its own piece, split from the data, or sharing a
+ * piece with it, depending on the length.
+ */
+static const unsigned int chacha20poly1305_test_splits[][4] __initconst = {
+	{ 8192 }, { 1 }, { 7, 57 }, { 64 }, { 65 }, { 100, 412, 3 },
+	{ 512 }, { 513, 1 }, { 1000, 24 }
+};
+
+enum { CHACHA20POLY1305_TEST_SG = 64 };
+
+static void __init chacha20poly1305_selftest_sg(struct scatterlist *sg,
+						 u8 *buf, size_t len,
+						 const unsigned int *split)
+{
+	unsigned int i = 0, n = 0;
+	size_t off, l;
+
+	sg_init_table(sg, CHACHA20POLY1305_TEST_SG);
+	for (off = 0; off < len; off += l, ++n) {
+		if (i == ARRAY_SIZE(chacha20poly1305_test_splits[0]) ||
+		    !split[i])
+			i = 0;
+		l = min_t(size_t, len - off, split[i++]);
+		if (n == CHACHA20POLY1305_TEST_SG - 1)
+			l = len - off;
+		sg_set_buf(&sg[n], buf + off, l);
+	}
+	sg_mark_end(&sg[n - 1]);
+}
+
+static bool __init chacha20poly1305_selftest(void)
+{
+	enum { MAXIMUM_TEST_BUFFER_LEN = 4097 + POLY1305_MAC_SIZE };
+	u8 key[CHACHA20POLY1305_KEY_SIZE], ad[13];
+	u8 xnonce[XCHACHA20POLY1305_NONCE_SIZE];
+	u8 *plain = NULL, *expected = NULL, *work = NULL;
+	struct scatterlist *sg = NULL;
+	simd_context_t simd_context;
+	size_t i, j, k, len;
+	bool success = true, ret;
+	u64 nonce;
+
+	plain = kmalloc(MAXIMUM_TEST_BUFFER_LEN, GFP_KERNEL);
+	expected = kmalloc(MAXIMUM_TEST_BUFFER_LEN, GFP_KERNEL);
+	work = kmalloc(MAXIMUM_TEST_BUFFER_LEN, GFP_KERNEL);
+	sg = kmalloc_array(CHACHA20POLY1305_TEST_SG, sizeof(*sg), GFP_KERNEL);
+	if (!plain || !expected || !work || !sg) {
+		success = false;
+		goto out;
+	}
+
+	for (i = 0; i < MAXIMUM_TEST_BUFFER_LEN; ++i)
+		plain[i] = i * 7 + 3;
+	for (i = 0; i < sizeof(key); ++i)
+		key[i] = i * 13 + 1;
+	for (i = 0; i < sizeof(ad); ++i)
+		ad[i] = 0xa0 + i;
+	for (i = 0; i < sizeof(xnonce); ++i)
+		xnonce[i] = 0x40 + i;
+	nonce = 0x0706050403020100ULL;
+
+	for (i = 0; i < ARRAY_SIZE(chacha20poly1305_test_lens); ++i) {
+		len = chacha20poly1305_test_lens[i];
+
+		chacha20poly1305_encrypt(expected, plain, len, ad, sizeof(ad),
+					 nonce, key);
+		ret = chacha20poly1305_decrypt(work, expected,
+					       len + POLY1305_MAC_SIZE, ad,
+					       sizeof(ad), nonce, key);
+		if (!ret || memcmp(work, plain, len)) {
+			pr_err("chacha20poly1305 self-test %zu: FAIL\n", i + 1);
+			success = false;
+		}
+
+		for (j = 0; j < ARRAY_SIZE(chacha20poly1305_test_splits); ++j) {
+			const unsigned int *split =
+				chacha20poly1305_test_splits[j];
+
+			memcpy(work, plain, len);
+			chacha20poly1305_selftest_sg(sg, work,
+						     len + POLY1305_MAC_SIZE,
+						     split);
+			simd_get(&simd_context);
+			ret = chacha20poly1305_encrypt_sg_inplace(sg, len, ad,
+						sizeof(ad), nonce, key,
+						&simd_context);
+			simd_put(&simd_context);
+			if (!ret || memcmp(work, expected,
+					   len + POLY1305_MAC_SIZE)) {
+				pr_err("chacha20poly1305 sg encryption self-test %zu/%zu: FAIL\n",
+				       i + 1, j + 1);
+				success = false;
+			}
+
+			simd_get(&simd_context);
+			ret = chacha20poly1305_decrypt_sg_inplace(sg,
+						len + POLY1305_MAC_SIZE, ad,
+						sizeof(ad), nonce, key,
+						&simd_context);
+			simd_put(&simd_context);
+			if (!ret || memcmp(work, plain, len)) {
+				pr_err("chacha20poly1305 sg decryption self-test %zu/%zu: FAIL\n",
+				       i + 1, j + 1);
+				success = false;
+			}
+		}
+
+		/* A flipped bit anywhere in the data or tag must be noticed. */
+		for (k = 0; k < len + POLY1305_MAC_SIZE;
+		     k += max_t(size_t, 1, len / 7)) {
+			memcpy(work, expected, len + POLY1305_MAC_SIZE);
+			work[k] ^= 0x20;
+			chacha20poly1305_selftest_sg(sg, work,
+						     len + POLY1305_MAC_SIZE,
+						     chacha20poly1305_test_splits[2]);
+			simd_get(&simd_context);
+			ret = chacha20poly1305_decrypt_sg_inplace(sg,
+						len + POLY1305_MAC_SIZE, ad,
+						sizeof(ad), nonce, key,
+						&simd_context);
+			simd_put(&simd_context);
+			if (ret || chacha20poly1305_decrypt(work, expected,
+					len + POLY1305_MAC_SIZE, ad,
+					sizeof(ad) - 1, nonce, key)) {
+				pr_err("chacha20poly1305 forgery self-test %zu/%zu: FAIL\n",
+				       i + 1, k + 1);
+				success = false;
+			}
+		}
+
+		xchacha20poly1305_encrypt(expected, plain, len, ad, sizeof(ad),
+					  xnonce, key);
+		ret = xchacha20poly1305_decrypt(work, expected,
+						len + POLY1305_MAC_SIZE, ad,
+						sizeof(ad), xnonce, key);
+		if (!ret || memcmp(work, plain, len)) {
+			pr_err("xchacha20poly1305 self-test %zu: FAIL\n", i + 1);
+			success = false;
+		}
+	}
+
+out:
+	kfree(sg);
+	kfree(work);
+	kfree(expected);
+	kfree(plain);
+	return success;
+}
+
+/* The scatterlist encryption as it was done before the chunking: ChaCha20
+ * over every piece, then Poly1305 over every piece again. Only valid for
+ * scatterlists whose pieces, apart from the last, are whole blocks, which
+ * is what the benchmark below builds.
+ */
+static void __init
+chacha20poly1305_bench_two_pass(struct scatterlist *src, const size_t src_len,
+				const u8 *ad, const size_t ad_len,
+				const u64 nonce,
+				const u8 key[CHACHA20POLY1305_KEY_SIZE],
+				simd_context_t *simd_context)
+{
+	struct poly1305_ctx poly1305_state;
+	struct chacha20_ctx chacha20_state;
+	struct scatterlist *sg;
+	union {
+		u8 block0[POLY1305_KEY_SIZE];
+		u8 mac[POLY1305_MAC_SIZE];
+		__le64 lens[2];
+	} b = { { 0 } };
+	size_t sl, l;
+
+	chacha20_init(&chacha20_state, key, nonce);
+	chacha20(&chacha20_state, b.block0, b.block0, sizeof(b.block0),
+		 simd_context);
+	poly1305_init(&poly1305_state, b.block0);
+
+	poly1305_update(&poly1305_state, ad, ad_len, simd_context);
+	poly1305_update(&poly1305_state, pad0, (0x10 - ad_len) & 0xf,
+			simd_context);
+
+	for (sg = src, sl = src_len; sl; sg = sg_next(sg), sl -= l) {
+		l = min_t(size_t, sl, sg->length);
+		chacha20(&chacha20_state, sg_virt(sg), sg_virt(sg), l,
+			 simd_context);
+	}
+	for (sg = src, sl = src_len; sl; sg = sg_next(sg), sl -= l) {
+		l = min_t(size_t, sl, sg->length);
+		poly1305_update(&poly1305_state, sg_virt(sg), l, simd_context);
+	}
+	poly1305_update(&poly1305_state, pad0, (0x10 - src_len) & 0xf,
+			simd_context);
+
+	b.lens[0] = cpu_to_le64(ad_len);
+	b.lens[1] = cpu_to_le64(src_len);
+	poly1305_update(&poly1305_state, (u8 *)b.lens, sizeof(b.lens),
+			simd_context);
+	poly1305_final(&poly1305_state, b.mac, simd_context);
+	scatterwalk_map_and_copy(b.mac, src, src_len, sizeof(b.mac), 1);
+
+	memzero_explicit(&chacha20_state, sizeof(chacha20_state));
+	memzero_explicit(&b, sizeof(b));
+}
+
+static const size_t chacha20poly1305_bench_lens[] __initconst = {
+	64, 128, 512, 1420, 4096, 16384, 65536
+};
+
+/* Prints the cycles per byte of the chunked and the two-pass scatterlist
+ * encryption, for messages spread over 4k pieces like the frags of a
+ * GSO skb.
+ */
+static void __init chacha20poly1305_bench(void)
+{
+	enum { BENCH_LEN = 65536, BENCH_PIECE = PAGE_SIZE, BENCH_TRIALS = 64 };
+	u8 key[CHACHA20POLY1305_KEY_SIZE] = { 0 }, ad[13] = { 0 };
+	struct scatterlist *sg;
+	simd_context_t simd_context;
+	u64 start, chunked, two_pass;
+	u32 rem_chunked, rem_two_pass;
+	size_t i, j, len;
+	u8 *buf;
+
+	buf = kzalloc(BENCH_LEN + POLY1305_MAC_SIZE, GFP_KERNEL);
+	sg = kmalloc_array(BENCH_LEN / BENCH_PIECE + 1, sizeof(*sg),
+			   GFP_KERNEL);
+	if (!buf || !sg)
+		goto out;
+
+	for (i = 0; i < ARRAY_SIZE(chacha20poly1305_bench_lens); ++i) {
+		len = chacha20poly1305_bench_lens[i];
+		sg_init_table(sg, DIV_ROUND_UP(len + POLY1305_MAC_SIZE,
+					       BENCH_PIECE));
+		for (j = 0; j < len + POLY1305_MAC_SIZE; j += BENCH_PIECE)
+			sg_set_buf(&sg[j / BENCH_PIECE], buf + j,
+				   min_t(size_t, len + POLY1305_MAC_SIZE - j,
+					 BENCH_PIECE));
+
+		simd_get(&simd_context);
+		start = get_cycles();
+		for (j = 0; j < BENCH_TRIALS; ++j) {
+			chacha20poly1305_encrypt_sg_inplace(sg, len, ad,
+						sizeof(ad), j, key,
+						&simd_context);
+			simd_relax(&simd_context);
+		}
+		chunked = get_cycles() - start;
+		start = get_cycles();
+		for (j = 0; j < BENCH_TRIALS; ++j) {
+			chacha20poly1305_bench_two_pass(sg, len, ad,
+						sizeof(ad), j, key,
+						&simd_context);
+			simd_relax(&simd_context);
+		}
+		two_pass = get_cycles() - start;
+		simd_put(&simd_context);
+
+		/* Split hundredths of a cycle per byte into whole and part. */
+		chunked = div_u64_rem(div_u64(chunked * 100, BENCH_TRIALS * len),
+				      100, &rem_chunked);
+		two_pass = div_u64_rem(div_u64(two_pass * 100,
+					       BENCH_TRIALS * len),
+				       100, &rem_two_pass);
+		pr_info("chacha20poly1305 bench %zu bytes: chunked %llu.%02u, two-pass %llu.%02u cycles/byte\n",
+			len, chunked, rem_chunked, two_pass, rem_two_pass);
+	}
+
+out:
+	kfree(sg);
+	kfree(buf);
+}
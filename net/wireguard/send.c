@@ -244,19 +244,22 @@ void wg_packet_send_keepalive(struct wg_peer *peer)
 
 static void wg_packet_create_data_done(struct wg_peer *peer, struct sk_buff *first)
 {
-	struct sk_buff *skb, *next;
-	bool is_keepalive, data_sent = false;
+	struct sk_buff *skb;
+	bool data = false;
 
 	wg_timers_any_authenticated_packet_traversal(peer);
 	wg_timers_any_authenticated_packet_sent(peer);
-	skb_list_walk_safe(first, skb, next) {
-		is_keepalive = skb->len == message_data_len(0);
-		if (likely(!wg_socket_send_skb_to_peer(peer, skb,
-				PACKET_CB(skb)->ds) && !is_keepalive))
-			data_sent = true;
+	for (skb = first; skb; skb = skb->next) {
+		if (skb->len != message_data_len(0)) {
+			data = true;
+			break;
+		}
 	}
 
-	if (likely(data_sent))
+	/* The whole flush shares one route lookup and one pass under the
+	 * endpoint lock, rather than one per encrypted packet.
+	 */
+	if (likely(!wg_socket_send_skbs_to_peer(peer, first) && data))
 		wg_timers_data_sent(peer);
 
 	keep_key_fresh(peer);
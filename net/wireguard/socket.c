@@ -17,8 +17,63 @@
 #include <net/udp_tunnel.h>
 #include <net/ipv6.h>
 
-static int send4(struct wg_device *wg, struct sk_buff *skb,
-		 struct endpoint *endpoint, u8 ds, struct dst_cache *cache)
+/* The outer UDP length field bounds how much one GSO packet can carry. */
+#define GSO_MAX_PAYLOAD (IP_MAX_MTU - sizeof(struct ipv6hdr) - \
+			 sizeof(struct udphdr))
+
+/* Takes @skb off its list and chains the packets following it onto its
+ * frag_list for as long as they have its length and DS field, so that the
+ * run goes down the stack as one UDP GSO packet and is only split up again
+ * at the device or on reception by a peer doing UDP GRO. The last packet of
+ * a run may be shorter, and ends it. Returns the first packet not merged.
+ */
+static struct sk_buff *coalesce_gso(struct sk_buff *skb)
+{
+	struct sk_buff **tail = &skb_shinfo(skb)->frag_list;
+	struct sk_buff *next = skb->next, *seg;
+	unsigned int gso_size = skb->len, segs = 1;
+
+	skb_mark_not_on_list(skb);
+	if (skb_has_frag_list(skb) || skb_is_gso(skb))
+		return next;
+
+	while ((seg = next) && segs < UDP_MAX_SEGMENTS &&
+	       seg->len <= gso_size &&
+	       skb->len + seg->len <= GSO_MAX_PAYLOAD &&
+	       PACKET_CB(seg)->ds == PACKET_CB(skb)->ds &&
+	       !skb_has_frag_list(seg) && !skb_is_gso(seg)) {
+		next = seg->next;
+		skb_mark_not_on_list(seg);
+		*tail = seg;
+		tail = &seg->next;
+		skb->len += seg->len;
+		skb->data_len += seg->len;
+		skb->truesize += seg->truesize;
+		++segs;
+		if (seg->len < gso_size)
+			break;
+	}
+
+	if (segs > 1) {
+		skb_shinfo(skb)->gso_size = gso_size;
+		skb_shinfo(skb)->gso_type = SKB_GSO_UDP_L4;
+		skb_shinfo(skb)->gso_segs = segs;
+		/* The UDP header goes right in front of the data; leave
+		 * its checksum to segmentation, which fills in each one.
+		 */
+		skb->ip_summed = CHECKSUM_PARTIAL;
+		skb->csum_start = skb_headroom(skb) - sizeof(struct udphdr);
+		skb->csum_offset = offsetof(struct udphdr, check);
+	}
+	return next;
+}
+
+/* Sends every skb on the list starting at @first, each with the outer DS
+ * field from PACKET_CB(skb)->ds, using a single route lookup for all of them.
+ * Runs of equally sized packets are sent as UDP GSO packets.
+ */
+static int send4(struct wg_device *wg, struct sk_buff *first,
+		 struct endpoint *endpoint, struct dst_cache *cache)
 {
 	struct flowi4 fl = {
 		.saddr = endpoint->src4.s_addr,
@@ -27,14 +82,11 @@ static int send4(struct wg_device *wg, struct sk_buff *skb,
 		.flowi4_mark = wg->fwmark,
 		.flowi4_proto = IPPROTO_UDP
 	};
+	struct sk_buff *skb, *next;
 	struct rtable *rt = NULL;
 	struct sock *sock;
 	int ret = 0;
 
-	skb_mark_not_on_list(skb);
-	skb->dev = wg->dev;
-	skb->mark = wg->fwmark;
-
 	rcu_read_lock_bh();
 	sock = rcu_dereference_bh(wg->sock4);
 
@@ -81,21 +133,30 @@ static int send4(struct wg_device *wg, struct sk_buff *skb,
 			dst_cache_set_ip4(cache, &rt->dst, fl.saddr);
 	}
 
-	skb->ignore_df = 1;
-	udp_tunnel_xmit_skb(rt, sock, skb, fl.saddr, fl.daddr, ds,
-			    ip4_dst_hoplimit(&rt->dst), 0, fl.fl4_sport,
-			    fl.fl4_dport, false, false);
+	for (skb = first; skb; skb = next) {
+		next = coalesce_gso(skb);
+		skb->dev = wg->dev;
+		skb->mark = wg->fwmark;
+		skb->ignore_df = 1;
+		/* Each transmit consumes a reference to the route. */
+		if (next)
+			dst_hold(&rt->dst);
+		udp_tunnel_xmit_skb(rt, sock, skb, fl.saddr, fl.daddr,
+				    PACKET_CB(skb)->ds,
+				    ip4_dst_hoplimit(&rt->dst), 0, fl.fl4_sport,
+				    fl.fl4_dport, false, false);
+	}
 	goto out;
 
 err:
-	kfree_skb(skb);
+	kfree_skb_list(first);
 out:
 	rcu_read_unlock_bh();
 	return ret;
 }
 
-static int send6(struct wg_device *wg, struct sk_buff *skb,
-		 struct endpoint *endpoint, u8 ds, struct dst_cache *cache)
+static int send6(struct wg_device *wg, struct sk_buff *first,
+		 struct endpoint *endpoint, struct dst_cache *cache)
 {
 #if IS_ENABLED(CONFIG_IPV6)
 	struct flowi6 fl = {
@@ -107,14 +168,11 @@ static int send6(struct wg_device *wg, struct sk_buff *skb,
 		.flowi6_proto = IPPROTO_UDP
 		/* TODO: addr->sin6_flowinfo */
 	};
+	struct sk_buff *skb, *next;
 	struct dst_entry *dst = NULL;
 	struct sock *sock;
 	int ret = 0;
 
-	skb_mark_not_on_list(skb);
-	skb->dev = wg->dev;
-	skb->mark = wg->fwmark;
-
 	rcu_read_lock_bh();
 	sock = rcu_dereference_bh(wg->sock6);
 
@@ -148,43 +206,63 @@ static int send6(struct wg_device *wg, struct sk_buff *skb,
 			dst_cache_set_ip6(cache, dst, &fl.saddr);
 	}
 
-	skb->ignore_df = 1;
-	udp_tunnel6_xmit_skb(dst, sock, skb, skb->dev, &fl.saddr, &fl.daddr, ds,
-			     ip6_dst_hoplimit(dst), 0, fl.fl6_sport,
-			     fl.fl6_dport, false);
+	for (skb = first; skb; skb = next) {
+		next = coalesce_gso(skb);
+		skb->dev = wg->dev;
+		skb->mark = wg->fwmark;
+		skb->ignore_df = 1;
+		if (next)
+			dst_hold(dst);
+		udp_tunnel6_xmit_skb(dst, sock, skb, skb->dev, &fl.saddr,
+				     &fl.daddr, PACKET_CB(skb)->ds,
+				     ip6_dst_hoplimit(dst), 0, fl.fl6_sport,
+				     fl.fl6_dport, false);
+	}
 	goto out;
 
 err:
-	kfree_skb(skb);
+	kfree_skb_list(first);
 out:
 	rcu_read_unlock_bh();
 	return ret;
 #else
+	kfree_skb_list(first);
 	return -EAFNOSUPPORT;
 #endif
 }
 
-int wg_socket_send_skb_to_peer(struct wg_peer *peer, struct sk_buff *skb, u8 ds)
+int wg_socket_send_skbs_to_peer(struct wg_peer *peer, struct sk_buff *first)
 {
-	size_t skb_len = skb->len;
+	struct sk_buff *skb;
+	size_t len = 0;
 	int ret = -EAFNOSUPPORT;
 
+	for (skb = first; skb; skb = skb->next)
+		len += skb->len;
+
 	read_lock_bh(&peer->endpoint_lock);
 	if (peer->endpoint.addr.sa_family == AF_INET)
-		ret = send4(peer->device, skb, &peer->endpoint, ds,
+		ret = send4(peer->device, first, &peer->endpoint,
 			    &peer->endpoint_cache);
 	else if (peer->endpoint.addr.sa_family == AF_INET6)
-		ret = send6(peer->device, skb, &peer->endpoint, ds,
+		ret = send6(peer->device, first, &peer->endpoint,
 			    &peer->endpoint_cache);
 	else
-		dev_kfree_skb(skb);
+		kfree_skb_list(first);
 	if (likely(!ret))
-		peer->tx_bytes += skb_len;
+		peer->tx_bytes += len;
 	read_unlock_bh(&peer->endpoint_lock);
 
 	return ret;
 }
 
+int wg_socket_send_skb_to_peer(struct wg_peer *peer, struct sk_buff *skb, u8 ds)
+{
+	skb_mark_not_on_list(skb);
+	PACKET_CB(skb)->ds = ds;
+	return wg_socket_send_skbs_to_peer(peer, skb);
+}
+
 int wg_socket_send_buffer_to_peer(struct wg_peer *peer, void *buffer,
 				  size_t len, u8 ds)
 {
@@ -219,11 +297,12 @@ int wg_socket_send_buffer_as_reply_to_skb(struct wg_device *wg,
 	skb_reserve(skb, SKB_HEADER_LEN);
 	skb_set_inner_network_header(skb, 0);
 	skb_put_data(skb, buffer, len);
+	PACKET_CB(skb)->ds = 0;
 
 	if (endpoint.addr.sa_family == AF_INET)
-		ret = send4(wg, skb, &endpoint, 0, NULL);
+		ret = send4(wg, skb, &endpoint, NULL);
 	else if (endpoint.addr.sa_family == AF_INET6)
-		ret = send6(wg, skb, &endpoint, 0, NULL);
+		ret = send6(wg, skb, &endpoint, NULL);
 	/* No other possibilities if the endpoint is valid, which it is,
 	 * as we checked above.
 	 */
@@ -322,6 +401,23 @@ static int wg_receive(struct sock *sk, struct sk_buff *skb)
 	if (unlikely(!wg))
 		goto err;
 	skb_mark_not_on_list(skb);
+	if (skb_is_gso(skb) && skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4) {
+		struct sk_buff *segs, *next;
+
+		/* A UDP GRO packet: split it back into the datagrams it was
+		 * built from, each starting at its UDP header, as
+		 * udp_queue_rcv_skb() would for a socket without UDP_GRO.
+		 */
+		__skb_push(skb, -skb_mac_offset(skb));
+		segs = udp_rcv_segment(sk, skb);
+		skb_list_walk_safe(segs, skb, next) {
+			skb_mark_not_on_list(skb);
+			__skb_pull(skb, skb_transport_offset(skb));
+			udp_post_segment_fix_csum(skb);
+			wg_packet_receive(wg, skb);
+		}
+		return 0;
+	}
 	wg_packet_receive(wg, skb);
 	return 0;
 
@@ -343,6 +439,8 @@ static void set_sock_opts(struct socket *sock)
 	sock->sk->sk_allocation = GFP_ATOMIC;
 	sock->sk->sk_sndbuf = INT_MAX;
 	sk_set_memalloc(sock->sk);
+	/* Let GRO merge runs of datagrams from a peer, see wg_receive(). */
+	udp_sk(sock->sk)->gro_enabled = 1;
 }
 
 int wg_socket_init(struct wg_device *wg, u16 port)
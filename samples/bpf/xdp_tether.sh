@@ -0,0 +1,141 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Compare forwarding and firewall drop through a router namespace, once
+# with iptables and once with xdp_tether in generic XDP mode.
+#
+#   ns1 (client) --- veth --- ns2 (router) --- veth --- ns3 (sink)
+#
+# pktgen in ns1 sends UDP to ns3, first from an allowed source and then
+# from a source in the drop list. Run from samples/bpf after building.
+
+[[ -z $IP ]] && IP='ip'
+
+TETHER_USER='./xdp_tether'
+COUNT="${1:-2000000}"
+
+RAND="$(mktemp -u XXXXXX)"
+ns1="ns1-${RAND}"
+ns2="ns2-${RAND}"
+ns3="ns3-${RAND}"
+
+if [ ! -x "$TETHER_USER" ]; then
+	echo "SKIP: $TETHER_USER not built"
+	exit 0
+fi
+
+modprobe pktgen > /dev/null 2>&1
+if [ ! -d /proc/net/pktgen ]; then
+	echo "SKIP: Could not run test without pktgen"
+	exit 0
+fi
+
+cleanup() {
+	[ -n "$tether_pid" ] && kill "$tether_pid" 2>/dev/null && wait "$tether_pid"
+	$IP netns del "$ns1" 2>/dev/null
+	$IP netns del "$ns2" 2>/dev/null
+	$IP netns del "$ns3" 2>/dev/null
+}
+
+trap cleanup EXIT
+
+$IP netns add "$ns1" || exit 1
+$IP netns add "$ns2"
+$IP netns add "$ns3"
+
+$IP link add veth0 netns "$ns1" type veth peer name veth0 netns "$ns2"
+$IP link add veth1 netns "$ns2" type veth peer name veth0 netns "$ns3"
+
+$IP -n "$ns1" link set veth0 address 02:00:00:00:01:99 up
+$IP -n "$ns2" link set veth0 address 02:00:00:00:01:01 up
+$IP -n "$ns2" link set veth1 address 02:00:00:00:02:01 up
+$IP -n "$ns3" link set veth0 address 02:00:00:00:02:99 up
+
+$IP -n "$ns1" addr add 10.0.1.99/24 dev veth0
+$IP -n "$ns1" addr add 10.0.9.99/24 dev veth0
+$IP -n "$ns2" addr add 10.0.1.1/24 dev veth0
+$IP -n "$ns2" addr add 10.0.9.1/24 dev veth0
+$IP -n "$ns2" addr add 10.0.2.1/24 dev veth1
+$IP -n "$ns3" addr add 10.0.2.99/24 dev veth0
+$IP -n "$ns1" route add default via 10.0.1.1
+$IP -n "$ns3" route add default via 10.0.2.1
+
+ip netns exec "$ns2" sysctl -q net.ipv4.ip_forward=1
+ip netns exec "$ns2" ping -q -c 1 10.0.2.99 > /dev/null || exit 1
+
+pg() {
+	local file="$1"
+	shift
+
+	ip netns exec "$ns1" sh -c "echo '$*' > /proc/net/pktgen/$file"
+}
+
+# pktgen <src ip> <count>
+pktgen() {
+	pg kpktgend_0 "rem_device_all"
+	pg kpktgend_0 "add_device veth0"
+	pg veth0 "count $2"
+	pg veth0 "clone_skb 0"
+	pg veth0 "pkt_size 60"
+	pg veth0 "delay 0"
+	pg veth0 "src_min $1"
+	pg veth0 "src_max $1"
+	pg veth0 "dst 10.0.2.99"
+	pg veth0 "dst_mac 02:00:00:00:01:01"
+	pg veth0 "udp_src_min 5000"
+	pg veth0 "udp_src_max 5000"
+	pg veth0 "udp_dst_min 6000"
+	pg veth0 "udp_dst_max 6000"
+	pg pgctrl "start"
+	pg kpktgend_0 "rem_device_all"
+}
+
+rx_packets() {
+	ip netns exec "$ns3" cat /sys/class/net/veth0/statistics/rx_packets
+}
+
+# run <label> <src ip>
+run() {
+	local rx t
+
+	pktgen "$2" 100
+
+	rx="$(rx_packets)"
+	t="$(date +%s%N)"
+	pktgen "$2" "$COUNT"
+	t=$(( $(date +%s%N) - t ))
+	rx=$(( $(rx_packets) - rx ))
+
+	echo "$1: $((COUNT * 1000000000 / t)) pps offered, $rx of $COUNT received"
+	RECEIVED="$rx"
+}
+
+ret=0
+
+ip netns exec "$ns2" iptables -A FORWARD -s 10.0.9.0/24 -j DROP
+ip netns exec "$ns2" iptables -A FORWARD -i veth0 -o veth1 -j ACCEPT
+
+run "iptables forward" 10.0.1.99
+run "iptables drop   " 10.0.9.99
+
+ip netns exec "$ns2" iptables -F FORWARD
+
+ip netns exec "$ns2" $TETHER_USER -S -i 3600 \
+	-f 10.0.2.99,veth1,02:00:00:00:02:99 -d 10.0.9.0/24 veth0 > /dev/null &
+tether_pid=$!
+sleep 1
+
+run "xdp forward     " 10.0.1.99
+if [ "$RECEIVED" -eq 0 ]; then
+	echo "FAIL: xdp_tether did not forward"
+	ret=1
+fi
+
+run "xdp drop        " 10.0.9.99
+if [ "$RECEIVED" -ne 0 ]; then
+	echo "FAIL: xdp_tether forwarded packets from the drop list"
+	ret=1
+fi
+
+[ $ret -eq 0 ] && echo "PASS: xdp_tether"
+exit $ret
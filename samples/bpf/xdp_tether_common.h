@@ -0,0 +1,51 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ */
+#ifndef _SAMPLES_BPF_XDP_TETHER_COMMON_H
+#define _SAMPLES_BPF_XDP_TETHER_COMMON_H
+
+#include <linux/types.h>
+
+#define MAX_TETHER_RULES	1024U
+#define MAX_TETHER_PORTS	64U
+#define MAX_DROP_PREFIXES	1024U
+#define MAX_IFACES		64U
+
+/* Forwarding rule, one per downstream neighbour. xdp_md carries no
+ * ingress ifindex here, so rules apply to every device the program is
+ * attached to. IPv4 addresses are stored as v4-mapped IPv6
+ * (::ffff:a.b.c.d) so a single map serves both families.
+ */
+struct tether_key {
+	__u32 daddr[4];
+};
+
+struct tether_value {
+	__u32 oif_port;		/* index into the tx_ports devmap */
+	__u32 oif;		/* ifindex, for statistics */
+	__u8 dmac[6];
+	__u8 smac[6];
+	__u16 pmtu;
+};
+
+/* Firewall drop list, matched against the source address. Uses the same
+ * v4-mapped layout, so IPv4 prefix lengths are offset by 96.
+ */
+struct drop_key {
+	__u32 prefixlen;
+	__u32 saddr[4];
+};
+
+/* Same layout as netd's iface_stats_map value (StatsValue), keyed by
+ * ifindex, so offloaded traffic can be merged into the interface stats.
+ */
+struct iface_stats_value {
+	__u64 rx_packets;
+	__u64 rx_bytes;
+	__u64 tx_packets;
+	__u64 tx_bytes;
+};
+
+#endif
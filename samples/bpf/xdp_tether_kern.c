@@ -0,0 +1,196 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * Tethering forward and firewall drop for XDP. Packets whose source
+ * matches the drop list are dropped; packets to a known downstream
+ * neighbour get their TTL decremented, their ethernet header rewritten
+ * and are redirected through the tx_ports devmap. Everything else goes
+ * up the stack. Works in both native and generic (skb) mode; in generic
+ * mode devmap redirects are sent in bulk at the end of the NAPI poll.
+ */
+#define KBUILD_MODNAME "foo"
+#include <uapi/linux/bpf.h>
+#include <linux/in.h>
+#include <linux/if_ether.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include "bpf_helpers.h"
+#include "xdp_tether_common.h"
+
+struct bpf_map_def SEC("maps") tx_ports = {
+	.type = BPF_MAP_TYPE_DEVMAP,
+	.key_size = sizeof(int),
+	.value_size = sizeof(int),
+	.max_entries = MAX_TETHER_PORTS,
+};
+
+struct bpf_map_def SEC("maps") tether_rules = {
+	.type = BPF_MAP_TYPE_HASH,
+	.key_size = sizeof(struct tether_key),
+	.value_size = sizeof(struct tether_value),
+	.max_entries = MAX_TETHER_RULES,
+};
+
+struct bpf_map_def SEC("maps") drop_list = {
+	.type = BPF_MAP_TYPE_LPM_TRIE,
+	.key_size = sizeof(struct drop_key),
+	.value_size = sizeof(__u32),
+	.max_entries = MAX_DROP_PREFIXES,
+	.map_flags = BPF_F_NO_PREALLOC,
+};
+
+struct bpf_map_def SEC("maps") iface_stats = {
+	.type = BPF_MAP_TYPE_HASH,
+	.key_size = sizeof(__u32),
+	.value_size = sizeof(struct iface_stats_value),
+	.max_entries = MAX_IFACES,
+};
+
+enum {
+	CNT_PASS,
+	CNT_DROP,
+	CNT_REDIRECT,
+	CNT_MAX,
+};
+
+struct bpf_map_def SEC("maps") action_cnt = {
+	.type = BPF_MAP_TYPE_PERCPU_ARRAY,
+	.key_size = sizeof(__u32),
+	.value_size = sizeof(__u64),
+	.max_entries = CNT_MAX,
+};
+
+static __always_inline int count(__u32 key, int action)
+{
+	__u64 *value;
+
+	value = bpf_map_lookup_elem(&action_cnt, &key);
+	if (value)
+		*value += 1;
+	return action;
+}
+
+static __always_inline void count_tx(__u32 ifindex, __u64 bytes)
+{
+	struct iface_stats_value *stats;
+
+	stats = bpf_map_lookup_elem(&iface_stats, &ifindex);
+	if (stats) {
+		__sync_fetch_and_add(&stats->tx_packets, 1);
+		__sync_fetch_and_add(&stats->tx_bytes, bytes);
+	}
+}
+
+static __always_inline bool drop_saddr(__u32 *saddr)
+{
+	struct drop_key key = {
+		.prefixlen = 128,
+	};
+
+	__builtin_memcpy(key.saddr, saddr, sizeof(key.saddr));
+	return bpf_map_lookup_elem(&drop_list, &key) != NULL;
+}
+
+static __always_inline int forward(struct ethhdr *eth,
+				   struct tether_value *rule, __u64 len)
+{
+	__builtin_memcpy(eth->h_dest, rule->dmac, ETH_ALEN);
+	__builtin_memcpy(eth->h_source, rule->smac, ETH_ALEN);
+	count_tx(rule->oif, len);
+	count(CNT_REDIRECT, XDP_REDIRECT);
+	return bpf_redirect_map(&tx_ports, rule->oif_port, 0);
+}
+
+static __always_inline int handle_ipv4(struct xdp_md *ctx)
+{
+	void *data_end = (void *)(long)ctx->data_end;
+	void *data = (void *)(long)ctx->data;
+	struct ethhdr *eth = data;
+	struct iphdr *iph = data + sizeof(*eth);
+	struct tether_value *rule;
+	struct tether_key key = {};
+	__u32 saddr[4] = {};
+	__u32 check;
+
+	if (iph + 1 > data_end)
+		return count(CNT_PASS, XDP_PASS);
+
+	saddr[2] = htonl(0xffff);
+	saddr[3] = iph->saddr;
+	if (drop_saddr(saddr))
+		return count(CNT_DROP, XDP_DROP);
+
+	/* options and local delivery stay with the stack */
+	if (iph->ihl != 5 || iph->ttl <= 1)
+		return count(CNT_PASS, XDP_PASS);
+
+	key.daddr[2] = htonl(0xffff);
+	key.daddr[3] = iph->daddr;
+	rule = bpf_map_lookup_elem(&tether_rules, &key);
+	if (!rule || ntohs(iph->tot_len) > rule->pmtu)
+		return count(CNT_PASS, XDP_PASS);
+
+	check = iph->check;
+	check += htons(0x0100);
+	iph->check = (__u16)(check + (check >= 0xFFFF));
+	iph->ttl--;
+
+	return forward(eth, rule, data_end - data);
+}
+
+static __always_inline int handle_ipv6(struct xdp_md *ctx)
+{
+	void *data_end = (void *)(long)ctx->data_end;
+	void *data = (void *)(long)ctx->data;
+	struct ethhdr *eth = data;
+	struct ipv6hdr *ip6h = data + sizeof(*eth);
+	struct tether_value *rule;
+	struct tether_key key;
+
+	if (ip6h + 1 > data_end)
+		return count(CNT_PASS, XDP_PASS);
+
+	if (drop_saddr(ip6h->saddr.s6_addr32))
+		return count(CNT_DROP, XDP_DROP);
+
+	if (ip6h->hop_limit <= 1)
+		return count(CNT_PASS, XDP_PASS);
+
+	__builtin_memcpy(key.daddr, ip6h->daddr.s6_addr32, sizeof(key.daddr));
+	rule = bpf_map_lookup_elem(&tether_rules, &key);
+	if (!rule || sizeof(*ip6h) + ntohs(ip6h->payload_len) > rule->pmtu)
+		return count(CNT_PASS, XDP_PASS);
+
+	ip6h->hop_limit--;
+
+	return forward(eth, rule, data_end - data);
+}
+
+SEC("xdp_tether")
+int xdp_tether_prog(struct xdp_md *ctx)
+{
+	void *data_end = (void *)(long)ctx->data_end;
+	void *data = (void *)(long)ctx->data;
+	struct ethhdr *eth = data;
+
+	if (eth + 1 > data_end)
+		return count(CNT_PASS, XDP_PASS);
+
+	if (eth->h_proto == htons(ETH_P_IP))
+		return handle_ipv4(ctx);
+	if (eth->h_proto == htons(ETH_P_IPV6))
+		return handle_ipv6(ctx);
+
+	return count(CNT_PASS, XDP_PASS);
+}
+
+/* Redirect requires an XDP bpf_prog loaded on the TX device */
+SEC("xdp_tether_dummy")
+int xdp_tether_dummy_prog(struct xdp_md *ctx)
+{
+	return XDP_PASS;
+}
+
+char _license[] SEC("license") = "GPL";
@@ -0,0 +1,335 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ */
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <arpa/inet.h>
+#include <assert.h>
+#include <errno.h>
+#include <net/if.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <libgen.h>
+
+#include "bpf_load.h"
+#include "bpf_util.h"
+#include "libbpf.h"
+#include "xdp_tether_common.h"
+
+enum {
+	MAP_TX_PORTS,
+	MAP_TETHER_RULES,
+	MAP_DROP_LIST,
+	MAP_IFACE_STATS,
+	MAP_ACTION_CNT,
+};
+
+static int ifindex_in[MAX_TETHER_PORTS];
+static int nr_in;
+static int ifindex_out[MAX_TETHER_PORTS];
+static bool out_dummy_attached[MAX_TETHER_PORTS];
+static int nr_out;
+
+static __u32 xdp_flags;
+
+static void int_exit(int sig)
+{
+	int i;
+
+	for (i = 0; i < nr_in; i++)
+		set_link_xdp_fd(ifindex_in[i], -1, xdp_flags);
+	for (i = 0; i < nr_out; i++)
+		if (out_dummy_attached[i])
+			set_link_xdp_fd(ifindex_out[i], -1, xdp_flags);
+	exit(0);
+}
+
+static void poll_stats(int interval)
+{
+	static const char * const names[] = { "pass", "drop", "redirect" };
+	unsigned int nr_cpus = bpf_num_possible_cpus();
+	__u64 values[nr_cpus], prev[3][nr_cpus];
+	__u32 key;
+	int i;
+
+	memset(prev, 0, sizeof(prev));
+
+	while (1) {
+		sleep(interval);
+		for (key = 0; key < 3; key++) {
+			__u64 sum = 0;
+
+			assert(bpf_map_lookup_elem(map_fd[MAP_ACTION_CNT],
+						   &key, values) == 0);
+			for (i = 0; i < nr_cpus; i++)
+				sum += values[i] - prev[key][i];
+			printf("%-8s %10llu pkt/s%s", names[key],
+			       sum / interval, key == 2 ? "\n" : "  ");
+			memcpy(prev[key], values, sizeof(values));
+		}
+	}
+}
+
+/* IPv4 addresses are stored v4-mapped, see xdp_tether_common.h */
+static int parse_addr(const char *str, __u32 *addr)
+{
+	struct in_addr in4;
+
+	if (inet_pton(AF_INET6, str, addr) == 1)
+		return 128;
+
+	if (inet_pton(AF_INET, str, &in4) != 1)
+		return -1;
+
+	addr[0] = 0;
+	addr[1] = 0;
+	addr[2] = htonl(0xffff);
+	addr[3] = in4.s_addr;
+	return 32;
+}
+
+static int get_hwaddr(const char *ifname, __u8 *mac)
+{
+	struct ifreq ifr;
+	int fd, ret;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		return -1;
+
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+	ret = ioctl(fd, SIOCGIFHWADDR, &ifr);
+	close(fd);
+	if (ret)
+		return -1;
+
+	memcpy(mac, ifr.ifr_hwaddr.sa_data, 6);
+	return 0;
+}
+
+static int out_port(int ifindex)
+{
+	int i;
+
+	for (i = 0; i < nr_out; i++)
+		if (ifindex_out[i] == ifindex)
+			return i;
+
+	if (nr_out == MAX_TETHER_PORTS)
+		return -1;
+
+	if (bpf_map_update_elem(map_fd[MAP_TX_PORTS], &nr_out, &ifindex, 0)) {
+		perror("bpf_map_update_elem tx_ports");
+		return -1;
+	}
+	ifindex_out[nr_out] = ifindex;
+	return nr_out++;
+}
+
+static int add_iface_stats(int ifindex)
+{
+	struct iface_stats_value stats = {};
+	__u32 key = ifindex;
+
+	return bpf_map_update_elem(map_fd[MAP_IFACE_STATS], &key, &stats,
+				   BPF_NOEXIST) && errno != EEXIST ? -1 : 0;
+}
+
+/* ADDR,IFNAME,DMAC[,MTU] */
+static int add_rule(char *arg)
+{
+	char *addr, *ifname, *dmac, *mtu;
+	struct tether_value value = {};
+	struct tether_key key;
+	int port;
+
+	addr = strtok(arg, ",");
+	ifname = strtok(NULL, ",");
+	dmac = strtok(NULL, ",");
+	mtu = strtok(NULL, ",");
+	if (!addr || !ifname || !dmac)
+		return -1;
+
+	if (parse_addr(addr, key.daddr) < 0) {
+		fprintf(stderr, "ERROR: bad address %s\n", addr);
+		return -1;
+	}
+
+	value.oif = if_nametoindex(ifname);
+	if (!value.oif || get_hwaddr(ifname, value.smac)) {
+		fprintf(stderr, "ERROR: bad device %s\n", ifname);
+		return -1;
+	}
+
+	if (sscanf(dmac, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx",
+		   &value.dmac[0], &value.dmac[1], &value.dmac[2],
+		   &value.dmac[3], &value.dmac[4], &value.dmac[5]) != 6) {
+		fprintf(stderr, "ERROR: bad mac address %s\n", dmac);
+		return -1;
+	}
+
+	value.pmtu = mtu ? strtoul(mtu, NULL, 0) : 1500;
+
+	port = out_port(value.oif);
+	if (port < 0)
+		return -1;
+	value.oif_port = port;
+
+	if (add_iface_stats(value.oif))
+		return -1;
+
+	if (bpf_map_update_elem(map_fd[MAP_TETHER_RULES], &key, &value, 0)) {
+		perror("bpf_map_update_elem tether_rules");
+		return -1;
+	}
+	return 0;
+}
+
+/* PREFIX[/LEN] */
+static int add_drop(char *arg)
+{
+	struct drop_key key;
+	char *len;
+	__u32 one = 1;
+	int max;
+
+	len = strchr(arg, '/');
+	if (len)
+		*len++ = '\0';
+
+	max = parse_addr(arg, key.saddr);
+	if (max < 0) {
+		fprintf(stderr, "ERROR: bad address %s\n", arg);
+		return -1;
+	}
+
+	key.prefixlen = len ? strtoul(len, NULL, 0) : max;
+	if (key.prefixlen > max)
+		return -1;
+	key.prefixlen += 128 - max;
+
+	if (bpf_map_update_elem(map_fd[MAP_DROP_LIST], &key, &one, 0)) {
+		perror("bpf_map_update_elem drop_list");
+		return -1;
+	}
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [OPTS] IFNAME...\n\n"
+		"Attach the tethering program to every IFNAME.\n\n"
+		"OPTS:\n"
+		"    -S                       use skb-mode\n"
+		"    -N                       enforce native mode\n"
+		"    -f ADDR,IFNAME,DMAC[,MTU] forward ADDR out of IFNAME to DMAC\n"
+		"    -d PREFIX[/LEN]          drop packets from PREFIX\n"
+		"    -i SECONDS               statistics interval\n",
+		prog);
+}
+
+int main(int argc, char **argv)
+{
+	const char *optstr = "SNf:d:i:";
+	char *rules[MAX_TETHER_RULES], *drops[MAX_DROP_PREFIXES];
+	int nr_rules = 0, nr_drops = 0;
+	int interval = 2;
+	char filename[256];
+	int i, opt;
+
+	while ((opt = getopt(argc, argv, optstr)) != -1) {
+		switch (opt) {
+		case 'S':
+			xdp_flags |= XDP_FLAGS_SKB_MODE;
+			break;
+		case 'N':
+			xdp_flags |= XDP_FLAGS_DRV_MODE;
+			break;
+		case 'f':
+			if (nr_rules == MAX_TETHER_RULES)
+				return 1;
+			rules[nr_rules++] = optarg;
+			break;
+		case 'd':
+			if (nr_drops == MAX_DROP_PREFIXES)
+				return 1;
+			drops[nr_drops++] = optarg;
+			break;
+		case 'i':
+			interval = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(basename(argv[0]));
+			return 1;
+		}
+	}
+
+	if (optind == argc || interval <= 0) {
+		usage(basename(argv[0]));
+		return 1;
+	}
+
+	snprintf(filename, sizeof(filename), "%s_kern.o", argv[0]);
+
+	if (load_bpf_file(filename)) {
+		printf("%s", bpf_log_buf);
+		return 1;
+	}
+
+	if (!prog_fd[0]) {
+		printf("load_bpf_file: %s\n", strerror(errno));
+		return 1;
+	}
+
+	for (i = 0; i < nr_rules; i++)
+		if (add_rule(rules[i])) {
+			fprintf(stderr, "ERROR: bad rule %d\n", i);
+			return 1;
+		}
+
+	for (i = 0; i < nr_drops; i++)
+		if (add_drop(drops[i])) {
+			fprintf(stderr, "ERROR: bad drop prefix %d\n", i);
+			return 1;
+		}
+
+	signal(SIGINT, int_exit);
+	signal(SIGTERM, int_exit);
+
+	for (; optind < argc && nr_in < MAX_TETHER_PORTS; optind++) {
+		int ifindex = if_nametoindex(argv[optind]);
+
+		if (!ifindex) {
+			fprintf(stderr, "ERROR: unknown device %s\n",
+				argv[optind]);
+			int_exit(0);
+		}
+		if (set_link_xdp_fd(ifindex, prog_fd[0], xdp_flags) < 0) {
+			printf("ERROR: link set xdp fd failed on %d\n",
+			       ifindex);
+			int_exit(0);
+		}
+		ifindex_in[nr_in++] = ifindex;
+	}
+
+	/* Loading dummy XDP prog on out-devices without the real one */
+	for (i = 0; i < nr_out; i++) {
+		if (set_link_xdp_fd(ifindex_out[i], prog_fd[1],
+				    (xdp_flags | XDP_FLAGS_UPDATE_IF_NOEXIST)) < 0)
+			continue;
+		out_dummy_attached[i] = true;
+	}
+
+	poll_stats(interval);
+	return 0;
+}
@@ -0,0 +1,371 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Decoder for the debug-snapshot compact kevent log
+ * (CONFIG_DEBUG_SNAPSHOT_COMPACT).
+ *
+ * Example use:
+ * cat /sys/kernel/debug/debug-snapshot/compact > compact.bin
+ * ./dss-decode -m System.map compact.bin
+ *
+ * A ramdump of the kevents region works as well; the log is located by
+ * its magic. Records of all cpus are merged in time order. The layout
+ * below must match lib/debug-snapshot-log.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+
+#define DSS_COMPACT_MAGIC	0x44535343
+#define DSS_COMPACT_VERSION	1
+#define TASK_COMM_LEN		16
+
+enum dss_compact_type {
+	DSS_CREC_TASK = 1,
+	DSS_CREC_WORK,
+	DSS_CREC_IRQ,
+	DSS_CREC_SPINLOCK,
+	DSS_CREC_CLK,
+};
+
+struct dss_compact_rec {
+	uint8_t type;
+	uint8_t len;
+	uint16_t flag;
+	uint32_t delta;
+	uint32_t data[];
+};
+
+struct dss_compact_block {
+	uint64_t base_time;
+	uint32_t seq;
+	uint32_t used;
+	uint8_t data[];
+};
+
+struct dss_compact_comm {
+	int32_t pid;
+	char comm[TASK_COMM_LEN];
+};
+
+struct dss_compact_hdr {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nr_cpus;
+	uint32_t block_sz;
+	uint32_t block_num;
+	uint32_t comm_num;
+	uint64_t text_base;
+	struct dss_compact_comm comm[];
+};
+
+struct event {
+	uint64_t time;
+	uint32_t cpu;
+	uint32_t seq;
+	const struct dss_compact_rec *rec;
+};
+
+struct sym {
+	uint64_t addr;
+	char *name;
+};
+
+static struct event *events;
+static size_t nr_events, max_events;
+static struct sym *syms;
+static size_t nr_syms, max_syms;
+static int64_t sym_offset;
+static const struct dss_compact_hdr *hdr;
+
+static void *xrealloc(void *p, size_t size)
+{
+	p = realloc(p, size);
+	if (!p) {
+		perror("realloc");
+		exit(1);
+	}
+	return p;
+}
+
+static int sym_cmp(const void *a, const void *b)
+{
+	const struct sym *x = a, *y = b;
+
+	return x->addr < y->addr ? -1 : x->addr > y->addr;
+}
+
+static void load_symbols(const char *path)
+{
+	uint64_t text = 0;
+	char line[512], type, name[256];
+	unsigned long long addr;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		exit(1);
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%llx %c %255s", &addr, &type, name) != 3)
+			continue;
+		if (!strcmp(name, "_text"))
+			text = addr;
+		if (type != 't' && type != 'T' && type != 'd' &&
+		    type != 'D' && type != 'b' && type != 'B')
+			continue;
+		if (nr_syms == max_syms) {
+			max_syms = max_syms ? max_syms * 2 : 4096;
+			syms = xrealloc(syms, max_syms * sizeof(*syms));
+		}
+		syms[nr_syms].addr = addr;
+		syms[nr_syms].name = strdup(name);
+		nr_syms++;
+	}
+	fclose(f);
+
+	qsort(syms, nr_syms, sizeof(*syms), sym_cmp);
+
+	/* account for KASLR */
+	if (text)
+		sym_offset = hdr->text_base - text;
+}
+
+static const char *symbol(uint64_t addr, char *buf, size_t size)
+{
+	size_t lo = 0, hi = nr_syms;
+
+	addr -= sym_offset;
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+
+		if (syms[mid].addr <= addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo)
+		snprintf(buf, size, "%s+0x%" PRIx64, syms[lo - 1].name,
+			 addr - syms[lo - 1].addr);
+	else
+		snprintf(buf, size, "0x%" PRIx64, addr + sym_offset);
+	return buf;
+}
+
+static uint64_t get64(const uint32_t *data)
+{
+	return data[0] | (uint64_t)data[1] << 32;
+}
+
+static const char *comm(uint32_t pid)
+{
+	const struct dss_compact_comm *c;
+
+	c = &hdr->comm[(uint32_t)(pid * 0x61C88647U) >> (32 - __builtin_ctz(hdr->comm_num))];
+	if (c->pid != (int32_t)pid)
+		return "?";
+	return c->comm;
+}
+
+static void add_block(uint32_t cpu, const struct dss_compact_block *blk)
+{
+	size_t data_sz = hdr->block_sz - sizeof(*blk);
+	uint64_t time = blk->base_time;
+	uint32_t off = 0;
+
+	if (!blk->seq || blk->used > data_sz)
+		return;
+
+	while (off + sizeof(struct dss_compact_rec) <= blk->used) {
+		const struct dss_compact_rec *rec = (const void *)&blk->data[off];
+
+		if (rec->len < sizeof(*rec) || rec->len % 4 ||
+		    off + rec->len > blk->used)
+			break;
+
+		time += rec->delta;
+		if (nr_events == max_events) {
+			max_events = max_events ? max_events * 2 : 4096;
+			events = xrealloc(events, max_events * sizeof(*events));
+		}
+		events[nr_events].time = time;
+		events[nr_events].cpu = cpu;
+		events[nr_events].seq = blk->seq;
+		events[nr_events].rec = rec;
+		nr_events++;
+		off += rec->len;
+	}
+}
+
+static int event_cmp(const void *a, const void *b)
+{
+	const struct event *x = a, *y = b;
+
+	if (x->time != y->time)
+		return x->time < y->time ? -1 : 1;
+	if (x->cpu != y->cpu)
+		return x->cpu < y->cpu ? -1 : 1;
+	if (x->seq != y->seq)
+		return x->seq < y->seq ? -1 : 1;
+	return x->rec < y->rec ? -1 : x->rec > y->rec;
+}
+
+static const char *flag_name(uint16_t flag)
+{
+	switch (flag) {
+	case 1:
+		return "in";
+	case 2:
+		return "on";
+	case 3:
+		return "out";
+	default:
+		return "req";
+	}
+}
+
+static void print_event(const struct event *ev)
+{
+	const struct dss_compact_rec *rec = ev->rec;
+	const uint32_t *d = rec->data;
+	unsigned int words = (rec->len - sizeof(*rec)) / 4;
+	char sym[300];
+
+	printf("[%6" PRIu64 ".%09" PRIu64 "] cpu%-2u ",
+	       ev->time / 1000000000, ev->time % 1000000000, ev->cpu);
+
+	switch (rec->type) {
+	case DSS_CREC_TASK:
+		if (words < 1)
+			break;
+		printf("task     %s[%u]\n", comm(d[0]), d[0]);
+		return;
+	case DSS_CREC_WORK:
+		if (words < 3)
+			break;
+		printf("work     %-3s %s by %s[%u]\n", flag_name(rec->flag),
+		       symbol(get64(&d[1]), sym, sizeof(sym)), comm(d[0]), d[0]);
+		return;
+	case DSS_CREC_IRQ:
+		if (words < 4)
+			break;
+		printf("irq      %-3s %u %s latency %uns\n", flag_name(rec->flag),
+		       d[0], symbol(get64(&d[2]), sym, sizeof(sym)), d[1]);
+		return;
+	case DSS_CREC_SPINLOCK:
+		if (words < 2)
+			break;
+		printf("spinlock %-3s %s\n", flag_name(rec->flag),
+		       symbol(get64(d), sym, sizeof(sym)));
+		return;
+	case DSS_CREC_CLK:
+		if (words < 5)
+			break;
+		printf("clk      mode %u clk 0x%" PRIx64 " arg %u from 0x%" PRIx64 "\n",
+		       rec->flag, get64(&d[1]), d[0], get64(&d[3]));
+		return;
+	}
+	printf("unknown  type %u len %u\n", rec->type, rec->len);
+}
+
+static const struct dss_compact_hdr *find_log(const uint8_t *buf, size_t size)
+{
+	size_t off;
+
+	for (off = 0; off + sizeof(*hdr) <= size; off += 8) {
+		const struct dss_compact_hdr *h = (const void *)(buf + off);
+		size_t ring_sz, total;
+
+		if (h->magic != DSS_COMPACT_MAGIC)
+			continue;
+		if (h->version != DSS_COMPACT_VERSION) {
+			fprintf(stderr, "unsupported version %u\n", h->version);
+			continue;
+		}
+		if (!h->comm_num || h->comm_num & (h->comm_num - 1) ||
+		    h->block_sz <= sizeof(struct dss_compact_block) ||
+		    h->block_sz % 8)
+			continue;
+
+		ring_sz = 16 + (size_t)h->block_sz * h->block_num;
+		total = sizeof(*h) + h->comm_num * sizeof(struct dss_compact_comm);
+		total = (total + 7) & ~7UL;
+		total += ring_sz * h->nr_cpus;
+		if (off + total <= size)
+			return h;
+	}
+	return NULL;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-m System.map] FILE\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *map = NULL;
+	const uint8_t *rings;
+	uint8_t *buf = NULL;
+	size_t size = 0, n;
+	uint32_t cpu, i;
+	FILE *f;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "m:")) != -1) {
+		switch (opt) {
+		case 'm':
+			map = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1)
+		usage(argv[0]);
+
+	f = fopen(argv[optind], "rb");
+	if (!f) {
+		perror(argv[optind]);
+		return 1;
+	}
+	do {
+		buf = xrealloc(buf, size + 65536);
+		n = fread(buf + size, 1, 65536, f);
+		size += n;
+	} while (n);
+	fclose(f);
+
+	hdr = find_log(buf, size);
+	if (!hdr) {
+		fprintf(stderr, "no compact log found\n");
+		return 1;
+	}
+
+	if (map)
+		load_symbols(map);
+
+	n = sizeof(*hdr) + hdr->comm_num * sizeof(struct dss_compact_comm);
+	rings = (const uint8_t *)hdr + ((n + 7) & ~7UL);
+	for (cpu = 0; cpu < hdr->nr_cpus; cpu++) {
+		const uint8_t *ring = rings +
+			cpu * (16 + (size_t)hdr->block_sz * hdr->block_num);
+
+		for (i = 0; i < hdr->block_num; i++)
+			add_block(cpu, (const void *)(ring + 16 +
+						      (size_t)i * hdr->block_sz));
+	}
+
+	qsort(events, nr_events, sizeof(*events), event_cmp);
+	for (n = 0; n < nr_events; n++)
+		print_event(&events[n]);
+
+	return 0;
+}
@@ -0,0 +1,355 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Stream the live debug-snapshot kevent rings
+ * (CONFIG_DEBUG_SNAPSHOT_KEVENT_EXPORT).
+ *
+ * Example use:
+ * ./dss-stream -i 50 -r task,irq > kevents.txt
+ *
+ * The rings are mmap()ed read-only from debugfs and polled. Entries are
+ * printed in time order per poll; entries that were overwritten before
+ * they could be read are counted and reported instead of silently lost.
+ * The layout below must match lib/debug-snapshot-log.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+
+#define DSS_EXPORT_MAGIC	0x4453534b
+#define DSS_EXPORT_VERSION	1
+#define DSS_EXPORT_MAX_RINGS	8
+#define DSS_EXPORT_MAX_FIELDS	8
+
+/* the newest entries of a ring may still be in the middle of being written */
+#define HOLDBACK		4
+
+enum dss_export_kind {
+	DSS_FIELD_UINT,
+	DSS_FIELD_SINT,
+	DSS_FIELD_PTR,
+	DSS_FIELD_STR,
+};
+
+struct dss_export_field {
+	char name[12];
+	uint16_t offset;
+	uint8_t size;
+	uint8_t kind;
+};
+
+struct dss_export_ring {
+	char name[16];
+	uint64_t base;
+	uint32_t nr;
+	uint32_t size;
+	uint32_t nr_rings;
+	uint32_t last;
+	uint32_t nr_fields;
+	uint32_t pad;
+	struct dss_export_field field[DSS_EXPORT_MAX_FIELDS];
+};
+
+struct dss_export_info {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nr_cpus;
+	uint32_t nr_rings;
+	uint64_t map_size;
+	struct dss_export_ring ring[DSS_EXPORT_MAX_RINGS];
+};
+
+struct event {
+	uint64_t time;
+	const struct dss_export_ring *ring;
+	uint32_t cpu;
+	uint8_t data[256];
+};
+
+static const uint8_t *map;
+static const struct dss_export_info *info;
+static uint32_t *seen[DSS_EXPORT_MAX_RINGS];
+static unsigned long long lost[DSS_EXPORT_MAX_RINGS];
+static struct event *events;
+static size_t nr_events, max_events;
+static volatile sig_atomic_t stop;
+
+static uint64_t get_uint(const uint8_t *p, unsigned int size)
+{
+	uint64_t v = 0;
+
+	memcpy(&v, p, size > 8 ? 8 : size);
+	return v;
+}
+
+static int64_t get_sint(const uint8_t *p, unsigned int size)
+{
+	switch (size) {
+	case 1:
+		return (int8_t)p[0];
+	case 2:
+		return (int16_t)get_uint(p, 2);
+	case 4:
+		return (int32_t)get_uint(p, 4);
+	default:
+		return (int64_t)get_uint(p, 8);
+	}
+}
+
+static uint32_t read_last(const struct dss_export_ring *ring, uint32_t r)
+{
+	return __atomic_load_n((const uint32_t *)(map + ring->last) + r,
+			       __ATOMIC_ACQUIRE);
+}
+
+static const uint8_t *entry(const struct dss_export_ring *ring, uint32_t r,
+			    uint32_t c)
+{
+	return map + ring->base +
+		((uint64_t)r * ring->nr + (c & (ring->nr - 1))) * ring->size;
+}
+
+static int add_event(const struct dss_export_ring *ring, uint32_t cpu,
+		     const uint8_t *src)
+{
+	struct event *ev;
+
+	if (nr_events == max_events) {
+		max_events = max_events ? max_events * 2 : 4096;
+		events = realloc(events, max_events * sizeof(*events));
+		if (!events) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	ev = &events[nr_events++];
+	ev->ring = ring;
+	ev->cpu = cpu;
+	memcpy(ev->data, src, ring->size);
+	ev->time = get_uint(ev->data, 8);
+
+	/* never written */
+	if (!ev->time) {
+		nr_events--;
+		return 0;
+	}
+	return 1;
+}
+
+static void poll_ring(unsigned int i)
+{
+	const struct dss_export_ring *ring = &info->ring[i];
+	uint32_t r;
+
+	for (r = 0; r < ring->nr_rings; r++) {
+		uint32_t last = read_last(ring, r) - HOLDBACK;
+		uint32_t c = seen[i][r];
+
+		if ((int32_t)(last - c) <= 0)
+			continue;
+
+		/* the producer lapped us */
+		if (last - c > ring->nr - HOLDBACK) {
+			lost[i] += last - c - (ring->nr - HOLDBACK);
+			c = last - (ring->nr - HOLDBACK);
+		}
+
+		for (; c != last; c++) {
+			const uint8_t *e = entry(ring, r, c + 1);
+			int added;
+
+			added = add_event(ring, ring->nr_rings > 1 ? r : UINT32_MAX, e);
+
+			/* overwritten while it was copied */
+			if (read_last(ring, r) - (c + 1) >= ring->nr) {
+				nr_events -= added;
+				lost[i]++;
+			}
+		}
+		seen[i][r] = c;
+	}
+}
+
+static int event_cmp(const void *a, const void *b)
+{
+	const struct event *x = a, *y = b;
+
+	return x->time < y->time ? -1 : x->time > y->time;
+}
+
+static void print_event(const struct event *ev)
+{
+	const struct dss_export_ring *ring = ev->ring;
+	uint32_t f;
+
+	printf("[%6" PRIu64 ".%09" PRIu64 "] ",
+	       ev->time / 1000000000, ev->time % 1000000000);
+	if (ev->cpu != UINT32_MAX)
+		printf("cpu%-2u ", ev->cpu);
+	else
+		printf("      ");
+	printf("%-8s", ring->name);
+
+	for (f = 0; f < ring->nr_fields; f++) {
+		const struct dss_export_field *fd = &ring->field[f];
+		const uint8_t *p = ev->data + fd->offset;
+
+		if (!strcmp(fd->name, "time"))
+			continue;
+		switch (fd->kind) {
+		case DSS_FIELD_SINT:
+			printf(" %s=%" PRId64, fd->name, get_sint(p, fd->size));
+			break;
+		case DSS_FIELD_PTR:
+			printf(" %s=0x%" PRIx64, fd->name, get_uint(p, fd->size));
+			break;
+		case DSS_FIELD_STR:
+			printf(" %s=%.*s", fd->name, fd->size, (const char *)p);
+			break;
+		default:
+			printf(" %s=%" PRIu64, fd->name, get_uint(p, fd->size));
+			break;
+		}
+	}
+	putchar('\n');
+}
+
+static int check_info(size_t size)
+{
+	uint32_t i, f;
+
+	if (info->magic != DSS_EXPORT_MAGIC ||
+	    info->version != DSS_EXPORT_VERSION ||
+	    info->nr_rings > DSS_EXPORT_MAX_RINGS || info->map_size != size)
+		return -1;
+
+	for (i = 0; i < info->nr_rings; i++) {
+		const struct dss_export_ring *ring = &info->ring[i];
+
+		if (!ring->nr || ring->nr & (ring->nr - 1) || ring->nr <= HOLDBACK ||
+		    ring->size < 8 || ring->size > sizeof(events->data) ||
+		    ring->nr_fields > DSS_EXPORT_MAX_FIELDS ||
+		    ring->base + (uint64_t)ring->nr * ring->size * ring->nr_rings > size ||
+		    ring->last + 4ULL * ring->nr_rings > size)
+			return -1;
+		for (f = 0; f < ring->nr_fields; f++)
+			if (ring->field[f].offset + ring->field[f].size > ring->size)
+				return -1;
+	}
+	return 0;
+}
+
+static void sigint(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-f FILE] [-i MSEC] [-r RING,...] [-a]\n\n"
+		"    -f FILE   kevents file (/sys/kernel/debug/debug-snapshot/kevents)\n"
+		"    -i MSEC   poll interval, default 100\n"
+		"    -r RINGS  only follow these rings, default all\n"
+		"    -a        start with the entries already in the rings\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *file = "/sys/kernel/debug/debug-snapshot/kevents";
+	struct dss_export_info hdr;
+	char *rings = NULL;
+	int interval = 100, all = 0;
+	uint32_t i, r;
+	size_t n;
+	int fd, opt;
+
+	while ((opt = getopt(argc, argv, "f:i:r:a")) != -1) {
+		switch (opt) {
+		case 'f':
+			file = optarg;
+			break;
+		case 'i':
+			interval = atoi(optarg);
+			break;
+		case 'r':
+			rings = optarg;
+			break;
+		case 'a':
+			all = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc || interval <= 0)
+		usage(argv[0]);
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0) {
+		perror(file);
+		return 1;
+	}
+	if (read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+	    hdr.magic != DSS_EXPORT_MAGIC) {
+		fprintf(stderr, "%s: not a kevents export\n", file);
+		return 1;
+	}
+
+	map = mmap(NULL, hdr.map_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	info = (const void *)map;
+	if (check_info(hdr.map_size)) {
+		fprintf(stderr, "%s: unsupported layout\n", file);
+		return 1;
+	}
+
+	for (i = 0; i < info->nr_rings; i++) {
+		const struct dss_export_ring *ring = &info->ring[i];
+
+		seen[i] = calloc(ring->nr_rings, sizeof(uint32_t));
+		if (!seen[i])
+			return 1;
+		for (r = 0; r < ring->nr_rings; r++)
+			seen[i][r] = read_last(ring, r) -
+				     (all ? ring->nr : HOLDBACK);
+	}
+
+	signal(SIGINT, sigint);
+	signal(SIGTERM, sigint);
+
+	while (!stop) {
+		usleep(interval * 1000);
+
+		nr_events = 0;
+		for (i = 0; i < info->nr_rings; i++) {
+			if (rings && !strstr(rings, info->ring[i].name))
+				continue;
+			poll_ring(i);
+		}
+
+		qsort(events, nr_events, sizeof(*events), event_cmp);
+		for (n = 0; n < nr_events; n++)
+			print_event(&events[n]);
+		fflush(stdout);
+	}
+
+	for (i = 0; i < info->nr_rings; i++)
+		if (lost[i])
+			fprintf(stderr, "%s: %llu entries lost\n",
+				info->ring[i].name, lost[i]);
+
+	return 0;
+}
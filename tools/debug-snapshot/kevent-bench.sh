@@ -0,0 +1,84 @@
+#!/bin/sh
+# SPDX-License-Identifier: GPL-2.0
+#
+# Measure the scheduler hot-path cost of debug-snapshot kevent logging by
+# running perf bench sched pipe with:
+#   off    - the task, work, irq and softirq kevents switched off
+#   on     - the kevents logged
+#   stream - the kevents logged and followed by dss-stream
+#   ftrace - the kevents off and the matching ftrace events read from
+#            trace_pipe instead
+#
+# usage: kevent-bench.sh [LOOPS]
+
+SYSFS=/sys/devices/system/debug-snapshot
+TRACING=/sys/kernel/debug/tracing
+STREAM="$(dirname "$0")/dss-stream"
+LOOPS="${1:-1000000}"
+EVENTS="task work irq softirq"
+FTRACE_EVENTS="sched/sched_switch workqueue/workqueue_execute_start
+	workqueue/workqueue_execute_end irq/irq_handler_entry
+	irq/irq_handler_exit irq/softirq_entry irq/softirq_exit"
+
+if [ ! -w "$SYSFS/kevents" ]; then
+	echo "SKIP: $SYSFS/kevents not available"
+	exit 0
+fi
+
+if ! command -v perf > /dev/null; then
+	echo "SKIP: perf not found"
+	exit 0
+fi
+
+# kevents toggles a name, so only flip the ones in the wanted state
+set_events() {
+	for ev in $EVENTS; do
+		if ! grep -q "^$ev .*: $1" "$SYSFS/kevents"; then
+			echo "$ev" > "$SYSFS/kevents"
+		fi
+	done
+	# the static keys are switched from a work item
+	sleep 1
+}
+
+set_ftrace() {
+	for ev in $FTRACE_EVENTS; do
+		echo "$1" > "$TRACING/events/$ev/enable"
+	done
+}
+
+bench() {
+	echo "$1:"
+	perf bench sched pipe -l "$LOOPS" | grep -E 'Total time|usecs/op'
+}
+
+set_events disable
+bench off
+
+set_events enable
+bench on
+
+if [ -x "$STREAM" ] && [ -e /sys/kernel/debug/debug-snapshot/kevents ]; then
+	"$STREAM" -i 10 > /dev/null &
+	stream_pid=$!
+	bench stream
+	kill "$stream_pid"
+	wait "$stream_pid"
+else
+	echo "stream: skipped, dss-stream or the kevents export not available"
+fi
+
+if [ -d "$TRACING/events" ]; then
+	set_events disable
+	echo > "$TRACING/trace"
+	set_ftrace 1
+	cat "$TRACING/trace_pipe" > /dev/null &
+	trace_pid=$!
+	bench ftrace
+	kill "$trace_pid"
+	set_ftrace 0
+else
+	echo "ftrace: skipped, $TRACING not available"
+fi
+
+set_events enable
@@ -0,0 +1,32 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Compare native aio (libaio) with psync and glibc's posixaio on the
+# buffered jobs of aio_bench.fio: cold random reads, sequential reads and
+# random writes with fdatasync. Reports IOPS and bandwidth per job.
+#
+# usage: aio_bench.sh [directory on the file system to test]
+
+set -e
+
+readonly DIR="${1:-.}"
+readonly JOBFILE="$(dirname "$0")/aio_bench.fio"
+readonly ENGINES="libaio posixaio psync"
+
+if ! command -v fio >/dev/null; then
+	echo "SKIP: fio not installed"
+	exit 0
+fi
+
+printf "%-10s %-22s %10s %12s\n" engine job IOPS "KiB/s"
+for engine in ${ENGINES}; do
+	# terse v3: field 3 is the job, 7/8 read KiB/s and IOPS, 48/49 write
+	IOENGINE="${engine}" DIR="${DIR}" \
+		fio --minimal --terse-version=3 "${JOBFILE}" |
+		awk -F';' -v engine="${engine}" '{
+			bw = $7 + $48; iops = $8 + $49
+			printf "%-10s %-22s %10d %12d\n", engine, $3, iops, bw
+		}'
+done
+rm -f "${DIR}"/randread-cold.* "${DIR}"/seqread.* \
+	"${DIR}"/randwrite-fdatasync.*
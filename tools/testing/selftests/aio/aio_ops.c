@@ -0,0 +1,451 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Native aio beyond O_DIRECT file I/O: IOCB_CMD_FSYNC/FDSYNC, buffered
+ * reads that miss the page cache, and IOCB_CMD_POLL.
+ *
+ * Buffered reads are checked against a file whose pages were dropped, so
+ * they have to be finished by the aio worker. The iovec array is clobbered
+ * right after io_submit() returns, the worker must have its own copy.
+ *
+ * Poll requests are checked for readiness, cancellation, hang-up, teardown
+ * by io_destroy() and POLLFREE: a signalfd polls the waitqueue of its
+ * poller's sighand, which is freed when a poller that does not share it
+ * with us exits.
+ *
+ * The test file is created in the current directory, which must not be on
+ * tmpfs for the page cache to be dropped.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+#include <linux/aio_abi.h>
+#include <linux/fs.h>
+
+#include "../kselftest.h"
+
+#define FILE_SIZE	(1 << 20)
+#define NR_EVENTS	16
+
+static aio_context_t ctx;
+static char filename[] = "aio_ops.XXXXXX";
+static int fd = -1;
+static unsigned char *pattern;
+
+static int io_setup(unsigned int nr, aio_context_t *ctxp)
+{
+	return syscall(__NR_io_setup, nr, ctxp);
+}
+
+static int io_destroy(aio_context_t ctx)
+{
+	return syscall(__NR_io_destroy, ctx);
+}
+
+static int io_submit(aio_context_t ctx, long nr, struct iocb **iocbpp)
+{
+	return syscall(__NR_io_submit, ctx, nr, iocbpp);
+}
+
+static int io_cancel(aio_context_t ctx, struct iocb *iocb,
+		     struct io_event *result)
+{
+	return syscall(__NR_io_cancel, ctx, iocb, result);
+}
+
+static int io_getevents(aio_context_t ctx, long min_nr, long nr,
+			struct io_event *events, struct timespec *timeout)
+{
+	return syscall(__NR_io_getevents, ctx, min_nr, nr, events, timeout);
+}
+
+static void prep(struct iocb *iocb, int fildes, unsigned int opcode,
+		 void *buf, size_t nbytes, off_t offset)
+{
+	memset(iocb, 0, sizeof(*iocb));
+	iocb->aio_data = (unsigned long)iocb;
+	iocb->aio_lio_opcode = opcode;
+	iocb->aio_fildes = fildes;
+	iocb->aio_buf = (unsigned long)buf;
+	iocb->aio_nbytes = nbytes;
+	iocb->aio_offset = offset;
+}
+
+static int submit(struct iocb *iocb)
+{
+	return io_submit(ctx, 1, &iocb) == 1 ? 0 : -1;
+}
+
+/* Waits up to @ms for the completion of @iocb, returns its result in @res */
+static int wait_one(struct iocb *iocb, long ms, long long *res)
+{
+	struct timespec ts = { ms / 1000, (ms % 1000) * 1000000 };
+	struct io_event ev;
+	int ret;
+
+	ret = io_getevents(ctx, 1, 1, &ev, &ts);
+	if (ret != 1)
+		return -1;
+	if (ev.obj != (unsigned long)iocb || ev.data != (unsigned long)iocb) {
+		ksft_print_msg("completion for an unexpected iocb\n");
+		return -1;
+	}
+	*res = ev.res;
+	return 0;
+}
+
+static int no_event(void)
+{
+	struct timespec ts = { 0, 0 };
+	struct io_event ev;
+
+	return io_getevents(ctx, 0, 1, &ev, &ts) == 0;
+}
+
+static int drop_cache(void)
+{
+	if (fdatasync(fd))
+		return -1;
+	return posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+}
+
+static int test_fsync(void)
+{
+	static const unsigned int cmds[] = { IOCB_CMD_FSYNC, IOCB_CMD_FDSYNC };
+	struct iocb iocb;
+	long long res;
+	int i, pipefd[2];
+
+	for (i = 0; i < 2; i++) {
+		if (pwrite(fd, pattern, 4096, 0) != 4096)
+			return KSFT_FAIL;
+		prep(&iocb, fd, cmds[i], NULL, 0, 0);
+		if (submit(&iocb) || wait_one(&iocb, 10000, &res)) {
+			ksft_print_msg("%s: %s\n", i ? "fdsync" : "fsync",
+				       strerror(errno));
+			return KSFT_FAIL;
+		}
+		if (res) {
+			ksft_print_msg("%s completed with %lld\n",
+				       i ? "fdsync" : "fsync", res);
+			return KSFT_FAIL;
+		}
+	}
+
+	/* fields that mean nothing to fsync must be zero */
+	prep(&iocb, fd, IOCB_CMD_FSYNC, NULL, 4096, 0);
+	if (!submit(&iocb) || errno != EINVAL) {
+		ksft_print_msg("fsync with a length accepted\n");
+		return KSFT_FAIL;
+	}
+
+	/* and files without ->fsync are refused at submission */
+	if (pipe(pipefd))
+		return KSFT_FAIL;
+	prep(&iocb, pipefd[1], IOCB_CMD_FSYNC, NULL, 0, 0);
+	i = submit(&iocb) ? errno : 0;
+	close(pipefd[0]);
+	close(pipefd[1]);
+	if (i != EINVAL) {
+		ksft_print_msg("fsync of a pipe not refused\n");
+		return KSFT_FAIL;
+	}
+	return KSFT_PASS;
+}
+
+static int check_read(struct iocb *iocb, unsigned char *buf, off_t offset,
+		      size_t len, const char *what)
+{
+	long long res;
+
+	if (wait_one(iocb, 10000, &res)) {
+		ksft_print_msg("%s: no completion\n", what);
+		return -1;
+	}
+	if (res != len) {
+		ksft_print_msg("%s: read %lld of %zu bytes\n", what, res, len);
+		return -1;
+	}
+	if (memcmp(buf, pattern + offset, len)) {
+		ksft_print_msg("%s: wrong data\n", what);
+		return -1;
+	}
+	return 0;
+}
+
+static int test_buffered_read(void)
+{
+	enum { SEGS = 4, SEG_LEN = 64 << 10 };
+	struct iovec iov[SEGS];
+	unsigned char *buf;
+	struct iocb iocb;
+	long long res;
+	int i, ret = KSFT_FAIL;
+
+	buf = malloc(SEGS * SEG_LEN);
+	if (!buf)
+		return KSFT_FAIL;
+	if (pwrite(fd, pattern, FILE_SIZE, 0) != FILE_SIZE)
+		goto out;
+
+	/* cold cache: the worker reads, with its own copy of the iovec */
+	if (drop_cache())
+		goto out;
+	memset(buf, 0, SEGS * SEG_LEN);
+	for (i = 0; i < SEGS; i++) {
+		iov[i].iov_base = buf + i * SEG_LEN;
+		iov[i].iov_len = SEG_LEN;
+	}
+	prep(&iocb, fd, IOCB_CMD_PREADV, iov, SEGS, SEG_LEN);
+	if (submit(&iocb))
+		goto out;
+	memset(iov, 0, sizeof(iov));
+	if (check_read(&iocb, buf, SEG_LEN, SEGS * SEG_LEN, "cold preadv"))
+		goto out;
+
+	/* half cached: served inline up to the miss, the rest by the worker */
+	if (drop_cache() || pread(fd, buf, SEG_LEN, 0) != SEG_LEN)
+		goto out;
+	memset(buf, 0, SEGS * SEG_LEN);
+	prep(&iocb, fd, IOCB_CMD_PREAD, buf, SEGS * SEG_LEN, 0);
+	if (submit(&iocb) ||
+	    check_read(&iocb, buf, 0, SEGS * SEG_LEN, "partly cached pread"))
+		goto out;
+
+	/* warm cache */
+	memset(buf, 0, SEGS * SEG_LEN);
+	prep(&iocb, fd, IOCB_CMD_PREAD, buf, SEGS * SEG_LEN, 0);
+	if (submit(&iocb) ||
+	    check_read(&iocb, buf, 0, SEGS * SEG_LEN, "cached pread"))
+		goto out;
+
+	/* short read at the end of the file */
+	prep(&iocb, fd, IOCB_CMD_PREAD, buf, SEGS * SEG_LEN, FILE_SIZE - 100);
+	if (submit(&iocb) ||
+	    check_read(&iocb, buf, FILE_SIZE - 100, 100, "pread at EOF"))
+		goto out;
+
+	/* RWF_NOWAIT still means -EAGAIN on a miss, not a trip to the worker */
+	if (drop_cache())
+		goto out;
+	prep(&iocb, fd, IOCB_CMD_PREAD, buf, SEG_LEN, 0);
+	iocb.aio_rw_flags = RWF_NOWAIT;
+	if (submit(&iocb)) {
+		if (errno != EOPNOTSUPP)
+			goto out;
+		ksft_print_msg("RWF_NOWAIT not supported here, not checked\n");
+	} else {
+		if (wait_one(&iocb, 10000, &res))
+			goto out;
+		if (res != -EAGAIN) {
+			ksft_print_msg("RWF_NOWAIT read of a miss returned %lld\n",
+				       res);
+			goto out;
+		}
+	}
+	ret = KSFT_PASS;
+out:
+	free(buf);
+	return ret;
+}
+
+static volatile int child_err;
+
+/* Runs in our mm but with its own sighand, which goes away on exit */
+static int pollfree_child(void *arg)
+{
+	struct iocb *iocb = arg;
+	sigset_t mask;
+	int sfd;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGUSR1);
+	sfd = signalfd(-1, &mask, 0);
+	if (sfd < 0) {
+		child_err = errno;
+		return 1;
+	}
+	prep(iocb, sfd, IOCB_CMD_POLL, NULL, 0, 0);
+	iocb->aio_buf = POLLIN;
+	if (submit(iocb))
+		child_err = errno;
+	return 0;
+}
+
+static int test_pollfree(void)
+{
+	enum { STACK_SIZE = 64 << 10 };
+	struct iocb iocb;
+	long long res;
+	char *stack;
+	pid_t pid;
+
+	stack = malloc(STACK_SIZE);
+	if (!stack)
+		return KSFT_FAIL;
+	pid = clone(pollfree_child, stack + STACK_SIZE, CLONE_VM | SIGCHLD,
+		    &iocb);
+	if (pid < 0 || waitpid(pid, NULL, 0) != pid) {
+		free(stack);
+		return KSFT_FAIL;
+	}
+	free(stack);
+	if (child_err) {
+		ksft_print_msg("poll of a signalfd: %s\n", strerror(child_err));
+		return KSFT_FAIL;
+	}
+
+	/* reaping the child freed the waitqueue the request was on */
+	if (wait_one(&iocb, 5000, &res)) {
+		ksft_print_msg("no completion after POLLFREE\n");
+		return KSFT_FAIL;
+	}
+	/* as cancelled, or with the hang-up that came with POLLFREE */
+	if (res & ~POLLHUP) {
+		ksft_print_msg("POLLFREE completed with %#llx\n", res);
+		return KSFT_FAIL;
+	}
+	return KSFT_PASS;
+}
+
+static int test_poll(void)
+{
+	struct iocb iocb;
+	struct io_event ev;
+	aio_context_t ctx2 = 0;
+	long long res;
+	int p[2];
+
+	if (pipe(p))
+		return KSFT_FAIL;
+
+	/* waits for data, then completes with the ready mask */
+	prep(&iocb, p[0], IOCB_CMD_POLL, NULL, 0, 0);
+	iocb.aio_buf = POLLIN;
+	if (submit(&iocb)) {
+		ksft_print_msg("poll submit: %s\n", strerror(errno));
+		goto fail;
+	}
+	if (!no_event()) {
+		ksft_print_msg("poll of an empty pipe completed\n");
+		goto fail;
+	}
+	if (write(p[1], "x", 1) != 1 || wait_one(&iocb, 5000, &res) ||
+	    !(res & POLLIN)) {
+		ksft_print_msg("poll not woken by a write\n");
+		goto fail;
+	}
+
+	/* ready at submission */
+	if (submit(&iocb) || wait_one(&iocb, 5000, &res) || !(res & POLLIN)) {
+		ksft_print_msg("poll of a readable pipe failed\n");
+		goto fail;
+	}
+	if (read(p[0], &res, 1) != 1)
+		goto fail;
+	prep(&iocb, p[1], IOCB_CMD_POLL, NULL, 0, 0);
+	iocb.aio_buf = POLLOUT;
+	if (submit(&iocb) || wait_one(&iocb, 5000, &res) || !(res & POLLOUT)) {
+		ksft_print_msg("poll of a writable pipe failed\n");
+		goto fail;
+	}
+
+	/* fields that mean nothing to poll must be zero */
+	prep(&iocb, p[0], IOCB_CMD_POLL, NULL, 1, 0);
+	if (!submit(&iocb) || errno != EINVAL) {
+		ksft_print_msg("poll with a length accepted\n");
+		goto fail;
+	}
+
+	/* cancellation completes the request with no events */
+	prep(&iocb, p[0], IOCB_CMD_POLL, NULL, 0, 0);
+	iocb.aio_buf = POLLIN;
+	if (submit(&iocb))
+		goto fail;
+	if (!io_cancel(ctx, &iocb, &ev) || errno != EINPROGRESS) {
+		ksft_print_msg("poll cancel: %s\n", strerror(errno));
+		goto fail;
+	}
+	if (wait_one(&iocb, 5000, &res) || res) {
+		ksft_print_msg("cancelled poll not completed empty\n");
+		goto fail;
+	}
+
+	/* io_destroy() must not wait for the event forever */
+	if (io_setup(NR_EVENTS, &ctx2))
+		goto fail;
+	prep(&iocb, p[0], IOCB_CMD_POLL, NULL, 0, 0);
+	iocb.aio_buf = POLLIN;
+	if (io_submit(ctx2, 1, (struct iocb *[]){ &iocb }) != 1)
+		goto fail;
+	alarm(10);
+	if (io_destroy(ctx2))
+		goto fail;
+	alarm(0);
+
+	/* hang-up is reported whatever was asked for */
+	prep(&iocb, p[0], IOCB_CMD_POLL, NULL, 0, 0);
+	iocb.aio_buf = POLLIN;
+	if (submit(&iocb))
+		goto fail;
+	close(p[1]);
+	p[1] = -1;
+	if (wait_one(&iocb, 5000, &res) || !(res & POLLHUP)) {
+		ksft_print_msg("poll not woken by a hang-up\n");
+		goto fail;
+	}
+	close(p[0]);
+
+	return test_pollfree();
+
+fail:
+	close(p[0]);
+	if (p[1] >= 0)
+		close(p[1]);
+	return KSFT_FAIL;
+}
+
+int main(int argc, char *argv[])
+{
+	int i, ret;
+
+	if (io_setup(NR_EVENTS, &ctx)) {
+		ksft_print_msg("io_setup: %s\n", strerror(errno));
+		return errno == ENOSYS ? KSFT_SKIP : KSFT_FAIL;
+	}
+
+	pattern = malloc(FILE_SIZE);
+	fd = mkstemp(filename);
+	if (!pattern || fd < 0) {
+		ksft_print_msg("setup failed: %s\n", strerror(errno));
+		return KSFT_FAIL;
+	}
+	unlink(filename);
+	/* no readahead, so that a partly cached read really misses */
+	posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+	for (i = 0; i < FILE_SIZE; i++)
+		pattern[i] = i * 31 + (i >> 12);
+
+	ret = test_fsync();
+	if (ret == KSFT_PASS)
+		ret = test_buffered_read();
+	if (ret == KSFT_PASS)
+		ret = test_poll();
+
+	close(fd);
+	io_destroy(ctx);
+	return ret;
+}
@@ -0,0 +1,399 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Reference count stress test and benchmark.
+ *
+ * A server process becomes context manager and hands out one of its
+ * own nodes.  The client then hammers the resulting handle with
+ * BC_ACQUIRE/BC_RELEASE pairs from several threads, which the driver
+ * handles without taking proc->outer_lock, while another thread keeps
+ * moving the weak count between 0 and 1, which has to go through the
+ * locked path.  Afterwards the handle must still work while the
+ * client's last strong reference is held, and must be gone once it is
+ * released, so any lost or duplicated update shows up as a failure.
+ *
+ * Run it on a kernel with CONFIG_PROVE_LOCKING to check the locking
+ * as well:
+ *	binder_ref_bench [-d /dev/binder] [-i iterations] [-t threads]
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/android/binder.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include <kselftest.h>
+
+#define MAP_SIZE	(1 << 20)
+#define BATCH		32
+#define GET_NODE	1
+#define PING		2
+
+struct ref_cmd {
+	uint32_t cmd;
+	uint32_t handle;
+} __attribute__((packed));
+
+static const char *dev = "/dev/binder";
+static int iterations = 100000;
+static int nr_threads = 4;
+
+static int binder_fd;
+static uint32_t handle;
+
+static int binder_open(void **map)
+{
+	struct binder_version version;
+	int fd;
+
+	fd = open(dev, O_RDWR | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	if (ioctl(fd, BINDER_VERSION, &version) ||
+	    version.protocol_version != BINDER_CURRENT_PROTOCOL_VERSION) {
+		close(fd);
+		errno = EPROTO;
+		return -1;
+	}
+	*map = mmap(NULL, MAP_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (*map == MAP_FAILED) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int binder_write_read(int fd, void *wbuf, size_t wlen,
+			     void *rbuf, size_t rlen, size_t *consumed)
+{
+	struct binder_write_read bwr = {
+		.write_buffer = (uintptr_t)wbuf,
+		.write_size = wlen,
+		.read_buffer = (uintptr_t)rbuf,
+		.read_size = rlen,
+	};
+	int ret;
+
+	do {
+		ret = ioctl(fd, BINDER_WRITE_READ, &bwr);
+	} while (ret < 0 && errno == EINTR);
+	if (consumed)
+		*consumed = bwr.read_consumed;
+	return ret;
+}
+
+static int free_buffer(int fd, binder_uintptr_t ptr)
+{
+	struct {
+		uint32_t cmd;
+		binder_uintptr_t ptr;
+	} __attribute__((packed)) free_cmd = { BC_FREE_BUFFER, ptr };
+
+	return binder_write_read(fd, &free_cmd, sizeof(free_cmd),
+				 NULL, 0, NULL);
+}
+
+/* Reply to GET_NODE with one of our nodes, and to anything else empty */
+static int server(int ready)
+{
+	struct flat_binder_object obj = {
+		.hdr.type = BINDER_TYPE_BINDER,
+		.binder = 0x1000,
+		.cookie = 0x2000,
+	};
+	binder_size_t offset = 0;
+	struct {
+		uint32_t cmd;
+		struct binder_transaction_data tr;
+	} __attribute__((packed)) reply;
+	uint8_t rbuf[256];
+	uint32_t cmd = BC_ENTER_LOOPER;
+	void *map;
+	int fd;
+
+	fd = binder_open(&map);
+	if (fd < 0 || ioctl(fd, BINDER_SET_CONTEXT_MGR, 0) ||
+	    binder_write_read(fd, &cmd, sizeof(cmd), NULL, 0, NULL))
+		return 1;
+	if (write(ready, "", 1) != 1)
+		return 1;
+
+	for (;;) {
+		size_t len, off = 0;
+
+		if (binder_write_read(fd, NULL, 0, rbuf, sizeof(rbuf), &len))
+			return 1;
+		while (off + sizeof(uint32_t) <= len) {
+			struct binder_transaction_data *tr;
+
+			memcpy(&cmd, rbuf + off, sizeof(cmd));
+			off += sizeof(cmd);
+			if (cmd != BR_TRANSACTION) {
+				off += _IOC_SIZE(cmd);
+				continue;
+			}
+			tr = (void *)(rbuf + off);
+			off += sizeof(*tr);
+
+			memset(&reply, 0, sizeof(reply));
+			reply.cmd = BC_REPLY;
+			if (tr->code == GET_NODE) {
+				reply.tr.data_size = sizeof(obj);
+				reply.tr.offsets_size = sizeof(offset);
+				reply.tr.data.ptr.buffer = (uintptr_t)&obj;
+				reply.tr.data.ptr.offsets = (uintptr_t)&offset;
+			}
+			if (free_buffer(fd, tr->data.ptr.buffer) ||
+			    binder_write_read(fd, &reply, sizeof(reply),
+					      NULL, 0, NULL))
+				return 1;
+		}
+	}
+}
+
+/*
+ * Send @code to @target and wait for the reply.  For GET_NODE the
+ * returned handle is stored in @out, and the reply buffer, which holds
+ * a strong reference on it, is only freed after taking our own
+ * references.
+ */
+static int transact(uint32_t target, uint32_t code, uint32_t *out)
+{
+	struct {
+		uint32_t cmd;
+		struct binder_transaction_data tr;
+	} __attribute__((packed)) txn = {
+		.cmd = BC_TRANSACTION,
+		.tr.target.handle = target,
+		.tr.code = code,
+	};
+	struct ref_cmd take[2] = {
+		{ BC_INCREFS, 0 },
+		{ BC_ACQUIRE, 0 },
+	};
+	uint8_t rbuf[256];
+	void *wbuf = &txn;
+	size_t wlen = sizeof(txn);
+
+	for (;;) {
+		size_t rlen, off = 0;
+
+		if (binder_write_read(binder_fd, wbuf, wlen, rbuf,
+				      sizeof(rbuf), &rlen))
+			return -1;
+		wlen = 0;
+		while (off + sizeof(uint32_t) <= rlen) {
+			struct binder_transaction_data *tr;
+			struct flat_binder_object *obj;
+			uint32_t cmd;
+
+			memcpy(&cmd, rbuf + off, sizeof(cmd));
+			off += sizeof(cmd);
+			if (cmd == BR_DEAD_REPLY || cmd == BR_FAILED_REPLY)
+				return -1;
+			if (cmd != BR_REPLY) {
+				off += _IOC_SIZE(cmd);
+				continue;
+			}
+			tr = (void *)(rbuf + off);
+			if (out) {
+				obj = (void *)(uintptr_t)tr->data.ptr.buffer;
+				if (tr->data_size != sizeof(*obj) ||
+				    obj->hdr.type != BINDER_TYPE_HANDLE)
+					return -1;
+				*out = take[0].handle = take[1].handle =
+					obj->handle;
+				if (binder_write_read(binder_fd, take,
+						      sizeof(take), NULL, 0,
+						      NULL))
+					return -1;
+			}
+			return free_buffer(binder_fd, tr->data.ptr.buffer);
+		}
+	}
+}
+
+static int send_cmds(struct ref_cmd *cmds, int n)
+{
+	return binder_write_read(binder_fd, cmds, n * sizeof(*cmds),
+				 NULL, 0, NULL);
+}
+
+/* BC_ACQUIRE/BC_RELEASE pairs; the strong count never drops below 1 */
+static void *acquire_release(void *arg)
+{
+	struct ref_cmd cmds[2 * BATCH];
+	int i;
+
+	for (i = 0; i < BATCH; i++) {
+		cmds[2 * i].cmd = BC_ACQUIRE;
+		cmds[2 * i].handle = handle;
+		cmds[2 * i + 1].cmd = BC_RELEASE;
+		cmds[2 * i + 1].handle = handle;
+	}
+	for (i = 0; i < iterations / BATCH; i++)
+		if (send_cmds(cmds, 2 * BATCH))
+			return (void *)-1L;
+	return NULL;
+}
+
+/* Move the weak count between 1 and 0 (and back) through the locked path */
+static volatile bool stop_toggle;
+
+static void *toggle_weak(void *arg)
+{
+	struct ref_cmd decref = { BC_DECREFS, handle };
+	struct ref_cmd incref = { BC_INCREFS, handle };
+
+	while (!stop_toggle)
+		if (send_cmds(&decref, 1) || send_cmds(&incref, 1))
+			return (void *)-1L;
+	return NULL;
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int run(int threads, bool toggle, double *ns)
+{
+	pthread_t tid[threads + 1];
+	void *res;
+	double start;
+	int i, ret = 0;
+
+	stop_toggle = false;
+	start = now_ns();
+	for (i = 0; i < threads; i++)
+		if (pthread_create(&tid[i], NULL, acquire_release, NULL))
+			return -1;
+	if (toggle && pthread_create(&tid[threads], NULL, toggle_weak, NULL))
+		return -1;
+	for (i = 0; i < threads; i++) {
+		pthread_join(tid[i], &res);
+		ret |= res != NULL;
+	}
+	*ns = (now_ns() - start) / ((double)threads * iterations * 2);
+	if (toggle) {
+		stop_toggle = true;
+		pthread_join(tid[threads], &res);
+		ret |= res != NULL;
+	}
+	return ret ? -1 : 0;
+}
+
+static int client(void)
+{
+	struct ref_cmd release[2] = {
+		{ BC_RELEASE, 0 },
+		{ BC_DECREFS, 0 },
+	};
+	double ns;
+	void *map;
+	int threads;
+
+	binder_fd = binder_open(&map);
+	if (binder_fd < 0 || transact(0, GET_NODE, &handle)) {
+		ksft_print_msg("failed to get a handle from the server\n");
+		return KSFT_FAIL;
+	}
+
+	printf("%8s %16s %16s\n", "threads", "ns/cmd", "ns/cmd (toggle)");
+	for (threads = 1; threads <= nr_threads; threads *= 2) {
+		double toggle_ns;
+
+		if (run(threads, false, &ns) || run(threads, true, &toggle_ns)) {
+			ksft_print_msg("refcount command failed: %s\n",
+				       strerror(errno));
+			return KSFT_FAIL;
+		}
+		printf("%8d %16.1f %16.1f\n", threads, ns, toggle_ns);
+	}
+
+	/* Both counts must be back at exactly 1 */
+	if (transact(handle, PING, NULL)) {
+		ksft_print_msg("handle %u lost while references were held\n",
+			       handle);
+		return KSFT_FAIL;
+	}
+	release[0].handle = release[1].handle = handle;
+	if (send_cmds(release, 2)) {
+		ksft_print_msg("failed to drop the last references\n");
+		return KSFT_FAIL;
+	}
+	if (!transact(handle, PING, NULL)) {
+		ksft_print_msg("handle %u still valid after the last release\n",
+			       handle);
+		return KSFT_FAIL;
+	}
+	return KSFT_PASS;
+}
+
+int main(int argc, char *argv[])
+{
+	int opt, ready[2], status, ret;
+	char c;
+	pid_t pid;
+
+	while ((opt = getopt(argc, argv, "d:i:t:")) != -1) {
+		switch (opt) {
+		case 'd':
+			dev = optarg;
+			break;
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-d device] [-i iterations] [-t threads]\n",
+				argv[0]);
+			return KSFT_FAIL;
+		}
+	}
+	if (iterations < BATCH || nr_threads < 1) {
+		fprintf(stderr, "need at least %d iterations and 1 thread\n",
+			BATCH);
+		return KSFT_FAIL;
+	}
+	if (access(dev, R_OK | W_OK)) {
+		ksft_print_msg("%s: %s\n", dev, strerror(errno));
+		return KSFT_SKIP;
+	}
+
+	if (pipe(ready))
+		return KSFT_FAIL;
+	pid = fork();
+	if (pid < 0)
+		return KSFT_FAIL;
+	if (!pid) {
+		close(ready[0]);
+		_exit(server(ready[1]));
+	}
+	close(ready[1]);
+	if (read(ready[0], &c, 1) != 1) {
+		ksft_print_msg("server failed to become context manager\n");
+		waitpid(pid, &status, 0);
+		return KSFT_SKIP;
+	}
+
+	ret = client();
+	kill(pid, SIGKILL);
+	waitpid(pid, &status, 0);
+	return ret;
+}
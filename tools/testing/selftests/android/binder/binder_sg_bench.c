@@ -0,0 +1,334 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Scatter-gather transaction throughput, in the style of
+ * binderThroughputTest.
+ *
+ * A server process becomes context manager and replies to every
+ * transaction.  A client sends transactions carrying a single
+ * BINDER_TYPE_PTR buffer of 4K to 1M, either from anonymous memory
+ * (copied by the driver) or from a write-sealed memfd (mapped into the
+ * server when it is at least binder_alloc.zero_copy_min bytes).  The
+ * server checks the payload and the client reports the time per round
+ * trip and the throughput.
+ *
+ * Needs a binder device, e.g. run as root in QEMU:
+ *	binder_sg_bench [-d /dev/binder] [-i iterations]
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/android/binder.h>
+#include <linux/memfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include <kselftest.h>
+
+#define MAP_SIZE	(4 << 20)
+#define MIN_PAYLOAD	(4 << 10)
+#define MAX_PAYLOAD	(1 << 20)
+#define PAGE		4096
+
+static const char *dev = "/dev/binder";
+static int iterations = 1000;
+
+static int binder_open(void **map)
+{
+	struct binder_version version;
+	int fd;
+
+	fd = open(dev, O_RDWR | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	if (ioctl(fd, BINDER_VERSION, &version) ||
+	    version.protocol_version != BINDER_CURRENT_PROTOCOL_VERSION) {
+		close(fd);
+		errno = EPROTO;
+		return -1;
+	}
+	*map = mmap(NULL, MAP_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (*map == MAP_FAILED) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int binder_write_read(int fd, void *wbuf, size_t wlen,
+			     void *rbuf, size_t rlen, size_t *consumed)
+{
+	struct binder_write_read bwr = {
+		.write_buffer = (uintptr_t)wbuf,
+		.write_size = wlen,
+		.read_buffer = (uintptr_t)rbuf,
+		.read_size = rlen,
+	};
+	int ret;
+
+	do {
+		ret = ioctl(fd, BINDER_WRITE_READ, &bwr);
+	} while (ret < 0 && errno == EINTR);
+	if (consumed)
+		*consumed = bwr.read_consumed;
+	return ret;
+}
+
+/* Reply to each transaction after checking its PTR payload */
+static int server(int ready)
+{
+	struct {
+		uint32_t cmd;
+		struct binder_transaction_data tr;
+	} __attribute__((packed)) reply;
+	struct {
+		uint32_t cmd;
+		binder_uintptr_t ptr;
+	} __attribute__((packed)) free_cmd;
+	uint8_t rbuf[256];
+	uint32_t cmd = BC_ENTER_LOOPER;
+	void *map;
+	int fd;
+
+	fd = binder_open(&map);
+	if (fd < 0 || ioctl(fd, BINDER_SET_CONTEXT_MGR, 0) ||
+	    binder_write_read(fd, &cmd, sizeof(cmd), NULL, 0, NULL))
+		return 1;
+	if (write(ready, "", 1) != 1)
+		return 1;
+
+	for (;;) {
+		size_t len, off = 0;
+
+		if (binder_write_read(fd, NULL, 0, rbuf, sizeof(rbuf), &len))
+			return 1;
+		while (off + sizeof(uint32_t) <= len) {
+			struct binder_transaction_data *tr;
+			struct binder_buffer_object *bp;
+			const uint8_t *p;
+			bool ok;
+
+			memcpy(&cmd, rbuf + off, sizeof(cmd));
+			off += sizeof(cmd);
+			if (cmd != BR_TRANSACTION) {
+				off += _IOC_SIZE(cmd);
+				continue;
+			}
+			tr = (void *)(rbuf + off);
+			off += sizeof(*tr);
+
+			bp = (void *)(uintptr_t)tr->data.ptr.buffer;
+			p = (void *)(uintptr_t)bp->buffer;
+			ok = tr->data_size == sizeof(*bp) &&
+			     bp->hdr.type == BINDER_TYPE_PTR &&
+			     p[0] == (uint8_t)bp->length &&
+			     p[bp->length - 1] == (uint8_t)(2 * bp->length - 1);
+
+			free_cmd.cmd = BC_FREE_BUFFER;
+			free_cmd.ptr = tr->data.ptr.buffer;
+			memset(&reply, 0, sizeof(reply));
+			reply.cmd = BC_REPLY;
+			reply.tr.flags = ok ? 0 : TF_STATUS_CODE;
+			if (binder_write_read(fd, &free_cmd, sizeof(free_cmd),
+					      NULL, 0, NULL) ||
+			    binder_write_read(fd, &reply, sizeof(reply),
+					      NULL, 0, NULL))
+				return 1;
+		}
+	}
+}
+
+/* Fill a payload of @len bytes, from a write-sealed memfd if @sealed */
+static void *payload(size_t len, bool sealed)
+{
+	uint8_t *buf = malloc(len);
+	void *map;
+	size_t i;
+	int fd;
+
+	if (!buf)
+		return NULL;
+	for (i = 0; i < len; i++)
+		buf[i] = (uint8_t)(len + i);
+	if (!sealed)
+		return buf;
+
+	fd = syscall(__NR_memfd_create, "binder_sg_bench", MFD_ALLOW_SEALING);
+	if (fd < 0 || write(fd, buf, len) != len ||
+	    fcntl(fd, F_ADD_SEALS, F_SEAL_WRITE | F_SEAL_SHRINK | F_SEAL_GROW)) {
+		free(buf);
+		return NULL;
+	}
+	free(buf);
+	map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	return map == MAP_FAILED ? NULL : map;
+}
+
+static int transact(int fd, void *buf, size_t len)
+{
+	struct binder_buffer_object bp = {
+		.hdr.type = BINDER_TYPE_PTR,
+		.buffer = (uintptr_t)buf,
+		.length = len,
+	};
+	binder_size_t offset = 0;
+	struct {
+		uint32_t cmd;
+		struct binder_transaction_data_sg sg;
+	} __attribute__((packed)) txn = {
+		.cmd = BC_TRANSACTION_SG,
+		.sg.transaction_data = {
+			.target.handle = 0,
+			.data_size = sizeof(bp),
+			.offsets_size = sizeof(offset),
+			.data.ptr.buffer = (uintptr_t)&bp,
+			.data.ptr.offsets = (uintptr_t)&offset,
+		},
+		/* a page of slack lets the driver page align the payload */
+		.sg.buffers_size = ((len + 7) & ~7UL) + PAGE,
+	};
+	struct {
+		uint32_t cmd;
+		binder_uintptr_t ptr;
+	} __attribute__((packed)) free_cmd = { .cmd = BC_FREE_BUFFER };
+	uint8_t rbuf[256];
+	void *wbuf = &txn;
+	size_t wlen = sizeof(txn);
+
+	for (;;) {
+		size_t rlen, off = 0;
+
+		if (binder_write_read(fd, wbuf, wlen, rbuf, sizeof(rbuf), &rlen))
+			return -1;
+		wlen = 0;
+		while (off + sizeof(uint32_t) <= rlen) {
+			struct binder_transaction_data *tr;
+			uint32_t cmd;
+
+			memcpy(&cmd, rbuf + off, sizeof(cmd));
+			off += sizeof(cmd);
+			if (cmd == BR_DEAD_REPLY || cmd == BR_FAILED_REPLY)
+				return -1;
+			if (cmd != BR_REPLY) {
+				off += _IOC_SIZE(cmd);
+				continue;
+			}
+			tr = (void *)(rbuf + off);
+			free_cmd.ptr = tr->data.ptr.buffer;
+			if (binder_write_read(fd, &free_cmd, sizeof(free_cmd),
+					      NULL, 0, NULL))
+				return -1;
+			return tr->flags & TF_STATUS_CODE ? -1 : 0;
+		}
+	}
+}
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int client(void)
+{
+	size_t len;
+	void *map;
+	int fd, i, mode;
+
+	fd = binder_open(&map);
+	if (fd < 0)
+		return KSFT_FAIL;
+
+	printf("%8s %12s %12s %12s %12s\n", "size", "copy us", "copy MB/s",
+	       "sealed us", "sealed MB/s");
+	for (len = MIN_PAYLOAD; len <= MAX_PAYLOAD; len *= 2) {
+		double us[2];
+
+		for (mode = 0; mode < 2; mode++) {
+			void *buf = payload(len, mode);
+			double start;
+
+			if (!buf) {
+				ksft_print_msg("payload setup failed: %s\n",
+					       strerror(errno));
+				return KSFT_FAIL;
+			}
+			start = now_us();
+			for (i = 0; i < iterations; i++) {
+				if (transact(fd, buf, len)) {
+					ksft_print_msg("%s transaction of %zu bytes failed\n",
+						       mode ? "sealed" : "copy",
+						       len);
+					return KSFT_FAIL;
+				}
+			}
+			us[mode] = (now_us() - start) / iterations;
+			if (mode)
+				munmap(buf, len);
+			else
+				free(buf);
+		}
+		printf("%8zu %12.1f %12.1f %12.1f %12.1f\n", len,
+		       us[0], len / us[0], us[1], len / us[1]);
+	}
+	return KSFT_PASS;
+}
+
+int main(int argc, char *argv[])
+{
+	int opt, ready[2], status, ret;
+	char c;
+	pid_t pid;
+
+	while ((opt = getopt(argc, argv, "d:i:")) != -1) {
+		switch (opt) {
+		case 'd':
+			dev = optarg;
+			break;
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-d device] [-i iterations]\n",
+				argv[0]);
+			return KSFT_FAIL;
+		}
+	}
+	if (access(dev, R_OK | W_OK)) {
+		ksft_print_msg("%s: %s\n", dev, strerror(errno));
+		return KSFT_SKIP;
+	}
+
+	if (pipe(ready))
+		return KSFT_FAIL;
+	pid = fork();
+	if (pid < 0)
+		return KSFT_FAIL;
+	if (!pid) {
+		close(ready[0]);
+		_exit(server(ready[1]));
+	}
+	close(ready[1]);
+	if (read(ready[0], &c, 1) != 1) {
+		ksft_print_msg("server failed to become context manager\n");
+		waitpid(pid, &status, 0);
+		return KSFT_SKIP;
+	}
+
+	ret = client();
+	kill(pid, SIGKILL);
+	waitpid(pid, &status, 0);
+	return ret;
+}
@@ -0,0 +1,153 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Multi-producer epoll wakeup benchmark.
+ *
+ * Every producer thread owns an eventfd and keeps writing to it, while
+ * a single consumer waits on all of them through one edge-triggered
+ * epoll instance and drains whatever it is told is ready.  Each write
+ * runs ep_poll_callback() on the producer's CPU, so with several
+ * producers the callbacks race with each other and with the consumer
+ * on the same eventpoll.
+ *
+ * The consumer has to account for every single write: a ready item
+ * lost by the callback leaves it waiting on an edge that never comes,
+ * which is reported as a failure after a timeout.
+ *
+ *	epoll_wakeup_bench [-i iterations] [-t threads]
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "kselftest.h"
+
+#define TIMEOUT_MS	5000
+
+static int iterations = 200000;
+static int nr_threads = 8;
+
+static int efd[64];
+
+static void *producer(void *arg)
+{
+	uint64_t one = 1;
+	int fd = *(int *)arg;
+	int i;
+
+	for (i = 0; i < iterations; i++)
+		if (write(fd, &one, sizeof(one)) != sizeof(one))
+			return (void *)-1L;
+	return NULL;
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Returns ns per wakeup, or a negative value on failure */
+static double run(int threads)
+{
+	struct epoll_event ev[64];
+	pthread_t tid[64];
+	uint64_t total = 0, want = (uint64_t)threads * iterations;
+	double start, ns;
+	void *res;
+	int epfd, i, n, ret = 0;
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd < 0)
+		return -1;
+	for (i = 0; i < threads; i++) {
+		efd[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		ev[0].events = EPOLLIN | EPOLLET;
+		ev[0].data.fd = efd[i];
+		if (efd[i] < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, efd[i], ev))
+			return -1;
+	}
+
+	start = now_ns();
+	for (i = 0; i < threads; i++)
+		if (pthread_create(&tid[i], NULL, producer, &efd[i]))
+			return -1;
+
+	while (total < want) {
+		n = epoll_wait(epfd, ev, threads, TIMEOUT_MS);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			ksft_print_msg("%s after %llu of %llu writes\n",
+				       n ? strerror(errno) : "no wakeup",
+				       (unsigned long long)total,
+				       (unsigned long long)want);
+			ret = -1;
+			break;
+		}
+		for (i = 0; i < n; i++) {
+			uint64_t cnt;
+
+			if (read(ev[i].data.fd, &cnt, sizeof(cnt)) == sizeof(cnt))
+				total += cnt;
+			else if (errno != EAGAIN)
+				ret = -1;
+		}
+	}
+	ns = (now_ns() - start) / want;
+
+	for (i = 0; i < threads; i++) {
+		pthread_join(tid[i], &res);
+		ret |= res != NULL;
+		close(efd[i]);
+	}
+	close(epfd);
+	return ret ? -1 : ns;
+}
+
+int main(int argc, char *argv[])
+{
+	int opt, threads;
+	double ns;
+
+	while ((opt = getopt(argc, argv, "i:t:")) != -1) {
+		switch (opt) {
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-i iterations] [-t threads]\n",
+				argv[0]);
+			return KSFT_FAIL;
+		}
+	}
+	if (iterations < 1 || nr_threads < 1 || nr_threads > 64) {
+		fprintf(stderr, "need at least 1 iteration and 1 to 64 threads\n");
+		return KSFT_FAIL;
+	}
+
+	printf("%8s %16s\n", "threads", "ns/wakeup");
+	for (threads = 1; threads <= nr_threads; threads *= 2) {
+		ns = run(threads);
+		if (ns < 0) {
+			ksft_print_msg("%d producers: lost or failed wakeups\n",
+				       threads);
+			return KSFT_FAIL;
+		}
+		printf("%8d %16.1f\n", threads, ns);
+	}
+	return KSFT_PASS;
+}
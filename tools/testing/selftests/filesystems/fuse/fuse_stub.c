@@ -0,0 +1,833 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Minimal passthrough FUSE daemon speaking the raw /dev/fuse protocol,
+ * with a built-in small-file stat/open benchmark.
+ *
+ * The daemon mirrors a backing directory.  Entry and attribute timeouts
+ * are zero, so every stat() and open() on the mount is a round trip to
+ * the daemon.  With -q, one /dev/fuse clone per CPU is bound to that
+ * CPU's input queue with FUSE_DEV_IOC_BIND_CPU and served by a thread
+ * pinned to the same CPU.
+ *
+ * With -s, the clients instead repeatedly scan (readdir + stat) a single
+ * directory of -n files, like a gallery or file manager would.  With -p,
+ * that directory is approved for metadata passthrough with
+ * FUSE_DEV_IOC_PASSTHROUGH_DIR first, so the scan is served from the
+ * backing directory.
+ *
+ * With -r, the clients instead read a file of -n MiB sequentially, dropping
+ * its page cache before every pass.  With -m, the daemon replies to reads
+ * by splicing the backing file into a pipe and the pipe into /dev/fuse
+ * with SPLICE_F_MOVE, donating the pages instead of having them copied.
+ *
+ * Must be run as root.
+ */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <linux/fuse.h>
+
+#include <kselftest.h>
+
+#define BUF_SIZE	(FUSE_MIN_READ_BUFFER + 128 * 1024)
+#define MAX_NODES	(1 << 20)
+#define HASH_BITS	16
+
+struct node {
+	char *path;
+	uint64_t nlookup;
+	uint64_t hash_next;
+};
+
+static struct node *nodes;
+static uint64_t nr_nodes;
+static uint64_t node_hash[1 << HASH_BITS];
+static pthread_mutex_t nodes_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static char backing_dir[PATH_MAX];
+static char mount_dir[PATH_MAX];
+static int nr_files = 1000;
+static int nr_clients;
+static int duration = 5;
+static bool per_cpu_queues;
+static bool scan;
+static bool passthrough_dir;
+static bool read_bench;
+static bool splice_move;
+static volatile bool stop;
+
+static unsigned int path_hash(const char *path)
+{
+	unsigned int h = 5381;
+
+	while (*path)
+		h = h * 33 + (unsigned char)*path++;
+	return h & ((1 << HASH_BITS) - 1);
+}
+
+static uint64_t node_get(const char *path)
+{
+	unsigned int h = path_hash(path);
+	uint64_t i;
+
+	pthread_mutex_lock(&nodes_lock);
+	for (i = node_hash[h]; i; i = nodes[i].hash_next) {
+		if (!strcmp(nodes[i].path, path))
+			goto out;
+	}
+	if (nr_nodes == MAX_NODES) {
+		i = 0;
+		goto out_unlock;
+	}
+	i = nr_nodes++;
+	nodes[i].path = strdup(path);
+	nodes[i].hash_next = node_hash[h];
+	node_hash[h] = i;
+out:
+	nodes[i].nlookup++;
+out_unlock:
+	pthread_mutex_unlock(&nodes_lock);
+	return i;
+}
+
+static uint64_t node_find(const char *path)
+{
+	uint64_t i;
+
+	pthread_mutex_lock(&nodes_lock);
+	for (i = node_hash[path_hash(path)]; i; i = nodes[i].hash_next) {
+		if (!strcmp(nodes[i].path, path))
+			break;
+	}
+	pthread_mutex_unlock(&nodes_lock);
+	return i;
+}
+
+static const char *node_path(uint64_t nodeid)
+{
+	const char *path = NULL;
+
+	pthread_mutex_lock(&nodes_lock);
+	if (nodeid < nr_nodes)
+		path = nodes[nodeid].path;
+	pthread_mutex_unlock(&nodes_lock);
+	return path;
+}
+
+static void node_forget(uint64_t nodeid, uint64_t nlookup)
+{
+	pthread_mutex_lock(&nodes_lock);
+	if (nodeid > FUSE_ROOT_ID && nodeid < nr_nodes &&
+	    nodes[nodeid].nlookup >= nlookup)
+		nodes[nodeid].nlookup -= nlookup;
+	pthread_mutex_unlock(&nodes_lock);
+}
+
+static void fill_attr(struct fuse_attr *attr, const struct stat *st)
+{
+	memset(attr, 0, sizeof(*attr));
+	attr->ino = st->st_ino;
+	attr->size = st->st_size;
+	attr->blocks = st->st_blocks;
+	attr->atime = st->st_atim.tv_sec;
+	attr->mtime = st->st_mtim.tv_sec;
+	attr->ctime = st->st_ctim.tv_sec;
+	attr->atimensec = st->st_atim.tv_nsec;
+	attr->mtimensec = st->st_mtim.tv_nsec;
+	attr->ctimensec = st->st_ctim.tv_nsec;
+	attr->mode = st->st_mode;
+	attr->nlink = st->st_nlink;
+	attr->uid = st->st_uid;
+	attr->gid = st->st_gid;
+	attr->blksize = st->st_blksize;
+}
+
+static int reply(int fd, uint64_t unique, int error, const void *arg,
+		 size_t argsize)
+{
+	struct fuse_out_header out = {
+		.unique = unique,
+		.error = error,
+		.len = sizeof(out) + (error ? 0 : argsize),
+	};
+	struct iovec iov[2] = {
+		{ .iov_base = &out, .iov_len = sizeof(out) },
+		{ .iov_base = (void *)arg, .iov_len = argsize },
+	};
+
+	return writev(fd, iov, error || !argsize ? 1 : 2) < 0 ? -errno : 0;
+}
+
+static void do_lookup(int fd, struct fuse_in_header *in, const char *name)
+{
+	const char *parent = node_path(in->nodeid);
+	struct fuse_entry_out out;
+	char path[PATH_MAX];
+	struct stat st;
+
+	if (!parent) {
+		reply(fd, in->unique, -ENOENT, NULL, 0);
+		return;
+	}
+	snprintf(path, sizeof(path), "%s/%s", parent, name);
+	if (lstat(path, &st)) {
+		reply(fd, in->unique, -errno, NULL, 0);
+		return;
+	}
+	memset(&out, 0, sizeof(out));
+	out.nodeid = node_get(path);
+	if (!out.nodeid) {
+		reply(fd, in->unique, -ENOMEM, NULL, 0);
+		return;
+	}
+	fill_attr(&out.attr, &st);
+	reply(fd, in->unique, 0, &out, sizeof(out));
+}
+
+static void do_getattr(int fd, struct fuse_in_header *in)
+{
+	const char *path = node_path(in->nodeid);
+	struct fuse_attr_out out;
+	struct stat st;
+
+	if (!path || lstat(path, &st)) {
+		reply(fd, in->unique, path ? -errno : -ENOENT, NULL, 0);
+		return;
+	}
+	memset(&out, 0, sizeof(out));
+	fill_attr(&out.attr, &st);
+	reply(fd, in->unique, 0, &out, sizeof(out));
+}
+
+static void do_open(int fd, struct fuse_in_header *in,
+		    struct fuse_open_in *arg, bool dir)
+{
+	const char *path = node_path(in->nodeid);
+	struct fuse_open_out out;
+	int backing;
+
+	if (!path) {
+		reply(fd, in->unique, -ENOENT, NULL, 0);
+		return;
+	}
+	backing = open(path, dir ? O_RDONLY | O_DIRECTORY :
+				   arg->flags & ~(O_CREAT | O_EXCL | O_NOCTTY));
+	if (backing < 0) {
+		reply(fd, in->unique, -errno, NULL, 0);
+		return;
+	}
+	memset(&out, 0, sizeof(out));
+	out.fh = backing;
+	reply(fd, in->unique, 0, &out, sizeof(out));
+}
+
+struct server {
+	pthread_t thread;
+	int fd;
+	int cpu;
+	int pipe[2];
+};
+
+/*
+ * Reply with the header and the data in separate pipe buffers, so that
+ * every page of data can be moved into the page cache.
+ */
+static void do_read_splice(struct server *srv, struct fuse_in_header *in,
+			   struct fuse_read_in *arg)
+{
+	struct fuse_out_header out = { .unique = in->unique };
+	struct iovec iov = { .iov_base = &out, .iov_len = sizeof(out) };
+	loff_t off = arg->offset;
+	size_t size = arg->size;
+	char sink[4096];
+	struct stat st;
+	ssize_t ret;
+
+	if (fstat(arg->fh, &st)) {
+		reply(srv->fd, in->unique, -errno, NULL, 0);
+		return;
+	}
+	if (off >= st.st_size)
+		size = 0;
+	else if (size > st.st_size - off)
+		size = st.st_size - off;
+
+	out.len = sizeof(out) + size;
+	if (vmsplice(srv->pipe[1], &iov, 1, 0) != sizeof(out))
+		goto err;
+	while (size) {
+		ret = splice(arg->fh, &off, srv->pipe[1], NULL, size,
+			     SPLICE_F_MOVE);
+		if (ret <= 0)
+			goto err;
+		size -= ret;
+	}
+	ret = splice(srv->pipe[0], NULL, srv->fd, NULL, out.len,
+		     SPLICE_F_MOVE);
+	if (ret == out.len)
+		return;
+err:
+	/* Drain whatever made it into the (non-blocking) pipe */
+	while (read(srv->pipe[0], sink, sizeof(sink)) > 0)
+		;
+	reply(srv->fd, in->unique, -EIO, NULL, 0);
+}
+
+static void do_read(int fd, struct fuse_in_header *in,
+		    struct fuse_read_in *arg, char *buf)
+{
+	ssize_t ret;
+
+	if (arg->size > BUF_SIZE)
+		arg->size = BUF_SIZE;
+	ret = pread(arg->fh, buf, arg->size, arg->offset);
+	if (ret < 0)
+		reply(fd, in->unique, -errno, NULL, 0);
+	else
+		reply(fd, in->unique, 0, buf, ret);
+}
+
+static void do_readdir(int fd, struct fuse_in_header *in,
+		       struct fuse_read_in *arg, char *buf)
+{
+	size_t len = 0;
+	struct dirent *de;
+	DIR *dir;
+	int dfd;
+
+	dfd = dup(arg->fh);
+	dir = dfd < 0 ? NULL : fdopendir(dfd);
+	if (!dir) {
+		reply(fd, in->unique, -errno, NULL, 0);
+		return;
+	}
+	seekdir(dir, arg->offset);
+	while ((de = readdir(dir)) != NULL) {
+		struct fuse_dirent *fde = (struct fuse_dirent *)(buf + len);
+		size_t namelen = strlen(de->d_name);
+		size_t entsize = FUSE_DIRENT_ALIGN(FUSE_NAME_OFFSET + namelen);
+
+		if (len + entsize > arg->size)
+			break;
+		memset(fde, 0, entsize);
+		fde->ino = de->d_ino;
+		fde->off = telldir(dir);
+		fde->namelen = namelen;
+		fde->type = de->d_type;
+		memcpy(fde->name, de->d_name, namelen);
+		len += entsize;
+	}
+	closedir(dir);
+	reply(fd, in->unique, 0, buf, len);
+}
+
+static void do_init(int fd, struct fuse_in_header *in,
+		    struct fuse_init_in *arg)
+{
+	struct fuse_init_out out;
+
+	memset(&out, 0, sizeof(out));
+	out.major = FUSE_KERNEL_VERSION;
+	out.minor = arg->minor < FUSE_KERNEL_MINOR_VERSION ?
+		    arg->minor : FUSE_KERNEL_MINOR_VERSION;
+	out.max_readahead = arg->max_readahead;
+	out.flags = arg->flags & (FUSE_ASYNC_READ | FUSE_BIG_WRITES);
+	if (passthrough_dir)
+		out.flags |= arg->flags & FUSE_PASSTHROUGH;
+	if (splice_move)
+		out.flags |= arg->flags & (FUSE_SPLICE_WRITE | FUSE_SPLICE_MOVE);
+	out.max_background = 64;
+	out.congestion_threshold = 48;
+	out.max_write = 128 * 1024;
+	reply(fd, in->unique, 0, &out, sizeof(out));
+}
+
+static int handle_one(struct server *srv, char *buf, char *outbuf)
+{
+	int fd = srv->fd;
+	struct fuse_in_header *in = (struct fuse_in_header *)buf;
+	void *arg = buf + sizeof(*in);
+	ssize_t ret;
+
+	ret = read(fd, buf, BUF_SIZE);
+	if (ret < 0)
+		return errno == EINTR || errno == ENOENT ? 0 : -errno;
+	if (ret < (ssize_t)sizeof(*in))
+		return -EIO;
+
+	switch (in->opcode) {
+	case FUSE_INIT:
+		do_init(fd, in, arg);
+		break;
+	case FUSE_LOOKUP:
+		do_lookup(fd, in, arg);
+		break;
+	case FUSE_GETATTR:
+		do_getattr(fd, in);
+		break;
+	case FUSE_OPEN:
+		do_open(fd, in, arg, false);
+		break;
+	case FUSE_OPENDIR:
+		do_open(fd, in, arg, true);
+		break;
+	case FUSE_READ:
+		if (splice_move)
+			do_read_splice(srv, in, arg);
+		else
+			do_read(fd, in, arg, outbuf);
+		break;
+	case FUSE_READDIR:
+		do_readdir(fd, in, arg, outbuf);
+		break;
+	case FUSE_RELEASE:
+	case FUSE_RELEASEDIR:
+		close(((struct fuse_release_in *)arg)->fh);
+		reply(fd, in->unique, 0, NULL, 0);
+		break;
+	case FUSE_FLUSH:
+	case FUSE_FSYNC:
+	case FUSE_FSYNCDIR:
+		reply(fd, in->unique, 0, NULL, 0);
+		break;
+	case FUSE_FORGET:
+		node_forget(in->nodeid,
+			    ((struct fuse_forget_in *)arg)->nlookup);
+		break;
+	case FUSE_BATCH_FORGET: {
+		struct fuse_batch_forget_in *bf = arg;
+		struct fuse_forget_one *one = (void *)(bf + 1);
+		uint32_t i;
+
+		for (i = 0; i < bf->count; i++)
+			node_forget(one[i].nodeid, one[i].nlookup);
+		break;
+	}
+	case FUSE_INTERRUPT:
+		break;
+	case FUSE_DESTROY:
+		reply(fd, in->unique, 0, NULL, 0);
+		return -ENODEV;
+	default:
+		reply(fd, in->unique, -ENOSYS, NULL, 0);
+		break;
+	}
+	return 0;
+}
+
+static void *server_thread(void *data)
+{
+	struct server *srv = data;
+	char *buf = malloc(BUF_SIZE);
+	char *outbuf = malloc(BUF_SIZE);
+
+	if (srv->cpu >= 0) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(srv->cpu, &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	}
+	if (splice_move) {
+		if (pipe2(srv->pipe, O_NONBLOCK | O_CLOEXEC))
+			goto out;
+		fcntl(srv->pipe[1], F_SETPIPE_SZ, BUF_SIZE * 2);
+	}
+	while (buf && outbuf && handle_one(srv, buf, outbuf) == 0)
+		;
+	if (splice_move) {
+		close(srv->pipe[0]);
+		close(srv->pipe[1]);
+	}
+out:
+	free(buf);
+	free(outbuf);
+	return NULL;
+}
+
+static int clone_dev(int fd, int cpu)
+{
+	uint32_t master = fd;
+	int clonefd;
+
+	clonefd = open("/dev/fuse", O_RDWR | O_CLOEXEC);
+	if (clonefd < 0)
+		return -errno;
+	if (ioctl(clonefd, FUSE_DEV_IOC_CLONE, &master))
+		goto err;
+	if (cpu >= 0) {
+		uint32_t c = cpu;
+
+		if (ioctl(clonefd, FUSE_DEV_IOC_BIND_CPU, &c))
+			goto err;
+	}
+	return clonefd;
+err:
+	close(clonefd);
+	return -errno;
+}
+
+struct client {
+	pthread_t thread;
+	int cpu;
+	unsigned long stats;
+	unsigned long opens;
+};
+
+static void *client_thread(void *data)
+{
+	struct client *cl = data;
+	unsigned int seed = cl->cpu;
+	char path[PATH_MAX];
+	cpu_set_t set;
+	struct stat st;
+
+	CPU_ZERO(&set);
+	CPU_SET(cl->cpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+	while (!stop) {
+		int fd;
+
+		snprintf(path, sizeof(path), "%s/f%d", mount_dir,
+			 rand_r(&seed) % nr_files);
+		if (!stat(path, &st))
+			cl->stats++;
+		fd = open(path, O_RDONLY);
+		if (fd >= 0) {
+			cl->opens++;
+			close(fd);
+		}
+	}
+	return NULL;
+}
+
+static void *scan_thread(void *data)
+{
+	struct client *cl = data;
+	char path[PATH_MAX];
+	struct dirent *de;
+	cpu_set_t set;
+	struct stat st;
+	DIR *dir;
+
+	CPU_ZERO(&set);
+	CPU_SET(cl->cpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+	snprintf(path, sizeof(path), "%s/scan", mount_dir);
+	while (!stop) {
+		dir = opendir(path);
+		if (!dir)
+			break;
+		while (!stop && (de = readdir(dir)) != NULL) {
+			if (de->d_name[0] == '.')
+				continue;
+			if (!fstatat(dirfd(dir), de->d_name, &st,
+				     AT_SYMLINK_NOFOLLOW))
+				cl->stats++;
+		}
+		closedir(dir);
+		cl->opens++;
+	}
+	return NULL;
+}
+
+static void *read_thread(void *data)
+{
+	struct client *cl = data;
+	char path[PATH_MAX];
+	cpu_set_t set;
+	ssize_t ret;
+	char *buf;
+	int fd;
+
+	CPU_ZERO(&set);
+	CPU_SET(cl->cpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+	buf = malloc(1 << 20);
+	snprintf(path, sizeof(path), "%s/big", mount_dir);
+	while (buf && !stop) {
+		fd = open(path, O_RDONLY);
+		if (fd < 0)
+			break;
+		/* Every pass has to fetch the data from the daemon */
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		while (!stop && (ret = read(fd, buf, 1 << 20)) > 0)
+			cl->stats += ret;
+		close(fd);
+		cl->opens++;
+	}
+	free(buf);
+	return NULL;
+}
+
+static int approve_scan_dir(int fd)
+{
+	struct fuse_passthrough_dir arg = {};
+	char path[PATH_MAX];
+	struct stat st;
+	int ret = 0;
+
+	/* Look the directory up so that it has a nodeid */
+	snprintf(path, sizeof(path), "%s/scan", mount_dir);
+	if (stat(path, &st))
+		return -errno;
+
+	snprintf(path, sizeof(path), "%s/scan", backing_dir);
+	arg.nodeid = node_find(path);
+	arg.fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (!arg.nodeid || arg.fd < 0)
+		return -ENOENT;
+	arg.mask = 0;
+	if (ioctl(fd, FUSE_DEV_IOC_PASSTHROUGH_DIR, &arg))
+		ret = -errno;
+	close(arg.fd);
+	return ret;
+}
+
+static int populate(void)
+{
+	char path[PATH_MAX];
+	const char *dir = backing_dir;
+	char scan_dir[PATH_MAX];
+	int i, fd;
+
+	if (read_bench) {
+		char *buf = calloc(1, 1 << 20);
+
+		snprintf(path, sizeof(path), "%s/big", backing_dir);
+		fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+		if (fd < 0 || !buf)
+			return -ENOMEM;
+		for (i = 0; i < nr_files; i++) {
+			memset(buf, i, 1 << 20);
+			if (write(fd, buf, 1 << 20) != 1 << 20) {
+				close(fd);
+				return -EIO;
+			}
+		}
+		fsync(fd);
+		close(fd);
+		free(buf);
+		return 0;
+	}
+
+	if (scan) {
+		snprintf(scan_dir, sizeof(scan_dir), "%s/scan", backing_dir);
+		if (mkdir(scan_dir, 0755))
+			return -errno;
+		dir = scan_dir;
+	}
+
+	for (i = 0; i < nr_files; i++) {
+		snprintf(path, sizeof(path), "%s/f%d", dir, i);
+		fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+		if (fd < 0)
+			return -errno;
+		if (write(fd, path, strlen(path)) < 0) {
+			close(fd);
+			return -errno;
+		}
+		close(fd);
+	}
+	return 0;
+}
+
+static void print_ctl(const char *name)
+{
+	char path[PATH_MAX], line[256];
+	struct stat st;
+	FILE *f;
+
+	if (stat(mount_dir, &st))
+		return;
+	snprintf(path, sizeof(path), "/sys/fs/fuse/connections/%u/%s",
+		 (unsigned int)st.st_dev, name);
+	f = fopen(path, "r");
+	if (!f)
+		return;
+	while (fgets(line, sizeof(line), f))
+		printf("  %s", line);
+	fclose(f);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-q] [-s [-p] | -r [-m]] [-n files] [-c clients] [-t seconds]\n"
+		"  -q  bind one /dev/fuse clone per CPU to its CPU queue\n"
+		"  -s  scan (readdir + stat) a directory of files\n"
+		"  -p  approve the scanned directory for metadata passthrough\n"
+		"  -r  read a file of -n MiB with a cold page cache\n"
+		"  -m  reply to reads with SPLICE_F_MOVE\n",
+		prog);
+}
+
+int main(int argc, char *argv[])
+{
+	int ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	struct server *servers;
+	struct client *clients;
+	unsigned long stats = 0, opens = 0;
+	char opts[256];
+	int opt, fd, i, nservers;
+
+	while ((opt = getopt(argc, argv, "qsprmn:c:t:h")) != -1) {
+		switch (opt) {
+		case 'q':
+			per_cpu_queues = true;
+			break;
+		case 's':
+			scan = true;
+			break;
+		case 'p':
+			passthrough_dir = true;
+			break;
+		case 'r':
+			read_bench = true;
+			break;
+		case 'm':
+			splice_move = true;
+			break;
+		case 'n':
+			nr_files = atoi(optarg);
+			break;
+		case 'c':
+			nr_clients = atoi(optarg);
+			break;
+		case 't':
+			duration = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return KSFT_FAIL;
+		}
+	}
+	if (!nr_clients)
+		nr_clients = scan || read_bench ? 1 : ncpus;
+	if (scan && nr_files == 1000)
+		nr_files = 50000;
+	if (read_bench && nr_files == 1000)
+		nr_files = 256;
+
+	if (geteuid()) {
+		ksft_print_msg("must be run as root\n");
+		return KSFT_SKIP;
+	}
+	fd = open("/dev/fuse", O_RDWR | O_CLOEXEC);
+	if (fd < 0) {
+		ksft_print_msg("no /dev/fuse: %s\n", strerror(errno));
+		return KSFT_SKIP;
+	}
+
+	strcpy(backing_dir, "/tmp/fuse_stub_backing.XXXXXX");
+	strcpy(mount_dir, "/tmp/fuse_stub_mnt.XXXXXX");
+	if (!mkdtemp(backing_dir) || !mkdtemp(mount_dir) || populate()) {
+		ksft_print_msg("setup failed: %s\n", strerror(errno));
+		return KSFT_FAIL;
+	}
+
+	nodes = calloc(MAX_NODES, sizeof(*nodes));
+	nodes[FUSE_ROOT_ID].path = backing_dir;
+	nr_nodes = FUSE_ROOT_ID + 1;
+
+	snprintf(opts, sizeof(opts),
+		 "fd=%d,rootmode=40000,user_id=0,group_id=0,allow_other", fd);
+	if (mount("fuse_stub", mount_dir, "fuse", MS_NOSUID | MS_NODEV,
+		  opts)) {
+		ksft_print_msg("mount failed: %s\n", strerror(errno));
+		return KSFT_FAIL;
+	}
+
+	/* One reader on the shared queue, plus one per CPU */
+	nservers = ncpus + 1;
+	servers = calloc(nservers, sizeof(*servers));
+	servers[0].fd = fd;
+	servers[0].cpu = -1;
+	for (i = 1; i < nservers; i++) {
+		servers[i].cpu = per_cpu_queues ? i - 1 : -1;
+		servers[i].fd = clone_dev(fd, servers[i].cpu);
+		if (servers[i].fd < 0) {
+			ksft_print_msg("clone failed: %s\n",
+				       strerror(-servers[i].fd));
+			umount2(mount_dir, MNT_DETACH);
+			return per_cpu_queues ? KSFT_SKIP : KSFT_FAIL;
+		}
+	}
+	for (i = 0; i < nservers; i++)
+		pthread_create(&servers[i].thread, NULL, server_thread,
+			       &servers[i]);
+
+	if (passthrough_dir) {
+		int err = approve_scan_dir(fd);
+
+		if (err) {
+			ksft_print_msg("passthrough dir failed: %s\n",
+				       strerror(-err));
+			umount2(mount_dir, MNT_DETACH);
+			return KSFT_SKIP;
+		}
+	}
+
+	clients = calloc(nr_clients, sizeof(*clients));
+	for (i = 0; i < nr_clients; i++) {
+		clients[i].cpu = i % ncpus;
+		pthread_create(&clients[i].thread, NULL,
+			       scan ? scan_thread :
+			       read_bench ? read_thread : client_thread,
+			       &clients[i]);
+	}
+	sleep(duration);
+	stop = true;
+	for (i = 0; i < nr_clients; i++) {
+		pthread_join(clients[i].thread, NULL);
+		stats += clients[i].stats;
+		opens += clients[i].opens;
+	}
+
+	printf("%s queues, %d %s, %d clients, %d s\n",
+	       per_cpu_queues ? "per-CPU" : "shared", nr_files,
+	       read_bench ? "MiB" : "files", nr_clients, duration);
+	if (read_bench) {
+		printf("%s read: %lu MiB/s, %lu passes\n",
+		       splice_move ? "splice move" : "copy",
+		       (stats >> 20) / duration, opens);
+		opens = opens ?: stats;
+	} else if (scan) {
+		printf("%s scan: %lu entries/s, %lu passes\n",
+		       passthrough_dir ? "passthrough" : "daemon",
+		       stats / duration, opens);
+		opens = opens ?: stats;
+	} else {
+		printf("stat: %lu ops/s\nopen: %lu ops/s\n", stats / duration,
+		       opens / duration);
+	}
+	print_ctl("queues");
+	print_ctl("pages");
+
+	umount2(mount_dir, MNT_DETACH);
+	for (i = 0; i < nservers; i++)
+		close(servers[i].fd);
+	return stats && opens ? KSFT_PASS : KSFT_FAIL;
+}
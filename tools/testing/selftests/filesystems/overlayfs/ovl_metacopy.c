@@ -0,0 +1,240 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * chown -R latency over a large lower tree, with and without metadata only
+ * copy up.
+ *
+ * Both layers live on a private tmpfs.  The lower layer gets -n files of
+ * -s MiB each.  For metacopy=off and then metacopy=on, a fresh overlay is
+ * mounted and every file is chowned through it, which copies each one up.
+ * The test then checks that the data still reads back through the overlay,
+ * and that opening a file for write copies its data up intact.
+ *
+ * Must be run as root.
+ */
+#define _XOPEN_SOURCE 700
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/types.h>
+
+#include <kselftest.h>
+
+#define FILES_PER_DIR	16
+#define CHUNK		(1 << 20)
+
+static char base[64];
+static char lower[128];
+static char merged[128];
+static int nr_files = 64;
+static int file_mib = 16;
+static unsigned long chowned;
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void file_path(char *buf, const char *root, int i)
+{
+	snprintf(buf, PATH_MAX, "%s/d%d/f%d", root, i / FILES_PER_DIR, i);
+}
+
+static int populate(void)
+{
+	char path[PATH_MAX];
+	char *buf = malloc(CHUNK);
+	int i, j, fd;
+
+	if (!buf)
+		return -ENOMEM;
+	for (i = 0; i < nr_files; i++) {
+		if (i % FILES_PER_DIR == 0) {
+			snprintf(path, sizeof(path), "%s/d%d", lower,
+				 i / FILES_PER_DIR);
+			if (mkdir(path, 0755))
+				return -errno;
+		}
+		file_path(path, lower, i);
+		fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+		if (fd < 0)
+			return -errno;
+		memset(buf, 'a' + i % 26, CHUNK);
+		for (j = 0; j < file_mib; j++) {
+			if (write(fd, buf, CHUNK) != CHUNK) {
+				close(fd);
+				return -EIO;
+			}
+		}
+		close(fd);
+	}
+	free(buf);
+	return 0;
+}
+
+static int chown_one(const char *path, const struct stat *st, int type,
+		     struct FTW *ftw)
+{
+	if (lchown(path, 1000, 1000))
+		return -errno;
+	chowned++;
+	return 0;
+}
+
+/* Data of file @i must be intact, plus @extra appended bytes */
+static bool check_data(int i, const char *extra)
+{
+	char path[PATH_MAX], buf[4096];
+	off_t size = (off_t)file_mib * CHUNK;
+	struct stat st;
+	bool ok = false;
+	int fd;
+
+	file_path(path, merged, i);
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st))
+		goto out;
+	if (st.st_size != size + (off_t)strlen(extra) || st.st_uid != 1000)
+		goto out;
+	if (pread(fd, buf, sizeof(buf), size - sizeof(buf)) != sizeof(buf) ||
+	    buf[0] != 'a' + i % 26 || buf[sizeof(buf) - 1] != 'a' + i % 26)
+		goto out;
+	if (*extra && (pread(fd, buf, strlen(extra), size) != strlen(extra) ||
+		       memcmp(buf, extra, strlen(extra))))
+		goto out;
+	ok = true;
+out:
+	if (fd >= 0)
+		close(fd);
+	return ok;
+}
+
+static int run(bool metacopy)
+{
+	char upper[128], work[128], path[PATH_MAX], opts[PATH_MAX];
+	const char *tail = "tail";
+	struct statvfs before, after;
+	double start, elapsed;
+	int ret = KSFT_FAIL, fd;
+
+	snprintf(upper, sizeof(upper), "%s/upper.%d", base, metacopy);
+	snprintf(work, sizeof(work), "%s/work.%d", base, metacopy);
+	snprintf(merged, sizeof(merged), "%s/merged.%d", base, metacopy);
+	if (mkdir(upper, 0755) || mkdir(work, 0755) || mkdir(merged, 0755))
+		return KSFT_FAIL;
+
+	snprintf(opts, sizeof(opts),
+		 "lowerdir=%s,upperdir=%s,workdir=%s,redirect_dir=on,metacopy=%s",
+		 lower, upper, work, metacopy ? "on" : "off");
+	if (mount("overlay", merged, "overlay", 0, opts)) {
+		ksft_print_msg("metacopy=%s: mount failed: %s\n",
+			       metacopy ? "on" : "off", strerror(errno));
+		return errno == EINVAL ? KSFT_SKIP : KSFT_FAIL;
+	}
+
+	statvfs(base, &before);
+	chowned = 0;
+	start = now_ms();
+	if (nftw(merged, chown_one, 64, FTW_PHYS)) {
+		ksft_print_msg("chown -R failed: %s\n", strerror(errno));
+		goto out;
+	}
+	elapsed = now_ms() - start;
+	statvfs(base, &after);
+
+	printf("metacopy=%-3s chown -R: %lu entries, %d MiB, %.1f ms, upper grew %lu MiB\n",
+	       metacopy ? "on" : "off", chowned, nr_files * file_mib, elapsed,
+	       (unsigned long)((before.f_bfree - after.f_bfree) *
+			       before.f_frsize >> 20));
+
+	if (!check_data(0, "") || !check_data(nr_files - 1, "")) {
+		ksft_print_msg("data changed by chown\n");
+		goto out;
+	}
+
+	/* First open for write copies the data up */
+	file_path(path, merged, 0);
+	fd = open(path, O_WRONLY | O_APPEND);
+	if (fd < 0 || write(fd, tail, strlen(tail)) != strlen(tail)) {
+		ksft_print_msg("append failed: %s\n", strerror(errno));
+		goto out;
+	}
+	close(fd);
+	if (!check_data(0, tail)) {
+		ksft_print_msg("data lost on data copy up\n");
+		goto out;
+	}
+	ret = KSFT_PASS;
+out:
+	umount2(merged, MNT_DETACH);
+	return ret;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-n files] [-s MiB per file]\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+	int opt, ret, ret_on;
+
+	while ((opt = getopt(argc, argv, "n:s:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			nr_files = atoi(optarg);
+			break;
+		case 's':
+			file_mib = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return KSFT_FAIL;
+		}
+	}
+	if (nr_files < 1 || file_mib < 1) {
+		usage(argv[0]);
+		return KSFT_FAIL;
+	}
+
+	if (geteuid()) {
+		ksft_print_msg("must be run as root\n");
+		return KSFT_SKIP;
+	}
+
+	strcpy(base, "/tmp/ovl_metacopy.XXXXXX");
+	if (!mkdtemp(base) || mount("tmpfs", base, "tmpfs", 0, NULL)) {
+		ksft_print_msg("tmpfs setup failed: %s\n", strerror(errno));
+		return KSFT_SKIP;
+	}
+	snprintf(lower, sizeof(lower), "%s/lower", base);
+	if (mkdir(lower, 0755) || populate()) {
+		ksft_print_msg("populate failed: %s\n", strerror(errno));
+		ret = KSFT_FAIL;
+		goto out;
+	}
+
+	ret = run(false);
+	if (ret == KSFT_PASS) {
+		ret_on = run(true);
+		ret = ret_on;
+	}
+out:
+	umount2(base, MNT_DETACH);
+	rmdir(base);
+	return ret;
+}
@@ -0,0 +1,317 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Lookup and stat throughput through sdcardfs, with and without package
+ * list updates running concurrently.
+ *
+ * The lower tree lives on a private tmpfs and looks like user 0's
+ * emulated storage: -p app directories below Android/data, each with
+ * -n files, registered in the sdcardfs configfs package list.  The test
+ * stats every file through the sdcardfs mount for -t seconds, first
+ * alone and then while another thread keeps rewriting the appid of a
+ * package nobody looks at.  Every stat revalidates the dentry chain and
+ * derives the permissions of the app directory.
+ *
+ * It then changes the appid of an app that has been looked up and checks
+ * that the new owner shows up on the next stat.
+ *
+ * Must be run as root.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <kselftest.h>
+
+#define APPID_BASE	10000
+#define AID_MEDIA_RW	1023
+#define AID_SDCARD_RW	1015
+#define CHURN_PKG	"com.example.churn"
+
+static char base[64];
+static char lower[128];
+static char merged[128];
+static char configfs[64];
+static int nr_pkgs = 32;
+static int nr_files = 256;
+static int duration = 5;
+static volatile bool stop;
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void pkg_name(char *buf, size_t size, int i)
+{
+	snprintf(buf, size, "com.example.app%d", i);
+}
+
+static void file_path(char *buf, const char *root, int pkg, int i)
+{
+	char name[64];
+
+	pkg_name(name, sizeof(name), pkg);
+	snprintf(buf, PATH_MAX, "%s/0/Android/data/%s/files/f%d", root, name,
+		 i);
+}
+
+static int set_appid(const char *pkg, unsigned int appid)
+{
+	char path[PATH_MAX], val[16];
+	int fd, len, ret = 0;
+
+	snprintf(path, sizeof(path), "%s/%s", configfs, pkg);
+	if (mkdir(path, 0755) && errno != EEXIST)
+		return -errno;
+	snprintf(path, sizeof(path), "%s/%s/appid", configfs, pkg);
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return -errno;
+	len = snprintf(val, sizeof(val), "%u", appid);
+	if (write(fd, val, len) != len)
+		ret = -EIO;
+	close(fd);
+	return ret;
+}
+
+static void remove_pkg(const char *pkg)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/%s", configfs, pkg);
+	rmdir(path);
+}
+
+static int find_configfs(void)
+{
+	static const char * const dirs[] = {
+		"/config/sdcardfs", "/sys/kernel/config/sdcardfs",
+	};
+	int i;
+
+	mount("configfs", "/sys/kernel/config", "configfs", 0, NULL);
+	for (i = 0; i < 2; i++) {
+		if (!access(dirs[i], F_OK)) {
+			strcpy(configfs, dirs[i]);
+			return 0;
+		}
+	}
+	return -ENOENT;
+}
+
+static int mkdirs(const char *root, const char *sub)
+{
+	char path[PATH_MAX], *p;
+
+	snprintf(path, sizeof(path), "%s/%s", root, sub);
+	for (p = path + strlen(root) + 1; (p = strchr(p, '/')); p++) {
+		*p = '\0';
+		if (mkdir(path, 0771) && errno != EEXIST)
+			return -errno;
+		*p = '/';
+	}
+	if (mkdir(path, 0771) && errno != EEXIST)
+		return -errno;
+	return 0;
+}
+
+static int populate(void)
+{
+	char path[PATH_MAX], name[64], sub[128];
+	int i, j, fd, err;
+
+	for (i = 0; i < nr_pkgs; i++) {
+		pkg_name(name, sizeof(name), i);
+		snprintf(sub, sizeof(sub), "0/Android/data/%s/files", name);
+		err = mkdirs(lower, sub);
+		if (err)
+			return err;
+		for (j = 0; j < nr_files; j++) {
+			file_path(path, lower, i, j);
+			fd = open(path, O_CREAT | O_WRONLY, 0660);
+			if (fd < 0)
+				return -errno;
+			close(fd);
+		}
+		err = set_appid(name, APPID_BASE + i);
+		if (err)
+			return err;
+	}
+	return set_appid(CHURN_PKG, APPID_BASE + nr_pkgs);
+}
+
+static void *churn_thread(void *data)
+{
+	unsigned long *updates = data;
+	unsigned int n = 0;
+
+	while (!stop) {
+		if (set_appid(CHURN_PKG, APPID_BASE + nr_pkgs + (n++ & 1)))
+			break;
+		(*updates)++;
+	}
+	return NULL;
+}
+
+/* Stat every file for @duration seconds, returns stats per second */
+static double stat_all(void)
+{
+	char path[PATH_MAX];
+	unsigned long stats = 0;
+	double start, elapsed;
+	struct stat st;
+	int i, j;
+
+	start = now_ms();
+	do {
+		for (i = 0; i < nr_pkgs; i++) {
+			for (j = 0; j < nr_files; j++) {
+				file_path(path, merged, i, j);
+				if (stat(path, &st))
+					return -1;
+			}
+		}
+		stats += nr_pkgs * nr_files;
+		elapsed = now_ms() - start;
+	} while (elapsed < duration * 1e3);
+
+	return stats / (elapsed / 1e3);
+}
+
+static int run(void)
+{
+	uid_t owner = APPID_BASE + nr_pkgs + 2;
+	char path[PATH_MAX], name[64];
+	unsigned long updates = 0;
+	double rate, churn_rate, start;
+	pthread_t churn;
+	struct stat st;
+
+	rate = stat_all();
+	if (rate < 0) {
+		ksft_print_msg("stat failed: %s\n", strerror(errno));
+		return KSFT_FAIL;
+	}
+	printf("stat, quiet package list:    %10.0f/s\n", rate);
+
+	stop = false;
+	start = now_ms();
+	if (pthread_create(&churn, NULL, churn_thread, &updates))
+		return KSFT_FAIL;
+	churn_rate = stat_all();
+	stop = true;
+	pthread_join(churn, NULL);
+	if (churn_rate < 0) {
+		ksft_print_msg("stat failed: %s\n", strerror(errno));
+		return KSFT_FAIL;
+	}
+	printf("stat, package list updating: %10.0f/s (%.0f updates/s)\n",
+	       churn_rate, updates / ((now_ms() - start) / 1e3));
+
+	/* A new appid must reach app directories that are already cached */
+	pkg_name(name, sizeof(name), 0);
+	if (set_appid(name, owner))
+		return KSFT_FAIL;
+	snprintf(path, sizeof(path), "%s/0/Android/data/%s", merged, name);
+	if (stat(path, &st) || st.st_uid != owner) {
+		ksft_print_msg("owner of %s not updated\n", name);
+		return KSFT_FAIL;
+	}
+	file_path(path, merged, 0, 0);
+	if (stat(path, &st) || st.st_uid != owner) {
+		ksft_print_msg("owner below %s not updated\n", name);
+		return KSFT_FAIL;
+	}
+	return KSFT_PASS;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-p packages] [-n files per package] [-t seconds]\n",
+		prog);
+}
+
+int main(int argc, char *argv[])
+{
+	char opts[128], name[64];
+	int opt, ret, i;
+
+	while ((opt = getopt(argc, argv, "p:n:t:h")) != -1) {
+		switch (opt) {
+		case 'p':
+			nr_pkgs = atoi(optarg);
+			break;
+		case 'n':
+			nr_files = atoi(optarg);
+			break;
+		case 't':
+			duration = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return KSFT_FAIL;
+		}
+	}
+	if (nr_pkgs < 1 || nr_files < 1 || duration < 1) {
+		usage(argv[0]);
+		return KSFT_FAIL;
+	}
+
+	if (geteuid()) {
+		ksft_print_msg("must be run as root\n");
+		return KSFT_SKIP;
+	}
+	if (find_configfs()) {
+		ksft_print_msg("no sdcardfs package list in configfs\n");
+		return KSFT_SKIP;
+	}
+
+	strcpy(base, "/tmp/sdcardfs_lookup.XXXXXX");
+	if (!mkdtemp(base) || mount("tmpfs", base, "tmpfs", 0, NULL)) {
+		ksft_print_msg("tmpfs setup failed: %s\n", strerror(errno));
+		return KSFT_SKIP;
+	}
+	snprintf(lower, sizeof(lower), "%s/lower", base);
+	snprintf(merged, sizeof(merged), "%s/merged", base);
+	if (mkdir(lower, 0771) || mkdir(merged, 0771) || populate()) {
+		ksft_print_msg("populate failed: %s\n", strerror(errno));
+		ret = KSFT_FAIL;
+		goto out;
+	}
+
+	snprintf(opts, sizeof(opts),
+		 "fsuid=%d,fsgid=%d,gid=%d,multiuser,mask=6,derive_gid",
+		 AID_MEDIA_RW, AID_MEDIA_RW, AID_SDCARD_RW);
+	if (mount(lower, merged, "sdcardfs", MS_NOSUID | MS_NODEV, opts)) {
+		ksft_print_msg("sdcardfs mount failed: %s\n", strerror(errno));
+		ret = errno == ENODEV ? KSFT_SKIP : KSFT_FAIL;
+		goto out;
+	}
+
+	ret = run();
+	umount2(merged, MNT_DETACH);
+out:
+	for (i = 0; i < nr_pkgs; i++) {
+		pkg_name(name, sizeof(name), i);
+		remove_pkg(name);
+	}
+	remove_pkg(CHURN_PKG);
+	umount2(base, MNT_DETACH);
+	rmdir(base);
+	return ret;
+}
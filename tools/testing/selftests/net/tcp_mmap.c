@@ -0,0 +1,344 @@
+/* Evaluate TCP_ZEROCOPY_RECEIVE
+ *
+ * Stream data over loopback from a child process to the parent, once
+ * with plain recv() and once with the receive buffer mmap()ed on the
+ * socket and filled with getsockopt(TCP_ZEROCOPY_RECEIVE), falling back
+ * to recv() for the bytes the kernel could not map.
+ *
+ * Each run is repeated for every MSS given with '-M' (by default an
+ * ethernet sized and a jumbo frame sized segment), since only payload
+ * that ends up in whole, page aligned frags can be mapped.
+ *
+ * The received stream is checked against the pattern the sender wrote,
+ * and the TcpExt TCPZeroCopyRx/TCPZeroCopyRxCopied counters are reported
+ * next to throughput and receiver CPU time.
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <error.h>
+#include <errno.h>
+#include <linux/tcp.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef TCP_ZEROCOPY_RECEIVE
+#define TCP_ZEROCOPY_RECEIVE	35
+
+struct tcp_zerocopy_receive {
+	__u64 address;
+	__u32 length;
+	__u32 recv_skip_hint;
+};
+#endif
+
+#define PATTERN_PERIOD	251		/* prime, so it never lines up with pages */
+#define MAX_MSS		16
+
+static size_t cfg_chunk		= 512 * 1024;
+static int    cfg_mss[MAX_MSS]	= { 1448, 8948 };
+static int    cfg_num_mss	= 2;
+static bool   cfg_mss_set;
+static int    cfg_port		= 8001;
+static size_t cfg_total		= 256UL * 1024 * 1024;
+static bool   cfg_verify	= true;
+
+static char *pattern;
+static char *buffer;
+
+static unsigned long gettimeofday_us(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec * 1000000UL) + tv.tv_usec;
+}
+
+static unsigned long rusage_us(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec * 1000000UL + ru.ru_utime.tv_usec +
+	       ru.ru_stime.tv_sec * 1000000UL + ru.ru_stime.tv_usec;
+}
+
+static unsigned long read_netstat(const char *name)
+{
+	char keys[4096], vals[4096], *k, *v, *ks, *vs;
+	unsigned long ret = 0;
+	FILE *f;
+
+	f = fopen("/proc/net/netstat", "r");
+	if (!f)
+		return 0;
+
+	while (fgets(keys, sizeof(keys), f) && fgets(vals, sizeof(vals), f)) {
+		if (strncmp(keys, "TcpExt:", 7))
+			continue;
+		k = strtok_r(keys, " \n", &ks);
+		v = strtok_r(vals, " \n", &vs);
+		while (k && v) {
+			if (!strcmp(k, name))
+				ret = strtoul(v, NULL, 10);
+			k = strtok_r(NULL, " \n", &ks);
+			v = strtok_r(NULL, " \n", &vs);
+		}
+	}
+	fclose(f);
+	return ret;
+}
+
+static void verify(const char *data, size_t len, size_t off)
+{
+	size_t n;
+
+	if (!cfg_verify)
+		return;
+
+	while (len) {
+		n = len < cfg_chunk ? len : cfg_chunk;
+		if (memcmp(data, pattern + off % PATTERN_PERIOD, n))
+			error(1, 0, "data mismatch at offset %zu", off);
+		data += n;
+		off += n;
+		len -= n;
+	}
+}
+
+static int do_setup(int fd, int mss)
+{
+	int one = 1;
+
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)))
+		error(1, errno, "setsockopt reuseaddr");
+	if (setsockopt(fd, IPPROTO_TCP, TCP_MAXSEG, &mss, sizeof(mss)))
+		error(1, errno, "setsockopt maxseg %d", mss);
+	return fd;
+}
+
+static void do_send(int mss)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(cfg_port),
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	size_t off = 0, len;
+	ssize_t ret;
+	int fd;
+
+	fd = do_setup(socket(PF_INET, SOCK_STREAM, 0), mss);
+	if (connect(fd, (void *)&addr, sizeof(addr)))
+		error(1, errno, "connect");
+
+	while (off < cfg_total) {
+		len = cfg_total - off < cfg_chunk ? cfg_total - off : cfg_chunk;
+		ret = send(fd, pattern + off % PATTERN_PERIOD, len, 0);
+		if (ret == -1)
+			error(1, errno, "send");
+		off += ret;
+	}
+
+	if (close(fd))
+		error(1, errno, "close");
+}
+
+static void wait_readable(int fd)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+	if (poll(&pfd, 1, -1) != 1)
+		error(1, errno, "poll");
+}
+
+/* Returns the number of bytes received through the mapping. */
+static size_t do_recv(int fd, bool zerocopy)
+{
+	struct tcp_zerocopy_receive zc;
+	size_t off = 0, mapped = 0;
+	socklen_t zc_len;
+	void *map = NULL;
+	ssize_t ret;
+
+	if (zerocopy) {
+		map = mmap(NULL, cfg_chunk, PROT_READ, MAP_SHARED, fd, 0);
+		if (map == MAP_FAILED)
+			error(1, errno, "mmap");
+	}
+
+	for (;;) {
+		size_t want = cfg_chunk;
+
+		if (zerocopy) {
+			memset(&zc, 0, sizeof(zc));
+			zc.address = (uintptr_t)map;
+			zc.length = cfg_chunk;
+			zc_len = sizeof(zc);
+			if (getsockopt(fd, IPPROTO_TCP, TCP_ZEROCOPY_RECEIVE,
+				       &zc, &zc_len)) {
+				/* Peer closed and nothing is left to read */
+				if (errno == EIO)
+					break;
+				error(1, errno, "getsockopt zerocopy receive");
+			}
+			if (zc.length) {
+				verify(map, zc.length, off);
+				off += zc.length;
+				mapped += zc.length;
+			}
+			if (!zc.recv_skip_hint) {
+				if (!zc.length)
+					wait_readable(fd);
+				continue;
+			}
+			/* Copy the bytes up to the next mappable page */
+			want = zc.recv_skip_hint < cfg_chunk ?
+			       zc.recv_skip_hint : cfg_chunk;
+		}
+
+		ret = recv(fd, buffer, want, 0);
+		if (ret == -1)
+			error(1, errno, "recv");
+		if (!ret)
+			break;
+		verify(buffer, ret, off);
+		off += ret;
+	}
+
+	if (off != cfg_total)
+		error(1, 0, "received %zu bytes, expected %zu", off, cfg_total);
+	if (map && munmap(map, cfg_chunk))
+		error(1, errno, "munmap");
+	return mapped;
+}
+
+static void do_run(int mss, bool zerocopy)
+{
+	unsigned long tstart, cstart, zc_rx, zc_copied;
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(cfg_port),
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	int fd, fdl, status;
+	size_t mapped;
+	pid_t pid;
+
+	fdl = do_setup(socket(PF_INET, SOCK_STREAM, 0), mss);
+	if (bind(fdl, (void *)&addr, sizeof(addr)))
+		error(1, errno, "bind");
+	if (listen(fdl, 1))
+		error(1, errno, "listen");
+
+	pid = fork();
+	if (pid == -1)
+		error(1, errno, "fork");
+	if (!pid) {
+		do_send(mss);
+		exit(0);
+	}
+
+	fd = accept(fdl, NULL, NULL);
+	if (fd == -1)
+		error(1, errno, "accept");
+
+	zc_rx = read_netstat("TCPZeroCopyRx");
+	zc_copied = read_netstat("TCPZeroCopyRxCopied");
+	tstart = gettimeofday_us();
+	cstart = rusage_us();
+
+	mapped = do_recv(fd, zerocopy);
+
+	tstart = gettimeofday_us() - tstart;
+	cstart = rusage_us() - cstart;
+	zc_rx = read_netstat("TCPZeroCopyRx") - zc_rx;
+	zc_copied = read_netstat("TCPZeroCopyRxCopied") - zc_copied;
+
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+	    WEXITSTATUS(status))
+		error(1, 0, "sender failed");
+	if (close(fd) || close(fdl))
+		error(1, errno, "close");
+
+	fprintf(stderr, "mss %5d %-8s %8.1f MB/s  cpu %5.1f%%",
+		mss, zerocopy ? "zerocopy" : "copy",
+		(double)cfg_total / tstart, 100.0 * cstart / tstart);
+	if (zerocopy)
+		fprintf(stderr, "  mapped %5.1f%%  (TCPZeroCopyRx %lu TCPZeroCopyRxCopied %lu)",
+			100.0 * mapped / cfg_total, zc_rx, zc_copied);
+	fprintf(stderr, "\n");
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "c:M:np:s:")) != -1) {
+		switch (c) {
+		case 'c':
+			cfg_chunk = strtoul(optarg, NULL, 0);
+			break;
+		case 'M':
+			if (!cfg_mss_set) {
+				cfg_mss_set = true;
+				cfg_num_mss = 0;
+			}
+			if (cfg_num_mss == MAX_MSS)
+				error(1, 0, "at most %d segment sizes", MAX_MSS);
+			cfg_mss[cfg_num_mss++] = strtol(optarg, NULL, 0);
+			break;
+		case 'n':
+			cfg_verify = false;
+			break;
+		case 'p':
+			cfg_port = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			cfg_total = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			error(1, 0, "usage: %s [-c chunk] [-M mss]... [-n] [-p port] [-s size]",
+			      argv[0]);
+		}
+	}
+
+	if (!cfg_chunk || cfg_chunk % getpagesize())
+		error(1, 0, "chunk size must be a multiple of the page size");
+}
+
+int main(int argc, char **argv)
+{
+	size_t i;
+	int m;
+
+	parse_opts(argc, argv);
+
+	pattern = malloc(cfg_chunk + PATTERN_PERIOD);
+	buffer = malloc(cfg_chunk);
+	if (!pattern || !buffer)
+		error(1, 0, "malloc");
+	for (i = 0; i < cfg_chunk + PATTERN_PERIOD; i++)
+		pattern[i] = i % PATTERN_PERIOD;
+
+	for (m = 0; m < cfg_num_mss; m++) {
+		do_run(cfg_mss[m], false);
+		do_run(cfg_mss[m], true);
+	}
+
+	fprintf(stderr, "OK. All tests passed\n");
+	return 0;
+}
@@ -0,0 +1,406 @@
+/* Evaluate UDP_SEGMENT and UDP_GRO
+ *
+ * Send a stream of UDP datagrams of one segment size between two
+ * processes, typically in two network namespaces joined by a veth pair
+ * (see udpgso_bench.sh), and report throughput and system calls per
+ * second on both sides.
+ *
+ * The sender either calls send() once per datagram, or with '-S' hands
+ * the kernel a buffer of up to 64 datagrams at once and lets UDP_SEGMENT
+ * split it. With '-c' the segment size is passed as a cmsg on every
+ * call instead of being set on the socket.
+ *
+ * The receiver ('-r') reads one datagram per recvmsg() call, or with
+ * '-G' enables UDP_GRO and reads whole trains of datagrams that the
+ * kernel kept together, splitting them at the segment size passed in
+ * the UDP_GRO cmsg. Every datagram is checked for length and content.
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <error.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifndef SOL_UDP
+#define SOL_UDP		17
+#endif
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT	103
+#endif
+
+#ifndef UDP_GRO
+#define UDP_GRO		104
+#endif
+
+#define UDP_MAX_SEGMENTS	64
+/* largest payload that fits in an IPv6 packet without extension headers */
+#define MAX_PAYLOAD	(int)(IP_MAXPACKET - sizeof(struct udphdr) - 40)
+
+static int	cfg_family	= PF_INET6;
+static int	cfg_gso_size	= 1400;
+static bool	cfg_gso;
+static bool	cfg_gso_cmsg;
+static bool	cfg_gro;
+static int	cfg_port	= 8000;
+static bool	cfg_rx;
+static int	cfg_runtime_ms	= 4000;
+static int	cfg_payload_len;
+
+static struct sockaddr_storage cfg_dst_addr;
+static socklen_t cfg_alen;
+
+static char buf[IP_MAXPACKET];
+
+static unsigned long gettimeofday_ms(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec * 1000) + (tv.tv_usec / 1000);
+}
+
+/* Every datagram carries the same pattern, starting from its first byte */
+static void fill_payload(void)
+{
+	int i;
+
+	for (i = 0; i < cfg_payload_len; i++)
+		buf[i] = 'a' + ((i % cfg_gso_size) % 26);
+}
+
+static void verify_segment(const char *data, int len)
+{
+	int i;
+
+	if (len != cfg_gso_size)
+		error(1, 0, "datagram of %d bytes, expected %d", len,
+		      cfg_gso_size);
+	for (i = 0; i < len; i++)
+		if (data[i] != 'a' + (i % 26))
+			error(1, 0, "data mismatch at byte %d", i);
+}
+
+static void setup_sockaddr(const char *str_addr)
+{
+	struct sockaddr_in6 *addr6 = (void *)&cfg_dst_addr;
+	struct sockaddr_in *addr4 = (void *)&cfg_dst_addr;
+
+	switch (cfg_family) {
+	case PF_INET:
+		addr4->sin_family = AF_INET;
+		addr4->sin_port = htons(cfg_port);
+		if (inet_pton(AF_INET, str_addr, &addr4->sin_addr) != 1)
+			error(1, 0, "ipv4 parse error: %s", str_addr);
+		cfg_alen = sizeof(*addr4);
+		break;
+	case PF_INET6:
+		addr6->sin6_family = AF_INET6;
+		addr6->sin6_port = htons(cfg_port);
+		if (inet_pton(AF_INET6, str_addr, &addr6->sin6_addr) != 1)
+			error(1, 0, "ipv6 parse error: %s", str_addr);
+		cfg_alen = sizeof(*addr6);
+		break;
+	default:
+		error(1, 0, "illegal domain");
+	}
+}
+
+static void report(const char *dir, unsigned long bytes,
+		   unsigned long calls, unsigned long segs,
+		   unsigned long ms)
+{
+	if (!ms)
+		ms = 1;
+	fprintf(stderr, "udp %s: %8.1f MB/s %8lu calls/s %8lu datagrams/s\n",
+		dir, (double)bytes / ms / 1000, calls * 1000 / ms,
+		segs * 1000 / ms);
+}
+
+static int recv_one(int fd, unsigned long *segs)
+{
+	char control[CMSG_SPACE(sizeof(int))] = {0};
+	struct iovec iov = { .iov_base = buf, .iov_len = sizeof(buf) };
+	struct msghdr msg = {0};
+	struct cmsghdr *cmsg;
+	int gso_size = 0;
+	int ret, off;
+
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	ret = recvmsg(fd, &msg, MSG_DONTWAIT);
+	if (ret == -1) {
+		if (errno == EAGAIN)
+			return 0;
+		error(1, errno, "recvmsg");
+	}
+	if (msg.msg_flags & MSG_TRUNC)
+		error(1, 0, "recvmsg: datagram truncated");
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+			gso_size = *(int *)CMSG_DATA(cmsg);
+	}
+	if (gso_size && !cfg_gro)
+		error(1, 0, "UDP_GRO cmsg on a socket without UDP_GRO");
+	if (!gso_size)
+		gso_size = ret;
+
+	for (off = 0; off < ret; off += gso_size) {
+		verify_segment(buf + off,
+			       ret - off < gso_size ? ret - off : gso_size);
+		(*segs)++;
+	}
+	return ret;
+}
+
+static void do_rx(int fd)
+{
+	unsigned long tstart, tnow, treport, bytes = 0, calls = 0, segs = 0;
+	unsigned long tot_bytes = 0, tot_calls = 0, tot_segs = 0;
+	unsigned long tlast = 0;
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	bool started = false;
+	int ret;
+
+	tstart = treport = gettimeofday_ms();
+	do {
+		ret = poll(&pfd, 1, started ? 500 : cfg_runtime_ms + 2000);
+		if (ret == -1)
+			error(1, errno, "poll");
+		if (!ret) {
+			if (!started)
+				error(1, 0, "no data received");
+			break;
+		}
+		if (!started) {
+			started = true;
+			tstart = treport = gettimeofday_ms();
+		}
+
+		while ((ret = recv_one(fd, &segs))) {
+			bytes += ret;
+			calls++;
+		}
+
+		tnow = tlast = gettimeofday_ms();
+		if (tnow - treport >= 1000) {
+			report("rx", bytes, calls, segs, tnow - treport);
+			tot_bytes += bytes;
+			tot_calls += calls;
+			tot_segs += segs;
+			bytes = calls = segs = 0;
+			treport = tnow;
+		}
+	} while (1);
+
+	tot_bytes += bytes;
+	tot_calls += calls;
+	tot_segs += segs;
+	/* leave out the idle timeout that ended the run */
+	report("rx total", tot_bytes, tot_calls, tot_segs, tlast - tstart);
+}
+
+static int send_one(int fd)
+{
+	char control[CMSG_SPACE(sizeof(uint16_t))] = {0};
+	struct iovec iov = { .iov_base = buf, .iov_len = cfg_payload_len };
+	struct msghdr msg = {0};
+	struct cmsghdr *cmsg;
+	int ret;
+
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	if (cfg_gso_cmsg) {
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_UDP;
+		cmsg->cmsg_type = UDP_SEGMENT;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+		*((uint16_t *)CMSG_DATA(cmsg)) = cfg_gso_size;
+	}
+
+	ret = sendmsg(fd, &msg, 0);
+	/* Local drops, and port unreachable until the receiver is up */
+	if (ret == -1 && (errno == ENOBUFS || errno == EAGAIN ||
+			  errno == ECONNREFUSED))
+		return 0;
+	if (ret != cfg_payload_len)
+		error(1, errno, "sendmsg: %d of %d", ret, cfg_payload_len);
+	return ret;
+}
+
+static void do_tx(int fd)
+{
+	unsigned long tstart, tnow, treport, bytes = 0, calls = 0, segs = 0;
+	unsigned long tot_bytes = 0, tot_calls = 0, tot_segs = 0;
+	int val = cfg_gso_size, nsegs;
+
+	if (connect(fd, (void *)&cfg_dst_addr, cfg_alen))
+		error(1, errno, "connect");
+	if (cfg_gso && !cfg_gso_cmsg &&
+	    setsockopt(fd, SOL_UDP, UDP_SEGMENT, &val, sizeof(val)))
+		error(1, errno, "setsockopt udp segment");
+
+	fill_payload();
+	nsegs = (cfg_payload_len + cfg_gso_size - 1) / cfg_gso_size;
+
+	tstart = treport = gettimeofday_ms();
+	do {
+		if (send_one(fd)) {
+			bytes += cfg_payload_len;
+			calls++;
+			segs += nsegs;
+		}
+
+		tnow = gettimeofday_ms();
+		if (tnow - treport >= 1000) {
+			report("tx", bytes, calls, segs, tnow - treport);
+			tot_bytes += bytes;
+			tot_calls += calls;
+			tot_segs += segs;
+			bytes = calls = segs = 0;
+			treport = tnow;
+		}
+	} while (tnow - tstart < (unsigned long)cfg_runtime_ms);
+
+	tot_bytes += bytes;
+	tot_calls += calls;
+	tot_segs += segs;
+	report("tx total", tot_bytes, tot_calls, tot_segs, tnow - tstart);
+}
+
+static void usage(const char *filepath)
+{
+	error(1, 0, "Usage: %s [-4|-6] [-c] [-D dst ip] [-G] [-l secs] [-M segment size] [-p port] [-r] [-s payload size] [-S]",
+	      filepath);
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	const char *daddr = NULL;
+	int c;
+
+	while ((c = getopt(argc, argv, "46cD:Gl:M:p:rs:S")) != -1) {
+		switch (c) {
+		case '4':
+			cfg_family = PF_INET;
+			break;
+		case '6':
+			cfg_family = PF_INET6;
+			break;
+		case 'c':
+			cfg_gso_cmsg = true;
+			cfg_gso = true;
+			break;
+		case 'D':
+			daddr = optarg;
+			break;
+		case 'G':
+			cfg_gro = true;
+			break;
+		case 'l':
+			cfg_runtime_ms = strtoul(optarg, NULL, 10) * 1000;
+			break;
+		case 'M':
+			cfg_gso_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			cfg_port = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			cfg_rx = true;
+			break;
+		case 's':
+			cfg_payload_len = strtoul(optarg, NULL, 0);
+			break;
+		case 'S':
+			cfg_gso = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind != argc)
+		usage(argv[0]);
+	if (!cfg_rx && !daddr)
+		error(1, 0, "sender needs a destination address (-D)");
+	if (cfg_gso_size < 1 || cfg_gso_size > MAX_PAYLOAD)
+		error(1, 0, "segment size must be 1..%d", MAX_PAYLOAD);
+
+	/* Without GSO, send one datagram per call */
+	if (!cfg_payload_len)
+		cfg_payload_len = cfg_gso ? cfg_gso_size * 44 : cfg_gso_size;
+	if (!cfg_gso && cfg_payload_len != cfg_gso_size)
+		error(1, 0, "payload size without -S must equal segment size");
+	if (cfg_payload_len > MAX_PAYLOAD ||
+	    cfg_payload_len > cfg_gso_size * UDP_MAX_SEGMENTS)
+		error(1, 0, "payload too large for %d byte segments",
+		      cfg_gso_size);
+	/* Every datagram but the last must be full for the checks in rx */
+	if (cfg_payload_len % cfg_gso_size)
+		error(1, 0, "payload size must be a multiple of segment size");
+
+	if (daddr)
+		setup_sockaddr(daddr);
+}
+
+int main(int argc, char **argv)
+{
+	struct sockaddr_in6 addr6 = {0};
+	int fd, val = 1;
+
+	parse_opts(argc, argv);
+
+	fd = socket(cfg_family, SOCK_DGRAM, 0);
+	if (fd == -1)
+		error(1, errno, "socket");
+
+	if (cfg_rx) {
+		struct sockaddr_in addr4 = {0};
+
+		if (cfg_family == PF_INET) {
+			addr4.sin_family = AF_INET;
+			addr4.sin_port = htons(cfg_port);
+			addr4.sin_addr.s_addr = htonl(INADDR_ANY);
+			if (bind(fd, (void *)&addr4, sizeof(addr4)))
+				error(1, errno, "bind");
+		} else {
+			addr6.sin6_family = AF_INET6;
+			addr6.sin6_port = htons(cfg_port);
+			addr6.sin6_addr = in6addr_any;
+			if (bind(fd, (void *)&addr6, sizeof(addr6)))
+				error(1, errno, "bind");
+		}
+		if (cfg_gro &&
+		    setsockopt(fd, SOL_UDP, UDP_GRO, &val, sizeof(val)))
+			error(1, errno, "setsockopt udp gro");
+		do_rx(fd);
+	} else {
+		do_tx(fd);
+	}
+
+	if (close(fd))
+		error(1, errno, "close");
+	return 0;
+}
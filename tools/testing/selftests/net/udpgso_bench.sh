@@ -0,0 +1,86 @@
+#!/bin/bash
+#
+# Send UDP datagrams between two namespaces over a veth pair and compare
+# - one send() per datagram
+# - UDP_SEGMENT, set on the socket and passed per call as cmsg
+# each against a plain receiver and against a UDP_GRO receiver
+
+set -e
+
+readonly DEV="veth0"
+readonly DEV_MTU=1500
+readonly BIN="./udpgso_bench"
+
+readonly RAND="$(mktemp -u XXXXXX)"
+readonly NSPREFIX="ns-${RAND}"
+readonly NS1="${NSPREFIX}1"
+readonly NS2="${NSPREFIX}2"
+
+# Argument parsing: without arguments, as run by kselftest, run both
+if [[ "$#" -lt "1" ]]; then
+	"$0" 4
+	"$0" 6
+	exit 0
+fi
+
+readonly IP="$1"
+shift
+readonly EXTRA_ARGS="$@"
+
+# Argument parsing: configure addresses and segment size
+if [[ "${IP}" == "4" ]]; then
+	readonly DADDR='192.168.1.2'
+	readonly GSO_SIZE=$((DEV_MTU - 20 - 8))
+elif [[ "${IP}" == "6" ]]; then
+	readonly DADDR='fd::2'
+	readonly GSO_SIZE=$((DEV_MTU - 40 - 8))
+else
+	echo "Invalid IP version ${IP}"
+	exit 1
+fi
+
+# Start of state changes: install cleanup handler
+cleanup() {
+	ip netns del "${NS2}"
+	ip netns del "${NS1}"
+}
+
+trap cleanup EXIT
+
+# Create virtual ethernet pair between network namespaces
+ip netns add "${NS1}"
+ip netns add "${NS2}"
+
+ip link add "${DEV}" mtu "${DEV_MTU}" netns "${NS1}" type veth \
+  peer name "${DEV}" mtu "${DEV_MTU}" netns "${NS2}"
+
+# Bring the devices up
+ip -netns "${NS1}" link set "${DEV}" up
+ip -netns "${NS2}" link set "${DEV}" up
+
+# Add fixed IP addresses to the devices
+ip -netns "${NS1}" addr add 192.168.1.1/24 dev "${DEV}"
+ip -netns "${NS2}" addr add 192.168.1.2/24 dev "${DEV}"
+ip -netns "${NS1}" addr add       fd::1/64 dev "${DEV}" nodad
+ip -netns "${NS2}" addr add       fd::2/64 dev "${DEV}" nodad
+
+# Optionally disable segmentation offload to segment in the stack
+# ip netns exec "${NS1}" ethtool -K "${DEV}" tx-udp-segmentation off
+
+do_test() {
+	local readonly TXARGS="$1"
+	local readonly RXARGS="$2"
+
+	echo "ipv${IP} tx [${TXARGS}] rx [${RXARGS}]"
+	ip netns exec "${NS2}" "${BIN}" "-${IP}" -M "${GSO_SIZE}" -l 3 -r ${RXARGS} ${EXTRA_ARGS} &
+	sleep 0.2
+	ip netns exec "${NS1}" "${BIN}" "-${IP}" -M "${GSO_SIZE}" -l 3 -D "${DADDR}" ${TXARGS} ${EXTRA_ARGS}
+	wait
+}
+
+do_test "" ""
+do_test "-S" ""
+do_test "-c" ""
+do_test "" "-G"
+do_test "-S" "-G"
+echo ok
@@ -0,0 +1,289 @@
+/* Evaluate MSG_ZEROCOPY on AF_UNIX SOCK_SEQPACKET
+ *
+ * For every message size given with '-s' (by default from a small
+ * control message up to a 64KB buffer), measure over a socketpair
+ *
+ * - throughput: a child process drains a stream of messages
+ * - latency: a child process answers every message with one byte
+ *
+ * once with plain copying send() and once with MSG_ZEROCOPY.
+ *
+ * In zerocopy mode the sender reaps completions from its error queue
+ * and checks that every message was acknowledged exactly once, and
+ * reports whether the kernel actually used the pages or fell back to a
+ * copy. The receiver checks the length and contents of every message.
+ */
+
+#define _GNU_SOURCE
+
+#include <error.h>
+#include <errno.h>
+#include <time.h>
+#include <linux/errqueue.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY	60
+#endif
+
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY		5
+#endif
+
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED	1
+#endif
+
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY	0x4000000
+#endif
+
+#define MAX_SIZES	16
+#define MAX_MSG		(64 * 1024)
+
+static int    cfg_count		= 20000;
+static int    cfg_sizes[MAX_SIZES] = { 64, 1024, 4096, 16384, 65536 };
+static int    cfg_num_sizes	= 5;
+static bool   cfg_sizes_set;
+
+static char *payload;
+
+static uint32_t next_completion;
+static uint32_t completions;
+static uint32_t copied;
+
+static unsigned long gettimeofday_us(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec * 1000000UL) + tv.tv_usec;
+}
+
+static bool do_recv_completion(int fd)
+{
+	struct sock_extended_err *serr;
+	struct msghdr msg = {};
+	struct cmsghdr *cm;
+	uint32_t hi, lo;
+	char control[100];
+	int ret;
+
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	ret = recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+	if (ret == -1 && errno == EAGAIN)
+		return false;
+	if (ret == -1)
+		error(1, errno, "recvmsg notification");
+	if (msg.msg_flags & MSG_CTRUNC)
+		error(1, 0, "recvmsg notification: truncated");
+
+	cm = CMSG_FIRSTHDR(&msg);
+	if (!cm)
+		error(1, 0, "cmsg: no cmsg");
+	if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SO_ZEROCOPY)
+		error(1, 0, "serr: wrong type: %d.%d",
+		      cm->cmsg_level, cm->cmsg_type);
+
+	serr = (void *)CMSG_DATA(cm);
+	if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+		error(1, 0, "serr: wrong origin: %u", serr->ee_origin);
+	if (serr->ee_errno != 0)
+		error(1, 0, "serr: wrong error code: %u", serr->ee_errno);
+
+	hi = serr->ee_data;
+	lo = serr->ee_info;
+
+	/* Nothing is dropped or reordered on the way to a local socket */
+	if (lo != next_completion)
+		error(1, 0, "gap: %u..%u does not append to %u",
+		      lo, hi, next_completion);
+	next_completion = hi + 1;
+
+	completions += hi - lo + 1;
+	if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+		copied += hi - lo + 1;
+	return true;
+}
+
+/* Wait for and read completions until @want messages are acknowledged */
+static void do_recv_completions(int fd, uint32_t want)
+{
+	struct pollfd pfd = { .fd = fd };
+
+	while (completions < want) {
+		if (do_recv_completion(fd))
+			continue;
+		if (poll(&pfd, 1, 1000) != 1)
+			error(1, errno, "poll: %u of %u completions",
+			      completions, want);
+	}
+}
+
+static void do_send(int fd, int size, bool zerocopy)
+{
+	int flags = zerocopy ? MSG_ZEROCOPY : 0;
+	struct pollfd pfd = { .fd = fd };
+	ssize_t ret;
+
+	for (;;) {
+		ret = send(fd, payload, size, flags);
+		if (ret == size)
+			return;
+		if (ret != -1 || errno != ENOBUFS || !zerocopy)
+			error(1, errno, "send %d", size);
+
+		/* Out of optmem for notifications: reap some and retry */
+		if (poll(&pfd, 1, 1000) != 1)
+			error(1, errno, "send %d: no completions to reap", size);
+		while (do_recv_completion(fd))
+			;
+	}
+}
+
+static void do_verify(const char *buf, ssize_t ret, int size)
+{
+	if (ret != size)
+		error(1, errno, "recv: %zd bytes, expected %d", ret, size);
+	if (memcmp(buf, payload, size))
+		error(1, 0, "recv: data mismatch");
+}
+
+static void child_sink(int fd, int size, bool echo)
+{
+	char *buf = malloc(MAX_MSG);
+	int i;
+
+	if (!buf)
+		error(1, 0, "malloc");
+	for (i = 0; i < cfg_count; i++) {
+		do_verify(buf, recv(fd, buf, MAX_MSG, 0), size);
+		if (echo && send(fd, "", 1, 0) != 1)
+			error(1, errno, "send echo");
+	}
+	exit(0);
+}
+
+static void do_run(int size, bool zerocopy, bool latency)
+{
+	unsigned long tstart;
+	int fds[2], status, one = 1, i;
+	char c;
+	pid_t pid;
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds))
+		error(1, errno, "socketpair");
+	if (zerocopy &&
+	    setsockopt(fds[0], SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)))
+		error(1, errno, "setsockopt zerocopy");
+
+	pid = fork();
+	if (pid == -1)
+		error(1, errno, "fork");
+	if (!pid) {
+		close(fds[0]);
+		child_sink(fds[1], size, latency);
+	}
+	close(fds[1]);
+
+	completions = copied = next_completion = 0;
+	tstart = gettimeofday_us();
+	for (i = 0; i < cfg_count; i++) {
+		do_send(fds[0], size, zerocopy);
+		if (latency && recv(fds[0], &c, 1, 0) != 1)
+			error(1, errno, "recv echo");
+		if (zerocopy)
+			while (do_recv_completion(fds[0]))
+				;
+	}
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+	    WEXITSTATUS(status))
+		error(1, 0, "receiver failed");
+	tstart = gettimeofday_us() - tstart;
+	if (zerocopy)
+		do_recv_completions(fds[0], cfg_count);
+	if (completions != (zerocopy ? cfg_count : 0))
+		error(1, 0, "%u completions for %d messages",
+		      completions, cfg_count);
+	close(fds[0]);
+
+	fprintf(stderr, "size %6d %-8s %-8s", size,
+		zerocopy ? "zerocopy" : "copy", latency ? "latency" : "tput");
+	if (latency)
+		fprintf(stderr, " %8.2f us/rtt", (double)tstart / cfg_count);
+	else
+		fprintf(stderr, " %8.1f MB/s",
+			(double)size * cfg_count / tstart);
+	if (zerocopy)
+		fprintf(stderr, "  (%u of %u copied)", copied, completions);
+	fprintf(stderr, "\n");
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "n:s:")) != -1) {
+		switch (c) {
+		case 'n':
+			cfg_count = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			if (!cfg_sizes_set) {
+				cfg_sizes_set = true;
+				cfg_num_sizes = 0;
+			}
+			if (cfg_num_sizes == MAX_SIZES)
+				error(1, 0, "at most %d sizes", MAX_SIZES);
+			cfg_sizes[cfg_num_sizes] = strtol(optarg, NULL, 0);
+			if (cfg_sizes[cfg_num_sizes] < 1 ||
+			    cfg_sizes[cfg_num_sizes] > MAX_MSG)
+				error(1, 0, "size must be 1..%d", MAX_MSG);
+			cfg_num_sizes++;
+			break;
+		default:
+			error(1, 0, "usage: %s [-n count] [-s size]...",
+			      argv[0]);
+		}
+	}
+	if (cfg_count < 1)
+		error(1, 0, "count must be positive");
+}
+
+int main(int argc, char **argv)
+{
+	int i;
+
+	parse_opts(argc, argv);
+
+	/* page aligned, so a 64KB message fits in the skb frags */
+	payload = mmap(NULL, MAX_MSG, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (payload == MAP_FAILED)
+		error(1, errno, "mmap");
+	for (i = 0; i < MAX_MSG; i++)
+		payload[i] = 'a' + (i % 26);
+
+	for (i = 0; i < cfg_num_sizes; i++) {
+		do_run(cfg_sizes[i], false, false);
+		do_run(cfg_sizes[i], true, false);
+		do_run(cfg_sizes[i], false, true);
+		do_run(cfg_sizes[i], true, true);
+	}
+
+	fprintf(stderr, "OK. All tests passed\n");
+	return 0;
+}
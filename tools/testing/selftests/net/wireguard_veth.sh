@@ -0,0 +1,88 @@
+#!/bin/bash
+#
+# Measure TCP throughput through a WireGuard tunnel over a veth pair
+#
+# Two namespaces are joined by a veth pair and each gets a wg0 peered with
+# the other. iperf3 runs over the tunnel twice: once with GSO enabled on
+# the veth, so that each flush of encrypted packets crosses it as UDP GSO
+# packets and reaches the receiving wg socket through UDP GRO, and once
+# with GSO disabled, so that every datagram is handed over on its own.
+
+set -e
+
+readonly DEV="veth0"
+readonly DURATION="${1:-10}"
+
+readonly RAND="$(mktemp -u XXXXXX)"
+readonly NSPREFIX="ns-${RAND}"
+readonly NS1="${NSPREFIX}1"
+readonly NS2="${NSPREFIX}2"
+
+for tool in wg iperf3 ethtool; do
+	if ! command -v "${tool}" >/dev/null; then
+		echo "SKIP: ${tool} not available"
+		exit 0
+	fi
+done
+
+# Start of state changes: install cleanup handler
+cleanup() {
+	ip netns exec "${NS2}" pkill iperf3 2>/dev/null || true
+	ip netns del "${NS2}"
+	ip netns del "${NS1}"
+}
+
+trap cleanup EXIT
+
+# Create virtual ethernet pair between network namespaces
+ip netns add "${NS1}"
+ip netns add "${NS2}"
+
+ip link add "${DEV}" netns "${NS1}" type veth \
+  peer name "${DEV}" netns "${NS2}"
+
+ip -netns "${NS1}" link set "${DEV}" up
+ip -netns "${NS2}" link set "${DEV}" up
+ip -netns "${NS1}" addr add 192.168.1.1/24 dev "${DEV}"
+ip -netns "${NS2}" addr add 192.168.1.2/24 dev "${DEV}"
+
+# Create the tunnel: 10.0.0.1 in ns1 and 10.0.0.2 in ns2
+if ! ip -netns "${NS1}" link add wg0 type wireguard 2>/dev/null; then
+	echo "SKIP: wireguard not available"
+	exit 0
+fi
+ip -netns "${NS2}" link add wg0 type wireguard
+
+readonly KEY1="$(wg genkey)"
+readonly KEY2="$(wg genkey)"
+readonly PUB1="$(echo "${KEY1}" | wg pubkey)"
+readonly PUB2="$(echo "${KEY2}" | wg pubkey)"
+
+ip netns exec "${NS1}" wg set wg0 listen-port 51820 \
+	private-key <(echo "${KEY1}") \
+	peer "${PUB2}" allowed-ips 10.0.0.2/32 endpoint 192.168.1.2:51820
+ip netns exec "${NS2}" wg set wg0 listen-port 51820 \
+	private-key <(echo "${KEY2}") \
+	peer "${PUB1}" allowed-ips 10.0.0.1/32 endpoint 192.168.1.1:51820
+
+ip -netns "${NS1}" addr add 10.0.0.1/24 dev wg0
+ip -netns "${NS2}" addr add 10.0.0.2/24 dev wg0
+ip -netns "${NS1}" link set wg0 up
+ip -netns "${NS2}" link set wg0 up
+
+ip netns exec "${NS2}" iperf3 -s -D -B 10.0.0.2
+sleep 1
+
+run() {
+	local readonly GSO="$1"
+
+	ip netns exec "${NS1}" ethtool -K "${DEV}" gso "${GSO}" 2>/dev/null
+	echo "wg over ${DEV}, gso ${GSO}"
+	ip netns exec "${NS1}" iperf3 -c 10.0.0.2 -t "${DURATION}" -f m |
+		grep -E "sender|receiver"
+}
+
+run on
+run off
+
+echo ok
@@ -0,0 +1,149 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Forward UDP through a masquerading router namespace, once through the
+# classic conntrack + iptables path and once with the connection moved
+# to the flow table by the FLOWOFFLOAD target, and compare packet rates.
+#
+#   ns1 (client) --- veth --- ns2 (router, MASQUERADE) --- veth --- ns3 (sink)
+#
+# pktgen in ns1 generates the traffic. The flow is established first by
+# replying from ns3 with pktgen, so that conntrack sees both directions.
+# The test fails if packets keep going through the FORWARD chain after
+# the flow was offloaded.
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+
+COUNT="${1:-2000000}"
+
+RAND="$(mktemp -u XXXXXX)"
+ns1="ns1-${RAND}"
+ns2="ns2-${RAND}"
+ns3="ns3-${RAND}"
+
+iptables --version > /dev/null 2>&1
+if [ $? -ne 0 ]; then
+	echo "SKIP: Could not run test without iptables tool"
+	exit $ksft_skip
+fi
+
+modprobe pktgen > /dev/null 2>&1
+if [ ! -d /proc/net/pktgen ]; then
+	echo "SKIP: Could not run test without pktgen"
+	exit $ksft_skip
+fi
+
+cleanup() {
+	ip netns del "$ns1" 2>/dev/null
+	ip netns del "$ns2" 2>/dev/null
+	ip netns del "$ns3" 2>/dev/null
+}
+
+trap cleanup EXIT
+
+ip netns add "$ns1" || exit $ksft_skip
+ip netns add "$ns2"
+ip netns add "$ns3"
+
+ip link add veth0 netns "$ns1" type veth peer name veth0 netns "$ns2"
+ip link add veth1 netns "$ns2" type veth peer name veth0 netns "$ns3"
+
+ip -net "$ns1" link set veth0 address 02:00:00:00:01:99 up
+ip -net "$ns2" link set veth0 address 02:00:00:00:01:01 up
+ip -net "$ns2" link set veth1 address 02:00:00:00:02:01 up
+ip -net "$ns3" link set veth0 address 02:00:00:00:02:99 up
+
+ip -net "$ns1" addr add 10.0.1.99/24 dev veth0
+ip -net "$ns2" addr add 10.0.1.1/24 dev veth0
+ip -net "$ns2" addr add 10.0.2.1/24 dev veth1
+ip -net "$ns3" addr add 10.0.2.99/24 dev veth0
+ip -net "$ns1" route add default via 10.0.1.1
+ip -net "$ns3" route add default via 10.0.2.1
+
+ip netns exec "$ns2" sysctl -q net.ipv4.ip_forward=1
+ip netns exec "$ns2" iptables -t nat -A POSTROUTING -o veth1 -j MASQUERADE
+if ! ip netns exec "$ns2" iptables -A FORWARD -p udp --dport 7000 \
+		-m conntrack --ctstate ESTABLISHED -j FLOWOFFLOAD; then
+	echo "SKIP: Could not add FLOWOFFLOAD rule"
+	exit $ksft_skip
+fi
+ip netns exec "$ns2" iptables -A FORWARD -p udp -j ACCEPT
+
+# Resolve neighbours up front so pktgen packets are not dropped
+ip netns exec "$ns1" ping -q -c 1 10.0.2.99 > /dev/null || exit 1
+
+pg() {
+	local ns="$1"
+	local file="$2"
+	shift 2
+
+	ip netns exec "$ns" sh -c "echo '$*' > /proc/net/pktgen/$file"
+}
+
+# pktgen <ns> <dst ip> <dst mac> <src port> <dst port> <count>
+pktgen() {
+	local ns="$1"
+
+	pg "$ns" kpktgend_0 "rem_device_all"
+	pg "$ns" kpktgend_0 "add_device veth0"
+	pg "$ns" veth0 "count $6"
+	pg "$ns" veth0 "clone_skb 0"
+	pg "$ns" veth0 "pkt_size 60"
+	pg "$ns" veth0 "delay 0"
+	pg "$ns" veth0 "dst $2"
+	pg "$ns" veth0 "dst_mac $3"
+	pg "$ns" veth0 "udp_src_min $4"
+	pg "$ns" veth0 "udp_src_max $4"
+	pg "$ns" veth0 "udp_dst_min $5"
+	pg "$ns" veth0 "udp_dst_max $5"
+	pg "$ns" pgctrl "start"
+	pg "$ns" kpktgend_0 "rem_device_all"
+}
+
+rx_packets() {
+	ip netns exec "$ns3" cat /sys/class/net/veth0/statistics/rx_packets
+}
+
+# every packet in the slow path ends at the final ACCEPT rule
+forwarded() {
+	ip netns exec "$ns2" iptables -v -x -n -L FORWARD |
+		awk '/ACCEPT/ { print $1 }'
+}
+
+# run <label> <src port> <dst port>
+run() {
+	local sport="$2"
+	local dport="$3"
+	local rx fwd t
+
+	# establish the connection: a few packets each way, then more
+	# originals so that conntrack marks it assured
+	pktgen "$ns1" 10.0.2.99 02:00:00:00:01:01 "$sport" "$dport" 10
+	pktgen "$ns3" 10.0.2.1 02:00:00:00:02:01 "$dport" "$sport" 10
+	pktgen "$ns1" 10.0.2.99 02:00:00:00:01:01 "$sport" "$dport" 10
+
+	fwd="$(forwarded)"
+	rx="$(rx_packets)"
+	t="$(date +%s%N)"
+	pktgen "$ns1" 10.0.2.99 02:00:00:00:01:01 "$sport" "$dport" "$COUNT"
+	t=$(( $(date +%s%N) - t ))
+	rx=$(( $(rx_packets) - rx ))
+	fwd=$(( $(forwarded) - fwd ))
+
+	echo "$1: $rx of $COUNT packets received, $((rx * 1000000000 / t)) pps, $fwd through FORWARD"
+	FORWARDED="$fwd"
+}
+
+ret=0
+
+run "conntrack + iptables" 5000 6000
+
+run "flow offload        " 5001 7000
+if [ "$FORWARDED" -gt $((COUNT / 100)) ]; then
+	echo "FAIL: offloaded flow still traverses the FORWARD chain"
+	ret=1
+fi
+
+[ $ret -eq 0 ] && echo "PASS: flow offload"
+exit $ret
@@ -0,0 +1,507 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Zero-copy reads of a per-CPU trace buffer through mmap().
+ *
+ * The test maps trace_pipe_raw of one CPU of a private tracing instance,
+ * writes numbered markers to it from that CPU and consumes them with
+ * TRACE_MMAP_IOCTL_GET_READER, parsing the events in place. It checks:
+ *
+ *  - that every marker is seen once and in order, across data added to
+ *    the current reader sub-buffer and across reader swaps,
+ *  - that an overflowed buffer reports the lost events in the meta page
+ *    and in the missed events flags of the sub-buffer commit, and that
+ *    reading carries on in sequence afterwards,
+ *  - that the mapping is read-only and that the buffer cannot be resized
+ *    while it is mapped.
+ *
+ * Must be run as root.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+
+#include <linux/trace_mmap.h>
+
+#include "../kselftest.h"
+
+#define INSTANCE	"map_test"
+#define BUFFER_KB	"32"
+
+/* Missed events flags in the sub-buffer commit, see ring_buffer.c */
+#define RB_MISSED_EVENTS	(1UL << 31)
+#define RB_MISSED_STORED	(1UL << 30)
+#define RB_MISSED_FLAGS		(RB_MISSED_EVENTS | RB_MISSED_STORED)
+
+/* Event types of struct ring_buffer_event, see linux/ring_buffer.h */
+#define RINGBUF_TYPE_PADDING		29
+#define RINGBUF_TYPE_TIME_EXTEND	30
+#define RINGBUF_TYPE_TIME_STAMP		31
+
+struct rb_event {
+	uint32_t	type_len:5, time_delta:27;
+	uint32_t	array[];
+};
+
+struct map {
+	int				fd;
+	char				*addr;
+	size_t				len;
+	struct trace_buffer_meta	*meta;
+};
+
+/* What was found in one sub-buffer hand out */
+struct handout {
+	unsigned int	markers;
+	unsigned long	flags;
+	unsigned long	stored_lost;
+	bool		empty;
+};
+
+static const char *tracefs;
+static char instance[128];
+static int marker_fd = -1;
+
+/* Layout of the sub-buffer header and the print event, from tracefs */
+static unsigned int commit_offset, commit_size, data_offset;
+static unsigned int print_id, print_buf_offset;
+
+static int read_file(const char *path, char *buf, size_t size)
+{
+	ssize_t len;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	len = read(fd, buf, size - 1);
+	close(fd);
+	if (len < 0)
+		return -1;
+	buf[len] = '\0';
+	return 0;
+}
+
+static int write_file(const char *path, const char *val)
+{
+	ssize_t len = strlen(val);
+	int fd, ret = 0;
+
+	fd = open(path, O_WRONLY | O_TRUNC);
+	if (fd < 0)
+		return -1;
+	if (write(fd, val, len) != len)
+		ret = -1;
+	close(fd);
+	return ret;
+}
+
+static int find_tracefs(void)
+{
+	static const char * const dirs[] = {
+		"/sys/kernel/tracing", "/sys/kernel/debug/tracing",
+	};
+	char path[PATH_MAX];
+	int i;
+
+	mount("nodev", dirs[0], "tracefs", 0, NULL);
+	for (i = 0; i < 2; i++) {
+		snprintf(path, sizeof(path), "%s/instances", dirs[i]);
+		if (!access(path, F_OK)) {
+			tracefs = dirs[i];
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/* Parses the offsets that the kernel exports for user space parsers */
+static int read_formats(void)
+{
+	char path[PATH_MAX], buf[4096], *p;
+
+	snprintf(path, sizeof(path), "%s/events/header_page", tracefs);
+	if (read_file(path, buf, sizeof(buf)))
+		return -1;
+	p = strstr(buf, " commit;");
+	if (!p || sscanf(p, " commit; offset:%u; size:%u;", &commit_offset,
+			 &commit_size) != 2)
+		return -1;
+	p = strstr(buf, " data;");
+	if (!p || sscanf(p, " data; offset:%u;", &data_offset) != 1)
+		return -1;
+	if (commit_size != 4 && commit_size != 8)
+		return -1;
+
+	snprintf(path, sizeof(path), "%s/events/ftrace/print/format", tracefs);
+	if (read_file(path, buf, sizeof(buf)))
+		return -1;
+	p = strstr(buf, "ID:");
+	if (!p || sscanf(p, "ID: %u", &print_id) != 1)
+		return -1;
+	p = strstr(buf, " buf[];");
+	if (!p || sscanf(p, " buf[]; offset:%u;", &print_buf_offset) != 1)
+		return -1;
+	return 0;
+}
+
+static int pin_cpu(void)
+{
+	cpu_set_t set;
+	int cpu;
+
+	if (sched_getaffinity(0, sizeof(set), &set))
+		return -1;
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+		if (CPU_ISSET(cpu, &set))
+			break;
+	if (cpu == CPU_SETSIZE)
+		return -1;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set))
+		return -1;
+	return cpu;
+}
+
+static int map_buffer(struct map *m, int cpu)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	char path[PATH_MAX];
+	void *addr;
+
+	snprintf(path, sizeof(path), "%s/per_cpu/cpu%d/trace_pipe_raw",
+		 instance, cpu);
+	m->fd = open(path, O_RDONLY | O_NONBLOCK);
+	if (m->fd < 0)
+		return -1;
+
+	/* The meta page says how much there is to map */
+	addr = mmap(NULL, page_size, PROT_READ, MAP_SHARED, m->fd, 0);
+	if (addr == MAP_FAILED)
+		return -1;
+	m->meta = addr;
+	m->len = m->meta->meta_page_size +
+		 (size_t)m->meta->nr_subbufs * m->meta->subbuf_size;
+	munmap(addr, page_size);
+
+	addr = mmap(NULL, m->len, PROT_READ, MAP_SHARED, m->fd, 0);
+	if (addr == MAP_FAILED)
+		return -1;
+	m->addr = addr;
+	m->meta = addr;
+	return 0;
+}
+
+static void unmap_buffer(struct map *m)
+{
+	if (m->addr)
+		munmap(m->addr, m->len);
+	if (m->fd >= 0)
+		close(m->fd);
+}
+
+static int write_markers(int *written, int n)
+{
+	char buf[32];
+	int len;
+
+	while (n--) {
+		len = snprintf(buf, sizeof(buf), "seq:%d\n", *written);
+		if (write(marker_fd, buf, len) != len)
+			return -1;
+		(*written)++;
+	}
+	return 0;
+}
+
+/*
+ * Hands out the next range with TRACE_MMAP_IOCTL_GET_READER and walks the
+ * events in it in place. *seq is the marker expected next. If @gap is set
+ * the first marker may be later than that, as events were lost.
+ */
+static int get_reader(struct map *m, int *seq, bool gap, struct handout *h)
+{
+	struct trace_buffer_meta *meta = m->meta;
+	unsigned long commit;
+	unsigned int off, len, size;
+	struct rb_event *event;
+	char *subbuf, *payload;
+	int val;
+
+	memset(h, 0, sizeof(*h));
+	if (ioctl(m->fd, TRACE_MMAP_IOCTL_GET_READER)) {
+		ksft_print_msg("GET_READER failed: %s\n", strerror(errno));
+		return -1;
+	}
+	if (meta->reader.id >= meta->nr_subbufs) {
+		ksft_print_msg("reader id %u out of range\n", meta->reader.id);
+		return -1;
+	}
+
+	subbuf = m->addr + meta->meta_page_size +
+		 (size_t)meta->reader.id * meta->subbuf_size;
+	if (commit_size == 8)
+		commit = *(volatile uint64_t *)(subbuf + commit_offset);
+	else
+		commit = *(volatile uint32_t *)(subbuf + commit_offset);
+	h->flags = commit & RB_MISSED_FLAGS;
+	size = commit & ~RB_MISSED_FLAGS;
+	if (size > meta->subbuf_size - data_offset) {
+		ksft_print_msg("commit %u beyond the sub-buffer\n", size);
+		return -1;
+	}
+	if (h->flags & RB_MISSED_STORED)
+		memcpy(&h->stored_lost, subbuf + data_offset + size,
+		       sizeof(h->stored_lost));
+	h->empty = meta->reader.read >= size;
+
+	for (off = meta->reader.read; off < size; off += len) {
+		event = (struct rb_event *)(subbuf + data_offset + off);
+
+		switch (event->type_len) {
+		case RINGBUF_TYPE_PADDING:
+			/* a null padding event fills the rest of the page */
+			len = event->time_delta ? event->array[0] + 4 :
+						  size - off;
+			continue;
+		case RINGBUF_TYPE_TIME_EXTEND:
+			len = 8;
+			continue;
+		case RINGBUF_TYPE_TIME_STAMP:
+			len = 16;
+			continue;
+		case 0:
+			len = event->array[0] + 4;
+			payload = (char *)&event->array[1];
+			break;
+		default:
+			len = event->type_len * 4 + 4;
+			payload = (char *)&event->array[0];
+			break;
+		}
+
+		if (*(unsigned short *)payload != print_id)
+			continue;
+		if (sscanf(payload + print_buf_offset, "seq:%d", &val) != 1) {
+			ksft_print_msg("unexpected marker %.16s\n",
+				       payload + print_buf_offset);
+			return -1;
+		}
+		if (val != *seq && !(gap && !h->markers && val > *seq)) {
+			ksft_print_msg("marker %d read, %d expected\n", val,
+				       *seq);
+			return -1;
+		}
+		*seq = val + 1;
+		h->markers++;
+	}
+	return 0;
+}
+
+/* Hands out ranges until there is nothing new, returns the reader swaps */
+static int drain(struct map *m, int *seq, bool gap, unsigned long *lost)
+{
+	unsigned int id = m->meta->reader.id;
+	struct handout h;
+	int swaps = 0;
+
+	do {
+		if (get_reader(m, seq, gap, &h))
+			return -1;
+		if (m->meta->reader.id != id) {
+			id = m->meta->reader.id;
+			swaps++;
+		}
+		if (m->meta->reader.lost_events) {
+			if (!gap) {
+				ksft_print_msg("%llu events lost without overflow\n",
+					       (unsigned long long)
+					       m->meta->reader.lost_events);
+				return -1;
+			}
+			if (!(h.flags & RB_MISSED_EVENTS)) {
+				ksft_print_msg("lost events not flagged in the commit\n");
+				return -1;
+			}
+			if ((h.flags & RB_MISSED_STORED) &&
+			    h.stored_lost != m->meta->reader.lost_events) {
+				ksft_print_msg("%lu lost events stored, %llu reported\n",
+					       h.stored_lost, (unsigned long long)
+					       m->meta->reader.lost_events);
+				return -1;
+			}
+			*lost += m->meta->reader.lost_events;
+		} else if (h.flags) {
+			ksft_print_msg("missed events flagged, none reported\n");
+			return -1;
+		}
+		if (h.markers)
+			gap = false;
+	} while (!h.empty);
+
+	return swaps;
+}
+
+/* Markers read in batches, within and across sub-buffers */
+static int test_swaps(struct map *m)
+{
+	static const int batches[] = { 1, 2, 37, 5, 150, 1, 300, 90, 3 };
+	unsigned long lost = 0;
+	int i, seq, written, swaps = 0, ret;
+
+	seq = written = 0;
+	for (i = 0; i < sizeof(batches) / sizeof(batches[0]); i++) {
+		if (write_markers(&written, batches[i]))
+			return KSFT_FAIL;
+		ret = drain(m, &seq, false, &lost);
+		if (ret < 0)
+			return KSFT_FAIL;
+		swaps += ret;
+		if (seq != written) {
+			ksft_print_msg("batch %d: read up to %d of %d markers\n",
+				       i, seq, written);
+			return KSFT_FAIL;
+		}
+	}
+	if (!swaps) {
+		ksft_print_msg("no reader swap happened\n");
+		return KSFT_FAIL;
+	}
+	ksft_print_msg("%d markers read in place over %d reader swaps\n",
+		       written, swaps);
+	return KSFT_PASS;
+}
+
+/* An overflow is reported and reading resumes in sequence after it */
+static int test_lost(struct map *m)
+{
+	unsigned long lost = 0;
+	int seq, written, n;
+
+	/* every event takes more than 8 bytes, so this wraps several times */
+	n = m->meta->nr_subbufs * m->meta->subbuf_size / 8;
+	seq = written = 1000000;
+	if (write_markers(&written, n))
+		return KSFT_FAIL;
+	if (drain(m, &seq, true, &lost) < 0)
+		return KSFT_FAIL;
+	if (!lost) {
+		ksft_print_msg("overflow of %d markers lost nothing\n", n);
+		return KSFT_FAIL;
+	}
+	if (seq != written) {
+		ksft_print_msg("read up to %d of %d markers after overflow\n",
+			       seq, written);
+		return KSFT_FAIL;
+	}
+
+	/* and nothing is reported once the reader caught up */
+	if (write_markers(&written, 10) || drain(m, &seq, false, &lost) < 0 ||
+	    seq != written)
+		return KSFT_FAIL;
+
+	ksft_print_msg("%d markers written, %lu lost on overflow\n", n, lost);
+	return KSFT_PASS;
+}
+
+/* The buffer must stay as it was mapped */
+static int test_restrictions(struct map *m)
+{
+	char path[PATH_MAX];
+	void *addr;
+
+	addr = mmap(NULL, m->len, PROT_READ | PROT_WRITE, MAP_SHARED, m->fd, 0);
+	if (addr != MAP_FAILED) {
+		munmap(addr, m->len);
+		ksft_print_msg("writable mapping allowed\n");
+		return KSFT_FAIL;
+	}
+	addr = mmap(NULL, m->len, PROT_READ, MAP_PRIVATE, m->fd, 0);
+	if (addr != MAP_FAILED) {
+		munmap(addr, m->len);
+		ksft_print_msg("private mapping allowed\n");
+		return KSFT_FAIL;
+	}
+
+	snprintf(path, sizeof(path), "%s/buffer_size_kb", instance);
+	if (!write_file(path, "64") || errno != EBUSY) {
+		ksft_print_msg("resize of a mapped buffer not refused\n");
+		return KSFT_FAIL;
+	}
+	return KSFT_PASS;
+}
+
+int main(int argc, char *argv[])
+{
+	struct map m = { .fd = -1 };
+	char path[PATH_MAX];
+	int cpu, ret;
+
+	if (geteuid()) {
+		ksft_print_msg("must be run as root\n");
+		return KSFT_SKIP;
+	}
+	if (find_tracefs() || read_formats()) {
+		ksft_print_msg("tracefs not available\n");
+		return KSFT_SKIP;
+	}
+
+	cpu = pin_cpu();
+	if (cpu < 0) {
+		ksft_print_msg("cannot pin to a cpu: %s\n", strerror(errno));
+		return KSFT_FAIL;
+	}
+
+	snprintf(instance, sizeof(instance), "%s/instances/" INSTANCE,
+		 tracefs);
+	rmdir(instance);
+	if (mkdir(instance, 0755)) {
+		ksft_print_msg("cannot create instance: %s\n", strerror(errno));
+		return KSFT_SKIP;
+	}
+	snprintf(path, sizeof(path), "%s/buffer_size_kb", instance);
+	if (write_file(path, BUFFER_KB)) {
+		ret = KSFT_FAIL;
+		goto out;
+	}
+	snprintf(path, sizeof(path), "%s/trace_marker", instance);
+	marker_fd = open(path, O_WRONLY);
+	if (marker_fd < 0) {
+		ret = KSFT_FAIL;
+		goto out;
+	}
+
+	if (map_buffer(&m, cpu)) {
+		ksft_print_msg("mmap of trace_pipe_raw failed: %s\n",
+			       strerror(errno));
+		ret = errno == ENODEV ? KSFT_SKIP : KSFT_FAIL;
+		goto out;
+	}
+	ksft_print_msg("cpu %d: %u sub-buffers of %u bytes\n", cpu,
+		       m.meta->nr_subbufs, m.meta->subbuf_size);
+
+	ret = test_restrictions(&m);
+	if (ret == KSFT_PASS)
+		ret = test_swaps(&m);
+	if (ret == KSFT_PASS)
+		ret = test_lost(&m);
+
+out:
+	unmap_buffer(&m);
+	if (marker_fd >= 0)
+		close(marker_fd);
+	rmdir(instance);
+	return ret;
+}